@@ -1,359 +1,586 @@
-#ifndef DCMTKHTJ2K_DJCODECD_H
-#define DCMTKHTJ2K_DJCODECD_H
-
-#include "dcmtk/config/osconfig.h"
-#include "dcmtk/dcmdata/dccodec.h" /* for class DcmCodec */
-#include "dcmtk/ofstd/ofstring.h"
-#include "dldefine.h"
-
-/* forward declaration */
-class HtJ2kCodecParameter;
-
-/** abstract codec class for HT-J2K decoders.
- *  This abstract class contains most of the application logic
- *  needed for a dcmdata codec object that implements a HT-J2K decoder.
- *  This class only supports decompression, it neither implements
- *  encoding nor transcoding.
- */
-class DCMTKHTJ2K_EXPORT HtJ2kDecoderBase : public DcmCodec {
- public:
-  /// default constructor
-  HtJ2kDecoderBase();
-
-  /// destructor
-  virtual ~HtJ2kDecoderBase();
-
-  /** decompresses the given pixel sequence and
-   *  stores the result in the given uncompressedPixelData element.
-   *  @param fromRepParam current representation parameter of compressed data,
-   * may be NULL
-   *  @param pixSeq compressed pixel sequence
-   *  @param uncompressedPixelData uncompressed pixel data stored in this
-   * element
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition decode(DcmRepresentationParameter const *fromRepParam,
-                             DcmPixelSequence *pixSeq,
-                             DcmPolymorphOBOW &uncompressedPixelData,
-                             DcmCodecParameter const *cp,
-                             DcmStack const &objStack) const;
-
-  /** decompresses the given pixel sequence and
-   *  stores the result in the given uncompressedPixelData element.
-   *  @param fromRepParam current representation parameter of compressed data,
-   * may be NULL
-   *  @param pixSeq compressed pixel sequence
-   *  @param uncompressedPixelData uncompressed pixel data stored in this
-   * element
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @param removeOldRep boolean flag that should be set to false before this
-   * method call and will be set to true if the codec modifies the DICOM dataset
-   * such that the pixel data of the original representation may not be usable
-   *    anymore.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition decode(DcmRepresentationParameter const *fromRepParam,
-                             DcmPixelSequence *pixSeq,
-                             DcmPolymorphOBOW &uncompressedPixelData,
-                             DcmCodecParameter const *cp,
-                             DcmStack const &objStack,
-                             OFBool &removeOldRep) const;
-
-  /** decompresses a single frame from the given pixel sequence and
-   *  stores the result in the given buffer.
-   *  @param fromParam representation parameter of current compressed
-   *    representation, may be NULL.
-   *  @param fromPixSeq compressed pixel sequence
-   *  @param cp codec parameters for this codec
-   *  @param dataset pointer to dataset in which pixel data element is contained
-   *  @param frameNo number of frame, starting with 0 for the first frame
-   *  @param startFragment index of the compressed fragment that contains
-   *    all or the first part of the compressed bitstream for the given frameNo.
-   *    Upon successful return this parameter is updated to contain the index
-   *    of the first compressed fragment of the next frame.
-   *    When unknown, zero should be passed. In this case the decompression
-   *    algorithm will try to determine the index by itself, which will always
-   *    work if frames are decompressed in increasing order from first to last,
-   *    but may fail if frames are decompressed in random order, multiple
-   * fragments per frame and multiple frames are present in the dataset, and the
-   * offset table is empty.
-   *  @param buffer pointer to buffer where frame is to be stored
-   *  @param bufSize size of buffer in bytes
-   *  @param decompressedColorModel upon successful return, the color model
-   *    of the decompressed image (which may be different from the one used
-   *    in the compressed images) is returned in this parameter.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition decodeFrame(DcmRepresentationParameter const *fromParam,
-                                  DcmPixelSequence *fromPixSeq,
-                                  DcmCodecParameter const *cp, DcmItem *dataset,
-                                  Uint32 frameNo, Uint32 &startFragment,
-                                  void *buffer, Uint32 bufSize,
-                                  OFString &decompressedColorModel) const;
-
-  /** compresses the given uncompressed DICOM image and stores
-   *  the result in the given pixSeq element.
-   *  @param pixelData pointer to the uncompressed image data in OW format
-   *    and local byte order
-   *  @param length of the pixel data field in bytes
-   *  @param toRepParam representation parameter describing the desired
-   *    compressed representation (e.g. JPEG quality)
-   *  @param pixSeq compressed pixel sequence (pointer to new DcmPixelSequence
-   * object allocated on heap) returned in this parameter upon success.
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition encode(Uint16 const *pixelData, Uint32 const length,
-                             DcmRepresentationParameter const *toRepParam,
-                             DcmPixelSequence *&pixSeq,
-                             DcmCodecParameter const *cp,
-                             DcmStack &objStack) const;
-
-  /** compresses the given uncompressed DICOM image and stores
-   *  the result in the given pixSeq element.
-   *  @param pixelData pointer to the uncompressed image data in OW format
-   *    and local byte order
-   *  @param length of the pixel data field in bytes
-   *  @param toRepParam representation parameter describing the desired
-   *    compressed representation (e.g. JPEG quality)
-   *  @param pixSeq compressed pixel sequence (pointer to new DcmPixelSequence
-   * object allocated on heap) returned in this parameter upon success.
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @param removeOldRep boolean flag that should be set to false before this
-   * method call and will be set to true if the codec modifies the DICOM dataset
-   * such that the pixel data of the original representation may not be usable
-   *    anymore.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition encode(Uint16 const *pixelData, Uint32 const length,
-                             DcmRepresentationParameter const *toRepParam,
-                             DcmPixelSequence *&pixSeq,
-                             DcmCodecParameter const *cp, DcmStack &objStack,
-                             OFBool &removeOldRep) const;
-
-  /** transcodes (re-compresses) the given compressed DICOM image and stores
-   *  the result in the given toPixSeq element.
-   *  @param fromRepType current transfer syntax of the compressed image
-   *  @param fromRepParam current representation parameter of compressed data,
-   * may be NULL
-   *  @param fromPixSeq compressed pixel sequence
-   *  @param toRepParam representation parameter describing the desired
-   *    new compressed representation (e.g. JPEG quality)
-   *  @param toPixSeq compressed pixel sequence (pointer to new DcmPixelSequence
-   * object allocated on heap) returned in this parameter upon success.
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition encode(E_TransferSyntax const fromRepType,
-                             DcmRepresentationParameter const *fromRepParam,
-                             DcmPixelSequence *fromPixSeq,
-                             DcmRepresentationParameter const *toRepParam,
-                             DcmPixelSequence *&toPixSeq,
-                             DcmCodecParameter const *cp,
-                             DcmStack &objStack) const;
-
-  /** transcodes (re-compresses) the given compressed DICOM image and stores
-   *  the result in the given toPixSeq element.
-   *  @param fromRepType current transfer syntax of the compressed image
-   *  @param fromRepParam current representation parameter of compressed data,
-   * may be NULL
-   *  @param fromPixSeq compressed pixel sequence
-   *  @param toRepParam representation parameter describing the desired
-   *    new compressed representation (e.g. JPEG quality)
-   *  @param toPixSeq compressed pixel sequence (pointer to new DcmPixelSequence
-   * object allocated on heap) returned in this parameter upon success.
-   *  @param cp codec parameters for this codec
-   *  @param objStack stack pointing to the location of the pixel data
-   *    element in the current dataset.
-   *  @param removeOldRep boolean flag that should be set to false before this
-   * method call and will be set to true if the codec modifies the DICOM dataset
-   * such that the pixel data of the original representation may not be usable
-   *    anymore.
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  virtual OFCondition encode(E_TransferSyntax const fromRepType,
-                             DcmRepresentationParameter const *fromRepParam,
-                             DcmPixelSequence *fromPixSeq,
-                             DcmRepresentationParameter const *toRepParam,
-                             DcmPixelSequence *&toPixSeq,
-                             DcmCodecParameter const *cp, DcmStack &objStack,
-                             OFBool &removeOldRep) const;
-
-  /** checks if this codec is able to convert from the
-   *  given current transfer syntax to the given new
-   *  transfer syntax
-   *  @param oldRepType current transfer syntax
-   *  @param newRepType desired new transfer syntax
-   *  @return true if transformation is supported by this codec, false
-   * otherwise.
-   */
-  virtual OFBool canChangeCoding(E_TransferSyntax const oldRepType,
-                                 E_TransferSyntax const newRepType) const;
-
-  /** determine color model of the decompressed image
-   *  @param fromParam representation parameter of current compressed
-   *    representation, may be NULL
-   *  @param fromPixSeq compressed pixel sequence
-   *  @param cp codec parameters for this codec
-   *  @param dataset pointer to dataset in which pixel data element is contained
-   *  @param dataset pointer to DICOM dataset in which this pixel data object
-   *    is located. Used to access photometric interpretation.
-   *  @param decompressedColorModel upon successful return, the color model
-   *    of the decompressed image (which may be different from the one used
-   *    in the compressed images) is returned in this parameter
-   *  @return EC_Normal if successful, an error code otherwise
-   */
-  virtual OFCondition determineDecompressedColorModel(
-      DcmRepresentationParameter const *fromParam, DcmPixelSequence *fromPixSeq,
-      DcmCodecParameter const *cp, DcmItem *dataset,
-      OFString &decompressedColorModel) const;
-
- private:
-  // static private helper methods
-
-  /** decompresses a single frame from the given pixel sequence and
-   *  stores the result in the given buffer.
-   *  @param fromPixSeq compressed pixel sequence
-   *  @param cp codec parameters for this codec
-   *  @param dataset pointer to dataset in which pixel data element is contained
-   *  @param frameNo number of frame, starting with 0 for the first frame
-   *  @param startFragment index of the compressed fragment that contains
-   *    all or the first part of the compressed bitstream for the given frameNo.
-   *    Upon successful return this parameter is updated to contain the index
-   *    of the first compressed fragment of the next frame.
-   *    When unknown, zero should be passed. In this case the decompression
-   *    algorithm will try to determine the index by itself, which will always
-   *    work if frames are decompressed in increasing order from first to last,
-   *    but may fail if frames are decompressed in random order, multiple
-   * fragments per frame and multiple frames are present in the dataset, and the
-   * offset table is empty.
-   *  @param buffer pointer to buffer where frame is to be stored
-   *  @param bufSize size of buffer in bytes
-   *  @param imageFrames number of frames in this image
-   *  @param imageColumns number of columns for each frame
-   *  @param imageRows number of rows for each frame
-   *  @param imageSamplesPerPixel number of samples per pixel
-   *  @param bytesPerSample number of bytes per sample
-   *  @return EC_Normal if successful, an error code otherwise.
-   */
-  static OFCondition decodeFrame(
-      DcmPixelSequence *fromPixSeq, HtJ2kCodecParameter const *cp,
-      DcmItem *dataset, Uint32 frameNo, Uint32 &startFragment, void *buffer,
-      Uint32 bufSize, Sint32 imageFrames, Uint16 imageColumns, Uint16 imageRows,
-      Uint16 imageSamplesPerPixel, Uint16 bytesPerSample);
-
-  /** determines if a given image requires color-by-plane planar configuration
-   *  depending on SOP Class UID (DICOM IOD) and photometric interpretation.
-   *  All SOP classes defined in the 2003 edition of the DICOM standard or
-   * earlier are handled correctly.
-   *  @param sopClassUID SOP Class UID
-   *  @param photometricInterpretation decompressed photometric interpretation
-   *  @return legal value for planar configuration
-   */
-  static Uint16 determinePlanarConfiguration(
-      OFString const &sopClassUID, OFString const &photometricInterpretation);
-
-  /** computes the number of fragments (pixel items) that comprise the current
-   *  frame in the compressed pixel sequence. This method uses various
-   * approaches to compute the number of fragments for a frame, including a
-   * check of the offset table and checking the start of each fragment for JPEG
-   * SOC markers.
-   *  @param numberOfFrames total number of frames of the DICOM object
-   *  @param currentFrame index of current frame (0..numberOfFrames-1)
-   *  @param startItem index of fragment (pixel item) the frame starts with
-   *  @param ignoreOffsetTable flag instructing the method to ignore the offset
-   * table even if present and presumably useful
-   *  @param pixSeq the compressed HT-J2K pixel sequence
-   *  @return number of fragments for the current frame, zero upon error
-   */
-  static Uint32 computeNumberOfFragments(Sint32 numberOfFrames,
-                                         Uint32 currentFrame, Uint32 startItem,
-                                         OFBool ignoreOffsetTable,
-                                         DcmPixelSequence *pixSeq);
-
-  /** check whether the given buffer contains a HT-J2K start-of-image code
-   *  @param fragmentData pointer to 4 or more bytes of HT-J2K data
-   *  @returns true if the first four bytes of the code stream indicate that
-   *     this fragment is the start of a new HT-J2K image,
-   *     i.e. codestream starts with SOC (FF4F), followed by SIZ (FF51).
-   */
-  static OFBool isJ2KStartOfImage(Uint8 *fragmentData);
-
-  /** converts an RGB or YBR frame with 8 bits/sample from
-   *  color-by-pixel to color-by-plane planar configuration.
-   *  @param imageFrame pointer to image frame, must contain
-   *    at least 3*columns*rows bytes of pixel data.
-   *  @param columns columns
-   *  @param rows rows
-   *  @return EC_Normal if successful, an error code otherwise
-   */
-  static OFCondition createPlanarConfiguration1Byte(Uint8 *imageFrame,
-                                                    Uint16 columns,
-                                                    Uint16 rows);
-
-  /** converts an RGB or YBR frame with 16 bits/sample from
-   *  color-by-pixel to color-by-plane planar configuration.
-   *  @param imageFrame pointer to image frame, must contain
-   *    at least 3*columns*rows words of pixel data.
-   *  @param columns columns
-   *  @param rows rows
-   *  @return EC_Normal if successful, an error code otherwise
-   */
-  static OFCondition createPlanarConfiguration1Word(Uint16 *imageFrame,
-                                                    Uint16 columns,
-                                                    Uint16 rows);
-
-  /** converts an RGB or YBR frame with 8 bits/sample from
-   *  color-by-plane to color-by-pixel planar configuration.
-   *  @param imageFrame pointer to image frame, must contain
-   *    at least 3*columns*rows bytes of pixel data.
-   *  @param columns columns
-   *  @param rows rows
-   *  @return EC_Normal if successful, an error code otherwise
-   */
-  static OFCondition createPlanarConfiguration0Byte(Uint8 *imageFrame,
-                                                    Uint16 columns,
-                                                    Uint16 rows);
-
-  /** converts an RGB or YBR frame with 16 bits/sample from
-   *  color-by-plane to color-by-pixel planar configuration.
-   *  @param imageFrame pointer to image frame, must contain
-   *    at least 3*columns*rows words of pixel data.
-   *  @param columns columns
-   *  @param rows rows
-   *  @return EC_Normal if successful, an error code otherwise
-   */
-  static OFCondition createPlanarConfiguration0Word(Uint16 *imageFrame,
-                                                    Uint16 columns,
-                                                    Uint16 rows);
-};
-
-/** codec class for HT-J2K lossy and lossless TS decoding
- */
-class DCMTKHTJ2K_EXPORT HtJ2kDecoder : public HtJ2kDecoderBase {
- public:
-  /** returns the number of bits per sample that will be stored in the
-   *  uncompressed pixel data when decoding the given pixel sequence.
-   *  @param bitsAllocated number of bits allocated per pixel in the source
-   * image
-   *  @param bitsStored number of bits stored per pixel in the source image
-   *  @return number of bits per sample, 0 if unknown
-   */
-  virtual Uint16 decodedBitsAllocated(Uint16 /* bitsAllocated */,
-                                      Uint16 /* bitsStored */) const {
-    return 0;  // unknown - will be determined during decompression
-  }
-};
-
-#endif
+#ifndef DCMTKHTJ2K_DJCODECD_H
+#define DCMTKHTJ2K_DJCODECD_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dccodec.h" /* for class DcmCodec */
+#include "dcmtk/ofstd/ofstring.h"
+#include "dcmtk/ofstd/ofvector.h"
+#include "djindex.h" /* for class HtJ2kFrameIndexCache */
+#include "dldefine.h"
+
+/* forward declaration */
+class HtJ2kCodecParameter;
+
+/** describes the compressed fragments (pixel items) that make up a single
+ *  HT-J2K frame. The fragment data is resolved up front so that the frame
+ *  can be decompressed without accessing the pixel sequence, which is not
+ *  safe to do from multiple threads.
+ */
+struct HtJ2kFrameFragments {
+  /// default constructor
+  HtJ2kFrameFragments() : startItem(0), compressedSize(0), data(), length() {}
+
+  /// index of the first fragment of the frame in the pixel sequence
+  Uint32 startItem;
+
+  /// total number of compressed bytes in all fragments of the frame
+  size_t compressedSize;
+
+  /// pointers to the data of the fragments of the frame
+  OFVector<Uint8 const *> data;
+
+  /// lengths of the fragments of the frame, in bytes
+  OFVector<Uint32> length;
+};
+
+/** rectangular window of a decompressed frame. The position and size are
+ *  given in samples at the resolution the frame is decompressed at.
+ */
+struct HtJ2kFrameWindow {
+  /// default constructor, creates an empty window
+  HtJ2kFrameWindow() : left(0), top(0), columns(0), rows(0) {}
+
+  /** constructor.
+   *  @param l first column of the window
+   *  @param t first row of the window
+   *  @param c number of columns of the window
+   *  @param r number of rows of the window
+   */
+  HtJ2kFrameWindow(Uint16 l, Uint16 t, Uint16 c, Uint16 r)
+      : left(l), top(t), columns(c), rows(r) {}
+
+  /// first column of the window
+  Uint16 left;
+
+  /// first row of the window
+  Uint16 top;
+
+  /// number of columns of the window
+  Uint16 columns;
+
+  /// number of rows of the window
+  Uint16 rows;
+};
+
+/** abstract codec class for HT-J2K decoders.
+ *  This abstract class contains most of the application logic
+ *  needed for a dcmdata codec object that implements a HT-J2K decoder.
+ *  This class only supports decompression, it neither implements
+ *  encoding nor transcoding.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kDecoderBase : public DcmCodec {
+ public:
+  /// default constructor
+  HtJ2kDecoderBase();
+
+  /// destructor
+  virtual ~HtJ2kDecoderBase();
+
+  /** decompresses the given pixel sequence and
+   *  stores the result in the given uncompressedPixelData element.
+   *  @param fromRepParam current representation parameter of compressed data,
+   * may be NULL
+   *  @param pixSeq compressed pixel sequence
+   *  @param uncompressedPixelData uncompressed pixel data stored in this
+   * element
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition decode(DcmRepresentationParameter const *fromRepParam,
+                             DcmPixelSequence *pixSeq,
+                             DcmPolymorphOBOW &uncompressedPixelData,
+                             DcmCodecParameter const *cp,
+                             DcmStack const &objStack) const;
+
+  /** decompresses the given pixel sequence and
+   *  stores the result in the given uncompressedPixelData element.
+   *  @param fromRepParam current representation parameter of compressed data,
+   * may be NULL
+   *  @param pixSeq compressed pixel sequence
+   *  @param uncompressedPixelData uncompressed pixel data stored in this
+   * element
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @param removeOldRep boolean flag that should be set to false before this
+   * method call and will be set to true if the codec modifies the DICOM dataset
+   * such that the pixel data of the original representation may not be usable
+   *    anymore.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition decode(DcmRepresentationParameter const *fromRepParam,
+                             DcmPixelSequence *pixSeq,
+                             DcmPolymorphOBOW &uncompressedPixelData,
+                             DcmCodecParameter const *cp,
+                             DcmStack const &objStack,
+                             OFBool &removeOldRep) const;
+
+  /** decompresses a single frame from the given pixel sequence and
+   *  stores the result in the given buffer. The frame is always decompressed
+   *  at full resolution, since the buffer is sized according to the Rows and
+   *  Columns of the dataset; see decodeReducedFrame() for decompression at a
+   *  reduced resolution.
+   *  @param fromParam representation parameter of current compressed
+   *    representation, may be NULL.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment that contains
+   *    all or the first part of the compressed bitstream for the given frameNo.
+   *    Upon successful return this parameter is updated to contain the index
+   *    of the first compressed fragment of the next frame.
+   *    The value passed is not required, zero may be passed. The fragments of
+   *    every frame are located through an index that is built from the
+   *    offset tables or the codestream markers and kept for as long as the
+   *    pixel sequence and the image attributes are unchanged, so frames may
+   *    be decompressed in any order.
+   *  @param buffer pointer to buffer where frame is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param decompressedColorModel upon successful return, the color model
+   *    of the decompressed image (which may be different from the one used
+   *    in the compressed images) is returned in this parameter.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition decodeFrame(DcmRepresentationParameter const *fromParam,
+                                  DcmPixelSequence *fromPixSeq,
+                                  DcmCodecParameter const *cp, DcmItem *dataset,
+                                  Uint32 frameNo, Uint32 &startFragment,
+                                  void *buffer, Uint32 bufSize,
+                                  OFString &decompressedColorModel) const;
+
+  /** decompresses a single frame from the given pixel sequence at a reduced
+   *  resolution and stores the result in the given buffer. The highest
+   *  resolution levels are not reconstructed, so decompression time and the
+   *  size of the decompressed frame shrink by a factor of about 4 per level.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment that contains
+   *    all or the first part of the compressed bitstream for the given frameNo,
+   *    see decodeFrame()
+   *  @param resolutionReduction number of resolution levels to skip, 0 for
+   *    full resolution. Must not exceed the number of decomposition levels of
+   *    the codestream.
+   *  @param buffer pointer to buffer where frame is to be stored, see
+   *    computeReducedDimensions() for the dimensions of the frame
+   *  @param bufSize size of buffer in bytes
+   *  @param reducedColumns upon successful return, number of columns of the
+   *    decompressed frame
+   *  @param reducedRows upon successful return, number of rows of the
+   *    decompressed frame
+   *  @param decompressedColorModel upon successful return, the color model
+   *    of the decompressed image is returned in this parameter.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  OFCondition decodeReducedFrame(DcmPixelSequence *fromPixSeq,
+                                 DcmCodecParameter const *cp, DcmItem *dataset,
+                                 Uint32 frameNo, Uint32 &startFragment,
+                                 Uint16 resolutionReduction, void *buffer,
+                                 Uint32 bufSize, Uint16 &reducedColumns,
+                                 Uint16 &reducedRows,
+                                 OFString &decompressedColorModel) const;
+
+  /** decompresses a rectangular window of a single frame from the given pixel
+   *  sequence and stores the result in the given buffer. Decoding stops after
+   *  the last row of the window, and only the samples inside the window are
+   *  converted, which saves most of the work for small windows of large
+   *  frames. The window is stored with the planar configuration selected by
+   *  the codec parameters.
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment index of the compressed fragment that contains
+   *    all or the first part of the compressed bitstream for the given frameNo,
+   *    see decodeFrame()
+   *  @param resolutionReduction number of resolution levels to skip, 0 for
+   *    full resolution, see decodeReducedFrame()
+   *  @param window window to be decompressed, relative to the frame at the
+   *    reduced resolution. Must lie completely inside the frame.
+   *  @param buffer pointer to buffer where the window is to be stored
+   *  @param bufSize size of buffer in bytes, at least the number of samples
+   *    in the window times the number of bytes per sample
+   *  @param decompressedColorModel upon successful return, the color model
+   *    of the decompressed image is returned in this parameter.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  OFCondition decodeFrameWindow(DcmPixelSequence *fromPixSeq,
+                                DcmCodecParameter const *cp, DcmItem *dataset,
+                                Uint32 frameNo, Uint32 &startFragment,
+                                Uint16 resolutionReduction,
+                                HtJ2kFrameWindow const &window, void *buffer,
+                                Uint32 bufSize,
+                                OFString &decompressedColorModel) const;
+
+  /** computes the dimensions of a frame decompressed at a reduced resolution.
+   *  Every resolution level halves the number of columns and rows, rounding
+   *  up.
+   *  @param columns number of columns at full resolution
+   *  @param rows number of rows at full resolution
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @param reducedColumns number of columns at the reduced resolution
+   *    returned in this parameter
+   *  @param reducedRows number of rows at the reduced resolution returned in
+   *    this parameter
+   */
+  static void computeReducedDimensions(Uint16 columns, Uint16 rows,
+                                       Uint16 resolutionReduction,
+                                       Uint16 &reducedColumns,
+                                       Uint16 &reducedRows);
+
+  /** frees the buffers and the codestream the calling thread keeps for
+   *  decompressing its next frame. They are reused as long as frames of the
+   *  same geometry are decompressed, and freed when the thread ends. An
+   *  application decompressing frames on a long-lived thread, e.g. for cine
+   *  playback, may call this function once the thread becomes idle.
+   */
+  static void releaseThreadWorkspace();
+
+  /** compresses the given uncompressed DICOM image and stores
+   *  the result in the given pixSeq element.
+   *  @param pixelData pointer to the uncompressed image data in OW format
+   *    and local byte order
+   *  @param length of the pixel data field in bytes
+   *  @param toRepParam representation parameter describing the desired
+   *    compressed representation (e.g. JPEG quality)
+   *  @param pixSeq compressed pixel sequence (pointer to new DcmPixelSequence
+   * object allocated on heap) returned in this parameter upon success.
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition encode(Uint16 const *pixelData, Uint32 const length,
+                             DcmRepresentationParameter const *toRepParam,
+                             DcmPixelSequence *&pixSeq,
+                             DcmCodecParameter const *cp,
+                             DcmStack &objStack) const;
+
+  /** compresses the given uncompressed DICOM image and stores
+   *  the result in the given pixSeq element.
+   *  @param pixelData pointer to the uncompressed image data in OW format
+   *    and local byte order
+   *  @param length of the pixel data field in bytes
+   *  @param toRepParam representation parameter describing the desired
+   *    compressed representation (e.g. JPEG quality)
+   *  @param pixSeq compressed pixel sequence (pointer to new DcmPixelSequence
+   * object allocated on heap) returned in this parameter upon success.
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @param removeOldRep boolean flag that should be set to false before this
+   * method call and will be set to true if the codec modifies the DICOM dataset
+   * such that the pixel data of the original representation may not be usable
+   *    anymore.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition encode(Uint16 const *pixelData, Uint32 const length,
+                             DcmRepresentationParameter const *toRepParam,
+                             DcmPixelSequence *&pixSeq,
+                             DcmCodecParameter const *cp, DcmStack &objStack,
+                             OFBool &removeOldRep) const;
+
+  /** transcodes (re-compresses) the given compressed DICOM image and stores
+   *  the result in the given toPixSeq element.
+   *  @param fromRepType current transfer syntax of the compressed image
+   *  @param fromRepParam current representation parameter of compressed data,
+   * may be NULL
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param toRepParam representation parameter describing the desired
+   *    new compressed representation (e.g. JPEG quality)
+   *  @param toPixSeq compressed pixel sequence (pointer to new DcmPixelSequence
+   * object allocated on heap) returned in this parameter upon success.
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition encode(E_TransferSyntax const fromRepType,
+                             DcmRepresentationParameter const *fromRepParam,
+                             DcmPixelSequence *fromPixSeq,
+                             DcmRepresentationParameter const *toRepParam,
+                             DcmPixelSequence *&toPixSeq,
+                             DcmCodecParameter const *cp,
+                             DcmStack &objStack) const;
+
+  /** transcodes (re-compresses) the given compressed DICOM image and stores
+   *  the result in the given toPixSeq element.
+   *  @param fromRepType current transfer syntax of the compressed image
+   *  @param fromRepParam current representation parameter of compressed data,
+   * may be NULL
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param toRepParam representation parameter describing the desired
+   *    new compressed representation (e.g. JPEG quality)
+   *  @param toPixSeq compressed pixel sequence (pointer to new DcmPixelSequence
+   * object allocated on heap) returned in this parameter upon success.
+   *  @param cp codec parameters for this codec
+   *  @param objStack stack pointing to the location of the pixel data
+   *    element in the current dataset.
+   *  @param removeOldRep boolean flag that should be set to false before this
+   * method call and will be set to true if the codec modifies the DICOM dataset
+   * such that the pixel data of the original representation may not be usable
+   *    anymore.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  virtual OFCondition encode(E_TransferSyntax const fromRepType,
+                             DcmRepresentationParameter const *fromRepParam,
+                             DcmPixelSequence *fromPixSeq,
+                             DcmRepresentationParameter const *toRepParam,
+                             DcmPixelSequence *&toPixSeq,
+                             DcmCodecParameter const *cp, DcmStack &objStack,
+                             OFBool &removeOldRep) const;
+
+  /** checks if this codec is able to convert from the
+   *  given current transfer syntax to the given new
+   *  transfer syntax
+   *  @param oldRepType current transfer syntax
+   *  @param newRepType desired new transfer syntax
+   *  @return true if transformation is supported by this codec, false
+   * otherwise.
+   */
+  virtual OFBool canChangeCoding(E_TransferSyntax const oldRepType,
+                                 E_TransferSyntax const newRepType) const;
+
+  /** determine color model of the decompressed image
+   *  @param fromParam representation parameter of current compressed
+   *    representation, may be NULL
+   *  @param fromPixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param dataset pointer to DICOM dataset in which this pixel data object
+   *    is located. Used to access photometric interpretation.
+   *  @param decompressedColorModel upon successful return, the color model
+   *    of the decompressed image (which may be different from the one used
+   *    in the compressed images) is returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition determineDecompressedColorModel(
+      DcmRepresentationParameter const *fromParam, DcmPixelSequence *fromPixSeq,
+      DcmCodecParameter const *cp, DcmItem *dataset,
+      OFString &decompressedColorModel) const;
+
+ private:
+  /// task decompressing the frames of a multi-frame image in parallel
+  class DecodeFramesTask;
+
+  // static private helper methods
+
+  /** decompresses a single frame from the given pixel sequence and
+   *  stores the result in the given buffer.
+   *  @param index fragment index of the compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment upon successful return, index of the first
+   *    compressed fragment of the next frame
+   *  @param buffer pointer to buffer where frame is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param imageColumns number of columns for each decompressed frame
+   *  @param imageRows number of rows for each decompressed frame
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @param bytesPerSample number of bytes per sample
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @param window window of the decompressed frame to be stored in the buffer
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeFrame(
+      HtJ2kFrameIndex const &index, HtJ2kCodecParameter const *cp,
+      DcmItem *dataset, Uint32 frameNo, Uint32 &startFragment, void *buffer,
+      Uint32 bufSize, Uint16 imageColumns, Uint16 imageRows,
+      Uint16 imageSamplesPerPixel, Uint16 bytesPerSample,
+      Uint16 resolutionReduction, HtJ2kFrameWindow const &window);
+
+  /** reads the image attributes of the given dataset and looks up the index
+   *  of the fragments of its pixel sequence, which is only built if no valid
+   *  one is cached yet.
+   *  @param pixSeq compressed pixel sequence
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param attributes image attributes returned in this parameter
+   *  @param index fragment index returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  OFCondition indexFrames(DcmPixelSequence *pixSeq,
+                          HtJ2kCodecParameter const *cp, DcmItem *dataset,
+                          HtJ2kImageAttributes &attributes,
+                          OFshared_ptr<HtJ2kFrameIndex const> &index) const;
+
+  /** decompresses a rectangular window of a single frame, see
+   *  decodeFrameWindow().
+   *  @param index fragment index of the compressed pixel sequence
+   *  @param attributes image attributes of the dataset
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment upon successful return, index of the first
+   *    compressed fragment of the next frame
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @param window window to be decompressed, relative to the frame at the
+   *    reduced resolution
+   *  @param buffer pointer to buffer where the window is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param decompressedColorModel upon successful return, the color model
+   *    of the decompressed image is returned in this parameter.
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeWindow(
+      HtJ2kFrameIndex const &index, HtJ2kImageAttributes const &attributes,
+      HtJ2kCodecParameter const *cp, DcmItem *dataset, Uint32 frameNo,
+      Uint32 &startFragment, Uint16 resolutionReduction,
+      HtJ2kFrameWindow const &window, void *buffer, Uint32 bufSize,
+      OFString &decompressedColorModel);
+
+  /** determines the fragments (pixel items) that comprise the given frame
+   *  and resolves pointers to their data.
+   *  @param index fragment index of the compressed pixel sequence
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @param startFragment upon successful return, index of the first
+   *    compressed fragment of the next frame
+   *  @param fragments fragments of the frame returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition gatherFragments(HtJ2kFrameIndex const &index,
+                                     Uint32 frameNo, Uint32 &startFragment,
+                                     HtJ2kFrameFragments &fragments);
+
+  /** decompresses a single frame from its previously gathered fragments and
+   *  stores the result in the given buffer. Neither the dataset nor the
+   *  pixel sequence is accessed, so this method may be called concurrently
+   *  for different frames.
+   *  @param fragments fragments of the frame
+   *  @param buffer pointer to buffer where frame is to be stored
+   *  @param bufSize size of buffer in bytes
+   *  @param imageColumns number of columns for each decompressed frame
+   *  @param imageRows number of rows for each decompressed frame
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @param bytesPerSample number of bytes per sample
+   *  @param imagePlanarConfiguration planar configuration of the decompressed
+   *    frame, 0 for color-by-pixel, 1 for color-by-plane
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @param window window of the decompressed frame to be stored in the buffer
+   *  @param numberOfThreads number of threads decompressing the tiles of the
+   *    frame
+   *  @param usingColorTransform upon successful return, true if the frame was
+   *    compressed using a color transform and has been converted back to RGB
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition decodeFragments(
+      HtJ2kFrameFragments const &fragments, void *buffer, Uint32 bufSize,
+      Uint16 imageColumns, Uint16 imageRows, Uint16 imageSamplesPerPixel,
+      Uint16 bytesPerSample, Uint16 imagePlanarConfiguration,
+      Uint16 resolutionReduction, HtJ2kFrameWindow const &window,
+      Uint16 numberOfThreads, OFBool &usingColorTransform);
+
+  /** updates the attributes describing the size of the pixels after the
+   *  image has been decompressed at a reduced resolution, i.e. Rows, Columns
+   *  and the pixel spacing attributes, including those of the Pixel Measures
+   *  in the shared and per-frame functional groups.
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param columns number of columns at full resolution
+   *  @param rows number of rows at full resolution
+   *  @param reducedColumns number of columns at the reduced resolution
+   *  @param reducedRows number of rows at the reduced resolution
+   *  @return EC_Normal if successful, an error code otherwise.
+   */
+  static OFCondition updateReducedImageAttributes(DcmItem *dataset,
+                                                  Uint16 columns, Uint16 rows,
+                                                  Uint16 reducedColumns,
+                                                  Uint16 reducedRows);
+
+  /** determines the planar configuration of the decompressed image
+   *  according to the codec parameters.
+   *  @param cp codec parameters for this codec
+   *  @param dataset pointer to dataset in which pixel data element is contained
+   *  @param imageSamplesPerPixel number of samples per pixel
+   *  @return 0 for color-by-pixel, 1 for color-by-plane
+   */
+  static Uint16 determineOutputPlanarConfiguration(
+      HtJ2kCodecParameter const *cp, DcmItem *dataset,
+      Uint16 imageSamplesPerPixel);
+
+  /** determines if a given image requires color-by-plane planar configuration
+   *  depending on SOP Class UID (DICOM IOD) and photometric interpretation.
+   *  All SOP classes defined in the 2003 edition of the DICOM standard or
+   * earlier are handled correctly.
+   *  @param sopClassUID SOP Class UID
+   *  @param photometricInterpretation decompressed photometric interpretation
+   *  @return legal value for planar configuration
+   */
+  static Uint16 determinePlanarConfiguration(
+      OFString const &sopClassUID, OFString const &photometricInterpretation);
+
+  /** converts an RGB or YBR frame with 8 bits/sample from
+   *  color-by-pixel to color-by-plane planar configuration.
+   *  @param imageFrame pointer to image frame, must contain
+   *    at least 3*columns*rows bytes of pixel data.
+   *  @param columns columns
+   *  @param rows rows
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  static OFCondition createPlanarConfiguration1Byte(Uint8 *imageFrame,
+                                                    Uint16 columns,
+                                                    Uint16 rows);
+
+  /** converts an RGB or YBR frame with 16 bits/sample from
+   *  color-by-pixel to color-by-plane planar configuration.
+   *  @param imageFrame pointer to image frame, must contain
+   *    at least 3*columns*rows words of pixel data.
+   *  @param columns columns
+   *  @param rows rows
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  static OFCondition createPlanarConfiguration1Word(Uint16 *imageFrame,
+                                                    Uint16 columns,
+                                                    Uint16 rows);
+
+  /** converts an RGB or YBR frame with 8 bits/sample from
+   *  color-by-plane to color-by-pixel planar configuration.
+   *  @param imageFrame pointer to image frame, must contain
+   *    at least 3*columns*rows bytes of pixel data.
+   *  @param columns columns
+   *  @param rows rows
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  static OFCondition createPlanarConfiguration0Byte(Uint8 *imageFrame,
+                                                    Uint16 columns,
+                                                    Uint16 rows);
+
+  /** converts an RGB or YBR frame with 16 bits/sample from
+   *  color-by-plane to color-by-pixel planar configuration.
+   *  @param imageFrame pointer to image frame, must contain
+   *    at least 3*columns*rows words of pixel data.
+   *  @param columns columns
+   *  @param rows rows
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  static OFCondition createPlanarConfiguration0Word(Uint16 *imageFrame,
+                                                    Uint16 columns,
+                                                    Uint16 rows);
+
+  /// image attributes and fragment indices of the pixel sequences that are
+  /// decompressed frame by frame
+  mutable HtJ2kFrameIndexCache frameIndexCache_;
+};
+
+/** codec class for HT-J2K lossy and lossless TS decoding
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kDecoder : public HtJ2kDecoderBase {
+ public:
+  /** returns the number of bits per sample that will be stored in the
+   *  uncompressed pixel data when decoding the given pixel sequence.
+   *  @param bitsAllocated number of bits allocated per pixel in the source
+   * image
+   *  @param bitsStored number of bits stored per pixel in the source image
+   *  @return number of bits per sample, 0 if unknown
+   */
+  virtual Uint16 decodedBitsAllocated(Uint16 /* bitsAllocated */,
+                                      Uint16 /* bitsStored */) const {
+    return 0;  // unknown - will be determined during decompression
+  }
+};
+
+#endif
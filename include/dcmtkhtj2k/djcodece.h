@@ -5,11 +5,21 @@
 #include "dcmtk/dcmdata/dccodec.h"  /* for class DcmCodec */
 #include "dcmtk/dcmdata/dcofsetl.h" /* for struct DcmOffsetList */
 #include "dcmtk/ofstd/ofstring.h"   /* for class OFString */
+#include "dcmtk/ofstd/ofvector.h"   /* for class OFVector */
 #include "dldefine.h"
 
 class HtJ2kRepresentationParameter;
 class HtJ2kCodecParameter;
 class DicomImage;
+struct HtJ2kFrameSamples;
+struct HtJ2kRawFrame;
+class HtJ2kEncoderContext;
+class HtJ2kEncoderContextPool;
+
+namespace ojph {
+class codestream;
+class outfile_base;
+}  // namespace ojph
 
 /** abstract codec class for HT-J2K encoders.
  *  This abstract class contains most of the application logic
@@ -222,6 +232,21 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderBase : public DcmCodec {
       OFString &decompressedColorModel) const;
 
  private:
+  /// task compressing the frames of an image and storing them in frame order
+  class EncodeFramesTask;
+
+  /// pipeline stages compressing the frames of an image with the raw encoder
+  class RawEncodeStages;
+
+  /// task compressing the frames of an image with the rendered encoder
+  class RenderedEncodeFramesTask;
+
+  /// task compressing a frame with several quantization steps concurrently
+  class QuantizationTrialsTask;
+
+  /// task compressing the tiles of a frame concurrently
+  class EncodeTilesTask;
+
   /** returns the transfer syntax that this particular codec
    *  is able to encode
    *  @return supported transfer syntax
@@ -238,6 +263,10 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderBase : public DcmCodec {
    *  @param pixSeq pixel sequence to write to
    *  @param djcp codec parameter
    *  @param compressionRatio compression ratio returned upon success
+   *  @param extractStoredBits if true, only the stored bits of the pixel
+   *    cell are compressed and the Image Pixel Module is adjusted the same
+   *    way as by RenderedEncode(). Must only be set if
+   *    canExtractStoredBits() returns true for the dataset.
    *  @return EC_Normal if successful, an error code otherwise.
    */
   OFCondition losslessRawEncode(Uint16 const *pixelData, Uint32 const length,
@@ -245,7 +274,18 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderBase : public DcmCodec {
                                 HtJ2kRepresentationParameter const *djrp,
                                 DcmPixelSequence *&pixSeq,
                                 HtJ2kCodecParameter const *djcp,
-                                double &compressionRatio) const;
+                                double &compressionRatio,
+                                OFBool extractStoredBits) const;
+
+  /** checks whether losslessRawEncode() can extract the stored bits of the
+   *  pixel cell itself, producing the same pixel values as RenderedEncode()
+   *  without rendering the image. This is the case for unsigned color and
+   *  all monochrome images with 8 or 16 bits allocated and without overlays
+   *  embedded in the pixel data.
+   *  @param dataset pointer to dataset containing image pixel module
+   *  @return true if the stored bits can be extracted by the raw encoder
+   */
+  OFBool canExtractStoredBits(DcmItem *dataset) const;
 
   /** lossless encoder that moves Overlays to (60xx,3000) and only
    *  compresses the stored bits of the pixel cell.
@@ -283,6 +323,20 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderBase : public DcmCodec {
    */
   OFCondition updateLossyCompressionRatio(DcmItem *dataset, double ratio) const;
 
+  /** adapt the attributes referring to sample values after the samples have
+   *  been scaled to another bit depth. Rescale Slope is adjusted so that the
+   *  rescaled values are preserved, Window Center and Width are scaled if
+   *  they refer to the samples directly, in which case the VOI LUT Sequence
+   *  is removed, and attributes describing specific sample values are
+   *  removed. Images with a Modality LUT Sequence are never scaled.
+   *  @param dataset dataset to be modified
+   *  @param depth original bit depth of the samples
+   *  @param bits bit depth of the scaled samples
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition updateScaledSampleAttributes(DcmItem *dataset, int depth,
+                                           int bits) const;
+
   /** create Derivation Description.
    *  @param dataset dataset to be modified
    *  @param djrp representation parameter passed to encode()
@@ -295,47 +349,212 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderBase : public DcmCodec {
       DcmItem *dataset, HtJ2kRepresentationParameter const *djrp,
       double ratio) const;
 
-  /** perform the lossless raw compression of a single frame
+  /** creates the offset table of the compressed pixel data. The Basic Offset
+   *  Table is used unless the codec parameters request an Extended Offset
+   *  Table or the offsets do not fit into 32 bits. In that case the Extended
+   *  Offset Table and the Extended Offset Table Lengths are added to the
+   *  dataset and the Basic Offset Table is left empty. Since the Extended
+   *  Offset Table is only permitted if every frame is a single fragment,
+   *  frames split into several fragments get a Basic Offset Table instead,
+   *  or none if their offsets do not fit into 32 bits. Offset tables of a
+   *  previous representation are removed from the dataset in any case.
+   *  @param dataset dataset to be modified
+   *  @param offsetTable first item of the compressed pixel sequence
+   *  @param offsetList size of every compressed frame in the pixel sequence,
+   *    including the item headers
+   *  @param frameLengths length of every compressed frame
+   *  @param numberOfFragments number of fragments in the pixel sequence,
+   *    not counting the offset table
+   *  @param djcp codec parameter
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition createOffsetTables(DcmItem *dataset, DcmPixelItem *offsetTable,
+                                 DcmOffsetList const &offsetList,
+                                 OFVector<Uint64> const &frameLengths,
+                                 unsigned long numberOfFragments,
+                                 HtJ2kCodecParameter const *djcp) const;
+
+  /** configures the image, coding style and progression order of a
+   *  codestream according to the codec and representation parameters. The
+   *  encoding options of the representation parameters, if any, are used
+   *  instead of those of the codec parameters.
+   *  @param codestream codestream to be configured
+   *  @param columns frame width
+   *  @param rows frame height
+   *  @param samplesPerPixel image samples per pixel
+   *  @param bitsAllocated number of bits allocated per sample
+   *  @param isSigned true if the samples are signed
+   *  @param colorTransform true if the color transform should be applied
+   *  @param djcp parameters for the codec
+   *  @param djrp representation parameters for the codec
+   */
+  void configureCodestream(ojph::codestream &codestream, Uint16 columns,
+                           Uint16 rows, Uint16 samplesPerPixel,
+                           Uint16 bitsAllocated, OFBool isSigned,
+                           OFBool colorTransform,
+                           HtJ2kCodecParameter const *djcp,
+                           HtJ2kRepresentationParameter const *djrp) const;
+
+  /** compresses the samples of a single frame. If the codec parameters
+   *  divide frames into tiles, the tiles are compressed concurrently and
+   *  assembled into a single codestream.
+   *  This method does not modify any shared state and may be called
+   *  concurrently for different frames.
+   *  @param samples samples of the frame
+   *  @param rows frame height
+   *  @param precision number of bits coded per sample
+   *  @param colorTransform true if the color transform should be applied
+   *  @param quantizationStep base quantization step of irreversible coding,
+   *    0 for the default of OpenJPH
+   *  @param numberOfThreads number of threads compressing the tiles
+   *  @param compressedFrame output file receiving the compressed frame
+   *  @param contexts contexts keeping the OpenJPH objects between frames
+   *  @param djcp parameters for the codec
+   *  @param djrp representation parameters for the codec
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition compressSamples(HtJ2kFrameSamples const &samples, Uint16 rows,
+                              Uint16 precision, OFBool colorTransform,
+                              float quantizationStep, Uint16 numberOfThreads,
+                              ojph::outfile_base &compressedFrame,
+                              HtJ2kEncoderContextPool &contexts,
+                              HtJ2kCodecParameter const *djcp,
+                              HtJ2kRepresentationParameter const *djrp) const;
+
+  /** compresses a single tile of a frame into a codestream of its own, which
+   *  describes an image restricted to the area of the tile.
+   *  @param samples samples of the frame
+   *  @param rows frame height
+   *  @param precision number of bits coded per sample
+   *  @param colorTransform true if the color transform should be applied
+   *  @param quantizationStep base quantization step of irreversible coding,
+   *    0 for the default of OpenJPH
+   *  @param tileSize width and height of the tiles, 0 for a single tile
+   *  @param tile tile index, in raster order
+   *  @param context context providing the codestream, which is reused if
+   *    the context compressed a tile of the same geometry before
+   *  @param compressedTile output file receiving the compressed tile
+   *  @param djcp parameters for the codec
+   *  @param djrp representation parameters for the codec
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition compressTile(HtJ2kFrameSamples const &samples, Uint16 rows,
+                           Uint16 precision, OFBool colorTransform,
+                           float quantizationStep, Uint16 tileSize,
+                           size_t tile, HtJ2kEncoderContext &context,
+                           ojph::outfile_base &compressedTile,
+                           HtJ2kCodecParameter const *djcp,
+                           HtJ2kRepresentationParameter const *djrp) const;
+
+  /** compresses the samples of a single frame with the quantization step
+   *  found by a search meeting the rate control target of the representation
+   *  parameters: the finest step not exceeding a target size, or the
+   *  coarsest step reaching a target PSNR. Every round of the search
+   *  compresses the frame with several steps concurrently.
+   *  @param samples samples of the frame
+   *  @param rows frame height
+   *  @param precision number of bits coded per sample
+   *  @param colorTransform true if the color transform should be applied
+   *  @param targetSize size in bytes the compressed frame should not exceed,
+   *    0 to search for the target PSNR of the representation parameters
+   *  @param numberOfTrials number of compressions per round of the search
+   *  @param quantizationStep quantization step the search starts with, e.g.
+   *    the one found for the previous frame, 0 for none. Returns the
+   *    quantization step used for the frame.
+   *  @param compressedFrame output file receiving the compressed frame
+   *  @param contexts contexts keeping the OpenJPH objects between frames
+   *  @param djcp parameters for the codec
+   *  @param djrp representation parameters for the codec
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition compressRateControlledSamples(
+      HtJ2kFrameSamples const &samples, Uint16 rows, Uint16 precision,
+      OFBool colorTransform, Uint64 targetSize, Uint16 numberOfTrials,
+      double &quantizationStep, ojph::outfile_base &compressedFrame,
+      HtJ2kEncoderContextPool &contexts, HtJ2kCodecParameter const *djcp,
+      HtJ2kRepresentationParameter const *djrp) const;
+
+  /** prepares a single frame for the lossless raw compression. The samples
+   *  of the frame are described in place or, if requested, converted into
+   *  the format of the OpenJPH line buffers, so that the compression does
+   *  not need to convert them anymore.
+   *  This method does not modify any shared state and may be called
+   *  concurrently for different frames.
    *  @param framePointer pointer to start of frame
    *  @param bitsAllocated number of bits allocated per pixel
+   *  @param bitsStored number of bits stored per pixel. If less than
+   *    bitsAllocated, only the stored bits are compressed.
+   *  @param highBit position of the highest stored bit
+   *  @param nominalPrecision precision with which the samples are coded if
+   *    they fit into it, i.e. if the bits above it are zero or, for signed
+   *    samples, copies of the sign bit. Only used if less than bitsStored,
+   *    typically High Bit + 1 when the complete pixel cell is compressed.
    *  @param columns frame width
    *  @param rows frame height
    *  @param samplesPerPixel image samples per pixel
    *  @param planarConfiguration image planar configuration
    *  @param photometricInterpretation photometric interpretation of the DICOM
    * dataset
-   *  @param pixelSequence object in which the compressed frame is stored
-   *  @param offsetList list of frame offsets updated in this parameter
-   *  @param compressedSize size of compressed frame returned in this parameter
+   *  @param convert if true, the samples are converted, otherwise the frame
+   *    refers to the uncompressed pixel data
+   *  @param frame frame receiving the prepared samples. Its buffers are
+   *    reused if the frame has been prepared before.
    *  @param djcp parameters for the codec
    *  @param djrp representation parameters for the codec
    *  @return EC_Normal if successful, an error code otherwise
    */
-  OFCondition compressRawFrame(
-      Uint8 const *framePointer, Uint16 bitsAllocated, Uint16 columns,
-      Uint16 rows, Uint16 samplesPerPixel, Uint16 planarConfiguration,
+  OFCondition prepareRawFrame(
+      Uint8 const *framePointer, Uint16 bitsAllocated, Uint16 bitsStored,
+      Uint16 highBit, Uint16 nominalPrecision, Uint16 columns, Uint16 rows,
+      Uint16 samplesPerPixel, Uint16 planarConfiguration,
       OFBool pixelRepresentation, OFString const &photometricInterpretation,
-      DcmPixelSequence *pixelSequence, DcmOffsetList &offsetList,
-      unsigned long &compressedSize, HtJ2kCodecParameter const *djcp,
+      OFBool convert, HtJ2kRawFrame &frame, HtJ2kCodecParameter const *djcp,
       HtJ2kRepresentationParameter const *djrp) const;
 
-  /** perform the lossless compression of a single rendered frame
-   *  @param pixelSequence object in which the compressed frame is stored
+  /** perform the lossless raw compression of a single frame.
+   *  This method does not modify any shared state and may be called
+   *  concurrently for different frames.
+   *  @param frame frame prepared by prepareRawFrame()
+   *  @param compressedFrame output file receiving the compressed frame
+   *  @param contexts contexts keeping the OpenJPH objects between frames
+   *  @param djcp parameters for the codec
+   *  @param djrp representation parameters for the codec
+   *  @param numberOfThreads number of threads compressing the tiles of the
+   *    frame
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition compressRawFrame(HtJ2kRawFrame const &frame,
+                               ojph::outfile_base &compressedFrame,
+                               HtJ2kEncoderContextPool &contexts,
+                               HtJ2kCodecParameter const *djcp,
+                               HtJ2kRepresentationParameter const *djrp,
+                               Uint16 numberOfThreads) const;
+
+  /** perform the compression of a single rendered frame.
+   *  This method does not modify any shared state and may be called
+   *  concurrently for different frames.
    *  @param dimage DicomImage instance used to process frame
    *  @param photometricInterpretation photometric interpretation of the DICOM
    * dataset
-   *  @param offsetList list of frame offsets updated in this parameter
-   *  @param compressedSize size of compressed frame returned in this parameter
+   *  @param compressedFrame output file receiving the compressed frame
+   *  @param contexts contexts keeping the OpenJPH objects between frames
    *  @param djcp parameters for the codec
    *  @param frame frame index
-   *  @param nearLosslessDeviation maximum deviation for near-lossless encoding
+   *  @param djrp representation parameters for the codec
+   *  @param numberOfTrials number of compressions per round of the rate
+   *    control search, without rate control the number of threads
+   *    compressing the tiles of the frame
+   *  @param quantizationStep quantization step the rate control search
+   *    starts with, 0 for none. Returns the quantization step used for the
+   *    frame, unchanged without rate control.
    *  @return EC_Normal if successful, an error code otherwise
    */
   OFCondition compressRenderedFrame(
-      DcmPixelSequence *pixelSequence, DicomImage *dimage,
-      OFString const &photometricInterpretation, DcmOffsetList &offsetList,
-      unsigned long &compressedSize, HtJ2kCodecParameter const *djcp,
-      Uint32 frame, HtJ2kRepresentationParameter const *djrp) const;
+      DicomImage *dimage, OFString const &photometricInterpretation,
+      ojph::outfile_base &compressedFrame, HtJ2kEncoderContextPool &contexts,
+      HtJ2kCodecParameter const *djcp, Uint32 frame,
+      HtJ2kRepresentationParameter const *djrp, Uint16 numberOfTrials,
+      double &quantizationStep) const;
 
   /** Convert an image from sample interleaved to uninterleaved.
    *  @param target A buffer where the converted image will be stored
@@ -3,13 +3,15 @@
 
 #include "dcmtk/config/osconfig.h"
 #include "dcmtk/dcmdata/dccodec.h" /* for DcmCodecParameter */
+#include "dcmtk/ofstd/ofvector.h"  /* for class OFVector */
 #include "djutils.h"               /* for enums */
 
 /** codec parameter for HT-J2K codecs
  */
 class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
  public:
-  /** constructor, for use with encoders.
+  /** constructor, for use with encoders. The remaining encoder options are
+   *  set to defaults and can be changed with the setters below.
    *  @param jp2k_optionsEnabled       enable/disable use of all HT-J2K
    * parameters
    *  @param jp2k_decompositions      HT-J2K decomposition levels parameter
@@ -18,7 +20,7 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
    *  @param jp2k_progressionOrder          progression order to be used in the
    * HT-J2K codestream
    *  @param preferCookedEncoding      true if the "cooked" lossless encoder
-   * should be preferred over the "raw" one
+   * should be preferred over the "raw" one, see setPreferCookedEncoding()
    *  @param fragmentSize              maximum fragment size (in kbytes) for
    * compression, 0 for unlimited.
    *  @param createOffsetTable         create offset table during image
@@ -50,11 +52,17 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
    * of decompressed color images should be handled
    *  @param ignoreOffsetTable         flag indicating whether to ignore the
    * offset table when decompressing multiframe images
+   *  @param numberOfThreads           number of threads used to decompress
+   * the frames of multiframe images, 0 for one thread per CPU core
+   *  @param resolutionReduction       number of resolution levels to skip
+   * when decompressing, 0 for full resolution. Every level halves the number
+   * of rows and columns.
    */
   HtJ2kCodecParameter(
       HTJ2K_UIDCreation uidCreation = EHTJ2KUC_default,
       HTJ2K_PlanarConfiguration planarConfiguration = EHTJ2KPC_restore,
-      OFBool ignoreOffsetTable = OFFalse);
+      OFBool ignoreOffsetTable = OFFalse, Uint16 numberOfThreads = 1,
+      Uint16 resolutionReduction = 0);
 
   /// copy constructor
   HtJ2kCodecParameter(HtJ2kCodecParameter const &arg);
@@ -83,6 +91,13 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
    */
   OFBool getCreateOffsetTable() const { return createOffsetTable_; }
 
+  /** returns create extended offset table flag
+   *  @return create extended offset table flag
+   */
+  OFBool getCreateExtendedOffsetTable() const {
+    return createExtendedOffsetTable_;
+  }
+
   /** returns mode for SOP Instance UID creation
    *  @return mode for SOP Instance UID creation
    */
@@ -101,6 +116,46 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
    */
   OFBool cookedEncodingPreferred() const { return preferCookedEncoding_; }
 
+  /** returns the number of frames the "cooked" encoder renders at a time
+   *  @return number of frames rendered at a time, 0 for all frames
+   */
+  Uint32 getFrameWindowSize() const { return frameWindowSize_; }
+
+  /** returns flag indicating whether lossless frames are coded with the
+   *  smallest precision holding their samples
+   *  @return true if the precision is fitted to the samples of each frame
+   */
+  OFBool getFitPrecision() const { return fitPrecision_; }
+
+  /** returns the bit depth handling upon lossy compression
+   *  @return bit depth handling upon lossy compression
+   */
+  HTJ2K_CompressionBitDepth getCompressionBitDepth() const {
+    return compressionBitDepth_;
+  }
+
+  /** returns the bit depth to which images are limited or forced upon lossy
+   *  compression
+   *  @return bit depth for lossy compression
+   */
+  Uint16 getCompressionBits() const { return compressionBits_; }
+
+  /** returns the precinct sizes of the resolutions, starting with the lowest
+   *  one
+   *  @return precinct sizes, empty for a single precinct per resolution
+   */
+  OFVector<Uint16> const &getPrecinctSizes() const { return precinctSizes_; }
+
+  /** returns flag indicating whether PLT marker segments are written
+   *  @return true if PLT marker segments are written
+   */
+  OFBool getPacketLengthMarkers() const { return packetLengthMarkers_; }
+
+  /** returns the width and height of the tiles frames are divided into
+   *  @return tile size, 0 for a single tile
+   */
+  Uint16 getTileSize() const { return tileSize_; }
+
   /** returns maximum fragment size (in kbytes) for compression, 0 for
    * unlimited.
    *  @return maximum fragment size for compression
@@ -141,6 +196,110 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
    */
   OFBool ignoreOffsetTable() const { return ignoreOffsetTable_; }
 
+  /** returns the number of threads used to process the frames of multiframe
+   * images, 0 for one thread per CPU core
+   *  @return number of threads used to process the frames of multiframe images
+   */
+  Uint16 getNumberOfThreads() const { return numberOfThreads_; }
+
+  /** returns the number of resolution levels to skip when decompressing,
+   * 0 for full resolution
+   *  @return number of resolution levels to skip when decompressing
+   */
+  Uint16 getResolutionReduction() const { return resolutionReduction_; }
+
+  /** sets flag indicating whether or not the "cooked" lossless encoder
+   *  should be preferred over the "raw" one. The "raw" encoder compresses
+   *  the complete pixel cell, with a precision of High Bit + 1 if the bits
+   *  above High Bit are zero (or copies of the sign bit for signed pixel
+   *  data) in a frame, and of Bits Allocated otherwise.
+   *  @param preferCookedEncoding raw/cooked lossless encoding flag
+   */
+  void setPreferCookedEncoding(OFBool preferCookedEncoding) {
+    preferCookedEncoding_ = preferCookedEncoding;
+  }
+
+  /** sets maximum fragment size (in kbytes) for compression
+   *  @param fragmentSize maximum fragment size, 0 for unlimited
+   */
+  void setFragmentSize(Uint32 fragmentSize) { fragmentSize_ = fragmentSize; }
+
+  /** sets create extended offset table flag. An Extended Offset Table is
+   *  always created if the offsets exceed the range of the Basic Offset Table.
+   *  @param createExtendedOffsetTable create an Extended Offset Table instead
+   *    of a Basic Offset Table during image compression
+   */
+  void setCreateExtendedOffsetTable(OFBool createExtendedOffsetTable) {
+    createExtendedOffsetTable_ = createExtendedOffsetTable;
+  }
+
+  /** sets the number of threads used to process the frames of multiframe
+   *  images
+   *  @param numberOfThreads number of threads, 0 for one thread per CPU core
+   */
+  void setNumberOfThreads(Uint16 numberOfThreads) {
+    numberOfThreads_ = numberOfThreads;
+  }
+
+  /** sets the number of frames the "cooked" encoder renders at a time. Limits
+   *  the memory required for large multiframe images; should be a multiple
+   *  of the number of threads.
+   *  @param frameWindowSize number of frames rendered at a time, 0 for all
+   *    frames at once
+   */
+  void setFrameWindowSize(Uint32 frameWindowSize) {
+    frameWindowSize_ = frameWindowSize;
+  }
+
+  /** sets flag indicating whether the range of the samples of each frame is
+   *  measured and lossless frames are coded with the smallest precision
+   *  holding them instead of with BitsStored
+   *  @param fitPrecision true if the precision is fitted to the samples
+   */
+  void setFitPrecision(OFBool fitPrecision) { fitPrecision_ = fitPrecision; }
+
+  /** sets the bit depth handling upon lossy compression. The lossy
+   *  compression of an image with a Modality LUT Sequence fails if its bit
+   *  depth would be changed, since the LUT maps the original sample values.
+   *  @param compressionBitDepth bit depth handling upon lossy compression
+   */
+  void setCompressionBitDepth(HTJ2K_CompressionBitDepth compressionBitDepth) {
+    compressionBitDepth_ = compressionBitDepth;
+  }
+
+  /** sets the bit depth to which images are limited or forced upon lossy
+   *  compression, unless the bit depth handling is EHTJ2KBD_original
+   *  @param compressionBits bit depth (1..16) for lossy compression
+   */
+  void setCompressionBits(Uint16 compressionBits) {
+    compressionBits_ = compressionBits;
+  }
+
+  /** sets the precinct sizes of the resolutions, starting with the lowest
+   *  one. The last size also applies to all higher resolutions.
+   *  @param precinctSizes precinct width and height (a power of two, at
+   *    least 2) per resolution, empty for a single precinct per resolution
+   */
+  void setPrecinctSizes(OFVector<Uint16> const &precinctSizes) {
+    precinctSizes_ = precinctSizes;
+  }
+
+  /** sets flag indicating whether PLT marker segments listing the length of
+   *  every packet are written. They are always written for the RPCL transfer
+   *  syntax.
+   *  @param packetLengthMarkers true if PLT marker segments are written
+   */
+  void setPacketLengthMarkers(OFBool packetLengthMarkers) {
+    packetLengthMarkers_ = packetLengthMarkers;
+  }
+
+  /** sets the width and height of the tiles frames are divided into. The
+   *  tiles of a frame are compressed concurrently, and decompressed
+   *  concurrently if the decoder uses multiple threads.
+   *  @param tileSize tile size, 0 for a single tile
+   */
+  void setTileSize(Uint16 tileSize) { tileSize_ = tileSize; }
+
  private:
   /// private undefined copy assignment operator
   HtJ2kCodecParameter &operator=(HtJ2kCodecParameter const &);
@@ -169,10 +328,34 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
   /// create offset table during image compression
   OFBool createOffsetTable_;
 
+  /// create an Extended Offset Table instead of a Basic Offset Table
+  OFBool createExtendedOffsetTable_;
+
   /// Flag indicating if the "cooked" lossless encoder should be preferred over
   /// the "raw" one
   OFBool preferCookedEncoding_;
 
+  /// number of frames the "cooked" encoder renders at a time, 0 for all
+  Uint32 frameWindowSize_;
+
+  /// code lossless frames with the smallest precision holding their samples
+  OFBool fitPrecision_;
+
+  /// bit depth handling upon lossy compression
+  HTJ2K_CompressionBitDepth compressionBitDepth_;
+
+  /// bit depth to which images are limited or forced upon lossy compression
+  Uint16 compressionBits_;
+
+  /// precinct sizes of the resolutions, starting with the lowest one
+  OFVector<Uint16> precinctSizes_;
+
+  /// write PLT marker segments
+  OFBool packetLengthMarkers_;
+
+  /// width and height of the tiles, 0 for a single tile
+  Uint16 tileSize_;
+
   /// mode for SOP Instance UID creation (used both for encoding and decoding)
   HTJ2K_UIDCreation uidCreation_;
 
@@ -190,6 +373,17 @@ class DCMTKHTJ2K_EXPORT HtJ2kCodecParameter : public DcmCodecParameter {
   /// flag indicating if temporary files should be kept, false if they should be
   /// deleted after use
   OFBool ignoreOffsetTable_;
+
+  /// number of resolution levels to skip when decompressing, 0 for full
+  /// resolution
+  Uint16 resolutionReduction_;
+
+  // ****************************************************
+  // **** Parameters describing both processes ****
+
+  /// number of threads used to process the frames of multiframe images,
+  /// 0 for one thread per CPU core
+  Uint16 numberOfThreads_;
 };
 
 #endif
@@ -22,11 +22,17 @@ class DCMTKHTJ2K_EXPORT HtJ2kDecoderRegistration {
    *    of color images should be encoded upon decompression.
    *  @param ignoreOffsetTable flag indicating whether to ignore the offset
    * table when decompressing multiframe images
+   *  @param numberOfThreads number of threads used to decompress the frames
+   * of multiframe images, 0 for one thread per CPU core
+   *  @param resolutionReduction number of resolution levels to skip when
+   * decompressing, 0 for full resolution. Every level halves the number of
+   * rows and columns of the decompressed image.
    */
   static void registerCodecs(
       HTJ2K_UIDCreation uidcreation = EHTJ2KUC_default,
       HTJ2K_PlanarConfiguration planarconfig = EHTJ2KPC_restore,
-      OFBool ignoreOffsetTable = OFFalse);
+      OFBool ignoreOffsetTable = OFFalse, Uint16 numberOfThreads = 1,
+      Uint16 resolutionReduction = 0);
 
   /** deregisters decoders.
    *  Attention: Must not be called while other threads might still use
@@ -36,10 +36,9 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderRegistration {
    *  @param uidCreation               mode for SOP Instance UID creation
    *  @param convertToSC               flag indicating whether image should be
    * converted to Secondary Capture upon compression
-   *  @param jplsInterleaveMode        flag describing which interleave the
-   * HT-J2K datastream should use
+   *  @see registerCodecs(HtJ2kCodecParameter const &) for the other encoder
+   *  options
    */
-
   static void registerCodecs(
       OFBool jp2k_optionsEnabled = OFFalse, Uint16 jp2k_decompositions = 5,
       Uint16 jp2k_cblkwidth = 64, Uint16 jp2k_cblkheight = 64,
@@ -49,6 +48,20 @@ class DCMTKHTJ2K_EXPORT HtJ2kEncoderRegistration {
       HTJ2K_UIDCreation uidCreation = EHTJ2KUC_default,
       OFBool convertToSC = OFFalse);
 
+  /** registers encoders for all supported HT-J2K processes with the given
+   *  codec parameter, on which any encoder option can be set, e.g.
+   *  @code
+   *  HtJ2kCodecParameter parameters;
+   *  parameters.setNumberOfThreads(0);
+   *  parameters.setTileSize(512);
+   *  HtJ2kEncoderRegistration::registerCodecs(parameters);
+   *  @endcode
+   *  If already registered, call is ignored unless cleanup() has
+   *  been performed before.
+   *  @param parameters codec parameter shared by all encoders, copied
+   */
+  static void registerCodecs(HtJ2kCodecParameter const &parameters);
+
   /** deregisters encoders.
    *  Attention: Must not be called while other threads might still use
    *  the registered codecs, e.g. because they are currently encoding
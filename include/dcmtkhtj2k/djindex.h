@@ -0,0 +1,234 @@
+#ifndef DCMTKHTJ2K_DJINDEX_H
+#define DCMTKHTJ2K_DJINDEX_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofcond.h"   /* for class OFCondition */
+#include "dcmtk/ofstd/ofmem.h"    /* for OFshared_ptr */
+#include "dcmtk/ofstd/ofthread.h" /* for class OFMutex */
+#include "dcmtk/ofstd/oftypes.h"  /* for Uint16 */
+#include "dcmtk/ofstd/ofvector.h" /* for class OFVector */
+#include "dldefine.h"
+
+class DcmItem;
+class DcmPixelItem;
+class DcmPixelSequence;
+
+/** attributes of the Image Pixel Module that are required to decompress the
+ *  frames of an image.
+ */
+struct DCMTKHTJ2K_EXPORT HtJ2kImageAttributes {
+  /// default constructor
+  HtJ2kImageAttributes()
+      : samplesPerPixel(0),
+        rows(0),
+        columns(0),
+        bitsStored(0),
+        bitsAllocated(0),
+        bytesPerSample(0),
+        numberOfFrames(0),
+        numberOfFramesPresent(OFFalse) {}
+
+  /** reads and checks the attributes from the given dataset.
+   *  @param dataset dataset in which the pixel data element is contained
+   *  @param numberOfItems number of items of the compressed pixel sequence,
+   *    including the offset table, used to limit the number of frames
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition read(DcmItem *dataset, unsigned long numberOfItems);
+
+  /** compares the attributes with the given ones
+   *  @param rhs attributes to compare with
+   *  @return true if all attributes are equal
+   */
+  OFBool operator==(HtJ2kImageAttributes const &rhs) const;
+
+  /// number of samples per pixel, 1 or 3
+  Uint16 samplesPerPixel;
+
+  /// number of rows of each frame
+  Uint16 rows;
+
+  /// number of columns of each frame
+  Uint16 columns;
+
+  /// number of bits stored per sample, 1..16
+  Uint16 bitsStored;
+
+  /// number of bits allocated per sample
+  Uint16 bitsAllocated;
+
+  /// number of bytes per sample of the decompressed image, 1 or 2
+  Uint16 bytesPerSample;
+
+  /// number of frames, limited to the number of fragments and at least 1
+  Sint32 numberOfFrames;
+
+  /// true if the Number of Frames attribute is present in the dataset
+  OFBool numberOfFramesPresent;
+};
+
+/** index of the fragments (pixel items) of a compressed pixel sequence,
+ *  mapping each frame to the range of fragments it is stored in. The index
+ *  is built from the Extended Offset Table, the Basic Offset Table or, if
+ *  neither is usable, by scanning the fragments for the start of a
+ *  codestream. Once built, the fragments of any frame can be located in
+ *  constant time for as long as matches() confirms that the pixel sequence
+ *  is unchanged.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kFrameIndex {
+ public:
+  /// default constructor, creates an empty index
+  HtJ2kFrameIndex();
+
+  /** builds the index for the given pixel sequence.
+   *  @param pixSeq compressed pixel sequence
+   *  @param dataset dataset in which the pixel data element is contained,
+   *    used to access the Extended Offset Table. May be NULL.
+   *  @param numberOfFrames number of frames of the image
+   *  @param ignoreOffsetTable flag instructing the method to ignore the
+   *    offset tables even if present and presumably useful
+   *  @return EC_Normal if successful, an error code otherwise. Frames whose
+   *    fragments could not be determined are not considered an error, they
+   *    are reported by numberOfItems().
+   */
+  OFCondition build(DcmPixelSequence *pixSeq, DcmItem *dataset,
+                    Sint32 numberOfFrames, OFBool ignoreOffsetTable);
+
+  /** checks if the index still describes the given pixel sequence, i.e. the
+   *  index was built for a sequence at the same address with the same number
+   *  of items, and the offset table and the last fragment are still the same
+   *  items with the same lengths. This catches fragments added, removed or
+   *  replaced since, and a sequence freed and another one created at the
+   *  same address. Only the pointers of the item list are followed, no
+   *  fragment data is read.
+   *  @param pixSeq compressed pixel sequence
+   *  @return true if the index is valid for the pixel sequence
+   */
+  OFBool matches(DcmPixelSequence *pixSeq) const;
+
+  /** returns the number of frames in the index
+   *  @return number of frames
+   */
+  size_t numberOfFrames() const {
+    return frameStart_.empty() ? 0 : frameStart_.size() - 1;
+  }
+
+  /** returns the index of the first fragment of the given frame
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @return index of the first fragment, 0 if unknown
+   */
+  Uint32 startItem(size_t frameNo) const;
+
+  /** returns the number of fragments of the given frame
+   *  @param frameNo number of frame, starting with 0 for the first frame
+   *  @return number of fragments, 0 if unknown
+   */
+  Uint32 numberOfItems(size_t frameNo) const;
+
+  /** returns the fragment (pixel item) with the given index
+   *  @param index index of the fragment, 0 for the offset table
+   *  @return fragment, NULL if the index is out of range
+   */
+  DcmPixelItem *item(Uint32 index) const;
+
+ private:
+  /// determines the first fragment of all frames from the given offsets
+  OFBool mapOffsets(OFVector<Uint64> const &offsets);
+
+  /// determines the first fragment of all frames by searching for SOC markers
+  void scanForCodestreams();
+
+  /// pixel sequence the index was built for
+  DcmPixelSequence *pixSeq_;
+
+  /// length of the offset table item when the index was built
+  Uint32 offsetTableLength_;
+
+  /// length of the last fragment when the index was built
+  Uint32 lastFragmentLength_;
+
+  /// all items of the pixel sequence, including the offset table
+  OFVector<DcmPixelItem *> items_;
+
+  /// index of the first fragment of every frame, followed by the number of
+  /// items. Frames whose fragments are unknown start at item 0.
+  OFVector<Uint32> frameStart_;
+};
+
+/** thread-safe cache of frame indices and image attributes for the pixel
+ *  sequences recently accessed frame by frame. Only a small number of
+ *  entries is kept, the least recently used entry is dropped first.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kFrameIndexCache {
+ public:
+  /** constructor.
+   *  @param capacity maximum number of pixel sequences in the cache
+   */
+  explicit HtJ2kFrameIndexCache(size_t capacity = 16);
+
+  /// destructor
+  ~HtJ2kFrameIndexCache();
+
+  /** looks up the frame index and image attributes for the given pixel
+   *  sequence, building and caching them if necessary. The image attributes
+   *  are read from the dataset on every call; a cached index is only used
+   *  if it was built for the same attributes and still matches the pixel
+   *  sequence, see HtJ2kFrameIndex::matches().
+   *  @param dataset dataset in which the pixel data element is contained
+   *  @param pixSeq compressed pixel sequence
+   *  @param ignoreOffsetTable flag instructing the method to ignore the
+   *    offset tables even if present and presumably useful
+   *  @param attributes image attributes returned in this parameter
+   *  @param index frame index returned in this parameter
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition lookup(DcmItem *dataset, DcmPixelSequence *pixSeq,
+                     OFBool ignoreOffsetTable,
+                     HtJ2kImageAttributes &attributes,
+                     OFshared_ptr<HtJ2kFrameIndex const> &index);
+
+  /** removes all entries of the given dataset, e.g. because its image
+   *  attributes have been modified.
+   *  @param dataset dataset to be removed
+   */
+  void invalidate(DcmItem const *dataset);
+
+  /// removes all entries
+  void clear();
+
+ private:
+  /// private undefined copy constructor
+  HtJ2kFrameIndexCache(HtJ2kFrameIndexCache const &);
+
+  /// private undefined copy assignment operator
+  HtJ2kFrameIndexCache &operator=(HtJ2kFrameIndexCache const &);
+
+  /// entry of the cache
+  struct Entry {
+    /// dataset in which the pixel data element is contained
+    DcmItem const *dataset;
+
+    /// compressed pixel sequence
+    DcmPixelSequence *pixSeq;
+
+    /// true if the offset tables were ignored when building the index
+    OFBool ignoreOffsetTable;
+
+    /// image attributes of the dataset
+    HtJ2kImageAttributes attributes;
+
+    /// frame index of the pixel sequence
+    OFshared_ptr<HtJ2kFrameIndex const> index;
+  };
+
+  /// maximum number of entries
+  size_t capacity_;
+
+  /// entries, most recently used first
+  OFVector<Entry> entries_;
+
+  /// mutex protecting the entries
+  OFMutex mutex_;
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef DCMTKHTJ2K_DJPLT_H
+#define DCMTKHTJ2K_DJPLT_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofcond.h"   /* for class OFCondition */
+#include "dcmtk/ofstd/oftypes.h"  /* for Uint8 */
+#include "dcmtk/ofstd/ofvector.h" /* for class OFVector */
+#include "dldefine.h"
+
+namespace ojph {
+class outfile_base;
+}
+
+/** lengths of the packets of a HT-J2K codestream, recovered by parsing the
+ *  packet headers of every tile-part. Used to insert PLT (packet length,
+ *  tile-part header) marker segments into codestreams written without them.
+ *  Together with the TLM marker, they allow a client to locate the packets of
+ *  a resolution, component or precinct and to fetch them by byte ranges.
+ *
+ *  Codestreams with a single quality layer, HT code-blocks, and components
+ *  that are not subsampled are supported, as written by the HT-J2K encoders.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kPacketLengthIndex {
+ public:
+  /// default constructor, creates an empty index
+  HtJ2kPacketLengthIndex();
+
+  /** parses the packet headers of the given codestream.
+   *  @param data codestream, starting with the SOC marker
+   *  @param size length of the codestream in bytes
+   *  @return EC_Normal if the lengths of all packets were determined, an error
+   *    code otherwise
+   */
+  OFCondition parse(Uint8 const *data, size_t size);
+
+  /** writes the parsed codestream with a PLT marker segment in the header of
+   *  every tile-part. The lengths of the tile-parts are updated in the SOT
+   *  and TLM marker segments.
+   *  @param data codestream passed to parse()
+   *  @param outfile file the codestream is written to
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition write(Uint8 const *data, ojph::outfile_base &outfile) const;
+
+  /** returns true if the codestream already contains PLT marker segments and
+   *  is written unchanged.
+   *  @return true if the codestream already contains PLT marker segments
+   */
+  OFBool hasPacketLengths() const { return hasPacketLengths_; }
+
+ private:
+  /// tile-part of the codestream
+  struct TilePart {
+    /// position of the Psot field in the SOT marker segment
+    size_t psotOffset;
+
+    /// length of the tile-part according to Psot, 0 up to the EOC marker
+    Uint32 psot;
+
+    /// position of the SOD marker
+    size_t sodOffset;
+
+    /// lengths of the packets in the tile-part
+    OFVector<Uint32> packetLengths;
+  };
+
+  /// length of the codestream
+  size_t size_;
+
+  /// true if the codestream already contains PLT marker segments
+  OFBool hasPacketLengths_;
+
+  /// tile-parts in codestream order
+  OFVector<TilePart> tileParts_;
+
+  /// positions of the Ptlm fields of the TLM marker segments
+  OFVector<size_t> tlmOffsets_;
+
+  /// size of the Ptlm fields, 2 or 4 bytes
+  Uint8 tlmSize_;
+};
+
+#endif
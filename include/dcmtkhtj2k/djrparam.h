@@ -3,17 +3,38 @@
 
 #include "dcmtk/config/osconfig.h"
 #include "dcmtk/dcmdata/dcpixel.h" /* for class DcmRepresentationParameter */
+#include "djutils.h"                /* for enums */
 #include "dldefine.h"
 
-/** representation parameter for HT-J2K
+/** representation parameter for HT-J2K. Besides the lossless or lossy
+ *  process, it may carry encoding options that are used instead of those of
+ *  the codec parameters, so that images can be compressed with different
+ *  settings without registering the codecs again.
  */
 class DCMTKHTJ2K_EXPORT HtJ2kRepresentationParameter
     : public DcmRepresentationParameter {
  public:
   /** constructor
    *  @param losslessProcess true if lossless process is requested
+   *  @param compressionRatio compression ratio that lossy compression should
+   *    approach without falling below it, 0 for none
+   *  @param targetFrameSize size in bytes that no lossy compressed frame
+   *    should exceed, 0 for none. Takes precedence over compressionRatio.
+   *  @param targetPSNR peak signal-to-noise ratio in dB that every lossy
+   *    compressed frame should reach with the smallest size, 0 for none.
+   *    Only used without compressionRatio and targetFrameSize.
+   *  @param maximumError maximum absolute difference between original and
+   *    reconstructed samples (near-lossless mode), 0 for none. Takes
+   *    precedence over all other targets; frames are compressed with the
+   *    coarsest quantization keeping this bound, and compression fails if
+   *    none does. The bound refers to the samples after any bit depth
+   *    scaling of the codec parameters.
    */
-  HtJ2kRepresentationParameter(OFBool losslessProcess = OFTrue);
+  HtJ2kRepresentationParameter(OFBool losslessProcess = OFTrue,
+                               double compressionRatio = 0.0,
+                               Uint32 targetFrameSize = 0,
+                               double targetPSNR = 0.0,
+                               Uint16 maximumError = 0);
 
   /// copy constructor
   HtJ2kRepresentationParameter(HtJ2kRepresentationParameter const &arg);
@@ -44,9 +65,115 @@ class DCMTKHTJ2K_EXPORT HtJ2kRepresentationParameter
    */
   OFBool useLosslessProcess() const { return losslessProcess_; }
 
+  /** returns the compression ratio targeted by lossy compression
+   *  @return target compression ratio, 0 for none
+   */
+  double getCompressionRatio() const { return compressionRatio_; }
+
+  /** returns the size that no lossy compressed frame should exceed
+   *  @return target frame size in bytes, 0 for none
+   */
+  Uint32 getTargetFrameSize() const { return targetFrameSize_; }
+
+  /** returns the peak signal-to-noise ratio targeted by lossy compression
+   *  @return target PSNR in dB, 0 for none
+   */
+  double getTargetPSNR() const { return targetPSNR_; }
+
+  /** returns the maximum absolute error of near-lossless compression
+   *  @return maximum error, 0 for none
+   */
+  Uint16 getMaximumError() const { return maximumError_; }
+
+  /** returns true if the quantization of lossy compression is searched for
+   *  every frame to meet a target size, ratio, PSNR or maximum error
+   *  @return true if rate control is requested
+   */
+  OFBool useRateControl() const {
+    return !losslessProcess_ &&
+           ((compressionRatio_ > 0.0) || (targetFrameSize_ > 0) ||
+            (targetPSNR_ > 0.0) || (maximumError_ > 0));
+  }
+
+  /** sets the encoding options used instead of those of the codec
+   *  parameters when compressing to this representation.
+   *  @param decompositions number of decomposition levels
+   *  @param cblkWidth code-block width
+   *  @param cblkHeight code-block height
+   *  @param progressionOrder progression order, ignored by the RPCL transfer
+   *    syntax
+   *  @param fragmentSize maximum fragment size in kbytes, 0 for unlimited
+   */
+  void setEncodingOptions(Uint16 decompositions, Uint16 cblkWidth,
+                          Uint16 cblkHeight,
+                          HTJ2K_ProgressionOrder progressionOrder,
+                          Uint32 fragmentSize);
+
+  /** returns true if this representation parameter carries encoding options
+   *  @return true if encoding options were set
+   */
+  OFBool hasEncodingOptions() const { return encodingOptions_; }
+
+  /** returns the number of decomposition levels
+   *  @return number of decomposition levels
+   */
+  Uint16 getDecompositions() const { return decompositions_; }
+
+  /** returns the code-block width
+   *  @return code-block width
+   */
+  Uint16 getCodeBlockWidth() const { return cblkWidth_; }
+
+  /** returns the code-block height
+   *  @return code-block height
+   */
+  Uint16 getCodeBlockHeight() const { return cblkHeight_; }
+
+  /** returns the progression order
+   *  @return progression order
+   */
+  HTJ2K_ProgressionOrder getProgressionOrder() const {
+    return progressionOrder_;
+  }
+
+  /** returns the maximum fragment size
+   *  @return maximum fragment size in kbytes, 0 for unlimited
+   */
+  Uint32 getFragmentSize() const { return fragmentSize_; }
+
  private:
   /// true if lossless process should be used even in lossy transfer syntax
   OFBool losslessProcess_;
+
+  /// compression ratio targeted by lossy compression, 0 for none
+  double compressionRatio_;
+
+  /// size in bytes no lossy compressed frame should exceed, 0 for none
+  Uint32 targetFrameSize_;
+
+  /// peak signal-to-noise ratio in dB targeted by lossy compression
+  double targetPSNR_;
+
+  /// maximum absolute error of near-lossless compression, 0 for none
+  Uint16 maximumError_;
+
+  /// true if the encoding options below replace those of the codec
+  OFBool encodingOptions_;
+
+  /// number of decomposition levels
+  Uint16 decompositions_;
+
+  /// code-block width
+  Uint16 cblkWidth_;
+
+  /// code-block height
+  Uint16 cblkHeight_;
+
+  /// progression order
+  HTJ2K_ProgressionOrder progressionOrder_;
+
+  /// maximum fragment size in kbytes, 0 for unlimited
+  Uint32 fragmentSize_;
 };
 
 #endif
@@ -0,0 +1,177 @@
+#ifndef DCMTKHTJ2K_DJSIMD_H
+#define DCMTKHTJ2K_DJSIMD_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/oftypes.h" /* for Uint8, Sint32 */
+#include "dldefine.h"
+
+/** instruction sets for which sample conversion kernels are available
+ */
+enum HTJ2K_InstructionSet {
+  /// portable implementation without vector instructions
+  EHTJ2KIS_scalar,
+
+  /// SSE2 (x86)
+  EHTJ2KIS_sse2,
+
+  /// AVX2 (x86)
+  EHTJ2KIS_avx2,
+
+  /// AVX-512 F and BW (x86)
+  EHTJ2KIS_avx512
+};
+
+/** table of kernels converting decoded samples, as delivered by OpenJPH in
+ *  32-bit line buffers, into DICOM pixel data and DICOM pixel data into the
+ *  line buffers consumed by the OpenJPH encoder. All implementations of a
+ *  kernel produce bit-exact identical results; they only differ in the
+ *  instruction set used. The implementation is selected at runtime depending
+ *  on the capabilities of the CPU.
+ */
+struct DCMTKHTJ2K_EXPORT HtJ2kSampleKernels {
+  /// instruction set used by the kernels in this table
+  HTJ2K_InstructionSet instructionSet;
+
+  /** converts 32-bit samples to unsigned 8-bit samples, saturating values
+   *  outside the range 0..255.
+   *  @param source samples to be converted
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*narrowToUint8)(Sint32 const *source, Uint8 *target, size_t count);
+
+  /** converts 32-bit samples to signed 8-bit samples, saturating values
+   *  outside the range -128..127.
+   *  @param source samples to be converted
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*narrowToSint8)(Sint32 const *source, Sint8 *target, size_t count);
+
+  /** converts 32-bit samples to unsigned 16-bit samples, saturating values
+   *  outside the range 0..65535.
+   *  @param source samples to be converted
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*narrowToUint16)(Sint32 const *source, Uint16 *target, size_t count);
+
+  /** converts 32-bit samples to signed 16-bit samples, saturating values
+   *  outside the range -32768..32767.
+   *  @param source samples to be converted
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*narrowToSint16)(Sint32 const *source, Sint16 *target, size_t count);
+
+  /** interleaves three planes of 8-bit samples into color-by-pixel order.
+   *  @param plane0 samples of the first component
+   *  @param plane1 samples of the second component
+   *  @param plane2 samples of the third component
+   *  @param target interleaved samples returned in this buffer, which must
+   *    provide room for 3 * count samples
+   *  @param count number of samples per plane
+   */
+  void (*interleave8)(Uint8 const *plane0, Uint8 const *plane1,
+                      Uint8 const *plane2, Uint8 *target, size_t count);
+
+  /** interleaves three planes of 16-bit samples into color-by-pixel order.
+   *  @param plane0 samples of the first component
+   *  @param plane1 samples of the second component
+   *  @param plane2 samples of the third component
+   *  @param target interleaved samples returned in this buffer, which must
+   *    provide room for 3 * count samples
+   *  @param count number of samples per plane
+   */
+  void (*interleave16)(Uint16 const *plane0, Uint16 const *plane1,
+                       Uint16 const *plane2, Uint16 *target, size_t count);
+
+  /** converts unsigned 8-bit samples of one component to 32-bit samples.
+   *  @param source first sample of the first pixel, not of the component
+   *  @param component index of the component to be converted
+   *  @param samplesPerPixel distance between two samples of the component,
+   *    1 for monochrome or color-by-plane and 3 for color-by-pixel data
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*widenUint8)(Uint8 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count);
+
+  /** converts signed 8-bit samples of one component to 32-bit samples.
+   *  @param source first sample of the first pixel, not of the component
+   *  @param component index of the component to be converted
+   *  @param samplesPerPixel distance between two samples of the component,
+   *    1 for monochrome or color-by-plane and 3 for color-by-pixel data
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*widenSint8)(Sint8 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count);
+
+  /** converts unsigned 16-bit samples of one component to 32-bit samples.
+   *  @param source first sample of the first pixel, not of the component
+   *  @param component index of the component to be converted
+   *  @param samplesPerPixel distance between two samples of the component,
+   *    1 for monochrome or color-by-plane and 3 for color-by-pixel data
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*widenUint16)(Uint16 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count);
+
+  /** converts signed 16-bit samples of one component to 32-bit samples.
+   *  @param source first sample of the first pixel, not of the component
+   *  @param component index of the component to be converted
+   *  @param samplesPerPixel distance between two samples of the component,
+   *    1 for monochrome or color-by-plane and 3 for color-by-pixel data
+   *  @param target converted samples returned in this buffer
+   *  @param count number of samples
+   */
+  void (*widenSint16)(Sint16 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count);
+
+  /** extracts the stored bits of widened samples in place. The samples are
+   *  shifted down to the lowest stored bit; all bits above the stored bits
+   *  are cleared for unsigned samples and set to the sign for signed ones.
+   *  @param line samples to be converted
+   *  @param count number of samples
+   *  @param lowBit position of the lowest stored bit, i.e.
+   *    HighBit + 1 - BitsStored
+   *  @param bitsStored number of stored bits, lowBit + bitsStored <= 32
+   *  @param isSigned true if the stored bits are a signed value
+   */
+  void (*extractBits)(Sint32 *line, size_t count, Uint16 lowBit,
+                      Uint16 bitsStored, OFBool isSigned);
+
+  /** determines the range of 32-bit samples.
+   *  @param line samples to be examined
+   *  @param count number of samples
+   *  @param minimum lowered to the smallest sample if that is smaller
+   *  @param maximum raised to the largest sample if that is larger
+   */
+  void (*findRange)(Sint32 const *line, size_t count, Sint32 &minimum,
+                    Sint32 &maximum);
+
+  /** scales widened samples up in place by shifting them to the left.
+   *  @param line samples to be converted
+   *  @param count number of samples
+   *  @param shift number of bits the samples are shifted by, less than 32
+   */
+  void (*shiftLeft)(Sint32 *line, size_t count, Uint16 shift);
+
+  /** returns the kernels for the most capable instruction set supported by
+   *  the CPU.
+   *  @return kernel table, never NULL
+   */
+  static HtJ2kSampleKernels const &best();
+
+  /** returns the kernels for the given instruction set.
+   *  @param instructionSet requested instruction set
+   *  @return kernel table, NULL if the instruction set is not supported by
+   *    the CPU or the kernels have not been compiled for this platform
+   */
+  static HtJ2kSampleKernels const *forInstructionSet(
+      HTJ2K_InstructionSet instructionSet);
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef DCMTKHTJ2K_DJTHREAD_H
+#define DCMTKHTJ2K_DJTHREAD_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofcond.h"  /* for class OFCondition */
+#include "dcmtk/ofstd/oftypes.h" /* for Uint16 */
+#include "dldefine.h"
+
+/** abstract unit of work that is executed once for every index of a
+ *  parallel loop, e.g. once for every frame of a multi-frame image.
+ *  Implementations must be safe to call concurrently for different indices.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kParallelTask {
+ public:
+  /// destructor
+  virtual ~HtJ2kParallelTask() {}
+
+  /** processes a single work item.
+   *  @param index index of the work item, 0..count-1
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition execute(size_t index) = 0;
+};
+
+/** helper class that distributes the work items of a HtJ2kParallelTask
+ *  over a number of threads. The calling thread always takes part in the
+ *  work, so a thread count of 1 executes all items serially without
+ *  creating any threads. If threads cannot be created (e.g. on platforms
+ *  without thread support), the remaining work is done by the calling thread.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kParallelLoop {
+ public:
+  /** executes the given task once for every index in 0..count-1.
+   *  No new work items are handed out after an item has failed.
+   *  @param task task to be executed
+   *  @param count number of work items
+   *  @param numberOfThreads maximum number of threads to be used (including
+   *    the calling thread), 0 for one thread per available CPU core
+   *  @param schedule optional array of count indices defining the order in
+   *    which the work items are handed out, NULL for ascending order
+   *  @return EC_Normal if all items were processed successfully, otherwise
+   *    the error code of the failed item with the lowest index
+   */
+  static OFCondition run(HtJ2kParallelTask &task, size_t count,
+                         Uint16 numberOfThreads,
+                         size_t const *schedule = NULL);
+
+  /** resolves a requested number of threads into the number of threads
+   *  that should actually be used.
+   *  @param numberOfThreads requested number of threads, 0 for one thread
+   *    per available CPU core
+   *  @return number of threads to be used, always at least 1
+   */
+  static Uint16 resolveThreadCount(Uint16 numberOfThreads);
+};
+
+/** data passed from stage to stage of a HtJ2kFramePipeline, e.g. the
+ *  buffers of a frame. Every item is reused for many work items, so that
+ *  its buffers are allocated only once.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kPipelineItem {
+ public:
+  /// destructor
+  virtual ~HtJ2kPipelineItem() {}
+};
+
+/** abstract stages of a HtJ2kFramePipeline, e.g. fetching and converting
+ *  the samples of a frame, compressing them and storing the compressed
+ *  frame. Every work item passes through all three stages in this order.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kPipelineStages {
+ public:
+  /// destructor
+  virtual ~HtJ2kPipelineStages() {}
+
+  /** creates an item passed through the stages.
+   *  @return new item, owned by the caller
+   */
+  virtual HtJ2kPipelineItem *createItem() = 0;
+
+  /** first stage, executed by a single thread in ascending index order.
+   *  @param index index of the work item, 0..count-1
+   *  @param item item receiving the prepared work item
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition prepare(size_t index, HtJ2kPipelineItem &item) = 0;
+
+  /** second stage, executed concurrently for different indices.
+   *  @param index index of the work item, 0..count-1
+   *  @param item item passed to prepare()
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition process(size_t index, HtJ2kPipelineItem &item) = 0;
+
+  /** last stage, executed by the calling thread in ascending index order.
+   *  @param index index of the work item, 0..count-1
+   *  @param item item passed to process()
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition finish(size_t index, HtJ2kPipelineItem &item) = 0;
+};
+
+/** helper class that passes work items through the three stages of a
+ *  HtJ2kPipelineStages concurrently. One thread prepares the work items and
+ *  the calling thread finishes them, both in ascending index order, while
+ *  the remaining threads process them in between. Each of these threads
+ *  owns a lane of its own, a ring of items handed from stage to stage by
+ *  lock-free single-producer single-consumer counters. Work items are
+ *  assigned to the lanes in turn, so the calling thread finishes them in
+ *  order without any reordering buffer. The number of items per lane
+ *  bounds the memory used: the preparation stalls while all items of the
+ *  next lane are still in use.
+ *  With a single thread or work item, or if threads cannot be created, all
+ *  stages are executed serially by the calling thread.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kFramePipeline {
+ public:
+  /** passes every index in 0..count-1 through the stages.
+   *  No new work items are prepared after an item has failed.
+   *  @param stages stages to be executed
+   *  @param count number of work items
+   *  @param numberOfThreads maximum number of threads preparing and
+   *    processing work items, 0 for one thread per available CPU core. One
+   *    of them prepares the work items. The calling thread, which finishes
+   *    the work items and mostly waits, is not counted.
+   *  @param itemsPerLane number of items of every lane, i.e. the number of
+   *    work items a lane holds at most
+   *  @return EC_Normal if all items were processed successfully, otherwise
+   *    the error code of the failed item with the lowest index
+   */
+  static OFCondition run(HtJ2kPipelineStages &stages, size_t count,
+                         Uint16 numberOfThreads, size_t itemsPerLane = 2);
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef DCMTKHTJ2K_DJTILE_H
+#define DCMTKHTJ2K_DJTILE_H
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofcond.h"   /* for class OFCondition */
+#include "dcmtk/ofstd/oftypes.h"  /* for Uint8 */
+#include "dcmtk/ofstd/ofvector.h" /* for class OFVector */
+#include "dldefine.h"
+
+namespace ojph {
+class outfile_base;
+}
+
+/** tile structure of a HT-J2K codestream. Used to split a codestream into
+ *  independent codestreams of a single tile each, so that the tiles can be
+ *  decompressed concurrently, and to assemble a codestream from tiles that
+ *  have been compressed concurrently.
+ *
+ *  The codestream of a tile keeps the main header of the complete codestream,
+ *  but its SIZ marker segment restricts the image to the area of the tile.
+ *  The tile is thus partitioned into the same resolutions, subbands,
+ *  precincts and code-blocks as in the complete codestream, and its
+ *  tile-parts are identical.
+ */
+class DCMTKHTJ2K_EXPORT HtJ2kTileIndex {
+ public:
+  /// default constructor, creates an empty index
+  HtJ2kTileIndex();
+
+  /** locates the tile-parts of every tile of the given codestream.
+   *  @param data codestream, starting with the SOC marker
+   *  @param size length of the codestream in bytes
+   *  @return EC_Normal if successful, EC_HTJ2KCodecUnsupportedValue if the
+   *    tiles cannot be decompressed independently of each other, another
+   *    error code otherwise
+   */
+  OFCondition parse(Uint8 const *data, size_t size);
+
+  /** determines the number of tiles of a codestream from its SIZ marker
+   *  segment, without parsing the rest of the codestream.
+   *  @param data codestream, starting with the SOC marker
+   *  @param size number of bytes available, at least the main header up to
+   *    the end of the SIZ marker segment
+   *  @return number of tiles, 0 if the codestream is invalid or its tiles
+   *    cannot be decompressed independently of each other
+   */
+  static size_t countTiles(Uint8 const *data, size_t size);
+
+  /** returns the number of tiles of the parsed codestream
+   *  @return number of tiles
+   */
+  size_t numberOfTiles() const { return tiles_.size(); }
+
+  /** determines the area of a tile within the image decompressed at a
+   *  reduced resolution. Every resolution level halves the coordinates on
+   *  the reference grid, rounding up.
+   *  @param tile tile index, in raster order
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @param left returns the first column of the tile
+   *  @param top returns the first row of the tile
+   *  @param columns returns the number of columns of the tile
+   *  @param rows returns the number of rows of the tile
+   */
+  void getTileRegion(size_t tile, Uint16 resolutionReduction, Uint32 &left,
+                     Uint32 &top, Uint32 &columns, Uint32 &rows) const;
+
+  /** writes the codestream of a single tile.
+   *  @param data codestream passed to parse()
+   *  @param tile tile index, in raster order
+   *  @param outfile file the codestream of the tile is written to
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition writeTile(Uint8 const *data, size_t tile,
+                        ojph::outfile_base &outfile) const;
+
+  /** assembles a codestream from the codestreams of its tiles. Like the
+   *  codestreams written by writeTile(), each of them describes an image
+   *  restricted to the area of the tile. The main header is taken from the
+   *  first tile, with the SIZ marker segment describing the complete image
+   *  and TLM marker segments listing all tile-parts.
+   *  @param tiles codestreams of all tiles, in raster order
+   *  @param sizes lengths of the codestreams of the tiles
+   *  @param columns width of the image
+   *  @param rows height of the image
+   *  @param tileSize width and height of the tiles
+   *  @param outfile file the codestream is written to
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  static OFCondition assemble(OFVector<Uint8 const *> const &tiles,
+                              OFVector<size_t> const &sizes, Uint32 columns,
+                              Uint32 rows, Uint32 tileSize,
+                              ojph::outfile_base &outfile);
+
+ private:
+  /** reads the image area and the tile partition from the SIZ marker
+   *  segment.
+   *  @param data codestream, starting with the SOC marker
+   *  @param size number of bytes available
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition parseSIZ(Uint8 const *data, size_t size);
+
+  /** determines the area of a tile on the reference grid.
+   *  @param tile tile index, in raster order
+   *  @param tx0 returns the horizontal position of the tile
+   *  @param ty0 returns the vertical position of the tile
+   *  @param tx1 returns the horizontal position following the tile
+   *  @param ty1 returns the vertical position following the tile
+   */
+  void getTileArea(size_t tile, Uint32 &tx0, Uint32 &ty0, Uint32 &tx1,
+                   Uint32 &ty1) const;
+
+  /// part of the codestream
+  struct Range {
+    /// position of the first byte
+    size_t offset;
+
+    /// number of bytes
+    size_t length;
+  };
+
+  /// parts of the main header, without the TLM and PLM marker segments
+  OFVector<Range> mainHeader_;
+
+  /// horizontal offset of the image on the reference grid
+  Uint32 x0_;
+
+  /// vertical offset of the image on the reference grid
+  Uint32 y0_;
+
+  /// width of the reference grid
+  Uint32 x1_;
+
+  /// height of the reference grid
+  Uint32 y1_;
+
+  /// horizontal offset of the first tile
+  Uint32 tileX0_;
+
+  /// vertical offset of the first tile
+  Uint32 tileY0_;
+
+  /// width of the tiles
+  Uint32 tileWidth_;
+
+  /// height of the tiles
+  Uint32 tileHeight_;
+
+  /// tile-parts of every tile, in codestream order
+  OFVector<OFVector<Range> > tiles_;
+};
+
+#endif
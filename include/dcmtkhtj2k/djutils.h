@@ -167,4 +167,18 @@ extern DCMTKHTJ2K_EXPORT const OFConditionConst EC_HTJ2KUnsupportedImageType;
 /// error condition constant: Trailing data after image
 extern DCMTKHTJ2K_EXPORT const OFConditionConst EC_HTJ2KTooMuchCompressedData;
 
+/// error condition constant: Requested resolution reduction exceeds the number
+/// of decomposition levels of the HT-J2K codestream
+extern DCMTKHTJ2K_EXPORT const OFConditionConst
+    EC_HTJ2KResolutionReductionTooLarge;
+
+/// error condition constant: Uncompressed pixel data would exceed the maximum
+/// length of a DICOM element
+extern DCMTKHTJ2K_EXPORT const OFConditionConst
+    EC_HTJ2KUncompressedDataTooLarge;
+
+/// error condition constant: No quantization keeps the reconstructed samples
+/// within the maximum error of near-lossless HT-J2K compression
+extern DCMTKHTJ2K_EXPORT const OFConditionConst EC_HTJ2KMaximumErrorExceeded;
+
 #endif
@@ -5,6 +5,7 @@
 #include "dcmtk/dcmdata/dcdeftag.h" /* for tag constants */
 #include "dcmtk/dcmdata/dcpixseq.h" /* for class DcmPixelSequence */
 #include "dcmtk/dcmdata/dcpxitem.h" /* for class DcmPixelItem */
+#include "dcmtk/dcmdata/dcsequen.h" /* for class DcmSequenceOfItems */
 #include "dcmtk/dcmdata/dcswap.h"   /* for swapIfNecessary() */
 #include "dcmtk/dcmdata/dcuid.h"    /* for dcmGenerateUniqueIdentifer()*/
 #include "dcmtk/dcmdata/dcvrpobw.h" /* for class DcmPolymorphOBOW */
@@ -13,6 +14,9 @@
 #include "dcmtk/ofstd/ofstd.h"      /* for class OFStandard */
 #include "dcmtk/ofstd/ofstream.h"   /* for ofstream */
 #include "dcmtkhtj2k/djcparam.h"    /* for class DJP2KCodecParameter */
+#include "dcmtkhtj2k/djsimd.h"      /* for struct HtJ2kSampleKernels */
+#include "dcmtkhtj2k/djthread.h"    /* for class HtJ2kParallelLoop */
+#include "dcmtkhtj2k/djtile.h"      /* for class HtJ2kTileIndex */
 
 // HT-J2K library (OpenJPH) includes
 #include "openjph/ojph_arch.h"
@@ -21,6 +25,716 @@
 #include "openjph/ojph_mem.h"
 #include "openjph/ojph_params.h"
 
+#include <algorithm>
+
+namespace {
+
+/** orders frame indices by descending compressed frame size, so that the
+ *  most expensive frames are decompressed first.
+ */
+class HtJ2kLargerFrameFirst {
+ public:
+  explicit HtJ2kLargerFrameFirst(OFVector<HtJ2kFrameFragments> const &frames)
+      : frames_(frames) {}
+
+  bool operator()(size_t a, size_t b) const {
+    return frames_[a].compressedSize > frames_[b].compressedSize;
+  }
+
+ private:
+  OFVector<HtJ2kFrameFragments> const &frames_;
+};
+
+/** OpenJPH input file reading a codestream directly from the fragments
+ *  (pixel items) it is split across, without first copying the fragments
+ *  into a contiguous buffer.
+ */
+class HtJ2kFragmentInfile : public ojph::infile_base {
+ public:
+  /** constructor.
+   *  @param fragments fragments of the frame
+   *  @param size size of the codestream, i.e. the total length of all
+   *    fragments without trailing padding
+   */
+  HtJ2kFragmentInfile(HtJ2kFrameFragments const &fragments, size_t size)
+      : fragments_(fragments),
+        size_(size),
+        position_(0),
+        fragment_(0),
+        fragmentPosition_(0) {}
+
+  virtual size_t read(void *ptr, size_t size) {
+    Uint8 *target = OFstatic_cast(Uint8 *, ptr);
+    size_t remaining = std::min(size, size_ - position_);
+    size_t bytesRead = 0;
+    while (remaining > 0) {
+      size_t available = fragments_.length[fragment_] - fragmentPosition_;
+      if (available == 0) {
+        ++fragment_;
+        fragmentPosition_ = 0;
+        continue;
+      }
+      size_t const count = std::min(available, remaining);
+      memcpy(target + bytesRead,
+             fragments_.data[fragment_] + fragmentPosition_, count);
+      fragmentPosition_ += count;
+      bytesRead += count;
+      remaining -= count;
+    }
+    position_ += bytesRead;
+    return bytesRead;
+  }
+
+  virtual int seek(ojph::si64 offset, enum infile_base::seek origin) {
+    ojph::si64 target = offset;
+    if (origin == OJPH_SEEK_CUR)
+      target += OFstatic_cast(ojph::si64, position_);
+    else if (origin == OJPH_SEEK_END)
+      target += OFstatic_cast(ojph::si64, size_);
+    if ((target < 0) || (target > OFstatic_cast(ojph::si64, size_))) return -1;
+
+    // locate the fragment containing the new position
+    position_ = OFstatic_cast(size_t, target);
+    fragment_ = 0;
+    fragmentPosition_ = position_;
+    while ((fragment_ < fragments_.length.size()) &&
+           (fragmentPosition_ >= fragments_.length[fragment_])) {
+      fragmentPosition_ -= fragments_.length[fragment_];
+      ++fragment_;
+    }
+    return 0;
+  }
+
+  virtual ojph::si64 tell() { return OFstatic_cast(ojph::si64, position_); }
+
+  virtual bool eof() { return position_ >= size_; }
+
+ private:
+  HtJ2kFrameFragments const &fragments_;
+  size_t size_;
+  size_t position_;
+  size_t fragment_;
+  size_t fragmentPosition_;
+};
+
+/** buffers and codestream a thread keeps from one frame to the next, so that
+ *  decompressing a series of frames of the same geometry does not allocate
+ *  and free them for every frame. The workspace belongs to the calling
+ *  thread and is released when the thread ends, or earlier by
+ *  HtJ2kDecoderBase::releaseThreadWorkspace().
+ */
+class HtJ2kDecoderWorkspace {
+ public:
+  /// default constructor
+  HtJ2kDecoderWorkspace()
+      : codestream_(NULL),
+        columns_(0),
+        rows_(0),
+        components_(0),
+        resolutionReduction_(0),
+        compressed_(),
+        rowBuffer_(),
+        tileFile_(NULL) {}
+
+  /// destructor
+  ~HtJ2kDecoderWorkspace() { release(); }
+
+  /** returns the workspace of the calling thread
+   *  @return workspace of the calling thread
+   */
+  static HtJ2kDecoderWorkspace &current() {
+    static thread_local HtJ2kDecoderWorkspace workspace;
+    return workspace;
+  }
+
+  /** returns a codestream to read the headers of the next codestream into.
+   *  The codestream of the last frame or tile is restarted, keeping its
+   *  buffers, if it had the same geometry, otherwise a new one is created.
+   *  @param columns expected width at the reduced resolution
+   *  @param rows expected height at the reduced resolution
+   *  @param components expected number of components
+   *  @param resolutionReduction number of resolution levels to skip
+   *  @return codestream without any data
+   */
+  ojph::codestream &codestream(Uint32 columns, Uint32 rows, Uint16 components,
+                               Uint16 resolutionReduction) {
+    if ((codestream_ != NULL) && (columns == columns_) && (rows == rows_) &&
+        (components == components_) &&
+        (resolutionReduction == resolutionReduction_)) {
+      codestream_->restart();
+    } else {
+      reset();
+      codestream_ = new ojph::codestream();
+      columns_ = columns;
+      rows_ = rows;
+      components_ = components;
+      resolutionReduction_ = resolutionReduction;
+    }
+    return *codestream_;
+  }
+
+  /// discards the codestream, e.g. after it failed
+  void reset() {
+    delete codestream_;
+    codestream_ = NULL;
+    columns_ = 0;
+    rows_ = 0;
+    components_ = 0;
+    resolutionReduction_ = 0;
+  }
+
+  /** returns the buffer a codestream split across fragments is assembled
+   *  in.
+   *  @param size size of the codestream
+   *  @return buffer of the given size
+   */
+  Uint8 *compressed(size_t size) {
+    compressed_.resize(size);
+    return compressed_.empty() ? NULL : &compressed_[0];
+  }
+
+  /** returns the buffer of the rows of the components of a color-by-pixel
+   *  frame, which are interleaved into the frame.
+   *  @param size size of the buffer
+   *  @return buffer of the given size
+   */
+  Uint8 *rowBuffer(size_t size) {
+    rowBuffer_.resize(size);
+    return rowBuffer_.empty() ? NULL : &rowBuffer_[0];
+  }
+
+  /** returns the memory file the codestream of a tile is written to, empty
+   *  but keeping the memory allocated for earlier tiles.
+   *  @return empty memory file
+   */
+  ojph::mem_outfile &tileFile() {
+    if (tileFile_ != NULL) {
+      tileFile_->seek(0, ojph::outfile_base::OJPH_SEEK_SET);
+    } else {
+      tileFile_ = new ojph::mem_outfile();
+      tileFile_->open();
+    }
+    return *tileFile_;
+  }
+
+  /// frees the codestream and all buffers
+  void release() {
+    reset();
+    OFVector<Uint8>().swap(compressed_);
+    OFVector<Uint8>().swap(rowBuffer_);
+    delete tileFile_;
+    tileFile_ = NULL;
+  }
+
+ private:
+  /// private undefined copy constructor
+  HtJ2kDecoderWorkspace(HtJ2kDecoderWorkspace const &);
+
+  /// private undefined copy assignment operator
+  HtJ2kDecoderWorkspace &operator=(HtJ2kDecoderWorkspace const &);
+
+  /// codestream of the last frame or tile, NULL if none
+  ojph::codestream *codestream_;
+
+  /// width of the last codestream at the reduced resolution
+  Uint32 columns_;
+
+  /// height of the last codestream at the reduced resolution
+  Uint32 rows_;
+
+  /// number of components of the last codestream
+  Uint16 components_;
+
+  /// number of resolution levels skipped in the last codestream
+  Uint16 resolutionReduction_;
+
+  /// codestream assembled from its fragments
+  OFVector<Uint8> compressed_;
+
+  /// rows of the components of a color-by-pixel frame
+  OFVector<Uint8> rowBuffer_;
+
+  /// codestream of a tile, NULL until the first tile
+  ojph::mem_outfile *tileFile_;
+};
+
+/** destination of the decoded lines of a frame.
+ */
+struct HtJ2kOutputFrame {
+  /// kernels used for narrowing and interleaving the samples
+  HtJ2kSampleKernels const *kernels;
+
+  /// first sample of the frame
+  Uint8 *frame;
+
+  /// one row of narrowed samples per component, for color-by-pixel only
+  Uint8 *rowBuffer;
+
+  /// number of columns of the frame
+  Uint16 columns;
+
+  /// number of rows of the frame
+  Uint16 rows;
+
+  /// first column of the frame the decoded lines are stored in
+  Uint16 left;
+
+  /// first row of the frame the decoded lines are stored in
+  Uint16 top;
+
+  /// number of samples of every decoded line
+  Uint16 width;
+
+  /// true if the components of each row are delivered one after another
+  OFBool rowByRow;
+};
+
+/// stores a decoded line of the given component and row in the output frame
+typedef void (*HtJ2kLineWriter)(HtJ2kOutputFrame const &output,
+                                ojph::si32 const *line, Uint32 component,
+                                Uint32 row);
+
+// narrowing and interleaving kernels selected by output sample type
+
+inline void narrowLine(HtJ2kSampleKernels const &kernels,
+                       ojph::si32 const *line, Uint8 *target, size_t count) {
+  kernels.narrowToUint8(line, target, count);
+}
+
+inline void narrowLine(HtJ2kSampleKernels const &kernels,
+                       ojph::si32 const *line, Sint8 *target, size_t count) {
+  kernels.narrowToSint8(line, target, count);
+}
+
+inline void narrowLine(HtJ2kSampleKernels const &kernels,
+                       ojph::si32 const *line, Uint16 *target, size_t count) {
+  kernels.narrowToUint16(line, target, count);
+}
+
+inline void narrowLine(HtJ2kSampleKernels const &kernels,
+                       ojph::si32 const *line, Sint16 *target, size_t count) {
+  kernels.narrowToSint16(line, target, count);
+}
+
+inline void interleaveRow(HtJ2kSampleKernels const &kernels, Uint8 const *row,
+                          Uint8 *target, size_t count) {
+  kernels.interleave8(row, row + count, row + 2 * count, target, count);
+}
+
+inline void interleaveRow(HtJ2kSampleKernels const &kernels, Sint8 const *row,
+                          Sint8 *target, size_t count) {
+  interleaveRow(kernels, OFreinterpret_cast(Uint8 const *, row),
+                OFreinterpret_cast(Uint8 *, target), count);
+}
+
+inline void interleaveRow(HtJ2kSampleKernels const &kernels, Uint16 const *row,
+                          Uint16 *target, size_t count) {
+  kernels.interleave16(row, row + count, row + 2 * count, target, count);
+}
+
+inline void interleaveRow(HtJ2kSampleKernels const &kernels, Sint16 const *row,
+                          Sint16 *target, size_t count) {
+  interleaveRow(kernels, OFreinterpret_cast(Uint16 const *, row),
+                OFreinterpret_cast(Uint16 *, target), count);
+}
+
+/** writer for monochrome and color-by-plane frames, where every decoded line
+ *  is a contiguous part of the plane of its component.
+ *  @tparam T output sample type, which also determines the signedness
+ *  @tparam Components number of components
+ *  @tparam PlanarConfiguration planar configuration of the output frame
+ */
+template <typename T, int Components, int PlanarConfiguration>
+struct HtJ2kFrameWriter {
+  static void writeLine(HtJ2kOutputFrame const &output, ojph::si32 const *line,
+                        Uint32 component, Uint32 row) {
+    size_t const columns = output.columns;
+    size_t const plane = OFstatic_cast(size_t, component) * output.rows;
+    T *target = OFreinterpret_cast(T *, output.frame) +
+                (plane + row) * columns + output.left;
+    narrowLine(*output.kernels, line, target, output.width);
+  }
+};
+
+/** writer for color-by-pixel frames. Every line is narrowed into the row
+ *  buffer of its component; the rows are then interleaved into the frame
+ *  once all components of a row are available.
+ *  @tparam T output sample type, which also determines the signedness
+ */
+template <typename T>
+struct HtJ2kFrameWriter<T, 3, 0> {
+  static void writeLine(HtJ2kOutputFrame const &output, ojph::si32 const *line,
+                        Uint32 component, Uint32 row) {
+    size_t const width = output.width;
+    T *componentRow = OFreinterpret_cast(T *, output.rowBuffer);
+    size_t const pixel = OFstatic_cast(size_t, row) * output.columns;
+    T *target =
+        OFreinterpret_cast(T *, output.frame) + (pixel + output.left) * 3;
+    narrowLine(*output.kernels, line, componentRow + component * width,
+               width);
+    if (output.rowByRow) {
+      if (component == 2)
+        interleaveRow(*output.kernels, componentRow, target, width);
+    } else {
+      // components are delivered plane by plane, scatter the line
+      T const *s = componentRow + component * width;  // source
+      T *t = target + component;                      // target
+      for (size_t x = width; x; x--) {
+        *t = *s++;
+        t += 3;
+      }
+    }
+  }
+};
+
+/** selects the line writer for the given output format.
+ *  @param bytesPerSample number of bytes per output sample, 1 or 2
+ *  @param isSigned true if the samples are signed
+ *  @param samplesPerPixel number of components, 1 or 3
+ *  @param planarConfiguration planar configuration of the output frame
+ *  @return line writer, NULL if the output format is not supported
+ */
+HtJ2kLineWriter selectLineWriter(Uint16 bytesPerSample, OFBool isSigned,
+                                 Uint16 samplesPerPixel,
+                                 Uint16 planarConfiguration) {
+  // indexed by sample type and layout (monochrome, color-by-pixel,
+  // color-by-plane)
+  static HtJ2kLineWriter const writers[4][3] = {
+      {&HtJ2kFrameWriter<Uint8, 1, 0>::writeLine,
+       &HtJ2kFrameWriter<Uint8, 3, 0>::writeLine,
+       &HtJ2kFrameWriter<Uint8, 3, 1>::writeLine},
+      {&HtJ2kFrameWriter<Sint8, 1, 0>::writeLine,
+       &HtJ2kFrameWriter<Sint8, 3, 0>::writeLine,
+       &HtJ2kFrameWriter<Sint8, 3, 1>::writeLine},
+      {&HtJ2kFrameWriter<Uint16, 1, 0>::writeLine,
+       &HtJ2kFrameWriter<Uint16, 3, 0>::writeLine,
+       &HtJ2kFrameWriter<Uint16, 3, 1>::writeLine},
+      {&HtJ2kFrameWriter<Sint16, 1, 0>::writeLine,
+       &HtJ2kFrameWriter<Sint16, 3, 0>::writeLine,
+       &HtJ2kFrameWriter<Sint16, 3, 1>::writeLine}};
+
+  if ((bytesPerSample != 1) && (bytesPerSample != 2)) return NULL;
+  size_t layout;
+  if (samplesPerPixel == 1)
+    layout = 0;
+  else if (samplesPerPixel == 3)
+    layout = (planarConfiguration == 0) ? 1 : 2;
+  else
+    return NULL;
+  return writers[(bytesPerSample - 1) * 2 + (isSigned ? 1 : 0)][layout];
+}
+
+/** decompresses the part of a codestream inside a window and stores it in
+ *  the output frame.
+ *  @param workspace workspace of the calling thread
+ *  @param infile codestream
+ *  @param columns expected width of the codestream at the reduced resolution
+ *  @param rows expected height of the codestream at the reduced resolution
+ *  @param samplesPerPixel expected number of components
+ *  @param bytesPerSample number of bytes per output sample
+ *  @param planarConfiguration planar configuration of the output frame
+ *  @param resolutionReduction number of resolution levels to skip
+ *  @param window part of the codestream to decompress
+ *  @param output output frame, with the position the window is stored at
+ *  @param usingColorTransform returns true if the codestream was compressed
+ *    using a color transform
+ *  @return EC_Normal if successful, an error code otherwise
+ */
+OFCondition decodeCodestream(HtJ2kDecoderWorkspace &workspace,
+                             ojph::infile_base *infile, Uint32 columns,
+                             Uint32 rows, Uint16 samplesPerPixel,
+                             Uint16 bytesPerSample,
+                             Uint16 planarConfiguration,
+                             Uint16 resolutionReduction,
+                             HtJ2kFrameWindow const &window,
+                             HtJ2kOutputFrame output,
+                             OFBool &usingColorTransform) {
+  OFCondition result = EC_Normal;
+  usingColorTransform = OFFalse;
+
+  // start of OpenJPH decoding
+  try {
+    ojph::codestream &codestream = workspace.codestream(
+        columns, rows, samplesPerPixel, resolutionReduction);
+    codestream.enable_resilience();
+    codestream.read_headers(infile);
+
+    ojph::param_siz siz = codestream.access_siz();
+    ojph::param_cod cod = codestream.access_cod();
+
+    // skip the highest resolution levels, both when reading the codestream
+    // and when reconstructing the image
+    OFBool const validReduction =
+        (resolutionReduction <= cod.get_num_decompositions());
+    if (validReduction && (resolutionReduction > 0))
+      codestream.restrict_input_resolution(resolutionReduction,
+                                           resolutionReduction);
+
+    int num_comps = siz.get_num_components();
+    Uint32 width = siz.get_recon_width(0);
+    Uint32 height = siz.get_recon_height(0);
+    usingColorTransform = (num_comps == 3) && cod.is_using_color_transform();
+
+    if (!validReduction)
+      result = EC_HTJ2KResolutionReductionTooLarge;
+    else if (width != columns)
+      result = EC_HTJ2KImageDataMismatch;
+    else if (height != rows)
+      result = EC_HTJ2KImageDataMismatch;
+    else if (num_comps != samplesPerPixel)
+      result = EC_HTJ2KImageDataMismatch;
+
+    // select the writer storing the decoded lines in the output format
+    OFBool const interleaved = (num_comps == 3) && (planarConfiguration == 0);
+    HtJ2kLineWriter const writeLine =
+        selectLineWriter(bytesPerSample, siz.is_signed(0), samplesPerPixel,
+                         planarConfiguration);
+    if (result.good() && (writeLine == NULL))
+      result = EC_HTJ2KUnsupportedBitDepth;
+
+    if (result.good() && ((window.left + window.columns > width) ||
+                          (window.top + window.rows > height)))
+      result = EC_IllegalParameter;
+
+    if (result.good()) {
+      // the components of each row should be delivered one after another,
+      // so color-by-pixel frames can be assembled row by row and decoding
+      // can stop after the last row of the window for all components
+      if (num_comps > 1) codestream.set_planar(false);
+      codestream.create();
+
+      // the samples of color-by-pixel frames are narrowed into one row
+      // buffer per component first, which are then interleaved into the frame
+      output.rowBuffer = workspace.rowBuffer(
+          interleaved
+              ? 3 * OFstatic_cast(size_t, window.columns) * bytesPerSample
+              : 0);
+      output.width = window.columns;
+      output.rowByRow = interleaved && !codestream.is_planar();
+
+      // Decode the lines up to the last row of the window, storing the part
+      // of every line inside the window directly in its row of the output
+      // buffer. The order in which the components are delivered depends on
+      // the codestream, so the next row is tracked per component.
+      Uint32 const endRow = OFstatic_cast(Uint32, window.top) + window.rows;
+      Uint32 const totalLines =
+          codestream.is_planar()
+              ? OFstatic_cast(Uint32, num_comps - 1) * height + endRow
+              : endRow * num_comps;
+      OFVector<Uint32> nextRow(num_comps, 0);
+      for (Uint32 i = 0; i < totalLines; i++) {
+        ojph::ui32 comp_num;
+        ojph::line_buf *line = codestream.pull(comp_num);
+        if (comp_num >= OFstatic_cast(ojph::ui32, num_comps)) continue;
+        Uint32 const row = nextRow[comp_num]++;
+        if ((row >= window.top) && (row < endRow))
+          writeLine(output, line->i32 + window.left, comp_num,
+                    row - window.top + output.top);
+      }
+
+      codestream.close();
+    }
+  } catch (std::exception &ex) {
+    DCMTKHTJ2K_ERROR("HT-J2K decoder caught OpenJPH exception: "
+                     << (ex.what() ? ex.what() : "Unknown reason"));
+    result =
+        makeOFCondition(1, OFM_dcmjp2k, OF_error,
+                        ex.what() ? ex.what() : "Unknown OpenJPH exception");
+  }
+
+  // a codestream that failed is not restarted for the next frame
+  if (result.bad()) workspace.reset();
+
+  return result;
+}
+
+/** task decompressing the tiles of a frame concurrently. Every tile is
+ *  split off into a codestream of its own, and the part of it inside the
+ *  window is stored in its area of the output frame.
+ */
+class HtJ2kDecodeTilesTask : public HtJ2kParallelTask {
+ public:
+  HtJ2kDecodeTilesTask(HtJ2kTileIndex const &index, Uint8 const *data,
+                       Uint16 samplesPerPixel, Uint16 bytesPerSample,
+                       Uint16 planarConfiguration,
+                       Uint16 resolutionReduction,
+                       HtJ2kFrameWindow const &window,
+                       HtJ2kOutputFrame const &output)
+      : index_(index),
+        data_(data),
+        samplesPerPixel_(samplesPerPixel),
+        bytesPerSample_(bytesPerSample),
+        planarConfiguration_(planarConfiguration),
+        resolutionReduction_(resolutionReduction),
+        window_(window),
+        output_(output),
+        tiles_(),
+        colorTransform_() {
+    // only the tiles overlapping the window are decompressed
+    for (size_t tile = 0; tile < index.numberOfTiles(); tile++) {
+      Uint32 left, top, columns, rows;
+      index.getTileRegion(tile, resolutionReduction, left, top, columns, rows);
+      if ((left < OFstatic_cast(Uint32, window.left) + window.columns) &&
+          (left + columns > window.left) &&
+          (top < OFstatic_cast(Uint32, window.top) + window.rows) &&
+          (top + rows > window.top))
+        tiles_.push_back(tile);
+    }
+    colorTransform_.resize(tiles_.size(), 0);
+  }
+
+  /// returns the number of tiles overlapping the window
+  size_t numberOfTiles() const { return tiles_.size(); }
+
+  virtual OFCondition execute(size_t index) {
+    size_t const tile = tiles_[index];
+    Uint32 left, top, columns, rows;
+    index_.getTileRegion(tile, resolutionReduction_, left, top, columns,
+                         rows);
+
+    // part of the tile inside the window
+    Uint32 const x0 = std::max(left, OFstatic_cast(Uint32, window_.left));
+    Uint32 const y0 = std::max(top, OFstatic_cast(Uint32, window_.top));
+    Uint32 const x1 = std::min(
+        left + columns, OFstatic_cast(Uint32, window_.left) + window_.columns);
+    Uint32 const y1 = std::min(
+        top + rows, OFstatic_cast(Uint32, window_.top) + window_.rows);
+    HtJ2kOutputFrame output = output_;
+    output.left = OFstatic_cast(Uint16, x0 - window_.left);
+    output.top = OFstatic_cast(Uint16, y0 - window_.top);
+
+    OFCondition result = EC_Normal;
+    OFBool usingColorTransform = OFFalse;
+    try {
+      HtJ2kDecoderWorkspace &workspace = HtJ2kDecoderWorkspace::current();
+      ojph::mem_outfile &codestream = workspace.tileFile();
+      result = index_.writeTile(data_, tile, codestream);
+      if (result.good()) {
+        ojph::mem_infile infile;
+        infile.open(codestream.get_data(),
+                    OFstatic_cast(size_t, codestream.tell()));
+        result = decodeCodestream(
+            workspace, &infile, columns, rows, samplesPerPixel_,
+            bytesPerSample_, planarConfiguration_, resolutionReduction_,
+            HtJ2kFrameWindow(OFstatic_cast(Uint16, x0 - left),
+                             OFstatic_cast(Uint16, y0 - top),
+                             OFstatic_cast(Uint16, x1 - x0),
+                             OFstatic_cast(Uint16, y1 - y0)),
+            output, usingColorTransform);
+      }
+    } catch (std::exception &ex) {
+      DCMTKHTJ2K_ERROR("HT-J2K decoder caught OpenJPH exception: "
+                       << (ex.what() ? ex.what() : "Unknown reason"));
+      result = makeOFCondition(
+          1, OFM_dcmjp2k, OF_error,
+          ex.what() ? ex.what() : "Unknown OpenJPH exception");
+    }
+    if (result.good() && usingColorTransform) colorTransform_[index] = 1;
+    return result;
+  }
+
+  /// returns true if any tile was converted by an inverse color transform
+  OFBool usingColorTransform() const {
+    for (size_t i = 0; i < colorTransform_.size(); ++i)
+      if (colorTransform_[i]) return OFTrue;
+    return OFFalse;
+  }
+
+ private:
+  HtJ2kTileIndex const &index_;
+  Uint8 const *data_;
+  Uint16 samplesPerPixel_;
+  Uint16 bytesPerSample_;
+  Uint16 planarConfiguration_;
+  Uint16 resolutionReduction_;
+  HtJ2kFrameWindow window_;
+  HtJ2kOutputFrame output_;
+  OFVector<size_t> tiles_;
+  OFVector<Uint8> colorTransform_;
+};
+
+}  // namespace
+
+/** task decompressing the frames of a multi-frame image in parallel.
+ *  All fragments are resolved up front on the calling thread; each frame is
+ *  then decompressed into its own, non-overlapping slice of the pixel data.
+ */
+class HtJ2kDecoderBase::DecodeFramesTask : public HtJ2kParallelTask {
+ public:
+  DecodeFramesTask(Uint8 *pixelData, size_t frameSize, Uint16 imageColumns,
+                   Uint16 imageRows, Uint16 imageSamplesPerPixel,
+                   Uint16 bytesPerSample, Uint16 imagePlanarConfiguration,
+                   Uint16 resolutionReduction, Uint16 numberOfTileThreads)
+      : pixelData_(pixelData),
+        frameSize_(frameSize),
+        imageColumns_(imageColumns),
+        imageRows_(imageRows),
+        imageSamplesPerPixel_(imageSamplesPerPixel),
+        bytesPerSample_(bytesPerSample),
+        imagePlanarConfiguration_(imagePlanarConfiguration),
+        resolutionReduction_(resolutionReduction),
+        numberOfTileThreads_(numberOfTileThreads),
+        frames_(),
+        colorTransform_() {}
+
+  /// resolves the fragments of all frames of the pixel sequence
+  OFCondition gather(HtJ2kFrameIndex const &index) {
+    OFCondition result = EC_Normal;
+    size_t const imageFrames = index.numberOfFrames();
+    frames_.resize(imageFrames);
+    colorTransform_.resize(imageFrames, 0);
+    Uint32 nextItem = 0;
+    for (size_t frame = 0; result.good() && (frame < imageFrames); ++frame) {
+      result = gatherFragments(index, OFstatic_cast(Uint32, frame), nextItem,
+                               frames_[frame]);
+    }
+    return result;
+  }
+
+  /// decompresses all frames, larger compressed frames first
+  OFCondition run(Uint16 numberOfThreads) {
+    OFVector<size_t> schedule(frames_.size());
+    for (size_t i = 0; i < schedule.size(); ++i) schedule[i] = i;
+    std::stable_sort(schedule.begin(), schedule.end(),
+                     HtJ2kLargerFrameFirst(frames_));
+    return HtJ2kParallelLoop::run(*this, frames_.size(), numberOfThreads,
+                                  &schedule[0]);
+  }
+
+  virtual OFCondition execute(size_t index) {
+    DCMTKHTJ2K_DEBUG("HT-J2K decoder processes frame " << (index + 1));
+    OFBool usingColorTransform = OFFalse;
+    OFCondition result = decodeFragments(
+        frames_[index], pixelData_ + index * frameSize_,
+        OFstatic_cast(Uint32, frameSize_), imageColumns_, imageRows_,
+        imageSamplesPerPixel_, bytesPerSample_, imagePlanarConfiguration_,
+        resolutionReduction_, HtJ2kFrameWindow(0, 0, imageColumns_, imageRows_),
+        numberOfTileThreads_, usingColorTransform);
+    if (result.good() && usingColorTransform) colorTransform_[index] = 1;
+    return result;
+  }
+
+  /// returns true if any frame was converted by an inverse color transform
+  OFBool usingColorTransform() const {
+    for (size_t i = 0; i < colorTransform_.size(); ++i)
+      if (colorTransform_[i]) return OFTrue;
+    return OFFalse;
+  }
+
+ private:
+  Uint8 *pixelData_;
+  size_t frameSize_;
+  Uint16 imageColumns_;
+  Uint16 imageRows_;
+  Uint16 imageSamplesPerPixel_;
+  Uint16 bytesPerSample_;
+  Uint16 imagePlanarConfiguration_;
+  Uint16 resolutionReduction_;
+  Uint16 numberOfTileThreads_;
+  OFVector<HtJ2kFrameFragments> frames_;
+  OFVector<Uint8> colorTransform_;
+};
+
 HtJ2kDecoderBase::HtJ2kDecoderBase() : DcmCodec() {}
 
 HtJ2kDecoderBase::~HtJ2kDecoderBase() {}
@@ -53,110 +767,110 @@ OFCondition HtJ2kDecoderBase::decode(
       ((dobject->ident() != EVR_dataset) && (dobject->ident() != EVR_item)))
     return EC_InvalidTag;
   DcmItem *dataset = OFstatic_cast(DcmItem *, dobject);
-  OFBool numberOfFramesPresent = OFFalse;
 
   // determine properties of uncompressed dataset
-  Uint16 imageSamplesPerPixel = 0;
-  if (dataset->findAndGetUint16(DCM_SamplesPerPixel, imageSamplesPerPixel)
-          .bad())
-    return EC_TagNotFound;
-  // we only handle one or three samples per pixel
-  if ((imageSamplesPerPixel != 3) && (imageSamplesPerPixel != 1))
-    return EC_InvalidTag;
-
-  Uint16 imageRows = 0;
-  if (dataset->findAndGetUint16(DCM_Rows, imageRows).bad())
-    return EC_TagNotFound;
-  if (imageRows < 1) return EC_InvalidTag;
-
-  Uint16 imageColumns = 0;
-  if (dataset->findAndGetUint16(DCM_Columns, imageColumns).bad())
-    return EC_TagNotFound;
-  if (imageColumns < 1) return EC_InvalidTag;
-
-  // number of frames is an optional attribute - we don't mind if it isn't
-  // present.
-  Sint32 imageFrames = 0;
-  if (dataset->findAndGetSint32(DCM_NumberOfFrames, imageFrames).good())
-    numberOfFramesPresent = OFTrue;
-
-  if (imageFrames >= OFstatic_cast(Sint32, pixSeq->card()))
-    imageFrames = pixSeq->card() -
-                  1;  // limit number of frames to number of pixel items - 1
-  if (imageFrames < 1)
-    imageFrames = 1;  // default in case the number of frames attribute is
-                      // absent or contains garbage
-
-  Uint16 imageBitsStored = 0;
-  if (dataset->findAndGetUint16(DCM_BitsStored, imageBitsStored).bad())
-    return EC_TagNotFound;
-
-  Uint16 imageBitsAllocated = 0;
-  if (dataset->findAndGetUint16(DCM_BitsAllocated, imageBitsAllocated).bad())
-    return EC_TagNotFound;
+  HtJ2kImageAttributes attributes;
+  OFCondition result = attributes.read(dataset, pixSeq->card());
+  if (result.bad()) return result;
 
   Uint16 imageHighBit = 0;
   if (dataset->findAndGetUint16(DCM_HighBit, imageHighBit).bad())
     return EC_TagNotFound;
 
-  // we only support up to 16 bits per sample
-  if ((imageBitsStored < 1) || (imageBitsStored > 16))
-    return EC_HTJ2KUnsupportedBitDepth;
+  Uint16 const imageSamplesPerPixel = attributes.samplesPerPixel;
+  Uint16 const imageRows = attributes.rows;
+  Uint16 const imageColumns = attributes.columns;
+  Sint32 const imageFrames = attributes.numberOfFrames;
+  Uint16 const bytesPerSample = attributes.bytesPerSample;
+
+  // assume we can cast the codec parameter to what we need
+  HtJ2kCodecParameter const *djcp =
+      OFreinterpret_cast(HtJ2kCodecParameter const *, cp);
 
-  // determine the number of bytes per sample (bits allocated) for the
-  // de-compressed object.
-  Uint16 bytesPerSample = 1;
-  if (imageBitsStored > 8)
-    bytesPerSample = 2;
-  else if (imageBitsAllocated > 8)
-    bytesPerSample = 2;
+  // determine the dimensions of the decompressed frames, which are smaller
+  // than the original ones if resolution levels are skipped
+  Uint16 const resolutionReduction = djcp->getResolutionReduction();
+  Uint16 frameColumns = imageColumns;
+  Uint16 frameRows = imageRows;
+  computeReducedDimensions(imageColumns, imageRows, resolutionReduction,
+                           frameColumns, frameRows);
 
   // compute size of uncompressed frame, in bytes
-  Uint32 frameSize =
-      bytesPerSample * imageRows * imageColumns * imageSamplesPerPixel;
+  Uint64 const frameSize = OFstatic_cast(Uint64, bytesPerSample) * frameRows *
+                           frameColumns * imageSamplesPerPixel;
 
-  // compute size of pixel data attribute, in bytes
-  Uint32 totalSize = frameSize * imageFrames;
+  // compute size of pixel data attribute, in bytes. Uncompressed pixel data
+  // is limited to the maximum length of an element, 0xFFFFFFFE bytes.
+  Uint64 totalSize = frameSize * OFstatic_cast(Uint64, imageFrames);
   if (totalSize & 1) totalSize++;  // align on 16-bit word boundary
+  if (totalSize > 0xFFFFFFFEUL) return EC_HTJ2KUncompressedDataTooLarge;
 
-  // assume we can cast the codec parameter to what we need
-  HtJ2kCodecParameter const *djcp =
-      OFreinterpret_cast(HtJ2kCodecParameter const *, cp);
-
-  // determine planar configuration for uncompressed data
-  OFString imageSopClass;
-  OFString imagePhotometricInterpretation;
-  dataset->findAndGetOFString(DCM_SOPClassUID, imageSopClass);
-  dataset->findAndGetOFString(DCM_PhotometricInterpretation,
-                              imagePhotometricInterpretation);
+  // locate the fragments of all frames in a single pass over the sequence
+  HtJ2kFrameIndex index;
+  result = index.build(pixSeq, dataset, imageFrames, djcp->ignoreOffsetTable());
+  if (result.bad()) return result;
 
   // allocate space for uncompressed pixel data element
   Uint16 *pixeldata16 = NULL;
-  OFCondition result = uncompressedPixelData.createUint16Array(
-      totalSize / sizeof(Uint16), pixeldata16);
+  result = uncompressedPixelData.createUint16Array(
+      OFstatic_cast(Uint32, totalSize / sizeof(Uint16)), pixeldata16);
   if (result.bad()) return result;
 
   Uint8 *pixeldata8 = OFreinterpret_cast(Uint8 *, pixeldata16);
-  Sint32 currentFrame = 0;
-  Uint32 currentItem = 1;  // item 0 contains the offset table
-  OFBool done = OFFalse;
+  Uint16 const numberOfThreads =
+      HtJ2kParallelLoop::resolveThreadCount(djcp->getNumberOfThreads());
+
+  if ((imageFrames > 1) && (numberOfThreads > 1)) {
+    // every frame is decompressed into its own slice of the pixel data,
+    // so the frames can be processed independently of each other. Threads
+    // not needed for the frames decompress the tiles of each frame.
+    Uint16 numberOfTileThreads = 1;
+    if (numberOfThreads > imageFrames)
+      numberOfTileThreads =
+          OFstatic_cast(Uint16, numberOfThreads / imageFrames);
+    DecodeFramesTask task(
+        pixeldata8, OFstatic_cast(size_t, frameSize), frameColumns, frameRows,
+        imageSamplesPerPixel, bytesPerSample,
+        determineOutputPlanarConfiguration(djcp, dataset, imageSamplesPerPixel),
+        resolutionReduction, numberOfTileThreads);
+    result = task.gather(index);
+    if (result.good()) result = task.run(numberOfThreads);
+
+    // update photometric interpretation
+    if (result.good() && task.usingColorTransform())
+      result =
+          dataset->putAndInsertString(DCM_PhotometricInterpretation, "RGB");
+  } else {
+    Sint32 currentFrame = 0;
+    Uint32 currentItem = 0;
+    OFBool done = OFFalse;
 
-  while (result.good() && !done) {
-    DCMTKHTJ2K_DEBUG("HT-J2K decoder processes frame " << (currentFrame + 1));
+    while (result.good() && !done) {
+      DCMTKHTJ2K_DEBUG("HT-J2K decoder processes frame "
+                       << (currentFrame + 1));
 
-    result = decodeFrame(pixSeq, djcp, dataset, currentFrame, currentItem,
-                         pixeldata8, frameSize, imageFrames, imageColumns,
-                         imageRows, imageSamplesPerPixel, bytesPerSample);
+      result = decodeFrame(index, djcp, dataset, currentFrame, currentItem,
+                           pixeldata8, OFstatic_cast(Uint32, frameSize),
+                           frameColumns, frameRows, imageSamplesPerPixel,
+                           bytesPerSample, resolutionReduction,
+                           HtJ2kFrameWindow(0, 0, frameColumns, frameRows));
 
-    if (result.good()) {
-      // increment frame number, check if we're finished
-      if (++currentFrame == imageFrames) done = OFTrue;
-      pixeldata8 += frameSize;
+      if (result.good()) {
+        // increment frame number, check if we're finished
+        if (++currentFrame == imageFrames) done = OFTrue;
+        pixeldata8 += frameSize;
+      }
     }
   }
 
+  // the size of the image has changed if resolution levels were skipped
+  if (result.good() && (resolutionReduction > 0))
+    result = updateReducedImageAttributes(dataset, imageColumns, imageRows,
+                                          frameColumns, frameRows);
+
   // Number of Frames might have changed in case the previous value was wrong
-  if (result.good() && (numberOfFramesPresent || (imageFrames > 1))) {
+  if (result.good() &&
+      (attributes.numberOfFramesPresent || (imageFrames > 1))) {
     char numBuf[20];
     snprintf(numBuf, sizeof(numBuf), "%ld", OFstatic_cast(long, imageFrames));
     result =
@@ -168,8 +882,15 @@ OFCondition HtJ2kDecoderBase::decode(
     // but other modules such as SOP Common.  We only perform these
     // changes if we're on the main level of the dataset,
     // which should always identify itself as dataset, not as item.
-    if ((dataset->ident() == EVR_dataset) &&
-        (djcp->getUIDCreation() == EHTJ2KUC_always)) {
+    if ((dataset->ident() == EVR_dataset) && (resolutionReduction > 0)) {
+      // an image decompressed at a reduced resolution is derived from the
+      // original image and always becomes a new SOP instance
+      result = DcmCodec::newInstance(
+          dataset, "DCM", "121322",
+          "Source image for image processing operation");
+      if (result.good()) result = DcmCodec::updateImageType(dataset);
+    } else if ((dataset->ident() == EVR_dataset) &&
+               (djcp->getUIDCreation() == EHTJ2KUC_always)) {
       // create new SOP instance UID
       result = DcmCodec::newInstance((DcmItem *)dataset, NULL, NULL, NULL);
     }
@@ -192,78 +913,99 @@ OFCondition HtJ2kDecoderBase::decodeFrame(
     DcmPixelSequence *fromPixSeq, DcmCodecParameter const *cp, DcmItem *dataset,
     Uint32 frameNo, Uint32 &currentItem, void *buffer, Uint32 bufSize,
     OFString &decompressedColorModel) const {
-  OFCondition result = EC_Normal;
+  Uint16 columns = 0;
+  Uint16 rows = 0;
+  return decodeReducedFrame(fromPixSeq, cp, dataset, frameNo, currentItem, 0,
+                            buffer, bufSize, columns, rows,
+                            decompressedColorModel);
+}
 
+OFCondition HtJ2kDecoderBase::decodeReducedFrame(
+    DcmPixelSequence *fromPixSeq, DcmCodecParameter const *cp, DcmItem *dataset,
+    Uint32 frameNo, Uint32 &currentItem, Uint16 resolutionReduction,
+    void *buffer, Uint32 bufSize, Uint16 &reducedColumns, Uint16 &reducedRows,
+    OFString &decompressedColorModel) const {
   // assume we can cast the codec parameter to what we need
   HtJ2kCodecParameter const *djcp =
       OFreinterpret_cast(HtJ2kCodecParameter const *, cp);
 
-  // determine properties of uncompressed dataset
-  Uint16 imageSamplesPerPixel = 0;
-  if (dataset->findAndGetUint16(DCM_SamplesPerPixel, imageSamplesPerPixel)
-          .bad())
-    return EC_TagNotFound;
-  // we only handle one or three samples per pixel
-  if ((imageSamplesPerPixel != 3) && (imageSamplesPerPixel != 1))
-    return EC_InvalidTag;
+  HtJ2kImageAttributes attributes;
+  OFshared_ptr<HtJ2kFrameIndex const> index;
+  OFCondition result =
+      indexFrames(fromPixSeq, djcp, dataset, attributes, index);
+  if (result.bad()) return result;
 
-  Uint16 imageRows = 0;
-  if (dataset->findAndGetUint16(DCM_Rows, imageRows).bad())
-    return EC_TagNotFound;
-  if (imageRows < 1) return EC_InvalidTag;
+  // the window covers the complete frame at the reduced resolution
+  computeReducedDimensions(attributes.columns, attributes.rows,
+                           resolutionReduction, reducedColumns, reducedRows);
+  return decodeWindow(*index, attributes, djcp, dataset, frameNo, currentItem,
+                      resolutionReduction,
+                      HtJ2kFrameWindow(0, 0, reducedColumns, reducedRows),
+                      buffer, bufSize, decompressedColorModel);
+}
 
-  Uint16 imageColumns = 0;
-  if (dataset->findAndGetUint16(DCM_Columns, imageColumns).bad())
-    return EC_TagNotFound;
-  if (imageColumns < 1) return EC_InvalidTag;
+OFCondition HtJ2kDecoderBase::decodeFrameWindow(
+    DcmPixelSequence *fromPixSeq, DcmCodecParameter const *cp, DcmItem *dataset,
+    Uint32 frameNo, Uint32 &currentItem, Uint16 resolutionReduction,
+    HtJ2kFrameWindow const &window, void *buffer, Uint32 bufSize,
+    OFString &decompressedColorModel) const {
+  // assume we can cast the codec parameter to what we need
+  HtJ2kCodecParameter const *djcp =
+      OFreinterpret_cast(HtJ2kCodecParameter const *, cp);
 
-  Uint16 imageBitsStored = 0;
-  if (dataset->findAndGetUint16(DCM_BitsStored, imageBitsStored).bad())
-    return EC_TagNotFound;
+  HtJ2kImageAttributes attributes;
+  OFshared_ptr<HtJ2kFrameIndex const> index;
+  OFCondition result =
+      indexFrames(fromPixSeq, djcp, dataset, attributes, index);
+  if (result.bad()) return result;
 
-  Uint16 imageBitsAllocated = 0;
-  if (dataset->findAndGetUint16(DCM_BitsAllocated, imageBitsAllocated).bad())
-    return EC_TagNotFound;
+  return decodeWindow(*index, attributes, djcp, dataset, frameNo, currentItem,
+                      resolutionReduction, window, buffer, bufSize,
+                      decompressedColorModel);
+}
 
-  // we only support up to 16 bits per sample
-  if ((imageBitsStored < 1) || (imageBitsStored > 16))
-    return EC_HTJ2KUnsupportedBitDepth;
-
-  // determine the number of bytes per sample (bits allocated) for the
-  // de-compressed object.
-  Uint16 bytesPerSample = 1;
-  if (imageBitsStored > 8)
-    bytesPerSample = 2;
-  else if (imageBitsAllocated > 8)
-    bytesPerSample = 2;
-
-  // number of frames is an optional attribute - we don't mind if it isn't
-  // present.
-  Sint32 imageFrames = 0;
-  dataset->findAndGetSint32(DCM_NumberOfFrames, imageFrames).good();
-
-  if (imageFrames >= OFstatic_cast(Sint32, fromPixSeq->card()))
-    imageFrames = fromPixSeq->card() -
-                  1;  // limit number of frames to number of pixel items - 1
-  if (imageFrames < 1)
-    imageFrames = 1;  // default in case the number of frames attribute is
-                      // absent or contains garbage
-
-  // if the user has provided this information, we trust him.
-  // If the user has passed a zero, try to find out ourselves.
-  if (currentItem == 0) {
-    result =
-        determineStartFragment(frameNo, imageFrames, fromPixSeq, currentItem);
-  }
+OFCondition HtJ2kDecoderBase::indexFrames(
+    DcmPixelSequence *pixSeq, HtJ2kCodecParameter const *cp, DcmItem *dataset,
+    HtJ2kImageAttributes &attributes,
+    OFshared_ptr<HtJ2kFrameIndex const> &index) const {
+  // Only the first frame of an image pays for locating the fragments, which
+  // may require scanning all of them. The cached index is checked against
+  // the current attributes and pixel sequence on every call, so it is built
+  // again if the dataset has been modified or replaced since.
+  return frameIndexCache_.lookup(dataset, pixSeq, cp->ignoreOffsetTable(),
+                                 attributes, index);
+}
 
-  if (result.good()) {
-    // We got all the data we need from the dataset, let's start decoding
-    DCMTKHTJ2K_DEBUG("Starting to decode frame " << frameNo << " with fragment "
-                                                 << currentItem);
-    result = decodeFrame(fromPixSeq, djcp, dataset, frameNo, currentItem,
-                         buffer, bufSize, imageFrames, imageColumns, imageRows,
-                         imageSamplesPerPixel, bytesPerSample);
-  }
+OFCondition HtJ2kDecoderBase::decodeWindow(
+    HtJ2kFrameIndex const &index, HtJ2kImageAttributes const &attributes,
+    HtJ2kCodecParameter const *cp, DcmItem *dataset, Uint32 frameNo,
+    Uint32 &currentItem, Uint16 resolutionReduction,
+    HtJ2kFrameWindow const &window, void *buffer, Uint32 bufSize,
+    OFString &decompressedColorModel) {
+  Uint16 const imageSamplesPerPixel = attributes.samplesPerPixel;
+  Uint16 const bytesPerSample = attributes.bytesPerSample;
+
+  // the window must lie inside the frame at the reduced resolution
+  Uint16 reducedColumns = 0;
+  Uint16 reducedRows = 0;
+  computeReducedDimensions(attributes.columns, attributes.rows,
+                           resolutionReduction, reducedColumns, reducedRows);
+  if ((window.columns < 1) || (window.rows < 1) ||
+      (window.left + window.columns > reducedColumns) ||
+      (window.top + window.rows > reducedRows))
+    return EC_IllegalParameter;
+  if (OFstatic_cast(size_t, window.columns) * window.rows *
+          imageSamplesPerPixel * bytesPerSample >
+      bufSize)
+    return EC_HTJ2KUncompressedBufferTooSmall;
+
+  // We got all the data we need from the dataset, let's start decoding
+  DCMTKHTJ2K_DEBUG("Starting to decode frame " << frameNo << " with fragment "
+                                               << index.startItem(frameNo));
+  OFCondition result = decodeFrame(
+      index, cp, dataset, frameNo, currentItem, buffer, bufSize,
+      reducedColumns, reducedRows, imageSamplesPerPixel, bytesPerSample,
+      resolutionReduction, window);
 
   if (result.good()) {
     // retrieve color model from given dataset
@@ -274,50 +1016,181 @@ OFCondition HtJ2kDecoderBase::decodeFrame(
   return result;
 }
 
-OFCondition copyUint32ToUint8(ojph::ui32 **comps_data, int num_comps,
-                              Uint8 *imageFrame, Uint16 columns, Uint16 rows);
+void HtJ2kDecoderBase::releaseThreadWorkspace() {
+  HtJ2kDecoderWorkspace::current().release();
+}
 
-OFCondition copyUint32ToUint16(ojph::ui32 **comps_data, int num_comps,
-                               Uint16 *imageFrame, Uint16 columns, Uint16 rows);
+OFCondition HtJ2kDecoderBase::decodeFrame(
+    HtJ2kFrameIndex const &index, HtJ2kCodecParameter const *cp,
+    DcmItem *dataset, Uint32 frameNo, Uint32 &currentItem, void *buffer,
+    Uint32 bufSize, Uint16 imageColumns, Uint16 imageRows,
+    Uint16 imageSamplesPerPixel, Uint16 bytesPerSample,
+    Uint16 resolutionReduction, HtJ2kFrameWindow const &window) {
+  HtJ2kFrameFragments fragments;
+  OFBool usingColorTransform = OFFalse;
 
-OFCondition copyRGBUint8ToRGBUint8(ojph::ui32 **comps_data, Uint8 *imageFrame,
-                                   Uint16 columns, Uint16 rows);
+  // determine the HT-J2K fragments we need in order to decode the next frame
+  OFCondition result = gatherFragments(index, frameNo, currentItem, fragments);
 
-OFCondition copyRGBUint8ToRGBUint8Planar(ojph::ui32 **comps_data,
-                                         Uint8 *imageFrame, Uint16 columns,
-                                         Uint16 rows);
+  if (result.good()) {
+    result = decodeFragments(
+        fragments, buffer, bufSize, imageColumns, imageRows,
+        imageSamplesPerPixel, bytesPerSample,
+        determineOutputPlanarConfiguration(cp, dataset, imageSamplesPerPixel),
+        resolutionReduction, window,
+        HtJ2kParallelLoop::resolveThreadCount(cp->getNumberOfThreads()),
+        usingColorTransform);
+  }
 
-OFCondition HtJ2kDecoderBase::decodeFrame(
-    DcmPixelSequence *fromPixSeq, HtJ2kCodecParameter const *cp,
-    DcmItem *dataset, Uint32 frameNo, Uint32 &currentItem, void *buffer,
-    Uint32 bufSize, Sint32 imageFrames, Uint16 imageColumns, Uint16 imageRows,
-    Uint16 imageSamplesPerPixel, Uint16 bytesPerSample) {
+  // Update photometric interpretation
+  if (result.good() && usingColorTransform) {
+    dataset->putAndInsertString(DCM_PhotometricInterpretation, "RGB");
+  }
+
+  return result;
+}
+
+OFCondition HtJ2kDecoderBase::gatherFragments(HtJ2kFrameIndex const &index,
+                                              Uint32 frameNo,
+                                              Uint32 &currentItem,
+                                              HtJ2kFrameFragments &fragments) {
   DcmPixelItem *pixItem = NULL;
-  Uint8 *htj2kData = NULL;
   Uint8 *htj2kFragmentData = NULL;
   Uint32 fragmentLength = 0;
-  size_t compressedSize = 0;
-  Uint32 fragmentsForThisFrame = 0;
   OFCondition result = EC_Normal;
-  OFBool ignoreOffsetTable = cp->ignoreOffsetTable();
 
-  // compute the number of HT-J2K fragments we need in order to decode the next
-  // frame
-  fragmentsForThisFrame = computeNumberOfFragments(
-      imageFrames, frameNo, currentItem, ignoreOffsetTable, fromPixSeq);
+  // look up the HT-J2K fragments we need in order to decode the frame
+  Uint32 fragmentsForThisFrame = index.numberOfItems(frameNo);
   if (fragmentsForThisFrame == 0)
-    result = EC_HTJ2KCannotComputeNumberOfFragments;
-
-  // determine planar configuration for uncompressed data
-  OFString imageSopClass;
-  OFString imagePhotometricInterpretation;
-  dataset->findAndGetOFString(DCM_SOPClassUID, imageSopClass);
-  dataset->findAndGetOFString(DCM_PhotometricInterpretation,
-                              imagePhotometricInterpretation);
+    return EC_HTJ2KCannotComputeNumberOfFragments;
+  currentItem = index.startItem(frameNo);
+
+  fragments.startItem = currentItem;
+  fragments.compressedSize = 0;
+  fragments.data.clear();
+  fragments.length.clear();
+  fragments.data.reserve(fragmentsForThisFrame);
+  fragments.length.reserve(fragmentsForThisFrame);
+
+  // resolve the data of all the fragments. This may load the fragments from
+  // file, which must not happen concurrently.
+  while (result.good() && fragmentsForThisFrame--) {
+    pixItem = index.item(currentItem++);
+    if (pixItem) {
+      fragmentLength = pixItem->getLength();
+      htj2kFragmentData = NULL;
+      result = pixItem->getUint8Array(htj2kFragmentData);
+      if (result.good() && htj2kFragmentData && (fragmentLength > 0)) {
+        fragments.data.push_back(htj2kFragmentData);
+        fragments.length.push_back(fragmentLength);
+        fragments.compressedSize += fragmentLength;
+      }
+    }
+  } /* while */
+
+  if (result.good() && (fragments.compressedSize == 0))
+    result = EC_HTJ2KInvalidCompressedData;
+
+  return result;
+}
+
+void HtJ2kDecoderBase::computeReducedDimensions(Uint16 columns, Uint16 rows,
+                                                Uint16 resolutionReduction,
+                                                Uint16 &reducedColumns,
+                                                Uint16 &reducedRows) {
+  reducedColumns = columns;
+  reducedRows = rows;
+  for (Uint16 level = 0; level < resolutionReduction; ++level) {
+    if ((reducedColumns <= 1) && (reducedRows <= 1)) break;
+    reducedColumns = OFstatic_cast(Uint16, (reducedColumns + 1U) / 2);
+    reducedRows = OFstatic_cast(Uint16, (reducedRows + 1U) / 2);
+  }
+}
+
+/** scales the pixel spacing attributes of an item by the factors the pixels
+ *  have grown by. The spacing is stored as row spacing (vertical) followed
+ *  by column spacing (horizontal).
+ *  @param item item containing the pixel spacing attributes
+ *  @param columnFactor factor the width of the pixels has grown by
+ *  @param rowFactor factor the height of the pixels has grown by
+ *  @return EC_Normal if successful, an error code otherwise
+ */
+static OFCondition scalePixelSpacing(DcmItem *item, double columnFactor,
+                                     double rowFactor) {
+  OFCondition result = EC_Normal;
+  DcmTagKey const spacingTags[] = {DCM_PixelSpacing, DCM_ImagerPixelSpacing};
+  for (size_t i = 0; result.good() && (i < 2); ++i) {
+    Float64 rowSpacing = 0.0;
+    Float64 columnSpacing = 0.0;
+    if (item->findAndGetFloat64(spacingTags[i], rowSpacing, 0).bad() ||
+        item->findAndGetFloat64(spacingTags[i], columnSpacing, 1).bad())
+      continue;  // attribute not present or invalid, leave it alone
+
+    char rowBuf[32];
+    char columnBuf[32];
+    OFStandard::ftoa(rowBuf, sizeof(rowBuf), rowSpacing * rowFactor, 0, 0, 8);
+    OFStandard::ftoa(columnBuf, sizeof(columnBuf), columnSpacing * columnFactor,
+                     0, 0, 8);
+    OFString spacing(rowBuf);
+    spacing += "\\";
+    spacing += columnBuf;
+    result = item->putAndInsertString(spacingTags[i], spacing.c_str());
+  }
+  return result;
+}
+
+OFCondition HtJ2kDecoderBase::updateReducedImageAttributes(
+    DcmItem *dataset, Uint16 columns, Uint16 rows, Uint16 reducedColumns,
+    Uint16 reducedRows) {
+  OFCondition result = dataset->putAndInsertUint16(DCM_Rows, reducedRows);
+  if (result.good())
+    result = dataset->putAndInsertUint16(DCM_Columns, reducedColumns);
+
+  // the pixels have grown by the reduction factor
+  double const columnFactor = OFstatic_cast(double, columns) / reducedColumns;
+  double const rowFactor = OFstatic_cast(double, rows) / reducedRows;
+  if (result.good())
+    result = scalePixelSpacing(dataset, columnFactor, rowFactor);
+
+  // the Pixel Measures of enhanced images are stored in the shared and the
+  // per-frame functional groups
+  DcmTagKey const groupTags[] = {DCM_SharedFunctionalGroupsSequence,
+                                 DCM_PerFrameFunctionalGroupsSequence};
+  for (size_t i = 0; result.good() && (i < 2); ++i) {
+    DcmSequenceOfItems *groups = NULL;
+    if (dataset->findAndGetSequence(groupTags[i], groups).bad() ||
+        (groups == NULL))
+      continue;
+    for (unsigned long g = 0; result.good() && (g < groups->card()); ++g) {
+      DcmSequenceOfItems *measures = NULL;
+      if (groups->getItem(g)
+              ->findAndGetSequence(DCM_PixelMeasuresSequence, measures)
+              .bad() ||
+          (measures == NULL))
+        continue;
+      for (unsigned long m = 0; result.good() && (m < measures->card()); ++m)
+        result =
+            scalePixelSpacing(measures->getItem(m), columnFactor, rowFactor);
+    }
+  }
+
+  return result;
+}
+
+Uint16 HtJ2kDecoderBase::determineOutputPlanarConfiguration(
+    HtJ2kCodecParameter const *cp, DcmItem *dataset,
+    Uint16 imageSamplesPerPixel) {
   Uint16 imagePlanarConfiguration =
       0;  // 0 is color-by-pixel, 1 is color-by-plane
 
   if (imageSamplesPerPixel > 1) {
+    // determine planar configuration for uncompressed data
+    OFString imageSopClass;
+    OFString imagePhotometricInterpretation;
+    dataset->findAndGetOFString(DCM_SOPClassUID, imageSopClass);
+    dataset->findAndGetOFString(DCM_PhotometricInterpretation,
+                                imagePhotometricInterpretation);
+
     switch (cp->getPlanarConfiguration()) {
       case EHTJ2KPC_restore:
         // get planar configuration from dataset
@@ -342,134 +1215,96 @@ OFCondition HtJ2kDecoderBase::decodeFrame(
     }
   }
 
-  // get the size of all the fragments
-  if (result.good()) {
-    // Don't modify the original values for now
-    Uint32 fragmentsForThisFrame2 = fragmentsForThisFrame;
-    Uint32 currentItem2 = currentItem;
-
-    while (result.good() && fragmentsForThisFrame2--) {
-      result = fromPixSeq->getItem(pixItem, currentItem2++);
-      if (result.good() && pixItem) {
-        fragmentLength = pixItem->getLength();
-        if (result.good()) compressedSize += fragmentLength;
-      }
-    } /* while */
-  }
+  return imagePlanarConfiguration;
+}
 
-  // get the compressed data
-  if (result.good()) {
-    Uint32 offset = 0;
-    htj2kData = new Uint8[compressedSize];
-
-    while (result.good() && fragmentsForThisFrame--) {
-      result = fromPixSeq->getItem(pixItem, currentItem++);
-      if (result.good() && pixItem) {
-        fragmentLength = pixItem->getLength();
-        result = pixItem->getUint8Array(htj2kFragmentData);
-        if (result.good() && htj2kFragmentData) {
-          memcpy(&htj2kData[offset], htj2kFragmentData, fragmentLength);
-          offset += fragmentLength;
-        }
+OFCondition HtJ2kDecoderBase::decodeFragments(
+    HtJ2kFrameFragments const &fragments, void *buffer, Uint32 bufSize,
+    Uint16 imageColumns, Uint16 imageRows, Uint16 imageSamplesPerPixel,
+    Uint16 bytesPerSample, Uint16 imagePlanarConfiguration,
+    Uint16 resolutionReduction, HtJ2kFrameWindow const &window,
+    Uint16 numberOfThreads, OFBool &usingColorTransform) {
+  size_t compressedSize = fragments.compressedSize;
+  OFCondition result = EC_Normal;
+  usingColorTransform = OFFalse;
+
+  // see if the last byte is a padding, otherwise, it should be 0xd9
+  if (fragments.data.back()[fragments.length.back() - 1] == 0)
+    compressedSize--;
+
+  HtJ2kOutputFrame output;
+  output.kernels = &HtJ2kSampleKernels::best();
+  output.frame = OFstatic_cast(Uint8 *, buffer);
+  output.rowBuffer = NULL;
+  output.columns = window.columns;
+  output.rows = window.rows;
+  output.left = 0;
+  output.top = 0;
+  output.width = window.columns;
+  output.rowByRow = OFFalse;
+
+  // the buffers and the codestream are reused from the last frame
+  // decompressed by this thread
+  HtJ2kDecoderWorkspace &workspace = HtJ2kDecoderWorkspace::current();
+
+  // the tiles of a tiled codestream are decompressed concurrently, which
+  // requires the codestream in a contiguous buffer
+  OFBool tiled = OFFalse;
+  if ((numberOfThreads > 1) &&
+      (HtJ2kTileIndex::countTiles(fragments.data[0], fragments.length[0]) >
+       1)) {
+    Uint8 const *data = fragments.data[0];
+    if (fragments.data.size() > 1) {
+      Uint8 *contiguous = workspace.compressed(compressedSize);
+      size_t offset = 0;
+      for (size_t i = 0; i < fragments.data.size(); ++i) {
+        size_t const count =
+            std::min(OFstatic_cast(size_t, fragments.length[i]),
+                     compressedSize - offset);
+        memcpy(contiguous + offset, fragments.data[i], count);
+        offset += count;
       }
-    } /* while */
-  }
-
-  if (result.good()) {
-    // see if the last byte is a padding, otherwise, it should be 0xd9
-    if (htj2kData[compressedSize - 1] == 0) compressedSize--;
-
-    // start of OpenJPH decoding
-    try {
-      ojph::codestream codestream;
-      ojph::mem_infile mem_file;
-
-      mem_file.open(htj2kData, compressedSize);
-      codestream.enable_resilience();
-      codestream.read_headers(&mem_file);
-
-      ojph::param_siz siz = codestream.access_siz();
-      ojph::param_cod cod = codestream.access_cod();
-      int num_comps = siz.get_num_components();
-      int width = siz.get_recon_width(0);
-      int height = siz.get_recon_height(0);
-      bool usingColorTransform =
-          (num_comps == 3) && cod.is_using_color_transform();
-
-      if (width != imageColumns)
-        result = EC_HTJ2KImageDataMismatch;
-      else if (height != imageRows)
-        result = EC_HTJ2KImageDataMismatch;
-      else if (num_comps != imageSamplesPerPixel)
+      data = contiguous;
+    }
+    HtJ2kTileIndex index;
+    if (index.parse(data, compressedSize).good()) {
+      tiled = OFTrue;
+
+      // the last tile ends in the lower right corner of the frame
+      Uint32 left, top, columns, rows;
+      index.getTileRegion(index.numberOfTiles() - 1, resolutionReduction,
+                          left, top, columns, rows);
+      if ((left + columns != imageColumns) || (top + rows != imageRows))
         result = EC_HTJ2KImageDataMismatch;
 
       if (result.good()) {
-        codestream.create();
-
-        // Allocate line buffer
-        ojph::ui32 **comps_data = new ojph::ui32 *[num_comps];
-        for (int c = 0; c < num_comps; c++) {
-          comps_data[c] = new ojph::ui32[width * height];
-        }
-
-        // Decode all lines
-        for (ojph::ui32 y = 0; y < (ojph::ui32)height; y++) {
-          for (int c = 0; c < num_comps; c++) {
-            ojph::ui32 comp_num;
-            ojph::line_buf *line = codestream.pull(comp_num);
-            ojph::si32 *sp = line->i32;
-            ojph::ui32 *dp = &comps_data[c][y * width];
-            for (ojph::ui32 x = 0; x < (ojph::ui32)width; x++) {
-              *dp++ = (ojph::ui32)*sp++;
-            }
-          }
-        }
-
-        codestream.close();
-
-        // Copy the image depending on planar configuration and bits
-        if (num_comps == 1)  // Greyscale
-        {
-          if (bytesPerSample == 1)
-            copyUint32ToUint8(comps_data, num_comps,
-                              OFreinterpret_cast(Uint8 *, buffer), imageColumns,
-                              imageRows);
-          else
-            copyUint32ToUint16(comps_data, num_comps,
-                               OFreinterpret_cast(Uint16 *, buffer),
-                               imageColumns, imageRows);
-        } else if (num_comps == 3) {
-          if (imagePlanarConfiguration == 0) {
-            copyRGBUint8ToRGBUint8(comps_data,
-                                   OFreinterpret_cast(Uint8 *, buffer),
-                                   imageColumns, imageRows);
-          } else if (imagePlanarConfiguration == 1) {
-            copyRGBUint8ToRGBUint8Planar(comps_data,
-                                         OFreinterpret_cast(Uint8 *, buffer),
-                                         imageColumns, imageRows);
-          }
-        }
-
-        // Update photometric interpretation
-        if (usingColorTransform) {
-          dataset->putAndInsertString(DCM_PhotometricInterpretation, "RGB");
-        }
-
-        // Clean up
-        for (int c = 0; c < num_comps; c++) {
-          delete[] comps_data[c];
-        }
-        delete[] comps_data;
+        HtJ2kDecodeTilesTask task(index, data, imageSamplesPerPixel,
+                                  bytesPerSample, imagePlanarConfiguration,
+                                  resolutionReduction, window, output);
+        DCMTKHTJ2K_DEBUG("HT-J2K decoder decompresses "
+                         << task.numberOfTiles() << " of "
+                         << index.numberOfTiles() << " tiles");
+        result = HtJ2kParallelLoop::run(task, task.numberOfTiles(),
+                                        numberOfThreads);
+        usingColorTransform = task.usingColorTransform();
       }
-    } catch (std::exception &ex) {
-      DCMTKHTJ2K_ERROR("HT-J2K decoder caught OpenJPH exception: "
-                       << (ex.what() ? ex.what() : "Unknown reason"));
-      result =
-          makeOFCondition(1, OFM_dcmjp2k, OF_error,
-                          ex.what() ? ex.what() : "Unknown OpenJPH exception");
     }
+  }
 
-    delete[] htj2kData;
+  if (!tiled) {
+    // a frame stored in a single fragment is read in place, otherwise the
+    // codestream is read across the fragments
+    ojph::mem_infile mem_file;
+    HtJ2kFragmentInfile fragment_file(fragments, compressedSize);
+    ojph::infile_base *infile = &fragment_file;
+    if (fragments.data.size() == 1) {
+      mem_file.open(fragments.data[0], compressedSize);
+      infile = &mem_file;
+    }
+    result = decodeCodestream(workspace, infile, imageColumns, imageRows,
+                              imageSamplesPerPixel, bytesPerSample,
+                              imagePlanarConfiguration, resolutionReduction,
+                              window, output, usingColorTransform);
   }
 
   if (result.good()) {
@@ -557,112 +1392,6 @@ Uint16 HtJ2kDecoderBase::determinePlanarConfiguration(
   return 0;
 }
 
-Uint32 HtJ2kDecoderBase::computeNumberOfFragments(Sint32 numberOfFrames,
-                                                  Uint32 currentFrame,
-                                                  Uint32 startItem,
-                                                  OFBool ignoreOffsetTable,
-                                                  DcmPixelSequence *pixSeq) {
-  unsigned long numItems = pixSeq->card();
-  DcmPixelItem *pixItem = NULL;
-
-  // We first check the simple cases, that is, a single-frame image,
-  // the last frame of a multi-frame image and the standard case where we do
-  // have a single fragment per frame.
-  if ((numberOfFrames <= 1) ||
-      (currentFrame + 1 == OFstatic_cast(Uint32, numberOfFrames))) {
-    // single-frame image or last frame. All remaining fragments belong to this
-    // frame
-    return (numItems - startItem);
-  }
-  if (OFstatic_cast(Uint32, numberOfFrames + 1) == numItems) {
-    // multi-frame image with one fragment per frame
-    return 1;
-  }
-
-  OFCondition result = EC_Normal;
-  if (!ignoreOffsetTable) {
-    // We do have a multi-frame image with multiple fragments per frame, and we
-    // are not working on the last frame. Let's check the offset table if
-    // present.
-    result = pixSeq->getItem(pixItem, 0);
-    if (result.good() && pixItem) {
-      Uint32 offsetTableLength = pixItem->getLength();
-      if (offsetTableLength == (OFstatic_cast(Uint32, numberOfFrames) * 4)) {
-        // offset table is non-empty and contains one entry per frame
-        Uint8 *offsetData = NULL;
-        result = pixItem->getUint8Array(offsetData);
-        if (result.good() && offsetData) {
-          // now we can access the offset table
-          Uint32 *offsetData32 = OFreinterpret_cast(Uint32 *, offsetData);
-
-          // extract the offset for the NEXT frame. This offset is guaranteed to
-          // exist because the "last frame/single frame" case is handled above.
-          Uint32 offset = offsetData32[currentFrame + 1];
-
-          // convert to local endian byte order (always little endian in file)
-          swapIfNecessary(gLocalByteOrder, EBO_LittleEndian, &offset,
-                          sizeof(Uint32), sizeof(Uint32));
-
-          // determine index of start fragment for next frame
-          Uint32 byteCount = 0;
-          Uint32 fragmentIndex = 1;
-          while ((byteCount < offset) && (fragmentIndex < numItems)) {
-            pixItem = NULL;
-            result = pixSeq->getItem(pixItem, fragmentIndex++);
-            if (result.good() && pixItem) {
-              byteCount += pixItem->getLength() +
-                           8;  // add 8 bytes for item tag and length
-              if ((byteCount == offset) && (fragmentIndex > startItem)) {
-                // bingo, we have found the offset for the next frame
-                return fragmentIndex - startItem;
-              }
-            } else
-              break; /* something went wrong, break out of while loop */
-          }          /* while */
-        }
-      }
-    }
-  }
-
-  // So we have a multi-frame image with multiple fragments per frame and the
-  // offset table is empty or wrong. Our last chance is to peek into the
-  // HT-J2K bitstream and identify the start of the next frame.
-  Uint32 nextItem = startItem;
-  Uint8 *fragmentData = NULL;
-  while (++nextItem < numItems) {
-    pixItem = NULL;
-    result = pixSeq->getItem(pixItem, nextItem);
-    if (result.good() && pixItem) {
-      fragmentData = NULL;
-      result = pixItem->getUint8Array(fragmentData);
-      if (result.good() && fragmentData && (pixItem->getLength() > 3)) {
-        if (isJ2KStartOfImage(fragmentData)) {
-          // found a HT-J2K SOC marker. Assume that this is the start of the
-          // next frame.
-          return (nextItem - startItem);
-        }
-      } else
-        break; /* something went wrong, break out of while loop */
-    } else
-      break; /* something went wrong, break out of while loop */
-  }
-
-  // We're bust. No way to determine the number of fragments per frame.
-  return 0;
-}
-
-OFBool HtJ2kDecoderBase::isJ2KStartOfImage(Uint8 *fragmentData) {
-  // A valid JPEG 2000 codestream starts with SOC (FF4F),
-  // followed by SIZ (FF51).
-  if ((*fragmentData++) != 0xFF) return OFFalse;
-  if ((*fragmentData++) != 0x4F) return OFFalse;
-  if ((*fragmentData++) != 0xFF) return OFFalse;
-  if (*fragmentData == 0x51) {
-    return OFTrue;
-  }
-  return OFFalse;
-}
-
 OFCondition HtJ2kDecoderBase::createPlanarConfiguration1Byte(Uint8 *imageFrame,
                                                              Uint16 columns,
                                                              Uint16 rows) {
@@ -766,74 +1495,3 @@ OFCondition HtJ2kDecoderBase::createPlanarConfiguration0Word(Uint16 *imageFrame,
     return EC_MemoryExhausted;
   return EC_Normal;
 }
-
-OFCondition copyUint32ToUint8(ojph::ui32 **comps_data, int num_comps,
-                              Uint8 *imageFrame, Uint16 columns, Uint16 rows) {
-  if (imageFrame == NULL) return EC_IllegalCall;
-
-  unsigned long numPixels = columns * rows;
-  if (numPixels == 0) return EC_IllegalCall;
-
-  Uint8 *t = imageFrame;          // target
-  ojph::ui32 *g = comps_data[0];  // grey plane
-  for (unsigned long i = numPixels; i; i--) {
-    *t++ = (Uint8)(*g++);
-  }
-
-  return EC_Normal;
-}
-
-OFCondition copyUint32ToUint16(ojph::ui32 **comps_data, int num_comps,
-                               Uint16 *imageFrame, Uint16 columns,
-                               Uint16 rows) {
-  if (imageFrame == NULL) return EC_IllegalCall;
-
-  unsigned long numPixels = columns * rows;
-  if (numPixels == 0) return EC_IllegalCall;
-
-  Uint16 *t = imageFrame;         // target
-  ojph::ui32 *g = comps_data[0];  // grey plane
-  for (unsigned long i = numPixels; i; i--) {
-    *t++ = (Uint16)(*g++);
-  }
-
-  return EC_Normal;
-}
-
-OFCondition copyRGBUint8ToRGBUint8(ojph::ui32 **comps_data, Uint8 *imageFrame,
-                                   Uint16 columns, Uint16 rows) {
-  if (imageFrame == NULL) return EC_IllegalCall;
-
-  unsigned long numPixels = columns * rows;
-  if (numPixels == 0) return EC_IllegalCall;
-
-  Uint8 *t = imageFrame;          // target
-  ojph::ui32 *r = comps_data[0];  // red plane
-  ojph::ui32 *g = comps_data[1];  // green plane
-  ojph::ui32 *b = comps_data[2];  // blue plane
-  for (unsigned long i = numPixels; i; i--) {
-    *t++ = (Uint8)(*r++);
-    *t++ = (Uint8)(*g++);
-    *t++ = (Uint8)(*b++);
-  }
-
-  return EC_Normal;
-}
-
-OFCondition copyRGBUint8ToRGBUint8Planar(ojph::ui32 **comps_data,
-                                         Uint8 *imageFrame, Uint16 columns,
-                                         Uint16 rows) {
-  if (imageFrame == NULL) return EC_IllegalCall;
-
-  unsigned long numPixels = columns * rows;
-  if (numPixels == 0) return EC_IllegalCall;
-
-  Uint8 *t = imageFrame;  // target
-  for (unsigned long j = 0; j < 3; j++) {
-    ojph::ui32 *r = comps_data[j];  // color plane
-    for (unsigned long i = numPixels; i; i--) {
-      *t++ = (Uint8)(*r++);
-    }
-  }
-  return EC_Normal;
-}
@@ -11,6 +11,8 @@
 #include "dcmtk/ofstd/ofstd.h"
 #include "dcmtk/ofstd/ofstdinc.h"
 #include "dcmtk/ofstd/ofstream.h"
+#include "dcmtk/ofstd/ofthread.h" /* for class OFMutex */
+#include "dcmtk/ofstd/ofvector.h"
 
 // dcmdata includes
 #include "dcmtk/dcmdata/dcdatset.h" /* for class DcmDataset */
@@ -23,12 +25,17 @@
 #include "dcmtk/dcmdata/dcvrcs.h"   /* for class DcmCodeString */
 #include "dcmtk/dcmdata/dcvrds.h"   /* for class DcmDecimalString */
 #include "dcmtk/dcmdata/dcvrlt.h"   /* for class DcmLongText */
+#include "dcmtk/dcmdata/dcvrov.h"   /* for class DcmOther64bitVeryLong */
 #include "dcmtk/dcmdata/dcvrst.h"   /* for class DcmShortText */
 #include "dcmtk/dcmdata/dcvrus.h"   /* for class DcmUnsignedShort */
 
 // dcmhtj2k includes
-#include "dcmtkhtj2k/djcparam.h" /* for class DJP2KCodecParameter */
-#include "dcmtkhtj2k/djrparam.h" /* for class D2RepresentationParameter */
+#include "dcmtkhtj2k/djcparam.h"  /* for class DJP2KCodecParameter */
+#include "dcmtkhtj2k/djplt.h"     /* for class HtJ2kPacketLengthIndex */
+#include "dcmtkhtj2k/djrparam.h"  /* for class D2RepresentationParameter */
+#include "dcmtkhtj2k/djsimd.h"    /* for struct HtJ2kSampleKernels */
+#include "dcmtkhtj2k/djthread.h"  /* for class HtJ2kParallelLoop */
+#include "dcmtkhtj2k/djtile.h"    /* for class HtJ2kTileIndex */
 
 // dcmimgle includes
 #include "dcmtk/dcmimgle/dcmimage.h" /* for class DicomImage */
@@ -51,6 +58,762 @@ BEGIN_EXTERN_C
 #endif
 END_EXTERN_C
 
+/** OpenJPH output file writing a codestream directly into the fragments
+ *  (pixel items) of a frame. If the fragment size is limited, every fragment
+ *  is allocated by the pixel item that finally stores it, so the compressed
+ *  data is neither reallocated while growing nor copied once more into the
+ *  pixel sequence. Only the last, partially filled fragment is trimmed to
+ *  its final length. If the fragment size is unlimited, the blocks are kept
+ *  for the next codestream written to the file.
+ */
+class HtJ2kFragmentOutfile : public ojph::outfile_base {
+ public:
+  /// default constructor
+  HtJ2kFragmentOutfile()
+      : fragmentSize_(0), items_(), blocks_(), position_(0), length_(0) {}
+
+  /// destructor, releases all fragments not stored in a pixel sequence
+  virtual ~HtJ2kFragmentOutfile() { release(OFTrue); }
+
+  /** prepares the file for the next codestream.
+   *  @param fragmentSize maximum fragment size in kbytes, 0 for unlimited
+   */
+  void open(Uint32 fragmentSize) {
+    // same limit as DcmPixelSequence::storeCompressedFrame()
+    Uint32 size = 0;
+    if ((fragmentSize > 0) && (fragmentSize < 0x400000))
+      size = fragmentSize << 10;  // unit is kbytes
+    // the blocks are only reused if the fragment size stays unlimited
+    release((size != 0) || (fragmentSize_ != 0));
+    fragmentSize_ = size;
+  }
+
+  virtual size_t write(void const *ptr, size_t size) {
+    Uint8 const *source = OFstatic_cast(Uint8 const *, ptr);
+    size_t const blockSize = getBlockSize();
+    size_t bytesWritten = 0;
+    while (bytesWritten < size) {
+      size_t const block = OFstatic_cast(size_t, position_ / blockSize);
+      size_t const blockOffset = OFstatic_cast(size_t, position_ % blockSize);
+      if ((block >= blocks_.size()) && !addBlock()) break;  // out of memory
+      size_t count = blockSize - blockOffset;
+      if (count > size - bytesWritten) count = size - bytesWritten;
+      memcpy(blocks_[block] + blockOffset, source + bytesWritten, count);
+      bytesWritten += count;
+      position_ += count;
+      if (position_ > length_) length_ = position_;
+    }
+    return bytesWritten;
+  }
+
+  virtual ojph::si64 tell() { return OFstatic_cast(ojph::si64, position_); }
+
+  virtual int seek(ojph::si64 offset, enum ojph::outfile_base::seek origin) {
+    ojph::si64 position = offset;
+    if (origin == ojph::outfile_base::OJPH_SEEK_CUR)
+      position += OFstatic_cast(ojph::si64, position_);
+    else if (origin == ojph::outfile_base::OJPH_SEEK_END)
+      position += OFstatic_cast(ojph::si64, length_);
+    if ((position < 0) || (position > OFstatic_cast(ojph::si64, length_)))
+      return -1;
+    position_ = OFstatic_cast(Uint64, position);
+    return 0;
+  }
+
+  /// returns the length of the codestream written so far
+  Uint64 getLength() const { return length_; }
+
+  /** appends the fragments to the given pixel sequence, which takes over
+   *  their ownership, and adds the size of the frame to the offset list.
+   *  Afterwards, the file is empty.
+   *  @param pixelSequence pixel sequence the fragments are appended to
+   *  @param offsetList offset list to be updated
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  OFCondition store(DcmPixelSequence *pixelSequence,
+                    DcmOffsetList &offsetList) {
+    if (length_ > 0xFFFFFFFEUL) return EC_HTJ2KTooMuchCompressedData;
+    OFCondition result = EC_Normal;
+    Uint32 const length = OFstatic_cast(Uint32, length_);
+    Uint32 numFragments = 0;
+    if (fragmentSize_ == 0) {
+      // a single fragment, assembled from the blocks
+      if (length > 0) {
+        DcmPixelItem *fragment = new DcmPixelItem(DcmTag(DCM_Item, EVR_OB));
+        Uint8 *data = NULL;
+        result = fragment->createUint8Array(length, data);
+        if (result.good()) {
+          for (Uint32 offset = 0, block = 0; offset < length; ++block) {
+            Uint32 count = length - offset;
+            if (count > kBlockSize) count = kBlockSize;
+            memcpy(data + offset, blocks_[block], count);
+            offset += count;
+          }
+          result = pixelSequence->insert(fragment);
+        }
+        if (result.good())
+          numFragments = 1;
+        else
+          delete fragment;
+      }
+    } else {
+      // the blocks are the fragments, only the last one may be shorter
+      size_t const used = (length + fragmentSize_ - 1) / fragmentSize_;
+      for (size_t i = 0; result.good() && (i < used); ++i) {
+        DcmPixelItem *fragment = items_[i];
+        Uint32 const count = (i + 1 < used)
+                                 ? fragmentSize_
+                                 : length - OFstatic_cast(Uint32, i) *
+                                                fragmentSize_;
+        if (count < fragmentSize_) {
+          // trim the last fragment
+          fragment = new DcmPixelItem(DcmTag(DCM_Item, EVR_OB));
+          result = fragment->putUint8Array(blocks_[i], count);
+          if (result.bad()) {
+            delete fragment;
+            break;
+          }
+        }
+        result = pixelSequence->insert(fragment);
+        if (result.good()) {
+          // the pixel sequence owns the fragment now
+          if (fragment == items_[i]) items_[i] = NULL;
+          ++numFragments;
+        } else if (fragment != items_[i]) {
+          delete fragment;
+        }
+      }
+    }
+
+    if (result.good()) {
+      // 8 bytes extra for each item header, an odd frame size requires
+      // padding of the last fragment
+      Uint32 frameSize = length + (numFragments << 3);
+      if (length & 1) ++frameSize;
+      offsetList.push_back(frameSize);
+    }
+    release(OFFalse);
+    return result;
+  }
+
+ private:
+  /// size of the blocks used if the fragment size is unlimited
+  static Uint32 const kBlockSize = 65536;
+
+  /// returns the size of every block of the file
+  size_t getBlockSize() const {
+    if (fragmentSize_ == 0) return kBlockSize;
+    return fragmentSize_;
+  }
+
+  /// allocates the next block, returns false if out of memory
+  OFBool addBlock() {
+    Uint8 *data = NULL;
+    if (fragmentSize_ == 0) {
+      data = new Uint8[kBlockSize];
+      if (data == NULL) return OFFalse;
+    } else {
+      DcmPixelItem *fragment = new DcmPixelItem(DcmTag(DCM_Item, EVR_OB));
+      if (fragment->createUint8Array(fragmentSize_, data).bad() ||
+          (data == NULL)) {
+        delete fragment;
+        return OFFalse;
+      }
+      items_.push_back(fragment);
+    }
+    blocks_.push_back(data);
+    return OFTrue;
+  }
+
+  /** empties the file, releasing all fragments not stored in a pixel
+   *  sequence.
+   *  @param freeBlocks if false, the blocks of an unlimited fragment size are
+   *    kept for the next codestream
+   */
+  void release(OFBool freeBlocks) {
+    if (fragmentSize_ == 0) {
+      if (freeBlocks) {
+        for (size_t i = 0; i < blocks_.size(); ++i) delete[] blocks_[i];
+        blocks_.clear();
+      }
+    } else {
+      for (size_t i = 0; i < items_.size(); ++i) delete items_[i];
+      items_.clear();
+      blocks_.clear();
+    }
+    position_ = 0;
+    length_ = 0;
+  }
+
+  /// maximum fragment size in bytes, 0 for unlimited
+  Uint32 fragmentSize_;
+
+  /// fragments the blocks belong to, unused if the fragment size is unlimited
+  OFVector<DcmPixelItem *> items_;
+
+  /// data of all blocks
+  OFVector<Uint8 *> blocks_;
+
+  /// current write position
+  Uint64 position_;
+
+  /// length of the codestream written so far
+  Uint64 length_;
+};
+
+/** image area, tiling, components and quantization of a codestream, i.e.
+ *  the parameters that vary between the codestreams of an image. Together
+ *  with the codec parameters, they determine the internal buffers allocated
+ *  by OpenJPH.
+ */
+struct HtJ2kCodestreamGeometry {
+  /// default constructor, describes no image
+  HtJ2kCodestreamGeometry()
+      : left(0),
+        top(0),
+        columns(0),
+        rows(0),
+        tileSize(0),
+        components(0),
+        precision(0),
+        isSigned(OFFalse),
+        colorTransform(OFFalse),
+        quantizationStep(0.0f) {}
+
+  /// comparison operator
+  OFBool operator==(HtJ2kCodestreamGeometry const &other) const {
+    return (left == other.left) && (top == other.top) &&
+           (columns == other.columns) && (rows == other.rows) &&
+           (tileSize == other.tileSize) && (components == other.components) &&
+           (precision == other.precision) && (isSigned == other.isSigned) &&
+           (colorTransform == other.colorTransform) &&
+           (quantizationStep == other.quantizationStep);
+  }
+
+  /// first column of the image or tile
+  Uint16 left;
+
+  /// first row of the image or tile
+  Uint16 top;
+
+  /// number of columns of the image or tile
+  Uint16 columns;
+
+  /// number of rows of the image or tile
+  Uint16 rows;
+
+  /// width and height of the tiles, 0 for a single tile
+  Uint16 tileSize;
+
+  /// number of components
+  Uint16 components;
+
+  /// number of bits coded per sample
+  Uint16 precision;
+
+  /// true if the samples are signed
+  OFBool isSigned;
+
+  /// true if the color transform is applied
+  OFBool colorTransform;
+
+  /// base quantization step of irreversible coding, 0 for the default
+  float quantizationStep;
+};
+
+/** OpenJPH objects kept alive between the codestreams compressed one after
+ *  the other by a thread, so that the codestream with its internal line and
+ *  code-block buffers and the memory file receiving it are allocated once
+ *  rather than for every frame.
+ */
+class HtJ2kEncoderContext {
+ public:
+  /// default constructor
+  HtJ2kEncoderContext()
+      : codestream_(NULL), geometry_(), file_(), fileOpen_(OFFalse) {}
+
+  /// destructor
+  ~HtJ2kEncoderContext() { delete codestream_; }
+
+  /** returns a codestream to be configured for the next frame or tile. A
+   *  codestream of the same geometry is restarted, keeping its buffers,
+   *  otherwise a new codestream is created.
+   *  @param geometry geometry of the next codestream
+   *  @return codestream without any data
+   */
+  ojph::codestream &codestream(HtJ2kCodestreamGeometry const &geometry) {
+    if ((codestream_ != NULL) && (geometry == geometry_)) {
+      codestream_->restart();
+    } else {
+      reset();
+      codestream_ = new ojph::codestream();
+      geometry_ = geometry;
+    }
+    return *codestream_;
+  }
+
+  /// discards the codestream, e.g. after it failed
+  void reset() {
+    delete codestream_;
+    codestream_ = NULL;
+    geometry_ = HtJ2kCodestreamGeometry();
+  }
+
+  /// returns the geometry of the last codestream
+  HtJ2kCodestreamGeometry const &geometry() const { return geometry_; }
+
+  /** returns the memory file of the context, empty but keeping the memory
+   *  allocated for earlier codestreams.
+   *  @return empty memory file
+   */
+  ojph::mem_outfile &file() {
+    if (fileOpen_)
+      file_.seek(0, ojph::outfile_base::OJPH_SEEK_SET);
+    else
+      file_.open();
+    fileOpen_ = OFTrue;
+    return file_;
+  }
+
+ private:
+  /// private undefined copy constructor
+  HtJ2kEncoderContext(HtJ2kEncoderContext const &);
+
+  /// private undefined copy assignment operator
+  HtJ2kEncoderContext &operator=(HtJ2kEncoderContext const &);
+
+  /// codestream of the last frame or tile, NULL if none
+  ojph::codestream *codestream_;
+
+  /// geometry of the last codestream
+  HtJ2kCodestreamGeometry geometry_;
+
+  /// memory file, e.g. for a compressed tile
+  ojph::mem_outfile file_;
+
+  /// true once the memory file has been opened
+  OFBool fileOpen_;
+};
+
+/** encoder contexts shared by the threads compressing the frames of an
+ *  image. A context is acquired for every codestream and released after it
+ *  has been compressed, so only as many contexts are created as codestreams
+ *  are compressed concurrently.
+ */
+class HtJ2kEncoderContextPool {
+ public:
+  /// default constructor
+  HtJ2kEncoderContextPool() : contexts_(), mutex_() {}
+
+  /// destructor, deletes all contexts
+  ~HtJ2kEncoderContextPool() {
+    for (size_t i = 0; i < contexts_.size(); ++i) delete contexts_[i];
+  }
+
+  /** acquires a context, preferably one whose last codestream had the given
+   *  geometry.
+   *  @param geometry geometry of the next codestream
+   *  @return context, to be released with release()
+   */
+  HtJ2kEncoderContext *acquire(HtJ2kCodestreamGeometry const &geometry) {
+    HtJ2kEncoderContext *context = NULL;
+    mutex_.lock();
+    if (!contexts_.empty()) {
+      size_t found = contexts_.size() - 1;
+      for (size_t i = 0; i < contexts_.size(); ++i) {
+        if (contexts_[i]->geometry() == geometry) {
+          found = i;
+          break;
+        }
+      }
+      context = contexts_[found];
+      contexts_[found] = contexts_.back();
+      contexts_.pop_back();
+    }
+    mutex_.unlock();
+    if (context == NULL) context = new HtJ2kEncoderContext();
+    return context;
+  }
+
+  /** returns a context acquired before to the pool.
+   *  @param context context to be returned
+   */
+  void release(HtJ2kEncoderContext *context) {
+    mutex_.lock();
+    contexts_.push_back(context);
+    mutex_.unlock();
+  }
+
+ private:
+  /// contexts not in use
+  OFVector<HtJ2kEncoderContext *> contexts_;
+
+  /// mutex protecting the contexts
+  OFMutex mutex_;
+};
+
+/** describes the rows of the components of an uncompressed frame and
+ *  converts them into the 32-bit line buffers consumed by the OpenJPH encoder.
+ */
+struct HtJ2kFrameSamples {
+  /// first row of each component, for color-by-pixel data the first pixel
+  OFVector<Uint8 const *> rows;
+
+  /// distance between two rows of a component in bytes
+  size_t rowSize;
+
+  /// true if the components are interleaved (color-by-pixel)
+  OFBool interleaved;
+
+  /// number of samples per row
+  Uint16 width;
+
+  /// bits allocated per sample, 8 or 16, or 32 for samples converted into
+  /// the format of the OpenJPH line buffers
+  Uint16 bitsAllocated;
+
+  /// true if the samples are signed
+  OFBool isSigned;
+
+  /// lowest bit of the stored value within the pixel cell
+  Uint16 lowBit;
+
+  /// number of stored bits, the pixel cell is used as is if this is equal
+  /// to bitsAllocated
+  Uint16 bitsStored;
+
+  /// number of bits the samples are scaled up by
+  Uint16 upShift;
+
+  /** converts one row of one component.
+   *  @param kernels sample conversion kernels
+   *  @param c component
+   *  @param y row
+   *  @param line line buffer receiving width samples
+   */
+  void feed(HtJ2kSampleKernels const &kernels, Uint16 c, Uint32 y,
+            ojph::si32 *line) const {
+    Uint8 const *row = rows[c] + y * rowSize;
+    if (bitsAllocated == 32) {
+      // converted ahead of the compression
+      memcpy(line, row, OFstatic_cast(size_t, width) * sizeof(ojph::si32));
+      return;
+    }
+    Uint16 const component = interleaved ? c : 0;
+    Uint16 const step =
+        interleaved ? OFstatic_cast(Uint16, rows.size()) : 1;
+    if (bitsAllocated <= 8) {
+      if (isSigned)
+        kernels.widenSint8(OFreinterpret_cast(Sint8 const *, row), component,
+                           step, line, width);
+      else
+        kernels.widenUint8(row, component, step, line, width);
+    } else {
+      if (isSigned)
+        kernels.widenSint16(OFreinterpret_cast(Sint16 const *, row),
+                            component, step, line, width);
+      else
+        kernels.widenUint16(OFreinterpret_cast(Uint16 const *, row),
+                            component, step, line, width);
+    }
+    if (bitsStored < bitsAllocated)
+      kernels.extractBits(line, width, lowBit, bitsStored, isSigned);
+    if (upShift > 0) kernels.shiftLeft(line, width, upShift);
+  }
+};
+
+/** frame of the raw encoder prepared for compression. The samples either
+ *  refer to the uncompressed pixel data or, if the frame has been converted
+ *  ahead of its compression, to the converted samples.
+ */
+struct HtJ2kRawFrame {
+  /// samples of the frame
+  HtJ2kFrameSamples samples;
+
+  /// frame height
+  Uint16 rows;
+
+  /// number of bits coded per sample
+  Uint16 precision;
+
+  /// true if the color transform should be applied
+  OFBool colorTransform;
+
+  /// samples converted into the format of the OpenJPH line buffers, one
+  /// plane per component. Empty unless converted ahead of the compression.
+  OFVector<ojph::si32> convertedSamples;
+};
+
+/** determines the maximum size of the fragments of a compressed frame.
+ *  @param djcp parameters for the codec
+ *  @param djrp representation parameters for the codec, whose encoding
+ *    options take precedence
+ *  @return maximum fragment size in kbytes, 0 for unlimited
+ */
+static Uint32 fragmentSizeFor(HtJ2kCodecParameter const *djcp,
+                              HtJ2kRepresentationParameter const *djrp) {
+  return djrp->hasEncodingOptions() ? djrp->getFragmentSize()
+                                    : djcp->getFragmentSize();
+}
+
+/** task compressing the frames of an image. Frames may be compressed
+ *  concurrently, but are always stored in the pixel sequence and the offset
+ *  list in frame order, as soon as all preceding frames have been stored.
+ *  The result is therefore identical to compressing the frames serially.
+ */
+class HtJ2kEncoderBase::EncodeFramesTask : public HtJ2kParallelTask {
+ public:
+  EncodeFramesTask(size_t frameCount, DcmPixelSequence *pixelSequence,
+                   DcmOffsetList &offsetList, Uint32 fragmentSize)
+      : frameCount_(frameCount),
+        pixelSequence_(pixelSequence),
+        offsetList_(offsetList),
+        fragmentSize_(fragmentSize),
+        compressedFrames_(new HtJ2kFragmentOutfile[frameCount]),
+        compressedFrameDone_(frameCount, 0),
+        frameLengths_(frameCount, 0),
+        nextFrameToStore_(0),
+        compressedSize_(0),
+        storeResult_(EC_Normal),
+        mutex_() {}
+
+  virtual ~EncodeFramesTask() { delete[] compressedFrames_; }
+
+  virtual OFCondition execute(size_t index) {
+    DCMTKHTJ2K_DEBUG("HT-J2K encoder processes frame " << (index + 1) << " of "
+                                                       << frameCount_);
+    compressedFrames_[index].open(fragmentSize_);
+    OFCondition result = compressFrame(index, compressedFrames_[index]);
+    if (result.good()) result = store(index);
+    return result;
+  }
+
+  /// returns the accumulated size of all compressed frames stored so far
+  Uint64 getCompressedSize() const { return compressedSize_; }
+
+  /// returns the length of every compressed frame stored so far
+  OFVector<Uint64> const &getFrameLengths() const { return frameLengths_; }
+
+ protected:
+  /** compresses a single frame.
+   *  @param index frame index
+   *  @param compressedFrame output file receiving the compressed frame
+   *  @return EC_Normal if successful, an error code otherwise
+   */
+  virtual OFCondition compressFrame(size_t index,
+                                    ojph::outfile_base &compressedFrame) = 0;
+
+ private:
+  /// stores all compressed frames whose predecessors have been stored
+  OFCondition store(size_t index) {
+    mutex_.lock();
+    compressedFrameDone_[index] = 1;
+    while (storeResult_.good() && (nextFrameToStore_ < frameCount_) &&
+           compressedFrameDone_[nextFrameToStore_]) {
+      HtJ2kFragmentOutfile &compressedFrame =
+          compressedFrames_[nextFrameToStore_];
+      Uint64 const compressedLen = compressedFrame.getLength();
+      storeResult_ = compressedFrame.store(pixelSequence_, offsetList_);
+      compressedSize_ += compressedLen;
+      frameLengths_[nextFrameToStore_] = compressedLen;
+      ++nextFrameToStore_;
+    }
+    OFCondition result = storeResult_;
+    mutex_.unlock();
+    return result;
+  }
+
+  size_t frameCount_;
+  DcmPixelSequence *pixelSequence_;
+  DcmOffsetList &offsetList_;
+  Uint32 fragmentSize_;
+  HtJ2kFragmentOutfile *compressedFrames_;
+  OFVector<Uint8> compressedFrameDone_;
+  OFVector<Uint64> frameLengths_;
+  size_t nextFrameToStore_;
+  Uint64 compressedSize_;
+  OFCondition storeResult_;
+  OFMutex mutex_;
+};
+
+/** stages of the pipeline compressing the frames of the uncompressed pixel
+ *  data with the raw encoder. The samples of a frame are prepared while
+ *  the preceding frames are compressed, and the compressed frames are
+ *  stored in the pixel sequence and the offset list in frame order. The
+ *  result is therefore identical to compressing the frames serially.
+ */
+class HtJ2kEncoderBase::RawEncodeStages : public HtJ2kPipelineStages {
+ public:
+  RawEncodeStages(HtJ2kEncoderBase const &encoder, Uint8 const *pixelData,
+                  size_t frameSize, size_t frameCount, Uint16 bitsAllocated,
+                  Uint16 bitsStored, Uint16 highBit, Uint16 nominalPrecision,
+                  Uint16 columns, Uint16 rows, Uint16 samplesPerPixel,
+                  Uint16 planarConfiguration, Uint16 pixelRepresentation,
+                  OFString const &photometricInterpretation,
+                  DcmPixelSequence *pixelSequence, DcmOffsetList &offsetList,
+                  HtJ2kCodecParameter const *djcp,
+                  HtJ2kRepresentationParameter const *djrp,
+                  OFBool convertAhead, Uint16 numberOfTileThreads)
+      : encoder_(encoder),
+        pixelData_(pixelData),
+        frameSize_(frameSize),
+        frameCount_(frameCount),
+        bitsAllocated_(bitsAllocated),
+        bitsStored_(bitsStored),
+        highBit_(highBit),
+        nominalPrecision_(nominalPrecision),
+        columns_(columns),
+        rows_(rows),
+        samplesPerPixel_(samplesPerPixel),
+        planarConfiguration_(planarConfiguration),
+        pixelRepresentation_(pixelRepresentation),
+        photometricInterpretation_(photometricInterpretation),
+        pixelSequence_(pixelSequence),
+        offsetList_(offsetList),
+        djcp_(djcp),
+        djrp_(djrp),
+        convertAhead_(convertAhead),
+        numberOfTileThreads_(numberOfTileThreads),
+        frameLengths_(frameCount, 0),
+        compressedSize_(0),
+        contexts_() {}
+
+  virtual HtJ2kPipelineItem *createItem() { return new FrameItem(); }
+
+  virtual OFCondition prepare(size_t index, HtJ2kPipelineItem &item) {
+    FrameItem &frame = OFstatic_cast(FrameItem &, item);
+    return encoder_.prepareRawFrame(
+        pixelData_ + index * frameSize_, bitsAllocated_, bitsStored_,
+        highBit_, nominalPrecision_, columns_, rows_, samplesPerPixel_,
+        planarConfiguration_, pixelRepresentation_, photometricInterpretation_,
+        convertAhead_, frame.rawFrame, djcp_, djrp_);
+  }
+
+  virtual OFCondition process(size_t index, HtJ2kPipelineItem &item) {
+    DCMTKHTJ2K_DEBUG("HT-J2K encoder processes frame " << (index + 1) << " of "
+                                                       << frameCount_);
+    FrameItem &frame = OFstatic_cast(FrameItem &, item);
+    frame.compressedFrame.open(fragmentSizeFor(djcp_, djrp_));
+    return encoder_.compressRawFrame(frame.rawFrame, frame.compressedFrame,
+                                     contexts_, djcp_, djrp_,
+                                     numberOfTileThreads_);
+  }
+
+  virtual OFCondition finish(size_t index, HtJ2kPipelineItem &item) {
+    FrameItem &frame = OFstatic_cast(FrameItem &, item);
+    Uint64 const compressedLen = frame.compressedFrame.getLength();
+    OFCondition result =
+        frame.compressedFrame.store(pixelSequence_, offsetList_);
+    compressedSize_ += compressedLen;
+    frameLengths_[index] = compressedLen;
+    return result;
+  }
+
+  /// returns the accumulated size of all compressed frames stored so far
+  Uint64 getCompressedSize() const { return compressedSize_; }
+
+  /// returns the length of every compressed frame stored so far
+  OFVector<Uint64> const &getFrameLengths() const { return frameLengths_; }
+
+ private:
+  /// frame passed through the stages, reused for later frames
+  struct FrameItem : public HtJ2kPipelineItem {
+    /// samples of the frame
+    HtJ2kRawFrame rawFrame;
+
+    /// output file receiving the compressed frame
+    HtJ2kFragmentOutfile compressedFrame;
+  };
+
+  HtJ2kEncoderBase const &encoder_;
+  Uint8 const *pixelData_;
+  size_t frameSize_;
+  size_t frameCount_;
+  Uint16 bitsAllocated_;
+  Uint16 bitsStored_;
+  Uint16 highBit_;
+  Uint16 nominalPrecision_;
+  Uint16 columns_;
+  Uint16 rows_;
+  Uint16 samplesPerPixel_;
+  Uint16 planarConfiguration_;
+  Uint16 pixelRepresentation_;
+  OFString const &photometricInterpretation_;
+  DcmPixelSequence *pixelSequence_;
+  DcmOffsetList &offsetList_;
+  HtJ2kCodecParameter const *djcp_;
+  HtJ2kRepresentationParameter const *djrp_;
+  OFBool convertAhead_;
+  Uint16 numberOfTileThreads_;
+  OFVector<Uint64> frameLengths_;
+  Uint64 compressedSize_;
+  HtJ2kEncoderContextPool contexts_;
+};
+
+/** task compressing the frames of a DicomImage with the rendered encoder.
+ */
+class HtJ2kEncoderBase::RenderedEncodeFramesTask
+    : public HtJ2kEncoderBase::EncodeFramesTask {
+ public:
+  RenderedEncodeFramesTask(HtJ2kEncoderBase const &encoder, DicomImage *dimage,
+                           size_t frameCount,
+                           OFString const &photometricInterpretation,
+                           DcmPixelSequence *pixelSequence,
+                           DcmOffsetList &offsetList,
+                           HtJ2kCodecParameter const *djcp,
+                           HtJ2kRepresentationParameter const *djrp,
+                           Uint16 numberOfTrials, double quantizationStep)
+      : EncodeFramesTask(frameCount, pixelSequence, offsetList,
+                         fragmentSizeFor(djcp, djrp)),
+        encoder_(encoder),
+        dimage_(dimage),
+        photometricInterpretation_(photometricInterpretation),
+        djcp_(djcp),
+        djrp_(djrp),
+        numberOfTrials_(numberOfTrials),
+        quantizationStep_(quantizationStep),
+        quantizationMutex_(),
+        contexts_() {}
+
+  /// returns the quantization step found for the most recently compressed
+  /// frame, 0 if none was searched
+  double getQuantizationStep() {
+    quantizationMutex_.lock();
+    double const quantizationStep = quantizationStep_;
+    quantizationMutex_.unlock();
+    return quantizationStep;
+  }
+
+ protected:
+  virtual OFCondition compressFrame(size_t index,
+                                    ojph::outfile_base &compressedFrame) {
+    // the rate control search starts with the quantization step of the
+    // frame compressed last, which is usually close to the one needed
+    double quantizationStep = getQuantizationStep();
+    OFCondition result = encoder_.compressRenderedFrame(
+        dimage_, photometricInterpretation_, compressedFrame, contexts_,
+        djcp_, OFstatic_cast(Uint32, index), djrp_, numberOfTrials_,
+        quantizationStep);
+    if (result.good()) {
+      quantizationMutex_.lock();
+      quantizationStep_ = quantizationStep;
+      quantizationMutex_.unlock();
+    }
+    return result;
+  }
+
+ private:
+  HtJ2kEncoderBase const &encoder_;
+  DicomImage *dimage_;
+  OFString const &photometricInterpretation_;
+  HtJ2kCodecParameter const *djcp_;
+  HtJ2kRepresentationParameter const *djrp_;
+  Uint16 numberOfTrials_;
+  double quantizationStep_;
+  OFMutex quantizationMutex_;
+  HtJ2kEncoderContextPool contexts_;
+};
+
 E_TransferSyntax HtJ2kLosslessEncoder::supportedTransferSyntax() const {
   return EXS_HighThroughputJPEG2000LosslessOnly;
 }
@@ -154,12 +917,16 @@ OFCondition HtJ2kEncoderBase::encode(
       supportedTransferSyntax() ==
           EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly ||
       djrp->useLosslessProcess()) {
-    if (djcp->cookedEncodingPreferred())
+    if (!djcp->cookedEncodingPreferred())
+      result = losslessRawEncode(pixelData, length, dataset, djrp, pixSeq, djcp,
+                                 compressionRatio, OFFalse);
+    else if (canExtractStoredBits(dataset))
+      // same pixel values as the "cooked" encoder, without rendering
+      result = losslessRawEncode(pixelData, length, dataset, djrp, pixSeq, djcp,
+                                 compressionRatio, OFTrue);
+    else
       result = RenderedEncode(pixelData, length, dataset, djrp, pixSeq, djcp,
                               compressionRatio);
-    else
-      result = losslessRawEncode(pixelData, length, dataset, djrp, pixSeq, djcp,
-                                 compressionRatio);
   } else {
     // near-lossless mode always uses the "cooked" encoder since this one is
     // guaranteed not to "mix" overlays and pixel data in one cell subjected to
@@ -349,13 +1116,64 @@ OFCondition HtJ2kEncoderBase::updateLossyCompressionRatio(DcmItem *dataset,
                                      m.c_str());
 }
 
+OFCondition HtJ2kEncoderBase::updateScaledSampleAttributes(DcmItem *dataset,
+                                                           int depth,
+                                                           int bits) const {
+  if (dataset == NULL) return EC_IllegalCall;
+
+  // scaled sample = original sample * factor
+  double const factor = ldexp(1.0, bits - depth);
+  char buf[64];
+  OFCondition result = EC_Normal;
+
+  Float64 slope = 1.0;
+  if (dataset->findAndGetFloat64(DCM_RescaleSlope, slope).good()) {
+    // keep the rescaled values, to which the VOI windows refer
+    OFStandard::ftoa(buf, sizeof(buf), slope / factor,
+                     OFStandard::ftoa_uppercase, 0, 8);
+    result = dataset->putAndInsertString(DCM_RescaleSlope, buf);
+  } else {
+    // without rescaling the VOI windows and LUTs refer to the samples. A VOI
+    // LUT cannot be scaled, so it is removed.
+    dataset->findAndDeleteElement(DCM_VOILUTSequence);
+    DcmTagKey const windowTags[] = {DCM_WindowCenter, DCM_WindowWidth};
+    for (size_t t = 0; (t < 2) && result.good(); ++t) {
+      OFString values;
+      Float64 value = 0.0;
+      for (unsigned long v = 0;
+           dataset->findAndGetFloat64(windowTags[t], value, v).good(); ++v) {
+        OFStandard::ftoa(buf, sizeof(buf), value * factor,
+                         OFStandard::ftoa_uppercase, 0, 8);
+        if (v > 0) values += "\\";
+        values += buf;
+      }
+      if (!values.empty())
+        result = dataset->putAndInsertOFStringArray(windowTags[t], values);
+    }
+  }
+
+  // specific sample values of the original image
+  if (result.good()) {
+    dataset->findAndDeleteElement(DCM_SmallestImagePixelValue);
+    dataset->findAndDeleteElement(DCM_LargestImagePixelValue);
+    dataset->findAndDeleteElement(DCM_SmallestPixelValueInSeries);
+    dataset->findAndDeleteElement(DCM_LargestPixelValueInSeries);
+    dataset->findAndDeleteElement(DCM_PixelPaddingValue);
+    dataset->findAndDeleteElement(DCM_PixelPaddingRangeLimit);
+  }
+  return result;
+}
+
 OFCondition HtJ2kEncoderBase::updateDerivationDescription(
     DcmItem *dataset, HtJ2kRepresentationParameter const *djrp,
     double ratio) const {
   OFString derivationDescription;
   char buf[64];
 
-  derivationDescription = "HT-J2K lossy compression, factor ";
+  if (djrp->getMaximumError() > 0)
+    derivationDescription = "HT-J2K near-lossless compression, factor ";
+  else
+    derivationDescription = "HT-J2K lossy compression, factor ";
   OFStandard::ftoa(buf, sizeof(buf), ratio, OFStandard::ftoa_uppercase, 0, 5);
   derivationDescription += buf;
 
@@ -382,15 +1200,125 @@ OFCondition HtJ2kEncoderBase::updateDerivationDescription(
   return result;
 }
 
+OFCondition HtJ2kEncoderBase::createOffsetTables(
+    DcmItem *dataset, DcmPixelItem *offsetTable,
+    DcmOffsetList const &offsetList, OFVector<Uint64> const &frameLengths,
+    unsigned long numberOfFragments, HtJ2kCodecParameter const *djcp) const {
+  // the offset tables of the original representation do not apply to the
+  // new pixel sequence
+  dataset->findAndDeleteElement(DCM_ExtendedOffsetTable);
+  dataset->findAndDeleteElement(DCM_ExtendedOffsetTableLengths);
+  if (!djcp->getCreateOffsetTable()) return EC_Normal;
+
+  // compute the offset of every frame, relative to the first fragment
+  OFVector<Uint64> offsets;
+  offsets.reserve(frameLengths.size());
+  Uint64 offset = 0;
+  OFListConstIterator(Uint32) first = offsetList.begin();
+  OFListConstIterator(Uint32) last = offsetList.end();
+  while (first != last) {
+    offsets.push_back(offset);
+    offset += *first;
+    ++first;
+  }
+  if (offsets.size() != frameLengths.size()) return EC_IllegalCall;
+
+  // the Basic Offset Table is limited to 32-bit offsets, the Extended Offset
+  // Table may only be used if every frame is a single fragment
+  OFBool const fitsBasicOffsetTable =
+      offsets.empty() || (offsets.back() <= 0xFFFFFFFFUL);
+  if (!djcp->getCreateExtendedOffsetTable() && fitsBasicOffsetTable)
+    return offsetTable->createOffsetTable(offsetList);
+  if (numberOfFragments != frameLengths.size()) {
+    if (fitsBasicOffsetTable) {
+      DCMTKHTJ2K_WARN("HT-J2K encoder cannot create an Extended Offset Table "
+                      "for frames split into several fragments, creating a "
+                      "Basic Offset Table instead");
+      return offsetTable->createOffsetTable(offsetList);
+    }
+    DCMTKHTJ2K_WARN("HT-J2K encoder cannot create an offset table for frames "
+                    "split into several fragments with offsets exceeding 32 "
+                    "bits, leaving the Basic Offset Table empty");
+    return EC_Normal;
+  }
+
+  DCMTKHTJ2K_DEBUG("HT-J2K encoder creates Extended Offset Table for "
+                   << offsets.size() << " frame(s)");
+  DcmOther64bitVeryLong *extendedOffsetTable =
+      new DcmOther64bitVeryLong(DcmTag(DCM_ExtendedOffsetTable, EVR_OV));
+  OFCondition result = extendedOffsetTable->putUint64Array(
+      &offsets[0], OFstatic_cast(unsigned long, offsets.size()));
+  if (result.good())
+    result = dataset->insert(extendedOffsetTable, OFTrue /*replaceOld*/);
+  else
+    delete extendedOffsetTable;
+  if (result.bad()) return result;
+
+  DcmOther64bitVeryLong *extendedOffsetTableLengths =
+      new DcmOther64bitVeryLong(DcmTag(DCM_ExtendedOffsetTableLengths, EVR_OV));
+  result = extendedOffsetTableLengths->putUint64Array(
+      &frameLengths[0], OFstatic_cast(unsigned long, frameLengths.size()));
+  if (result.good())
+    result = dataset->insert(extendedOffsetTableLengths, OFTrue /*replaceOld*/);
+  else
+    delete extendedOffsetTableLengths;
+  return result;
+}
+
+OFBool HtJ2kEncoderBase::canExtractStoredBits(DcmItem *dataset) const {
+  OFString photometricInterpretation;
+  Uint16 samplesPerPixel = 0;
+  Uint16 bitsAllocated = 0;
+  Uint16 bitsStored = 0;
+  Uint16 highBit = 0;
+  Uint16 pixelRepresentation = 0;
+  if (dataset->findAndGetOFString(DCM_PhotometricInterpretation,
+                                  photometricInterpretation)
+          .bad() ||
+      dataset->findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel).bad() ||
+      dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated).bad() ||
+      dataset->findAndGetUint16(DCM_BitsStored, bitsStored).bad() ||
+      dataset->findAndGetUint16(DCM_HighBit, highBit).bad())
+    return OFFalse;
+  dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+
+  if ((bitsAllocated != 8) && (bitsAllocated != 16)) return OFFalse;
+  if ((bitsStored < 1) || (highBit >= bitsAllocated) ||
+      (highBit + 1 < bitsStored))
+    return OFFalse;
+
+  if (photometricInterpretation == "MONOCHROME1" ||
+      photometricInterpretation == "MONOCHROME2") {
+    if (samplesPerPixel != 1) return OFFalse;
+  } else if (photometricInterpretation == "RGB" ||
+             photometricInterpretation == "YBR_FULL") {
+    // DicomImage converts signed color samples to unsigned ones
+    if ((samplesPerPixel != 3) || (pixelRepresentation != 0)) return OFFalse;
+  } else {
+    return OFFalse;
+  }
+
+  // overlays embedded in the pixel data must be moved to (60xx,3000), which
+  // requires a DicomImage
+  for (Uint16 group = 0x6000; group <= 0x601e; group += 2) {
+    if (dataset->tagExists(DcmTagKey(group, 0x0010)) &&
+        !dataset->tagExists(DcmTagKey(group, 0x3000)))
+      return OFFalse;
+  }
+  return OFTrue;
+}
+
 OFCondition HtJ2kEncoderBase::losslessRawEncode(
     Uint16 const *pixelData, Uint32 const length, DcmItem *dataset,
     HtJ2kRepresentationParameter const *djrp, DcmPixelSequence *&pixSeq,
-    HtJ2kCodecParameter const *djcp, double &compressionRatio) const {
+    HtJ2kCodecParameter const *djcp, double &compressionRatio,
+    OFBool extractStoredBits) const {
   compressionRatio = 0.0;  // initialize if something goes wrong
 
   // determine image properties
   Uint16 bitsAllocated = 0;
   Uint16 bitsStored = 0;
+  Uint16 highBit = 0;
   Uint16 bytesAllocated = 0;
   Uint16 samplesPerPixel = 0;
   Uint16 planarConfiguration = 0;
@@ -411,6 +1339,16 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
   if (result.good()) result = dataset->findAndGetUint16(DCM_Rows, rows);
   if (result.good())
     dataset->findAndGetUint16(DCM_PixelRepresentation, pixelRepresentation);
+  if (result.good()) {
+    // High Bit is only required for extracting the stored bits, otherwise
+    // the complete pixel cell is compressed
+    OFCondition const highBitResult =
+        dataset->findAndGetUint16(DCM_HighBit, highBit);
+    if (extractStoredBits)
+      result = highBitResult;
+    else if (highBitResult.bad() || (highBit >= bitsAllocated))
+      highBit = bitsAllocated - 1;
+  }
   if (result.good())
     result = dataset->findAndGetOFString(DCM_PhotometricInterpretation,
                                          photometricInterpretation);
@@ -453,8 +1391,8 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
       result = EC_HTJ2KUnsupportedImageType;
 
     // make sure that we have at least as many bytes of pixel data as we expect
-    if (bytesAllocated * samplesPerPixel * columns * rows *
-            OFstatic_cast(unsigned long, numberOfFrames) >
+    if (OFstatic_cast(Uint64, bytesAllocated) * samplesPerPixel * columns *
+            rows * OFstatic_cast(Uint64, numberOfFrames) >
         length)
       result = EC_HTJ2KUncompressedBufferTooSmall;
   }
@@ -478,11 +1416,11 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
   }
 
   DcmOffsetList offsetList;
-  unsigned long compressedSize = 0;
-  unsigned long compressedFrameSize = 0;
+  OFVector<Uint64> frameLengths;
+  Uint64 compressedSize = 0;
   double uncompressedSize = 0.0;
 
-  // render and compress each frame
+  // compress each frame
   if (result.good()) {
     // byte swap pixel data to little endian if bits allocate is 8
     if ((gLocalByteOrder == EBO_BigEndian) && (bitsAllocated == 8)) {
@@ -493,25 +1431,39 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
     }
 
     unsigned long frameCount = OFstatic_cast(unsigned long, numberOfFrames);
-    unsigned long frameSize = columns * rows * samplesPerPixel * bytesAllocated;
-    Uint8 const *framePointer = OFreinterpret_cast(Uint8 const *, pixelData);
+    size_t frameSize = OFstatic_cast(size_t, columns) * rows * samplesPerPixel *
+                       bytesAllocated;
 
     // compute original image size in bytes, ignoring any padding bits.
-    uncompressedSize =
-        columns * rows * samplesPerPixel * bitsStored * frameCount / 8.0;
-
-    for (unsigned long i = 0; (i < frameCount) && (result.good()); ++i) {
-      // compress frame
-      DCMTKHTJ2K_DEBUG("HT-J2K encoder processes frame " << (i + 1) << " of "
-                                                         << frameCount);
-      result = compressRawFrame(
-          framePointer, bitsAllocated, columns, rows, samplesPerPixel,
-          planarConfiguration, pixelRepresentation, photometricInterpretation,
-          pixelSequence, offsetList, compressedFrameSize, djcp, djrp);
-
-      compressedSize += compressedFrameSize;
-      framePointer += frameSize;
-    }
+    uncompressedSize = OFstatic_cast(double, columns) * rows *
+                       samplesPerPixel * bitsStored * frameCount / 8.0;
+
+    // threads not needed for the frames compress the tiles of each frame
+    Uint16 const numberOfThreads =
+        HtJ2kParallelLoop::resolveThreadCount(djcp->getNumberOfThreads());
+    Uint16 numberOfTileThreads = 1;
+    if ((frameCount > 0) && (numberOfThreads > frameCount))
+      numberOfTileThreads = OFstatic_cast(Uint16, numberOfThreads / frameCount);
+
+    // the samples of a frame are converted ahead of its compression if
+    // other threads compress the preceding frames meanwhile
+    OFBool const convertAhead = (frameCount > 1) && (numberOfThreads > 1);
+
+    // unless the stored bits are extracted, the complete pixel cell is
+    // compressed, with the precision of High Bit if the bits above it are
+    // not used
+    RawEncodeStages stages(
+        *this, OFreinterpret_cast(Uint8 const *, pixelData), frameSize,
+        frameCount, bitsAllocated,
+        extractStoredBits ? bitsStored : bitsAllocated,
+        extractStoredBits ? highBit : bitsAllocated - 1,
+        extractStoredBits ? bitsStored : highBit + 1, columns, rows,
+        samplesPerPixel, planarConfiguration, pixelRepresentation,
+        photometricInterpretation, pixelSequence, offsetList, djcp, djrp,
+        convertAhead, numberOfTileThreads);
+    result = HtJ2kFramePipeline::run(stages, frameCount, numberOfThreads);
+    compressedSize = stages.getCompressedSize();
+    frameLengths = stages.getFrameLengths();
   }
 
   // store pixel sequence if everything went well.
@@ -523,12 +1475,21 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
   }
 
   // create offset table
-  if ((result.good()) && (djcp->getCreateOffsetTable())) {
-    result = offsetTable->createOffsetTable(offsetList);
+  if (result.good()) {
+    result = createOffsetTables(dataset, offsetTable, offsetList, frameLengths,
+                                pixelSequence->card() - 1, djcp);
   }
 
   if (compressedSize > 0) compressionRatio = uncompressedSize / compressedSize;
 
+  // the stored bits are compressed like by the rendered encoder
+  if (result.good() && extractStoredBits) {
+    result = dataset->putAndInsertUint16(DCM_BitsAllocated,
+                                         (bitsStored > 8) ? 16 : 8);
+    if (result.good())
+      result = dataset->putAndInsertUint16(DCM_HighBit, bitsStored - 1);
+  }
+
   // update photometric interpretation for color images
   if (result.good() && photometricInterpretation == "RGB") {
     result = dataset->putAndInsertString(
@@ -546,135 +1507,594 @@ OFCondition HtJ2kEncoderBase::losslessRawEncode(
   return result;
 }
 
-OFCondition HtJ2kEncoderBase::compressRawFrame(
-    Uint8 const *framePointer, Uint16 bitsAllocated, Uint16 width,
-    Uint16 height, Uint16 samplesPerPixel, Uint16 planarConfiguration,
-    OFBool pixelRepresentation, OFString const &photometricInterpretation,
-    DcmPixelSequence *pixelSequence, DcmOffsetList &offsetList,
-    unsigned long &compressedSize, HtJ2kCodecParameter const *djcp,
+void HtJ2kEncoderBase::configureCodestream(
+    ojph::codestream &codestream, Uint16 columns, Uint16 rows,
+    Uint16 samplesPerPixel, Uint16 bitsAllocated, OFBool isSigned,
+    OFBool colorTransform, HtJ2kCodecParameter const *djcp,
     HtJ2kRepresentationParameter const *djrp) const {
-  OFCondition result = EC_Normal;
-  Uint16 bytesAllocated = bitsAllocated / 8;
-  Uint32 frameSize = width * height * bytesAllocated * samplesPerPixel;
-  Uint32 fragmentSize = djcp->getFragmentSize();
-
-  try {
-    ojph::codestream codestream;
-    ojph::mem_outfile destinationBuffer;
-
-    // Apply color transform only for RGB input
-    bool colorTransform = (photometricInterpretation == "RGB");
-    codestream.set_planar(colorTransform == false);
-    codestream.set_tilepart_divisions(true, false);
-    codestream.request_tlm_marker(true);
-
-    ojph::param_siz siz = codestream.access_siz();
-    siz.set_image_extent(ojph::point(width, height));
-    siz.set_num_components(samplesPerPixel);
-    for (Uint16 c = 0; c < samplesPerPixel; c++) {
-      siz.set_component(c, ojph::point(1, 1), bitsAllocated,
-                        pixelRepresentation == 1 ? true : false);
-    }
-    siz.set_image_offset(ojph::point(0, 0));
-    siz.set_tile_size(ojph::size(0, 0));
-    siz.set_tile_offset(ojph::point(0, 0));
-
-    ojph::param_cod cod = codestream.access_cod();
-
-    std::string progressionOrder = "LRCP";
-    if (djcp->getUseCustomOptions()) {
-      HTJ2K_ProgressionOrder po = djcp->get_progressionOrder();
-      if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_LRCP) {
-        progressionOrder = "LRCP";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RLCP) {
-        progressionOrder = "RLCP";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RPCL) {
-        progressionOrder = "RPCL";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_PCRL) {
-        progressionOrder = "PCRL";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_CPRL) {
-        progressionOrder = "CPRL";
-      }
-    }
-    if (supportedTransferSyntax() ==
-        EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly) {
+  codestream.set_planar(colorTransform == false);
+  codestream.set_tilepart_divisions(true, false);
+  codestream.request_tlm_marker(true);
+
+  ojph::param_siz siz = codestream.access_siz();
+  siz.set_image_extent(ojph::point(columns, rows));
+  siz.set_num_components(samplesPerPixel);
+  for (Uint16 c = 0; c < samplesPerPixel; c++) {
+    siz.set_component(c, ojph::point(1, 1), bitsAllocated,
+                      isSigned ? true : false);
+  }
+  siz.set_image_offset(ojph::point(0, 0));
+  siz.set_tile_size(ojph::size(0, 0));
+  siz.set_tile_offset(ojph::point(0, 0));
+
+  ojph::param_cod cod = codestream.access_cod();
+
+  // the encoding options of the representation parameter take precedence
+  // over those of the codec parameters
+  OFBool const representationOptions = djrp->hasEncodingOptions();
+  OFBool const customOptions =
+      representationOptions || djcp->getUseCustomOptions();
+
+  std::string progressionOrder = "LRCP";
+  if (customOptions) {
+    HTJ2K_ProgressionOrder po = representationOptions
+                                    ? djrp->getProgressionOrder()
+                                    : djcp->get_progressionOrder();
+    if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_LRCP) {
+      progressionOrder = "LRCP";
+    } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RLCP) {
+      progressionOrder = "RLCP";
+    } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RPCL) {
       progressionOrder = "RPCL";
+    } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_PCRL) {
+      progressionOrder = "PCRL";
+    } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_CPRL) {
+      progressionOrder = "CPRL";
     }
+  }
+  if (supportedTransferSyntax() ==
+      EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly) {
+    progressionOrder = "RPCL";
+  }
 
-    cod.set_progression_order(progressionOrder.c_str());
-    cod.set_color_transform(colorTransform);
-    if (djcp->getUseCustomOptions()) {
-      cod.set_block_dims(djcp->get_cblkwidth(), djcp->get_cblkheight());
-    }
+  cod.set_progression_order(progressionOrder.c_str());
+  cod.set_color_transform(colorTransform ? true : false);
+  if (representationOptions) {
+    cod.set_block_dims(djrp->getCodeBlockWidth(), djrp->getCodeBlockHeight());
+  } else if (customOptions) {
+    cod.set_block_dims(djcp->get_cblkwidth(), djcp->get_cblkheight());
+  }
+  cod.set_reversible(djrp->useLosslessProcess());
+
+  unsigned int numberOfDecompositions = 0;
+  size_t tw = columns;
+  size_t th = rows;
+  while (tw > 64 && th > 64) {
+    numberOfDecompositions++;
+    tw = static_cast<size_t>(ceil(tw / 2));
+    th = static_cast<size_t>(ceil(th / 2));
+  }
+  cod.set_num_decomposition(
+      numberOfDecompositions > 6 ? 6 : numberOfDecompositions);
+  if (representationOptions) {
+    cod.set_num_decomposition(djrp->getDecompositions());
+  } else if (customOptions) {
+    cod.set_num_decomposition(djcp->get_decompositions());
+  }
+
+  // precinct sizes refer to the resolutions, thus to the decompositions
+  OFVector<Uint16> const &precinctSizes = djcp->getPrecinctSizes();
+  if (precinctSizes.empty()) {
     cod.set_precinct_size(0, nullptr);
-    cod.set_reversible(djrp->useLosslessProcess());
-
-    unsigned int numberOfDecompositions = 0;
-    size_t tw = width;
-    size_t th = height;
-    while (tw > 64 && th > 64) {
-      numberOfDecompositions++;
-      tw = static_cast<size_t>(ceil(tw / 2));
-      th = static_cast<size_t>(ceil(th / 2));
+  } else {
+    OFVector<ojph::size> sizes;
+    for (size_t i = 0; i < precinctSizes.size(); i++)
+      sizes.push_back(ojph::size(precinctSizes[i], precinctSizes[i]));
+    cod.set_precinct_size(OFstatic_cast(int, sizes.size()), &sizes[0]);
+  }
+}
+
+/** copies a codestream into the compressed frame, inserting PLT marker
+ *  segments. If the packets of the codestream cannot be determined, it is
+ *  copied unchanged.
+ *  @param codestream codestream written by OpenJPH
+ *  @param compressedFrame compressed frame
+ *  @return EC_Normal if successful, an error code otherwise
+ */
+static OFCondition writePacketLengths(ojph::mem_outfile &codestream,
+                                      ojph::outfile_base &compressedFrame) {
+  Uint8 const *data = codestream.get_data();
+  size_t const size = OFstatic_cast(size_t, codestream.tell());
+  HtJ2kPacketLengthIndex index;
+  OFCondition result = index.parse(data, size);
+  if (result.good()) return index.write(data, compressedFrame);
+
+  DCMTKHTJ2K_WARN("HT-J2K encoder cannot determine the packet lengths, "
+                  "codestream written without PLT marker segments: "
+                  << result.text());
+  if (compressedFrame.write(data, size) != size) return EC_MemoryExhausted;
+  return EC_Normal;
+}
+
+/** determines the smallest precision that holds all samples of a range.
+ *  @param minimum smallest sample
+ *  @param maximum largest sample
+ *  @param isSigned true if the samples are signed
+ *  @param precision nominal precision of the samples
+ *  @return precision between 1 and the nominal precision
+ */
+static Uint16 rangePrecision(Sint32 minimum, Sint32 maximum, OFBool isSigned,
+                             Uint16 precision) {
+  // signed samples need one more bit for the sign
+  Uint16 bits = 1;
+  if (isSigned) {
+    while ((bits < precision) &&
+           ((minimum < -(OFstatic_cast(Sint32, 1) << (bits - 1))) ||
+            (maximum >= (OFstatic_cast(Sint32, 1) << (bits - 1)))))
+      bits++;
+  } else {
+    while ((bits < precision) &&
+           (maximum >= (OFstatic_cast(Sint32, 1) << bits)))
+      bits++;
+  }
+  return bits;
+}
+
+/** determines the smallest precision that holds all samples of a frame.
+ *  @param kernels sample conversion kernels
+ *  @param samples samples of the frame
+ *  @param height number of rows
+ *  @param precision nominal precision of the samples
+ *  @return precision between 1 and the nominal precision
+ */
+static Uint16 fitPrecision(HtJ2kSampleKernels const &kernels,
+                           HtJ2kFrameSamples const &samples, Uint16 height,
+                           Uint16 precision) {
+  OFVector<ojph::si32> line(samples.width);
+  Sint32 minimum = 0;
+  Sint32 maximum = 0;
+  Uint16 const components = OFstatic_cast(Uint16, samples.rows.size());
+  for (Uint16 c = 0; c < components; c++) {
+    for (Uint32 y = 0; y < height; y++) {
+      samples.feed(kernels, c, y, &line[0]);
+      kernels.findRange(&line[0], samples.width, minimum, maximum);
     }
-    cod.set_num_decomposition(
-        numberOfDecompositions > 6 ? 6 : numberOfDecompositions);
-    if (djcp->getUseCustomOptions()) {
-      cod.set_num_decomposition(djcp->get_decompositions());
+  }
+  return rangePrecision(minimum, maximum, samples.isSigned, precision);
+}
+
+/** feeds all rows of a frame to the OpenJPH encoder.
+ *  @param codestream codestream whose headers have been written
+ *  @param kernels sample conversion kernels
+ *  @param samples samples of the frame
+ *  @param height number of rows
+ */
+static void feedCodestream(ojph::codestream &codestream,
+                           HtJ2kSampleKernels const &kernels,
+                           HtJ2kFrameSamples const &samples, Uint16 height) {
+  // OpenJPH requests the lines either row by row or, if the codestream is
+  // planar, component by component, so the row of each component is
+  // tracked separately
+  Uint16 const components = OFstatic_cast(Uint16, samples.rows.size());
+  ojph::ui32 next_comp;
+  OFVector<Uint32> nextRow(components, 0);
+  ojph::line_buf *cur_line = codestream.exchange(nullptr, next_comp);
+  Uint32 const lineCount = OFstatic_cast(Uint32, height) * components;
+  for (Uint32 i = 0; i < lineCount; i++) {
+    Uint16 const c = OFstatic_cast(Uint16, next_comp);
+    samples.feed(kernels, c, nextRow[c]++, cur_line->i32);
+    cur_line = codestream.exchange(cur_line, next_comp);
+  }
+}
+
+/** decodes a compressed frame and compares it with the original samples
+ *  in the same pass, measuring peak signal-to-noise ratio and maximum
+ *  absolute error.
+ *  @param kernels sample conversion kernels
+ *  @param samples original samples of the frame
+ *  @param rows frame height
+ *  @param precision number of bits coded per sample
+ *  @param data compressed frame
+ *  @param size length of the compressed frame
+ *  @param errorLimit the comparison stops as soon as the maximum error
+ *    exceeds this limit, leaving the PSNR undetermined. Negative for none.
+ *  @param psnr returns the PSNR in dB, very large if the frame is
+ *    reconstructed exactly
+ *  @param maximumError returns the maximum absolute error
+ */
+static void measureError(HtJ2kSampleKernels const &kernels,
+                         HtJ2kFrameSamples const &samples, Uint16 rows,
+                         Uint16 precision, ojph::ui8 const *data, size_t size,
+                         Sint32 errorLimit, double &psnr,
+                         Sint32 &maximumError) {
+  psnr = 0.0;
+  maximumError = 0;
+
+  ojph::codestream codestream;
+  ojph::mem_infile infile;
+  infile.open(data, size);
+  codestream.read_headers(&infile);
+  Uint16 const components = OFstatic_cast(Uint16, samples.rows.size());
+  if (components > 1) codestream.set_planar(false);
+  codestream.create();
+
+  // reconstructed samples are clamped like by the decoder
+  Sint32 const lowest =
+      samples.isSigned ? -(OFstatic_cast(Sint32, 1) << (precision - 1)) : 0;
+  Sint32 const highest =
+      (OFstatic_cast(Sint32, 1) << (samples.isSigned ? precision - 1
+                                                     : precision)) -
+      1;
+  OFVector<ojph::si32> original(samples.width);
+  OFVector<Uint32> nextRow(components, 0);
+  double squaredError = 0.0;
+  Uint32 const lineCount = OFstatic_cast(Uint32, rows) * components;
+  for (Uint32 i = 0; i < lineCount; i++) {
+    ojph::ui32 c;
+    ojph::line_buf *line = codestream.pull(c);
+    samples.feed(kernels, OFstatic_cast(Uint16, c), nextRow[c]++,
+                 &original[0]);
+    for (Uint16 x = 0; x < samples.width; x++) {
+      Sint32 value = line->i32[x];
+      if (value < lowest) value = lowest;
+      if (value > highest) value = highest;
+      Sint32 const error = value - original[x];
+      Sint32 const absoluteError = (error < 0) ? -error : error;
+      if (absoluteError > maximumError) maximumError = absoluteError;
+      squaredError += OFstatic_cast(double, error) * error;
     }
+    // the remaining lines cannot bring the error back within the limit
+    if ((errorLimit >= 0) && (maximumError > errorLimit)) return;
+  }
+  codestream.close();
 
-    destinationBuffer.open();
+  if (squaredError == 0.0) {
+    psnr = 1000.0;
+  } else {
+    double const meanSquaredError =
+        squaredError / (OFstatic_cast(double, samples.width) * lineCount);
+    double const peak = OFstatic_cast(double, highest - lowest);
+    psnr = 10.0 * log10(peak * peak / meanSquaredError);
+  }
+}
 
-    ojph::comment_exchange com_ex;
-    codestream.write_headers(&destinationBuffer, &com_ex, 0);
-
-    ojph::ui32 next_comp;
-    Uint16 const bytesPerPixel = bitsAllocated / 8;
-    ojph::line_buf *cur_line = codestream.exchange(nullptr, next_comp);
-    ojph::ui32 const imageHeight =
-        siz.get_image_extent().y - siz.get_image_offset().y;
-    for (ojph::ui32 y = 0; y < imageHeight; y++) {
-      for (ojph::ui32 c = 0; c < siz.get_num_components(); c++) {
-        ojph::si32 *dp = cur_line->i32;
-        if (bitsAllocated <= 8) {
-          Uint8 *sp = (Uint8 *)&framePointer[(y * width * bytesPerPixel *
-                                              siz.get_num_components()) +
-                                             c];
-          for (Uint16 x = 0; x < width; x++) {
-            *dp++ = *sp;
-            sp += siz.get_num_components();
-          }
-        } else {
-          if (pixelRepresentation == 1) {
-            Sint16 *sp = (Sint16 *)&framePointer[y * width * bytesPerPixel];
-            for (Uint16 x = 0; x < width; x++) {
-              *dp++ = *sp++;
-            }
-          } else {
-            Uint16 *sp = (Uint16 *)&framePointer[y * width * bytesPerPixel];
-            for (Uint16 x = 0; x < width; x++) {
-              *dp++ = *sp++;
-            }
-          }
+/** task compressing a frame with several quantization steps concurrently,
+ *  one per work item, and measuring size and, if requested, the error of
+ *  each.
+ */
+class HtJ2kEncoderBase::QuantizationTrialsTask : public HtJ2kParallelTask {
+ public:
+  QuantizationTrialsTask(HtJ2kEncoderBase const &encoder,
+                         HtJ2kFrameSamples const &samples, Uint16 rows,
+                         Uint16 precision, OFBool colorTransform,
+                         OFBool measureError, Sint32 errorLimit,
+                         size_t numberOfTrials,
+                         HtJ2kEncoderContextPool &contexts,
+                         HtJ2kCodecParameter const *djcp,
+                         HtJ2kRepresentationParameter const *djrp)
+      : encoder_(encoder),
+        samples_(samples),
+        rows_(rows),
+        precision_(precision),
+        colorTransform_(colorTransform),
+        measureError_(measureError),
+        errorLimit_(errorLimit),
+        contexts_(contexts),
+        djcp_(djcp),
+        djrp_(djrp),
+        compressedFrames_(new ojph::mem_outfile[numberOfTrials]),
+        exponents_(),
+        sizes_(numberOfTrials, 0),
+        psnr_(numberOfTrials, 0.0),
+        maximumErrors_(numberOfTrials, 0) {}
+
+  virtual ~QuantizationTrialsTask() { delete[] compressedFrames_; }
+
+  /// sets the quantization steps of the next trials as powers of two
+  void setExponents(OFVector<double> const &exponents) {
+    exponents_ = exponents;
+  }
+
+  virtual OFCondition execute(size_t index) {
+    ojph::mem_outfile &compressedFrame = compressedFrames_[index];
+    compressedFrame.close();
+    compressedFrame.open();
+    OFCondition result = encoder_.compressSamples(
+        samples_, rows_, precision_, colorTransform_,
+        OFstatic_cast(float, pow(2.0, exponents_[index])), 1,
+        compressedFrame, contexts_, djcp_, djrp_);
+    if (result.good()) {
+      sizes_[index] = OFstatic_cast(Uint64, compressedFrame.tell());
+      if (measureError_) {
+        try {
+          measureError(HtJ2kSampleKernels::best(), samples_, rows_,
+                       precision_, compressedFrame.get_data(),
+                       OFstatic_cast(size_t, sizes_[index]), errorLimit_,
+                       psnr_[index], maximumErrors_[index]);
+        } catch (std::exception &ex) {
+          DCMTKHTJ2K_ERROR("HT-J2K encoder caught OpenJPH exception: "
+                           << (ex.what() ? ex.what() : "Unknown reason"));
+          result = makeOFCondition(
+              1, OFM_dcmjp2k, OF_error,
+              ex.what() ? ex.what() : "Unknown OpenJPH exception");
         }
-        cur_line = codestream.exchange(cur_line, next_comp);
       }
     }
+    return result;
+  }
 
-    codestream.flush();
+  /// returns the size of a compressed trial
+  Uint64 getSize(size_t index) const { return sizes_[index]; }
+
+  /// returns the PSNR of a compressed trial, if measured
+  double getPSNR(size_t index) const { return psnr_[index]; }
+
+  /// returns the maximum absolute error of a compressed trial, if measured
+  Sint32 getMaximumError(size_t index) const { return maximumErrors_[index]; }
+
+  /// copies a compressed trial
+  void copyCompressedFrame(size_t index, OFVector<Uint8> &data) const {
+    Uint8 const *first = compressedFrames_[index].get_data();
+    data.assign(first, first + sizes_[index]);
+  }
+
+ private:
+  HtJ2kEncoderBase const &encoder_;
+  HtJ2kFrameSamples const &samples_;
+  Uint16 rows_;
+  Uint16 precision_;
+  OFBool colorTransform_;
+  OFBool measureError_;
+  Sint32 errorLimit_;
+  HtJ2kEncoderContextPool &contexts_;
+  HtJ2kCodecParameter const *djcp_;
+  HtJ2kRepresentationParameter const *djrp_;
+  ojph::mem_outfile *compressedFrames_;
+  OFVector<double> exponents_;
+  OFVector<Uint64> sizes_;
+  OFVector<double> psnr_;
+  OFVector<Sint32> maximumErrors_;
+};
+
+/** determines the geometry of the codestream of a tile of a frame.
+ *  @param samples samples of the frame
+ *  @param rows frame height
+ *  @param precision number of bits coded per sample
+ *  @param colorTransform true if the color transform should be applied
+ *  @param quantizationStep base quantization step of irreversible coding,
+ *    0 for the default of OpenJPH
+ *  @param tileSize width and height of the tiles, 0 for a single tile
+ *  @param tile tile index, in raster order
+ *  @return geometry of the codestream of the tile
+ */
+static HtJ2kCodestreamGeometry tileGeometry(HtJ2kFrameSamples const &samples,
+                                            Uint16 rows, Uint16 precision,
+                                            OFBool colorTransform,
+                                            float quantizationStep,
+                                            Uint16 tileSize, size_t tile) {
+  HtJ2kCodestreamGeometry geometry;
+  geometry.columns = samples.width;
+  geometry.rows = rows;
+  if (tileSize > 0) {
+    size_t const tilesPerRow = (samples.width + tileSize - 1) / tileSize;
+    geometry.left = OFstatic_cast(Uint16, (tile % tilesPerRow) * tileSize);
+    geometry.top = OFstatic_cast(Uint16, (tile / tilesPerRow) * tileSize);
+    geometry.columns = OFstatic_cast(Uint16, samples.width - geometry.left);
+    if (geometry.columns > tileSize) geometry.columns = tileSize;
+    geometry.rows = OFstatic_cast(Uint16, rows - geometry.top);
+    if (geometry.rows > tileSize) geometry.rows = tileSize;
+  }
+  geometry.tileSize = tileSize;
+  geometry.components = OFstatic_cast(Uint16, samples.rows.size());
+  geometry.precision = precision;
+  geometry.isSigned = samples.isSigned;
+  geometry.colorTransform = colorTransform;
+  geometry.quantizationStep = quantizationStep;
+  return geometry;
+}
+
+/** task compressing the tiles of a frame concurrently, each into a
+ *  codestream of its own.
+ */
+class HtJ2kEncoderBase::EncodeTilesTask : public HtJ2kParallelTask {
+ public:
+  EncodeTilesTask(HtJ2kEncoderBase const &encoder,
+                  HtJ2kFrameSamples const &samples, Uint16 rows,
+                  Uint16 precision, OFBool colorTransform,
+                  float quantizationStep, Uint16 tileSize,
+                  size_t numberOfTiles, HtJ2kEncoderContextPool &contexts,
+                  HtJ2kCodecParameter const *djcp,
+                  HtJ2kRepresentationParameter const *djrp)
+      : encoder_(encoder),
+        samples_(samples),
+        rows_(rows),
+        precision_(precision),
+        colorTransform_(colorTransform),
+        quantizationStep_(quantizationStep),
+        tileSize_(tileSize),
+        numberOfTiles_(numberOfTiles),
+        contexts_(contexts),
+        djcp_(djcp),
+        djrp_(djrp),
+        tileContexts_(numberOfTiles, NULL),
+        compressedTiles_(numberOfTiles, NULL) {}
+
+  /// destructor, returns the contexts of the tiles to the pool
+  virtual ~EncodeTilesTask() {
+    for (size_t i = 0; i < numberOfTiles_; i++) {
+      if (tileContexts_[i] != NULL) contexts_.release(tileContexts_[i]);
+    }
+  }
+
+  virtual OFCondition execute(size_t index) {
+    // the context keeps the compressed tile until the frame is assembled
+    HtJ2kEncoderContext *context = contexts_.acquire(
+        tileGeometry(samples_, rows_, precision_, colorTransform_,
+                     quantizationStep_, tileSize_, index));
+    tileContexts_[index] = context;
+    compressedTiles_[index] = &context->file();
+    return encoder_.compressTile(samples_, rows_, precision_, colorTransform_,
+                                 quantizationStep_, tileSize_, index,
+                                 *context, *compressedTiles_[index], djcp_,
+                                 djrp_);
+  }
+
+  /// assembles the compressed tiles into the codestream of the frame
+  OFCondition assemble(ojph::outfile_base &compressedFrame) const {
+    OFVector<Uint8 const *> tiles(numberOfTiles_);
+    OFVector<size_t> sizes(numberOfTiles_);
+    for (size_t i = 0; i < numberOfTiles_; i++) {
+      tiles[i] = compressedTiles_[i]->get_data();
+      sizes[i] = OFstatic_cast(size_t, compressedTiles_[i]->tell());
+    }
+    return HtJ2kTileIndex::assemble(tiles, sizes, samples_.width, rows_,
+                                    tileSize_, compressedFrame);
+  }
+
+ private:
+  HtJ2kEncoderBase const &encoder_;
+  HtJ2kFrameSamples const &samples_;
+  Uint16 rows_;
+  Uint16 precision_;
+  OFBool colorTransform_;
+  float quantizationStep_;
+  Uint16 tileSize_;
+  size_t numberOfTiles_;
+  HtJ2kEncoderContextPool &contexts_;
+  HtJ2kCodecParameter const *djcp_;
+  HtJ2kRepresentationParameter const *djrp_;
+  OFVector<HtJ2kEncoderContext *> tileContexts_;
+  OFVector<ojph::mem_outfile *> compressedTiles_;
+};
+
+OFCondition HtJ2kEncoderBase::compressSamples(
+    HtJ2kFrameSamples const &samples, Uint16 rows, Uint16 precision,
+    OFBool colorTransform, float quantizationStep, Uint16 numberOfThreads,
+    ojph::outfile_base &compressedFrame, HtJ2kEncoderContextPool &contexts,
+    HtJ2kCodecParameter const *djcp,
+    HtJ2kRepresentationParameter const *djrp) const {
+  OFCondition result = EC_Normal;
+
+  OFVector<Uint16> const &precinctSizes = djcp->getPrecinctSizes();
+  for (size_t i = 0; i < precinctSizes.size(); i++) {
+    Uint16 const size = precinctSizes[i];
+    if ((size < 2) || ((size & (size - 1)) != 0)) {
+      DCMTKHTJ2K_ERROR("HT-J2K precinct size must be a power of two, not "
+                       << size);
+      return EC_HTJ2KCodecInvalidParameters;
+    }
+  }
+  // the RPCL transfer syntax requires the packet lengths
+  OFBool const packetLengths =
+      djcp->getPacketLengthMarkers() ||
+      (supportedTransferSyntax() ==
+       EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly);
+
+  // a frame not larger than a tile is compressed as a single tile
+  Uint16 tileSize = djcp->getTileSize();
+  if ((tileSize >= samples.width) && (tileSize >= rows)) tileSize = 0;
+  size_t const numberOfTiles =
+      (tileSize == 0)
+          ? 1
+          : OFstatic_cast(size_t, (samples.width + tileSize - 1) / tileSize) *
+                ((rows + tileSize - 1) / tileSize);
+
+  // a single tile is compressed with the codestream of the context
+  HtJ2kEncoderContext *context =
+      contexts.acquire(tileGeometry(samples, rows, precision, colorTransform,
+                                    quantizationStep, 0, 0));
+
+  // with packet lengths, the codestream is written to memory first and
+  // copied into the compressed frame with the PLT marker segments
+  try {
+    ojph::mem_outfile *codestreamFile =
+        packetLengths ? &context->file() : NULL;
+    ojph::outfile_base &codestream =
+        packetLengths ? OFstatic_cast(ojph::outfile_base &, *codestreamFile)
+                      : compressedFrame;
+    if (numberOfTiles == 1) {
+      result = compressTile(samples, rows, precision, colorTransform,
+                            quantizationStep, 0, 0, *context, codestream,
+                            djcp, djrp);
+    } else {
+      DCMTKHTJ2K_DEBUG("HT-J2K encoder compresses " << numberOfTiles
+                                                    << " tiles");
+      EncodeTilesTask task(*this, samples, rows, precision, colorTransform,
+                           quantizationStep, tileSize, numberOfTiles,
+                           contexts, djcp, djrp);
+      result = HtJ2kParallelLoop::run(task, numberOfTiles, numberOfThreads);
+      if (result.good()) result = task.assemble(codestream);
+    }
+    if (result.good() && packetLengths)
+      result = writePacketLengths(*codestreamFile, compressedFrame);
+  } catch (std::exception &ex) {
+    DCMTKHTJ2K_ERROR("HT-J2K encoder caught OpenJPH exception: "
+                     << (ex.what() ? ex.what() : "Unknown reason"));
+    result =
+        makeOFCondition(1, OFM_dcmjp2k, OF_error,
+                        ex.what() ? ex.what() : "Unknown OpenJPH exception");
+  }
+  contexts.release(context);
 
-    // Get compressed data from mem_outfile
-    Uint8 *compressed_data =
-        const_cast<Uint8 *>((Uint8 const *)destinationBuffer.get_data());
+  return result;
+}
 
-    // Store compressed frame
-    unsigned long compressedLen = (unsigned long)destinationBuffer.tell();
-    compressedSize = compressedLen;
-    result = pixelSequence->storeCompressedFrame(offsetList, compressed_data,
-                                                 compressedLen, fragmentSize);
+OFCondition HtJ2kEncoderBase::compressTile(
+    HtJ2kFrameSamples const &samples, Uint16 rows, Uint16 precision,
+    OFBool colorTransform, float quantizationStep, Uint16 tileSize,
+    size_t tile, HtJ2kEncoderContext &context,
+    ojph::outfile_base &compressedTile, HtJ2kCodecParameter const *djcp,
+    HtJ2kRepresentationParameter const *djrp) const {
+  OFCondition result = EC_Normal;
+
+  // the samples of the tile start at its upper left corner
+  HtJ2kCodestreamGeometry const geometry =
+      tileGeometry(samples, rows, precision, colorTransform, quantizationStep,
+                   tileSize, tile);
+  Uint16 const left = geometry.left;
+  Uint16 const top = geometry.top;
+  HtJ2kFrameSamples tileSamples(samples);
+  if (tileSize > 0) {
+    size_t const bytesPerSample = (samples.bitsAllocated + 7) / 8;
+    size_t const pixelSize =
+        samples.interleaved ? bytesPerSample * samples.rows.size()
+                            : bytesPerSample;
+    for (size_t c = 0; c < tileSamples.rows.size(); c++)
+      tileSamples.rows[c] += top * samples.rowSize + left * pixelSize;
+    tileSamples.width = geometry.columns;
+  }
+
+  try {
+    // the number of decompositions follows from the size of the frame
+    ojph::codestream &codestream = context.codestream(geometry);
+    configureCodestream(codestream, samples.width, rows,
+                        OFstatic_cast(Uint16, samples.rows.size()), precision,
+                        samples.isSigned, colorTransform, djcp, djrp);
+    if (tileSize > 0) {
+      // the image is restricted to the tile, which is partitioned like in
+      // the frame, so that its tile-parts can be taken over unchanged
+      ojph::param_siz siz = codestream.access_siz();
+      siz.set_image_extent(
+          ojph::point(left + geometry.columns, top + geometry.rows));
+      siz.set_image_offset(ojph::point(left, top));
+      siz.set_tile_size(ojph::size(tileSize, tileSize));
+      siz.set_tile_offset(ojph::point(left, top));
+    }
+    if (!djrp->useLosslessProcess() && (quantizationStep > 0.0f))
+      codestream.access_qcd().set_irrev_quant(quantizationStep);
 
-    codestream.close();
+    ojph::comment_exchange com_ex;
+    codestream.write_headers(&compressedTile, &com_ex, 0);
+
+    feedCodestream(codestream, HtJ2kSampleKernels::best(), tileSamples,
+                   geometry.rows);
+
+    codestream.flush();
+    // the codestream is deliberately not closed, since this would also close
+    // the compressed frame buffer and release the compressed data. It is
+    // restarted for the next frame instead.
   } catch (std::exception &ex) {
+    context.reset();
     DCMTKHTJ2K_ERROR("HT-J2K encoder caught OpenJPH exception: "
                      << (ex.what() ? ex.what() : "Unknown reason"));
     result =
@@ -685,6 +2105,235 @@ OFCondition HtJ2kEncoderBase::compressRawFrame(
   return result;
 }
 
+OFCondition HtJ2kEncoderBase::compressRateControlledSamples(
+    HtJ2kFrameSamples const &samples, Uint16 rows, Uint16 precision,
+    OFBool colorTransform, Uint64 targetSize, Uint16 numberOfTrials,
+    double &quantizationStep, ojph::outfile_base &compressedFrame,
+    HtJ2kEncoderContextPool &contexts, HtJ2kCodecParameter const *djcp,
+    HtJ2kRepresentationParameter const *djrp) const {
+  // The quantization step is searched as power of two, coarser steps
+  // yielding smaller frames of lower quality. The exponent threshold between
+  // steps that are too fine and steps that are coarse enough for the target
+  // size (or, for a target PSNR, steps reaching it and steps missing it) is
+  // bracketed by the finest and coarsest trials on either side.
+  double const minimumExponent = -16.0;
+  double const maximumExponent = 0.0;
+  double const tolerance = 1.0 / 32.0;
+  int const maximumRounds = 16;
+  OFBool const sizeTarget = (targetSize > 0);
+  Sint32 const errorLimit =
+      (djrp->getMaximumError() > 0) ? djrp->getMaximumError() : -1;
+
+  if (numberOfTrials < 1) numberOfTrials = 1;
+  QuantizationTrialsTask task(*this, samples, rows, precision, colorTransform,
+                              !sizeTarget, sizeTarget ? -1 : errorLimit,
+                              numberOfTrials, contexts, djcp, djrp);
+
+  // start with the step of the previous frame or halfway through the bits
+  OFBool const warmStart = (quantizationStep > 0.0);
+  double anchor = warmStart ? log(quantizationStep) / log(2.0)
+                            : -0.5 * precision;
+  if (anchor < minimumExponent) anchor = minimumExponent;
+  if (anchor > maximumExponent) anchor = maximumExponent;
+  double stride = warmStart ? 0.125 : 0.5;
+
+  double fine = minimumExponent;
+  double coarse = maximumExponent;
+  OFBool fineKnown = OFFalse;
+  OFBool coarseKnown = OFFalse;
+  Uint64 coarseSize = 0;
+  OFVector<Uint8> fineData;
+  OFVector<Uint8> coarseData;
+  OFVector<double> exponents;
+  OFCondition result = EC_Normal;
+  for (int round = 0; (round < maximumRounds) && result.good(); ++round) {
+    if (fineKnown && coarseKnown && (coarse - fine <= tolerance)) break;
+    if (fineKnown && (fine >= maximumExponent)) break;
+    if (coarseKnown && (coarse <= minimumExponent)) break;
+    // a frame close below the target size needs no further search
+    if (sizeTarget && coarseKnown && (coarseSize >= targetSize * 0.98)) break;
+
+    // the trials are spread over the bracket once it is known, and move
+    // away from the known side with growing distance otherwise
+    exponents.clear();
+    for (Uint16 i = 0; i < numberOfTrials; ++i) {
+      double exponent;
+      if (fineKnown && coarseKnown) {
+        exponent = fine + (coarse - fine) * (i + 1) / (numberOfTrials + 1);
+      } else if (fineKnown) {
+        exponent = fine + stride;
+        stride *= 2.0;
+      } else if (coarseKnown) {
+        exponent = coarse - stride;
+        stride *= 2.0;
+      } else {
+        exponent = anchor + (i - (numberOfTrials - 1) / 2.0) * stride;
+      }
+      if (exponent < minimumExponent) exponent = minimumExponent;
+      if (exponent > maximumExponent) exponent = maximumExponent;
+      if (exponents.empty() || (exponents.back() != exponent))
+        exponents.push_back(exponent);
+    }
+
+    task.setExponents(exponents);
+    result = HtJ2kParallelLoop::run(task, exponents.size(), numberOfTrials);
+    for (size_t i = 0; (i < exponents.size()) && result.good(); ++i) {
+      OFBool fineSide;
+      if (sizeTarget)
+        fineSide = (task.getSize(i) > targetSize);
+      else if (errorLimit >= 0)
+        fineSide = (task.getMaximumError(i) <= errorLimit);
+      else
+        fineSide = (task.getPSNR(i) >= djrp->getTargetPSNR());
+      if (fineSide && (!fineKnown || (exponents[i] > fine))) {
+        fine = exponents[i];
+        fineKnown = OFTrue;
+        task.copyCompressedFrame(i, fineData);
+      } else if (!fineSide && (!coarseKnown || (exponents[i] < coarse))) {
+        coarse = exponents[i];
+        coarseKnown = OFTrue;
+        coarseSize = task.getSize(i);
+        task.copyCompressedFrame(i, coarseData);
+      }
+    }
+  }
+
+  if (result.good()) {
+    // a target size is met by the finest coarse enough step, a target PSNR
+    // or maximum error by the coarsest step reaching it. If no step meets
+    // the target, the closest one is used, except for a maximum error.
+    OFBool useCoarse = sizeTarget ? coarseKnown : !fineKnown;
+    if (!sizeTarget && !fineKnown && (errorLimit >= 0)) {
+      DCMTKHTJ2K_ERROR("HT-J2K encoder cannot keep the maximum error of "
+                       << errorLimit);
+      return EC_HTJ2KMaximumErrorExceeded;
+    }
+    if ((sizeTarget && !coarseKnown) || (!sizeTarget && !fineKnown)) {
+      DCMTKHTJ2K_WARN("HT-J2K encoder cannot meet the rate control target, "
+                      "using the closest quantization step");
+    }
+    OFVector<Uint8> const &data = useCoarse ? coarseData : fineData;
+    quantizationStep = pow(2.0, useCoarse ? coarse : fine);
+    DCMTKHTJ2K_DEBUG("HT-J2K encoder uses quantization step "
+                     << quantizationStep << " for " << data.size()
+                     << " bytes");
+    if (compressedFrame.write(&data[0], data.size()) != data.size())
+      result = EC_MemoryExhausted;
+  }
+  return result;
+}
+
+OFCondition HtJ2kEncoderBase::prepareRawFrame(
+    Uint8 const *framePointer, Uint16 bitsAllocated, Uint16 bitsStored,
+    Uint16 highBit, Uint16 nominalPrecision, Uint16 width, Uint16 height,
+    Uint16 samplesPerPixel, Uint16 planarConfiguration,
+    OFBool pixelRepresentation, OFString const &photometricInterpretation,
+    OFBool convert, HtJ2kRawFrame &frame, HtJ2kCodecParameter const *djcp,
+    HtJ2kRepresentationParameter const *djrp) const {
+  if ((bitsAllocated != 8) && (bitsAllocated != 16))
+    return EC_HTJ2KUnsupportedBitDepth;
+  if ((bitsStored < 1) || (highBit >= bitsAllocated) ||
+      (highBit + 1 < bitsStored))
+    return EC_HTJ2KUnsupportedBitDepth;
+
+  HtJ2kSampleKernels const &kernels = HtJ2kSampleKernels::best();
+  size_t const rowSize = OFstatic_cast(size_t, width) * (bitsAllocated / 8);
+
+  HtJ2kFrameSamples &samples = frame.samples;
+  samples.rows.clear();
+  samples.interleaved = (samplesPerPixel > 1) && (planarConfiguration == 0);
+  for (Uint16 c = 0; c < samplesPerPixel; c++) {
+    // color-by-plane rows are contiguous rows of the plane of the component
+    samples.rows.push_back(
+        samples.interleaved
+            ? framePointer
+            : framePointer + OFstatic_cast(size_t, c) * height * rowSize);
+  }
+  samples.rowSize = samples.interleaved ? rowSize * samplesPerPixel : rowSize;
+  samples.width = width;
+  samples.bitsAllocated = bitsAllocated;
+  samples.isSigned = (pixelRepresentation == 1);
+  samples.lowBit = highBit + 1 - bitsStored;
+  samples.bitsStored = bitsStored;
+  samples.upShift = 0;
+  frame.rows = height;
+
+  // only the stored bits are coded. The range of the samples is measured
+  // for fitting the precision to them, and for coding a complete pixel cell
+  // with the nominal precision if the bits above it are not used.
+  frame.precision = bitsStored;
+  OFBool const fit = djcp->getFitPrecision() && djrp->useLosslessProcess();
+  OFBool const narrow = !fit && (nominalPrecision < bitsStored);
+  Uint16 fittedPrecision = bitsStored;
+  if (convert) {
+    // the range of the samples is found in the same pass as they are
+    // converted, the vector keeps its capacity for the next frame
+    size_t const planeSize = OFstatic_cast(size_t, width) * height;
+    frame.convertedSamples.resize(planeSize * samplesPerPixel);
+    Sint32 minimum = 0;
+    Sint32 maximum = 0;
+    for (Uint16 c = 0; c < samplesPerPixel; c++) {
+      ojph::si32 *plane = &frame.convertedSamples[c * planeSize];
+      for (Uint32 y = 0; y < height; y++) {
+        ojph::si32 *line = plane + OFstatic_cast(size_t, y) * width;
+        samples.feed(kernels, c, y, line);
+        if (fit || narrow) kernels.findRange(line, width, minimum, maximum);
+      }
+    }
+    if (fit || narrow)
+      fittedPrecision =
+          rangePrecision(minimum, maximum, samples.isSigned, bitsStored);
+
+    for (Uint16 c = 0; c < samplesPerPixel; c++) {
+      samples.rows[c] = OFreinterpret_cast(
+          Uint8 const *, &frame.convertedSamples[c * planeSize]);
+    }
+    samples.rowSize = OFstatic_cast(size_t, width) * sizeof(ojph::si32);
+    samples.interleaved = OFFalse;
+    samples.bitsAllocated = 32;
+    samples.lowBit = 0;
+    samples.bitsStored = 32;
+  } else if (fit || narrow) {
+    fittedPrecision = fitPrecision(kernels, samples, height, bitsStored);
+  }
+  if (fit)
+    frame.precision = fittedPrecision;
+  else if (narrow && (fittedPrecision <= nominalPrecision))
+    frame.precision = nominalPrecision;
+
+  // Apply color transform only for RGB input
+  frame.colorTransform = (photometricInterpretation == "RGB");
+  return EC_Normal;
+}
+
+OFCondition HtJ2kEncoderBase::compressRawFrame(
+    HtJ2kRawFrame const &frame, ojph::outfile_base &compressedFrame,
+    HtJ2kEncoderContextPool &contexts, HtJ2kCodecParameter const *djcp,
+    HtJ2kRepresentationParameter const *djrp, Uint16 numberOfThreads) const {
+  return compressSamples(frame.samples, frame.rows, frame.precision,
+                         frame.colorTransform, 0.0f, numberOfThreads,
+                         compressedFrame, contexts, djcp, djrp);
+}
+
+/** determines the bit depth of rendered frames upon compression.
+ *  @param depth bit depth of the rendered frames
+ *  @param djcp codec parameters
+ *  @param djrp representation parameters
+ *  @return bit depth of the compressed frames, 0 if the codec parameters
+ *    request an invalid bit depth
+ */
+static int compressionBitDepth(int depth, HtJ2kCodecParameter const *djcp,
+                               HtJ2kRepresentationParameter const *djrp) {
+  // the bit depth is only changed by lossy compression
+  HTJ2K_CompressionBitDepth const mode = djcp->getCompressionBitDepth();
+  if (djrp->useLosslessProcess() || (mode == EHTJ2KBD_original)) return depth;
+
+  int const bits = djcp->getCompressionBits();
+  if ((bits < 1) || (bits > 16)) return 0;
+  if ((mode == EHTJ2KBD_limit) && (depth <= bits)) return depth;
+  return bits;
+}
+
 OFCondition HtJ2kEncoderBase::RenderedEncode(
     Uint16 const *pixelData, Uint32 const length, DcmItem *dataset,
     HtJ2kRepresentationParameter const *djrp, DcmPixelSequence *&pixSeq,
@@ -708,7 +2357,7 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
     // a photometric interpretation that we don't handle. Fall back to raw
     // encoder (unless in near-lossless mode)
     return losslessRawEncode(pixelData, length, dataset, djrp, pixSeq, djcp,
-                             compressionRatio);
+                             compressionRatio, OFFalse);
   }
 
   Uint16 pixelRepresentation = 0;
@@ -733,8 +2382,10 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
   // differ and the decoder would error out.
   flags |= CIF_UseAbsolutePixelRange;
 
-  DicomImage *dimage = new DicomImage(dataset, EXS_LittleEndianImplicit,
-                                      flags);  // read all frames
+  // render either all frames or only the first window of frames
+  Uint32 const frameWindowSize = djcp->getFrameWindowSize();
+  DicomImage *dimage = new DicomImage(dataset, EXS_LittleEndianImplicit, flags,
+                                      0, frameWindowSize);
   if (dimage == NULL) return EC_MemoryExhausted;
   if (dimage->getStatus() != EIS_Normal) {
     delete dimage;
@@ -749,6 +2400,20 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
   if (result.good() && (bitsPerSample > 16))
     result = EC_HTJ2KUnsupportedBitDepth;
 
+  // lossy compression may scale the samples to another bit depth
+  int const compressedBitsPerSample =
+      compressionBitDepth(bitsPerSample, djcp, djrp);
+  if (result.good() && (compressedBitsPerSample == 0))
+    result = EC_HTJ2KCodecInvalidParameters;
+
+  // a Modality LUT maps the original sample values and cannot be scaled
+  if (result.good() && (compressedBitsPerSample != bitsPerSample) &&
+      dataset->tagExistsWithValue(DCM_ModalityLUTSequence)) {
+    DCMTKHTJ2K_ERROR("HT-J2K encoder cannot scale the samples of an image "
+                     "with a Modality LUT Sequence to another bit depth");
+    result = EC_HTJ2KCodecInvalidParameters;
+  }
+
   // create initial pixel sequence
   if (result.good()) {
     pixelSequence = new DcmPixelSequence(DcmTag(DCM_PixelData, EVR_OB));
@@ -765,27 +2430,60 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
   }
 
   DcmOffsetList offsetList;
-  unsigned long compressedSize = 0;
-  unsigned long compressedFrameSize = 0;
+  OFVector<Uint64> frameLengths;
+  Uint64 compressedSize = 0;
   double uncompressedSize = 0.0;
 
   // render and compress each frame
   if (result.good()) {
-    unsigned long frameCount = dimage->getFrameCount();
+    unsigned long const frameCount = dimage->getNumberOfFrames();
 
     // compute original image size in bytes, ignoring any padding bits.
-    uncompressedSize = dimage->getWidth() * dimage->getHeight() *
-                       bitsPerSample * frameCount * samplesPerPixel / 8.0;
-
-    for (unsigned long i = 0; (i < frameCount) && (result.good()); ++i) {
-      // compress frame
-      DCMTKHTJ2K_DEBUG("HT-J2K encoder processes frame " << (i + 1) << " of "
-                                                         << frameCount);
-      result = compressRenderedFrame(pixelSequence, dimage,
-                                     photometricInterpretation, offsetList,
-                                     compressedFrameSize, djcp, i, djrp);
-
-      compressedSize += compressedFrameSize;
+    uncompressedSize = OFstatic_cast(double, dimage->getWidth()) *
+                       dimage->getHeight() * bitsPerSample * frameCount *
+                       samplesPerPixel / 8.0;
+
+    // compress the rendered frames window by window. The frames of a window
+    // are released before the next window is rendered, so that the memory
+    // required does not depend on the number of frames.
+    unsigned long firstFrame = 0;
+    double quantizationStep = 0.0;
+    Uint16 const numberOfThreads =
+        HtJ2kParallelLoop::resolveThreadCount(djcp->getNumberOfThreads());
+    while (result.good()) {
+      unsigned long const windowFrameCount = dimage->getFrameCount();
+      // threads not needed for the frames run rate control trials or
+      // compress tiles instead
+      Uint16 numberOfTrials = 1;
+      if ((windowFrameCount > 0) && (numberOfThreads > windowFrameCount))
+        numberOfTrials =
+            OFstatic_cast(Uint16, numberOfThreads / windowFrameCount);
+      RenderedEncodeFramesTask task(*this, dimage, windowFrameCount,
+                                    photometricInterpretation, pixelSequence,
+                                    offsetList, djcp, djrp, numberOfTrials,
+                                    quantizationStep);
+      result = HtJ2kParallelLoop::run(task, windowFrameCount,
+                                      numberOfThreads);
+      quantizationStep = task.getQuantizationStep();
+      compressedSize += task.getCompressedSize();
+      frameLengths.insert(frameLengths.end(), task.getFrameLengths().begin(),
+                          task.getFrameLengths().end());
+
+      firstFrame += windowFrameCount;
+      if (result.bad() || (windowFrameCount == 0) ||
+          (firstFrame >= frameCount))
+        break;
+
+      DCMTKHTJ2K_DEBUG("HT-J2K encoder renders the frames starting with frame "
+                       << (firstFrame + 1));
+      delete dimage;
+      dimage = new DicomImage(dataset, EXS_LittleEndianImplicit, flags,
+                              firstFrame, frameWindowSize);
+      if (dimage == NULL)
+        result = EC_MemoryExhausted;
+      else if ((dimage->getStatus() != EIS_Normal) ||
+               (dimage->getDepth() != bitsPerSample))
+        result = EC_IllegalCall;
     }
   }
 
@@ -798,21 +2496,30 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
   }
 
   // create offset table
-  if ((result.good()) && (djcp->getCreateOffsetTable())) {
-    result = offsetTable->createOffsetTable(offsetList);
+  if (result.good()) {
+    result = createOffsetTables(dataset, offsetTable, offsetList, frameLengths,
+                                pixelSequence->card() - 1, djcp);
   }
 
   // adapt attributes in image pixel module
   if (result.good()) {
     // adjustments needed for both color and monochrome
-    if (bitsPerSample > 8)
+    if (compressedBitsPerSample > 8)
       result = dataset->putAndInsertUint16(DCM_BitsAllocated, 16);
     else
       result = dataset->putAndInsertUint16(DCM_BitsAllocated, 8);
-    if (result.good())
-      result = dataset->putAndInsertUint16(DCM_BitsStored, bitsPerSample);
-    if (result.good())
-      result = dataset->putAndInsertUint16(DCM_HighBit, bitsPerSample - 1);
+    if (result.good()) {
+      result =
+          dataset->putAndInsertUint16(DCM_BitsStored, compressedBitsPerSample);
+    }
+    if (result.good()) {
+      result =
+          dataset->putAndInsertUint16(DCM_HighBit, compressedBitsPerSample - 1);
+    }
+    if (result.good() && (compressedBitsPerSample != bitsPerSample)) {
+      result = updateScaledSampleAttributes(dataset, bitsPerSample,
+                                            compressedBitsPerSample);
+    }
     // update photometric interpretation for color images
     if (result.good() && photometricInterpretation == "RGB") {
       result = dataset->putAndInsertString(
@@ -827,10 +2534,11 @@ OFCondition HtJ2kEncoderBase::RenderedEncode(
 }
 
 OFCondition HtJ2kEncoderBase::compressRenderedFrame(
-    DcmPixelSequence *pixelSequence, DicomImage *dimage,
-    OFString const &photometricInterpretation, DcmOffsetList &offsetList,
-    unsigned long &compressedSize, HtJ2kCodecParameter const *djcp,
-    Uint32 frame, HtJ2kRepresentationParameter const *djrp) const {
+    DicomImage *dimage, OFString const &photometricInterpretation,
+    ojph::outfile_base &compressedFrame, HtJ2kEncoderContextPool &contexts,
+    HtJ2kCodecParameter const *djcp, Uint32 frame,
+    HtJ2kRepresentationParameter const *djrp, Uint16 numberOfTrials,
+    double &quantizationStep) const {
   if (dimage == NULL) return EC_IllegalCall;
 
   // access essential image parameters
@@ -839,8 +2547,6 @@ OFCondition HtJ2kEncoderBase::compressRenderedFrame(
   int depth = dimage->getDepth();
   if ((depth < 1) || (depth > 16)) return EC_HTJ2KUnsupportedBitDepth;
 
-  Uint32 fragmentSize = djcp->getFragmentSize();
-
   DiPixel const *dinter = dimage->getInterData();
   if (dinter == NULL) return EC_IllegalCall;
 
@@ -852,8 +2558,6 @@ OFCondition HtJ2kEncoderBase::compressRenderedFrame(
   void const *draw = dinter->getData();
   if (draw == NULL) return EC_IllegalCall;
 
-  OFCondition result = EC_Normal;
-
   void const *planes[3] = {NULL, NULL, NULL};
   if (samplesPerPixel == 3) {
     // for color images, dinter->getData() returns a pointer to an array
@@ -868,90 +2572,6 @@ OFCondition HtJ2kEncoderBase::compressRenderedFrame(
     planes[0] = draw;
   }
 
-  // This is the buffer with the uncompressed pixel data
-  Uint8 *buffer;
-  size_t buffer_size;
-
-  Uint32 framesize = dimage->getWidth() * dimage->getHeight();
-  switch (dinter->getRepresentation()) {
-    case EPR_Uint8:
-    case EPR_Sint8: {
-      // image representation is 8 bit signed or unsigned
-      if (samplesPerPixel == 1) {
-        Uint8 const *yv =
-            OFreinterpret_cast(Uint8 const *, planes[0]) + framesize * frame;
-        buffer_size = framesize;
-        buffer = new Uint8[buffer_size];
-        memcpy(buffer, yv, framesize);
-      } else {
-        Uint8 const *rv =
-            OFreinterpret_cast(Uint8 const *, planes[0]) + framesize * frame;
-        Uint8 const *gv =
-            OFreinterpret_cast(Uint8 const *, planes[1]) + framesize * frame;
-        Uint8 const *bv =
-            OFreinterpret_cast(Uint8 const *, planes[2]) + framesize * frame;
-
-        buffer_size = framesize * 3;
-        buffer = new Uint8[buffer_size];
-
-        size_t i = 0;
-        for (int row = height; row; --row) {
-          for (int col = width; col; --col) {
-            buffer[i++] = *rv;
-            buffer[i++] = *gv;
-            buffer[i++] = *bv;
-
-            rv++;
-            gv++;
-            bv++;
-          }
-        }
-      }
-    } break;
-    case EPR_Uint16:
-    case EPR_Sint16: {
-      // image representation is 16 bit signed or unsigned
-      if (samplesPerPixel == 1) {
-        Uint16 const *yv =
-            OFreinterpret_cast(Uint16 const *, planes[0]) + framesize * frame;
-        buffer_size = framesize * sizeof(Uint16);
-        buffer = new Uint8[buffer_size];
-        memcpy(buffer, yv, buffer_size);
-      } else {
-        Uint16 const *rv =
-            OFreinterpret_cast(Uint16 const *, planes[0]) + framesize * frame;
-        Uint16 const *gv =
-            OFreinterpret_cast(Uint16 const *, planes[1]) + framesize * frame;
-        Uint16 const *bv =
-            OFreinterpret_cast(Uint16 const *, planes[2]) + framesize * frame;
-
-        buffer_size = framesize * 3;
-        Uint16 *buffer16 = new Uint16[buffer_size];
-        buffer = OFreinterpret_cast(Uint8 *, buffer16);
-
-        // Convert to byte count
-        buffer_size *= 2;
-
-        size_t i = 0;
-        for (int row = height; row; --row) {
-          for (int col = width; col; --col) {
-            buffer16[i++] = *rv;
-            buffer16[i++] = *gv;
-            buffer16[i++] = *bv;
-
-            rv++;
-            gv++;
-            bv++;
-          }
-        }
-      }
-    } break;
-    default:
-      // we don't support images with > 16 bits/sample
-      return EC_HTJ2KUnsupportedBitDepth;
-      break;
-  }
-
   int bitsAllocated = 8;
   int pixelRepresentation = 0;
   switch (dinter->getRepresentation()) {
@@ -971,139 +2591,71 @@ OFCondition HtJ2kEncoderBase::compressRenderedFrame(
       bitsAllocated = 16;
       pixelRepresentation = 1;
       break;
-    case EPR_Uint32:
-    case EPR_Sint32:
-      // 32-bit images not supported
-      break;
+    default:
+      // we don't support images with > 16 bits/sample
+      return EC_HTJ2KUnsupportedBitDepth;
   }
 
-  try {
-    ojph::codestream codestream;
-    ojph::mem_outfile destinationBuffer;
-
-    // Apply color transform only for RGB input
-    bool colorTransform = (photometricInterpretation == "RGB");
-    codestream.set_planar(colorTransform == false);
-    codestream.set_tilepart_divisions(true, false);
-    codestream.request_tlm_marker(true);
-
-    ojph::param_siz siz = codestream.access_siz();
-    siz.set_image_extent(ojph::point(width, height));
-    siz.set_num_components(samplesPerPixel);
-    for (int c = 0; c < samplesPerPixel; c++) {
-      siz.set_component(c, ojph::point(1, 1), bitsAllocated,
-                        pixelRepresentation == 1 ? true : false);
-    }
-    siz.set_image_offset(ojph::point(0, 0));
-    siz.set_tile_size(ojph::size(0, 0));
-    siz.set_tile_offset(ojph::point(0, 0));
-
-    ojph::param_cod cod = codestream.access_cod();
-
-    std::string progressionOrder = "LRCP";
-    if (djcp->getUseCustomOptions()) {
-      HTJ2K_ProgressionOrder po = djcp->get_progressionOrder();
-      if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_LRCP) {
-        progressionOrder = "LRCP";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RLCP) {
-        progressionOrder = "RLCP";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_RPCL) {
-        progressionOrder = "RPCL";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_PCRL) {
-        progressionOrder = "PCRL";
-      } else if (po == HTJ2K_ProgressionOrder::EHTJ2KPO_CPRL) {
-        progressionOrder = "CPRL";
-      }
-    }
-    if (supportedTransferSyntax() ==
-        EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly) {
-      progressionOrder = "RPCL";
-    }
-
-    cod.set_progression_order(progressionOrder.c_str());
-    cod.set_color_transform(colorTransform);
-    if (djcp->getUseCustomOptions()) {
-      cod.set_block_dims(djcp->get_cblkwidth(), djcp->get_cblkheight());
-    }
-    cod.set_precinct_size(0, nullptr);
-    cod.set_reversible(djrp->useLosslessProcess());
-
-    unsigned int numberOfDecompositions = 0;
-    size_t tw = width;
-    size_t th = height;
-    while (tw > 64 && th > 64) {
-      numberOfDecompositions++;
-      tw = static_cast<size_t>(ceil(tw / 2));
-      th = static_cast<size_t>(ceil(th / 2));
-    }
-    cod.set_num_decomposition(
-        numberOfDecompositions > 6 ? 6 : numberOfDecompositions);
-    if (djcp->getUseCustomOptions()) {
-      cod.set_num_decomposition(djcp->get_decompositions());
-    }
-
-    destinationBuffer.open();
-
-    ojph::comment_exchange com_ex;
-    codestream.write_headers(&destinationBuffer, &com_ex, 0);
-
-    ojph::ui32 next_comp;
-    int const bytesPerPixel = bitsAllocated / 8;
-    ojph::line_buf *cur_line = codestream.exchange(nullptr, next_comp);
-    ojph::ui32 const imageHeight =
-        siz.get_image_extent().y - siz.get_image_offset().y;
-    for (ojph::ui32 y = 0; y < imageHeight; y++) {
-      for (ojph::ui32 c = 0; c < siz.get_num_components(); c++) {
-        ojph::si32 *dp = cur_line->i32;
-        if (bitsAllocated <= 8) {
-          Uint8 *sp = (Uint8 *)&buffer[(y * width * bytesPerPixel *
-                                        siz.get_num_components()) +
-                                       c];
-          for (int x = 0; x < width; x++) {
-            *dp++ = *sp;
-            sp += siz.get_num_components();
-          }
-        } else {
-          if (pixelRepresentation == 1) {
-            Sint16 *sp = (Sint16 *)&buffer[y * width * bytesPerPixel];
-            for (int x = 0; x < width; x++) {
-              *dp++ = *sp++;
-            }
-          } else {
-            Uint16 *sp = (Uint16 *)&buffer[y * width * bytesPerPixel];
-            for (int x = 0; x < width; x++) {
-              *dp++ = *sp++;
-            }
-          }
-        }
-        cur_line = codestream.exchange(cur_line, next_comp);
-      }
-    }
-
-    codestream.flush();
-
-    // Get compressed data from mem_outfile
-    Uint8 *compressed_data =
-        const_cast<Uint8 *>((Uint8 const *)destinationBuffer.get_data());
-
-    // Store compressed frame
-    unsigned long compressedLen = (unsigned long)destinationBuffer.tell();
-    compressedSize = compressedLen;
-    result = pixelSequence->storeCompressedFrame(offsetList, compressed_data,
-                                                 compressedLen, fragmentSize);
-
-    codestream.close();
-  } catch (std::exception &ex) {
-    DCMTKHTJ2K_ERROR("HT-J2K encoder caught OpenJPH exception: "
-                     << (ex.what() ? ex.what() : "Unknown reason"));
-    result =
-        makeOFCondition(1, OFM_dcmjp2k, OF_error,
-                        ex.what() ? ex.what() : "Unknown OpenJPH exception");
+  // the lines are fed directly from the planes of the intermediate
+  // representation
+  HtJ2kSampleKernels const &kernels = HtJ2kSampleKernels::best();
+  size_t const rowSize = OFstatic_cast(size_t, width) * (bitsAllocated / 8);
+  size_t const frameOffset = rowSize * OFstatic_cast(size_t, height) * frame;
+
+  HtJ2kFrameSamples samples;
+  for (int c = 0; c < samplesPerPixel; c++)
+    samples.rows.push_back(OFstatic_cast(Uint8 const *, planes[c]) +
+                           frameOffset);
+  samples.rowSize = rowSize;
+  samples.interleaved = OFFalse;
+  samples.width = OFstatic_cast(Uint16, width);
+  samples.bitsAllocated = OFstatic_cast(Uint16, bitsAllocated);
+  samples.isSigned = (pixelRepresentation == 1);
+  samples.lowBit = 0;
+  samples.bitsStored = samples.bitsAllocated;
+  samples.upShift = 0;
+
+  // only the bits of the rendered depth are coded, unless lossy compression
+  // scales the samples to another bit depth while they are fed
+  int const bits = compressionBitDepth(depth, djcp, djrp);
+  if (bits == 0) return EC_HTJ2KCodecInvalidParameters;
+  if (bits < depth) {
+    // the bits below the most significant ones are dropped
+    samples.lowBit = OFstatic_cast(Uint16, depth - bits);
+    samples.bitsStored = OFstatic_cast(Uint16, bits);
+  } else {
+    samples.upShift = OFstatic_cast(Uint16, bits - depth);
+  }
+  Uint16 precision = OFstatic_cast(Uint16, bits);
+  if (djcp->getFitPrecision() && djrp->useLosslessProcess()) {
+    precision = fitPrecision(kernels, samples, OFstatic_cast(Uint16, height),
+                             precision);
   }
 
-  delete[] buffer;
+  // Apply color transform only for RGB input
+  OFBool const colorTransform = (photometricInterpretation == "RGB");
+  if (!djrp->useRateControl()) {
+    return compressSamples(samples, OFstatic_cast(Uint16, height), precision,
+                           colorTransform, 0.0f, numberOfTrials,
+                           compressedFrame, contexts, djcp, djrp);
+  }
 
-  return result;
+  // the target size follows from the size of the rendered frame, which the
+  // compression ratio of the dataset refers to as well
+  // near-lossless compression ignores any target size
+  Uint64 targetSize =
+      (djrp->getMaximumError() > 0) ? 0 : djrp->getTargetFrameSize();
+  if ((targetSize == 0) && (djrp->getMaximumError() == 0) &&
+      (djrp->getCompressionRatio() > 0.0)) {
+    double const frameSize = OFstatic_cast(double, width) * height *
+                             samplesPerPixel * depth / 8.0;
+    targetSize = OFstatic_cast(Uint64, frameSize / djrp->getCompressionRatio());
+    if (targetSize == 0) targetSize = 1;
+  }
+  return compressRateControlledSamples(
+      samples, OFstatic_cast(Uint16, height), precision, colorTransform,
+      targetSize, numberOfTrials, quantizationStep, compressedFrame, contexts,
+      djcp, djrp);
 }
 
 OFCondition HtJ2kEncoderBase::convertToUninterleaved(
@@ -18,15 +18,26 @@ HtJ2kCodecParameter::HtJ2kCodecParameter(
       jp2k_progressionOrder_(jp2k_progressionOrder),
       fragmentSize_(fragmentSize),
       createOffsetTable_(createOffsetTable),
+      createExtendedOffsetTable_(OFFalse),
       preferCookedEncoding_(preferCookedEncoding),
+      frameWindowSize_(0),
+      fitPrecision_(OFFalse),
+      compressionBitDepth_(EHTJ2KBD_original),
+      compressionBits_(0),
+      precinctSizes_(),
+      packetLengthMarkers_(OFFalse),
+      tileSize_(0),
       uidCreation_(uidCreation),
       convertToSC_(convertToSC),
       planarConfiguration_(planarConfiguration),
-      ignoreOffsetTable_(ignoreOffsetTble) {}
+      ignoreOffsetTable_(ignoreOffsetTble),
+      resolutionReduction_(0),
+      numberOfThreads_(1) {}
 
 HtJ2kCodecParameter::HtJ2kCodecParameter(
     HTJ2K_UIDCreation uidCreation,
-    HTJ2K_PlanarConfiguration planarConfiguration, OFBool ignoreOffsetTble)
+    HTJ2K_PlanarConfiguration planarConfiguration, OFBool ignoreOffsetTble,
+    Uint16 numberOfThreads, Uint16 resolutionReduction)
     : DcmCodecParameter(),
       jp2k_optionsEnabled_(OFFalse),
       jp2k_decompositions_(5),
@@ -35,11 +46,21 @@ HtJ2kCodecParameter::HtJ2kCodecParameter(
       jp2k_progressionOrder_(EHTJ2KPO_default),
       fragmentSize_(0),
       createOffsetTable_(OFTrue),
+      createExtendedOffsetTable_(OFFalse),
       preferCookedEncoding_(OFTrue),
+      frameWindowSize_(0),
+      fitPrecision_(OFFalse),
+      compressionBitDepth_(EHTJ2KBD_original),
+      compressionBits_(0),
+      precinctSizes_(),
+      packetLengthMarkers_(OFFalse),
+      tileSize_(0),
       uidCreation_(uidCreation),
       convertToSC_(OFFalse),
       planarConfiguration_(planarConfiguration),
-      ignoreOffsetTable_(ignoreOffsetTble) {}
+      ignoreOffsetTable_(ignoreOffsetTble),
+      resolutionReduction_(resolutionReduction),
+      numberOfThreads_(numberOfThreads) {}
 
 HtJ2kCodecParameter::HtJ2kCodecParameter(HtJ2kCodecParameter const &arg)
     : DcmCodecParameter(arg),
@@ -50,11 +71,21 @@ HtJ2kCodecParameter::HtJ2kCodecParameter(HtJ2kCodecParameter const &arg)
       jp2k_progressionOrder_(arg.jp2k_progressionOrder_),
       fragmentSize_(arg.fragmentSize_),
       createOffsetTable_(arg.createOffsetTable_),
+      createExtendedOffsetTable_(arg.createExtendedOffsetTable_),
       preferCookedEncoding_(arg.preferCookedEncoding_),
+      frameWindowSize_(arg.frameWindowSize_),
+      fitPrecision_(arg.fitPrecision_),
+      compressionBitDepth_(arg.compressionBitDepth_),
+      compressionBits_(arg.compressionBits_),
+      precinctSizes_(arg.precinctSizes_),
+      packetLengthMarkers_(arg.packetLengthMarkers_),
+      tileSize_(arg.tileSize_),
       uidCreation_(arg.uidCreation_),
       convertToSC_(arg.convertToSC_),
       planarConfiguration_(arg.planarConfiguration_),
-      ignoreOffsetTable_(arg.ignoreOffsetTable_) {}
+      ignoreOffsetTable_(arg.ignoreOffsetTable_),
+      resolutionReduction_(arg.resolutionReduction_),
+      numberOfThreads_(arg.numberOfThreads_) {}
 
 HtJ2kCodecParameter::~HtJ2kCodecParameter() {}
 
@@ -12,9 +12,11 @@ HtJ2kDecoder *HtJ2kDecoderRegistration::decoder_ = NULL;
 
 void HtJ2kDecoderRegistration::registerCodecs(
     HTJ2K_UIDCreation uidcreation, HTJ2K_PlanarConfiguration planarconfig,
-    OFBool ignoreOffsetTable) {
+    OFBool ignoreOffsetTable, Uint16 numberOfThreads,
+    Uint16 resolutionReduction) {
   if (!registered_) {
-    cp_ = new HtJ2kCodecParameter(uidcreation, planarconfig, ignoreOffsetTable);
+    cp_ = new HtJ2kCodecParameter(uidcreation, planarconfig, ignoreOffsetTable,
+                                  numberOfThreads, resolutionReduction);
     if (cp_) {
       decoder_ = new HtJ2kDecoder();
       if (decoder_) DcmCodecList::registerCodec(decoder_, NULL, cp_);
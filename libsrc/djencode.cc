@@ -18,12 +18,16 @@ void HtJ2kEncoderRegistration::registerCodecs(
     HTJ2K_ProgressionOrder jp2k_progressionOrder, OFBool preferCookedEncoding,
     Uint32 fragmentSize, OFBool createOffsetTable,
     HTJ2K_UIDCreation uidCreation, OFBool convertToSC) {
+  registerCodecs(HtJ2kCodecParameter(
+      jp2k_optionsEnabled, jp2k_decompositions, jp2k_cblkwidth,
+      jp2k_cblkheight, jp2k_progressionOrder, preferCookedEncoding,
+      fragmentSize, createOffsetTable, uidCreation, convertToSC));
+}
+
+void HtJ2kEncoderRegistration::registerCodecs(
+    HtJ2kCodecParameter const &parameters) {
   if (!registered_) {
-    cp_ = new HtJ2kCodecParameter(jp2k_optionsEnabled, jp2k_decompositions,
-                                  jp2k_cblkwidth, jp2k_cblkheight,
-                                  jp2k_progressionOrder, preferCookedEncoding,
-                                  fragmentSize, createOffsetTable, uidCreation,
-                                  convertToSC, EHTJ2KPC_restore, OFFalse);
+    cp_ = new HtJ2kCodecParameter(parameters);
 
     if (cp_) {
       losslessencoder_ = new HtJ2kLosslessEncoder();
@@ -0,0 +1,312 @@
+#include "dcmtkhtj2k/djindex.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dcdeftag.h" /* for tag constants */
+#include "dcmtk/dcmdata/dcitem.h"   /* for class DcmItem */
+#include "dcmtk/dcmdata/dcpixseq.h" /* for class DcmPixelSequence */
+#include "dcmtk/dcmdata/dcpxitem.h" /* for class DcmPixelItem */
+#include "dcmtk/dcmdata/dcswap.h"   /* for swapIfNecessary() */
+#include "dcmtkhtj2k/djutils.h"
+
+namespace {
+
+/** checks whether the given fragment starts with a HT-J2K codestream, i.e.
+ *  with SOC (FF4F) followed by SIZ (FF51).
+ */
+OFBool isStartOfCodestream(DcmPixelItem *pixItem) {
+  Uint8 *data = NULL;
+  if ((pixItem == NULL) || (pixItem->getLength() < 4) ||
+      pixItem->getUint8Array(data).bad() || (data == NULL))
+    return OFFalse;
+  return (data[0] == 0xFF) && (data[1] == 0x4F) && (data[2] == 0xFF) &&
+         (data[3] == 0x51);
+}
+
+}  // namespace
+
+OFCondition HtJ2kImageAttributes::read(DcmItem *dataset,
+                                       unsigned long numberOfItems) {
+  if (dataset->findAndGetUint16(DCM_SamplesPerPixel, samplesPerPixel).bad())
+    return EC_TagNotFound;
+  // we only handle one or three samples per pixel
+  if ((samplesPerPixel != 3) && (samplesPerPixel != 1)) return EC_InvalidTag;
+
+  if (dataset->findAndGetUint16(DCM_Rows, rows).bad()) return EC_TagNotFound;
+  if (rows < 1) return EC_InvalidTag;
+
+  if (dataset->findAndGetUint16(DCM_Columns, columns).bad())
+    return EC_TagNotFound;
+  if (columns < 1) return EC_InvalidTag;
+
+  // number of frames is an optional attribute - we don't mind if it isn't
+  // present.
+  numberOfFrames = 0;
+  numberOfFramesPresent =
+      dataset->findAndGetSint32(DCM_NumberOfFrames, numberOfFrames).good();
+
+  if (numberOfFrames >= OFstatic_cast(Sint32, numberOfItems))
+    numberOfFrames = OFstatic_cast(Sint32, numberOfItems) -
+                     1;  // limit number of frames to number of pixel items - 1
+  if (numberOfFrames < 1)
+    numberOfFrames = 1;  // default in case the number of frames attribute is
+                         // absent or contains garbage
+
+  if (dataset->findAndGetUint16(DCM_BitsStored, bitsStored).bad())
+    return EC_TagNotFound;
+
+  if (dataset->findAndGetUint16(DCM_BitsAllocated, bitsAllocated).bad())
+    return EC_TagNotFound;
+
+  // we only support up to 16 bits per sample
+  if ((bitsStored < 1) || (bitsStored > 16)) return EC_HTJ2KUnsupportedBitDepth;
+
+  // determine the number of bytes per sample (bits allocated) for the
+  // de-compressed object.
+  bytesPerSample = 1;
+  if (bitsStored > 8)
+    bytesPerSample = 2;
+  else if (bitsAllocated > 8)
+    bytesPerSample = 2;
+
+  return EC_Normal;
+}
+
+OFBool HtJ2kImageAttributes::operator==(
+    HtJ2kImageAttributes const &rhs) const {
+  return (samplesPerPixel == rhs.samplesPerPixel) && (rows == rhs.rows) &&
+         (columns == rhs.columns) && (bitsStored == rhs.bitsStored) &&
+         (bitsAllocated == rhs.bitsAllocated) &&
+         (bytesPerSample == rhs.bytesPerSample) &&
+         (numberOfFrames == rhs.numberOfFrames) &&
+         (numberOfFramesPresent == rhs.numberOfFramesPresent);
+}
+
+HtJ2kFrameIndex::HtJ2kFrameIndex()
+    : pixSeq_(NULL),
+      offsetTableLength_(0),
+      lastFragmentLength_(0),
+      items_(),
+      frameStart_() {}
+
+OFCondition HtJ2kFrameIndex::build(DcmPixelSequence *pixSeq, DcmItem *dataset,
+                                   Sint32 numberOfFrames,
+                                   OFBool ignoreOffsetTable) {
+  pixSeq_ = pixSeq;
+  items_.clear();
+  frameStart_.clear();
+  if (pixSeq == NULL) return EC_IllegalCall;
+
+  // collect all items in a single pass; accessing the items by index
+  // would require a linear search through the sequence for every item
+  unsigned long const numItems = pixSeq->card();
+  items_.reserve(numItems);
+  DcmObject *object = NULL;
+  while ((object = pixSeq->nextInContainer(object)) != NULL)
+    items_.push_back(OFstatic_cast(DcmPixelItem *, object));
+  if (items_.size() < 2) return EC_HTJ2KInvalidCompressedData;
+  offsetTableLength_ = items_.front()->getLength();
+  lastFragmentLength_ = items_.back()->getLength();
+
+  Uint32 const itemCount = OFstatic_cast(Uint32, items_.size());
+  if (numberOfFrames < 1) numberOfFrames = 1;
+  frameStart_.assign(OFstatic_cast(size_t, numberOfFrames) + 1, 0);
+  frameStart_[0] = 1;  // item 0 contains the offset table
+  frameStart_.back() = itemCount;
+
+  // We first check the simple cases, that is, a single-frame image and the
+  // standard case where we do have a single fragment per frame.
+  if (numberOfFrames == 1) return EC_Normal;
+  if (OFstatic_cast(Uint32, numberOfFrames) + 1 == itemCount) {
+    for (Sint32 frame = 1; frame < numberOfFrames; ++frame)
+      frameStart_[frame] = OFstatic_cast(Uint32, frame) + 1;
+    return EC_Normal;
+  }
+
+  if (!ignoreOffsetTable) {
+    // We do have a multi-frame image with multiple fragments per frame. Let's
+    // check the Extended Offset Table and the Basic Offset Table if present.
+    OFVector<Uint64> offsets;
+    DcmElement *extendedOffsetTable = NULL;
+    Uint64 *extendedOffsets = NULL;
+    if ((dataset != NULL) &&
+        dataset->findAndGetElement(DCM_ExtendedOffsetTable, extendedOffsetTable)
+            .good() &&
+        extendedOffsetTable->getUint64Array(extendedOffsets).good() &&
+        (extendedOffsets != NULL) &&
+        (extendedOffsetTable->getLength() ==
+         OFstatic_cast(Uint32, numberOfFrames) * 8)) {
+      offsets.assign(extendedOffsets, extendedOffsets + numberOfFrames);
+    } else {
+      DcmPixelItem *offsetTable = items_[0];
+      Uint8 *offsetData = NULL;
+      if ((offsetTable->getLength() ==
+           OFstatic_cast(Uint32, numberOfFrames) * 4) &&
+          offsetTable->getUint8Array(offsetData).good() &&
+          (offsetData != NULL)) {
+        // offset table is non-empty and contains one entry per frame
+        Uint32 const *offsetData32 =
+            OFreinterpret_cast(Uint32 const *, offsetData);
+        offsets.reserve(OFstatic_cast(size_t, numberOfFrames));
+        for (Sint32 frame = 0; frame < numberOfFrames; ++frame) {
+          // convert to local endian byte order (always little endian in file)
+          Uint32 offset = offsetData32[frame];
+          swapIfNecessary(gLocalByteOrder, EBO_LittleEndian, &offset,
+                          sizeof(Uint32), sizeof(Uint32));
+          offsets.push_back(offset);
+        }
+      }
+    }
+    if (!offsets.empty() && mapOffsets(offsets)) return EC_Normal;
+  }
+
+  // So we have a multi-frame image with multiple fragments per frame and the
+  // offset tables are empty or wrong. Our last chance is to peek into the
+  // HT-J2K bitstreams and identify the start of each frame.
+  scanForCodestreams();
+  return EC_Normal;
+}
+
+OFBool HtJ2kFrameIndex::mapOffsets(OFVector<Uint64> const &offsets) {
+  // the offsets are relative to the first byte of the item tag of the first
+  // fragment and must be strictly increasing
+  size_t const frames = frameStart_.size() - 1;
+  Uint32 const itemCount = OFstatic_cast(Uint32, items_.size());
+  Uint64 position = 0;
+  Uint32 item = 1;
+  for (size_t frame = 0; frame < frames; ++frame) {
+    while ((item < itemCount) && (position < offsets[frame])) {
+      position += items_[item]->getLength() +
+                  8;  // add 8 bytes for item tag and length
+      ++item;
+    }
+    if ((item >= itemCount) || (position != offsets[frame])) return OFFalse;
+    if ((frame > 0) && (item <= frameStart_[frame - 1])) return OFFalse;
+    frameStart_[frame] = item;
+  }
+  return OFTrue;
+}
+
+void HtJ2kFrameIndex::scanForCodestreams() {
+  // the first frame always starts with the first fragment, every other frame
+  // with the next fragment containing a SOC marker
+  size_t const frames = frameStart_.size() - 1;
+  Uint32 const itemCount = OFstatic_cast(Uint32, items_.size());
+  size_t frame = 1;
+  for (Uint32 item = 2; (item < itemCount) && (frame < frames); ++item) {
+    if (isStartOfCodestream(items_[item])) frameStart_[frame++] = item;
+  }
+  // frames without a codestream of their own remain unknown
+}
+
+OFBool HtJ2kFrameIndex::matches(DcmPixelSequence *pixSeq) const {
+  if ((pixSeq == NULL) || (pixSeq != pixSeq_)) return OFFalse;
+  if (pixSeq->card() != items_.size()) return OFFalse;
+
+  // a sequence with the same number of items may have been replaced by a
+  // new one at the same address, so the offset table and the last fragment
+  // are compared as well
+  DcmPixelItem *offsetTable = NULL;
+  DcmPixelItem *lastFragment = NULL;
+  return pixSeq->getItem(offsetTable, 0).good() &&
+         (offsetTable == items_.front()) &&
+         (offsetTable->getLength() == offsetTableLength_) &&
+         pixSeq->getItem(lastFragment, pixSeq->card() - 1).good() &&
+         (lastFragment == items_.back()) &&
+         (lastFragment->getLength() == lastFragmentLength_);
+}
+
+Uint32 HtJ2kFrameIndex::startItem(size_t frameNo) const {
+  if (frameNo + 1 >= frameStart_.size()) return 0;
+  return frameStart_[frameNo];
+}
+
+Uint32 HtJ2kFrameIndex::numberOfItems(size_t frameNo) const {
+  Uint32 const start = startItem(frameNo);
+  if (start == 0) return 0;
+
+  // the frame ends with the start of the next known frame
+  for (size_t next = frameNo + 1; next < frameStart_.size(); ++next) {
+    if (frameStart_[next] != 0) return frameStart_[next] - start;
+  }
+  return 0;
+}
+
+DcmPixelItem *HtJ2kFrameIndex::item(Uint32 index) const {
+  if (index >= items_.size()) return NULL;
+  return items_[index];
+}
+
+HtJ2kFrameIndexCache::HtJ2kFrameIndexCache(size_t capacity)
+    : capacity_(capacity), entries_(), mutex_() {}
+
+HtJ2kFrameIndexCache::~HtJ2kFrameIndexCache() {}
+
+OFCondition HtJ2kFrameIndexCache::lookup(
+    DcmItem *dataset, DcmPixelSequence *pixSeq, OFBool ignoreOffsetTable,
+    HtJ2kImageAttributes &attributes,
+    OFshared_ptr<HtJ2kFrameIndex const> &index) {
+  // the attributes are read on every call, so that an index built for
+  // different Rows, Columns, BitsAllocated or Number of Frames is not used
+  OFCondition result = attributes.read(dataset, pixSeq->card());
+  if (result.bad()) return result;
+
+  mutex_.lock();
+
+  size_t found = entries_.size();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    Entry const &entry = entries_[i];
+    if ((entry.dataset == dataset) && (entry.pixSeq == pixSeq) &&
+        (entry.ignoreOffsetTable == ignoreOffsetTable) &&
+        (entry.attributes == attributes) && entry.index->matches(pixSeq)) {
+      found = i;
+      break;
+    }
+  }
+
+  Entry entry;
+  if (found < entries_.size()) {
+    entry = entries_[found];
+    entries_.erase(entries_.begin() + found);
+  } else {
+    // not cached yet (or outdated), build the index
+    for (size_t i = entries_.size(); i > 0; --i) {
+      if (entries_[i - 1].pixSeq == pixSeq)
+        entries_.erase(entries_.begin() + (i - 1));
+    }
+    entry.dataset = dataset;
+    entry.pixSeq = pixSeq;
+    entry.ignoreOffsetTable = ignoreOffsetTable;
+    entry.attributes = attributes;
+    HtJ2kFrameIndex *newIndex = new HtJ2kFrameIndex();
+    entry.index.reset(newIndex);
+    result = newIndex->build(pixSeq, dataset, attributes.numberOfFrames,
+                             ignoreOffsetTable);
+    DCMTKHTJ2K_DEBUG("HT-J2K decoder built frame index for "
+                     << attributes.numberOfFrames << " frame(s)");
+  }
+
+  if (result.good()) {
+    // the most recently used entry comes first
+    entries_.insert(entries_.begin(), entry);
+    if (entries_.size() > capacity_) entries_.resize(capacity_);
+    index = entry.index;
+  }
+
+  mutex_.unlock();
+  return result;
+}
+
+void HtJ2kFrameIndexCache::invalidate(DcmItem const *dataset) {
+  mutex_.lock();
+  for (size_t i = entries_.size(); i > 0; --i) {
+    if (entries_[i - 1].dataset == dataset)
+      entries_.erase(entries_.begin() + (i - 1));
+  }
+  mutex_.unlock();
+}
+
+void HtJ2kFrameIndexCache::clear() {
+  mutex_.lock();
+  entries_.clear();
+  mutex_.unlock();
+}
@@ -0,0 +1,762 @@
+#include "dcmtkhtj2k/djplt.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dcerror.h" /* for EC_MemoryExhausted */
+#include "dcmtkhtj2k/djutils.h"
+
+// OpenJPH includes
+#include "openjph/ojph_file.h"
+
+namespace {
+
+/// markers of a JPEG 2000 codestream
+enum {
+  MARKER_SOC = 0xFF4F,
+  MARKER_SIZ = 0xFF51,
+  MARKER_COD = 0xFF52,
+  MARKER_COC = 0xFF53,
+  MARKER_TLM = 0xFF55,
+  MARKER_PLM = 0xFF57,
+  MARKER_PLT = 0xFF58,
+  MARKER_POC = 0xFF5F,
+  MARKER_PPM = 0xFF60,
+  MARKER_PPT = 0xFF61,
+  MARKER_SOT = 0xFF90,
+  MARKER_SOP = 0xFF91,
+  MARKER_EPH = 0xFF92,
+  MARKER_SOD = 0xFF93,
+  MARKER_EOC = 0xFFD9
+};
+
+/// maximum number of decomposition levels of a JPEG 2000 codestream
+const Uint16 MAX_DECOMPOSITIONS = 32;
+
+Uint16 readUint16(Uint8 const *data) {
+  return OFstatic_cast(Uint16, (data[0] << 8) | data[1]);
+}
+
+Uint32 readUint32(Uint8 const *data) {
+  return (OFstatic_cast(Uint32, data[0]) << 24) |
+         (OFstatic_cast(Uint32, data[1]) << 16) |
+         (OFstatic_cast(Uint32, data[2]) << 8) | OFstatic_cast(Uint32, data[3]);
+}
+
+Sint64 ceilDiv(Sint64 a, Sint64 b) {
+  return (a >= 0) ? (a + b - 1) / b : -((-a) / b);
+}
+
+Sint64 floorDiv(Sint64 a, Sint64 b) {
+  return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+Sint64 minimum(Sint64 a, Sint64 b) { return (a < b) ? a : b; }
+
+Sint64 maximum(Sint64 a, Sint64 b) { return (a > b) ? a : b; }
+
+/** coding parameters of a codestream, as far as required to enumerate its
+ *  packets and the code-blocks of every packet.
+ */
+struct CodingLayout {
+  CodingLayout()
+      : sizFound(OFFalse),
+        codFound(OFFalse),
+        width(0),
+        height(0),
+        x0(0),
+        y0(0),
+        tileWidth(0),
+        tileHeight(0),
+        tileX0(0),
+        tileY0(0),
+        components(0),
+        progressionOrder(0),
+        decompositions(0),
+        xcb(0),
+        ycb(0),
+        sop(OFFalse),
+        eph(OFFalse) {
+    for (Uint16 r = 0; r <= MAX_DECOMPOSITIONS; r++) ppx[r] = ppy[r] = 15;
+  }
+
+  /// true if the SIZ and COD marker segments have been read
+  OFBool sizFound, codFound;
+
+  /// image and tile grid from the SIZ marker segment
+  Sint64 width, height, x0, y0, tileWidth, tileHeight, tileX0, tileY0;
+
+  /// number of components
+  Uint16 components;
+
+  /// progression order, 0 (LRCP) to 4 (CPRL)
+  Uint8 progressionOrder;
+
+  /// number of decomposition levels
+  Uint16 decompositions;
+
+  /// code-block width and height exponents
+  Uint16 xcb, ycb;
+
+  /// precinct width and height exponents per resolution
+  Uint16 ppx[MAX_DECOMPOSITIONS + 1], ppy[MAX_DECOMPOSITIONS + 1];
+
+  /// true if SOP and EPH markers may be used
+  OFBool sop, eph;
+};
+
+/// extent of a resolution of a tile-component and its precinct grid
+struct Resolution {
+  Sint64 x0, y0, x1, y1;
+  Sint64 firstPrecinctX, firstPrecinctY;
+  Sint64 precinctsX, precinctsY;
+};
+
+/// packet of a tile, identified by resolution, component and precinct
+struct Packet {
+  Uint16 resolution;
+  Uint16 component;
+  Sint64 precinct;
+};
+
+/// packets of a tile in codestream order
+struct TileProgress {
+  TileProgress() : initialized(OFFalse), packets(), next(0) {}
+
+  OFBool initialized;
+  Sint64 x0, y0, x1, y1;
+  OFVector<Resolution> resolutions;
+  OFVector<Packet> packets;
+  size_t next;
+};
+
+/** reads the bits of a packet header, skipping the bit stuffed after every
+ *  0xFF byte.
+ */
+class PacketHeaderReader {
+ public:
+  PacketHeaderReader(Uint8 const *data, size_t size)
+      : data_(data),
+        size_(size),
+        position_(0),
+        buffer_(0),
+        count_(0),
+        overrun_(OFFalse) {}
+
+  Uint32 readBit() {
+    if (count_ == 0) {
+      buffer_ = (buffer_ << 8) & 0xFFFF;
+      count_ = (buffer_ == 0xFF00) ? 7 : 8;
+      if (position_ < size_)
+        buffer_ |= data_[position_++];
+      else
+        overrun_ = OFTrue;
+    }
+    count_--;
+    return (buffer_ >> count_) & 1;
+  }
+
+  Uint32 read(Uint16 bits) {
+    Uint32 value = 0;
+    while (bits-- > 0) value = (value << 1) | readBit();
+    return value;
+  }
+
+  /// completes the header at a byte boundary and returns its length
+  size_t align() {
+    // a header ending with 0xFF is followed by a stuffing byte
+    if ((buffer_ & 0xFF) == 0xFF) {
+      if (position_ < size_)
+        position_++;
+      else
+        overrun_ = OFTrue;
+      buffer_ = 0;
+    }
+    count_ = 0;
+    return position_;
+  }
+
+  OFBool overrun() const { return overrun_; }
+
+ private:
+  Uint8 const *data_;
+  size_t size_;
+  size_t position_;
+  Uint32 buffer_;
+  Uint16 count_;
+  OFBool overrun_;
+};
+
+/// tag tree of the code-blocks of a precinct in a subband
+class TagTree {
+ public:
+  void reset(Uint32 width, Uint32 height) {
+    widths_.clear();
+    offsets_.clear();
+    size_t total = 0;
+    for (;;) {
+      widths_.push_back(width);
+      offsets_.push_back(total);
+      total += OFstatic_cast(size_t, width) * height;
+      if ((width == 1) && (height == 1)) break;
+      width = (width + 1) / 2;
+      height = (height + 1) / 2;
+    }
+    low_.assign(total, 0);
+    value_.assign(total, 0x7FFFFFFF);
+  }
+
+  /** decodes whether the value of a leaf is below the given threshold, reading
+   *  as many bits as necessary.
+   */
+  OFBool decode(PacketHeaderReader &reader, Uint32 x, Uint32 y,
+                Sint32 threshold) {
+    Sint32 low = 0;
+    size_t node = 0;
+    for (size_t level = widths_.size(); level-- > 0;) {
+      node = offsets_[level] + (y >> level) * widths_[level] + (x >> level);
+      if (low > low_[node])
+        low_[node] = low;
+      else
+        low = low_[node];
+      while ((low < threshold) && (low < value_[node])) {
+        if (reader.readBit())
+          value_[node] = low;
+        else
+          low++;
+      }
+      low_[node] = low;
+    }
+    return value_[node] < threshold;
+  }
+
+ private:
+  OFVector<Uint32> widths_;
+  OFVector<size_t> offsets_;
+  OFVector<Sint32> low_;
+  OFVector<Sint32> value_;
+};
+
+/// reads the number of coding passes of a code-block
+Uint32 readNumberOfPasses(PacketHeaderReader &reader) {
+  if (!reader.readBit()) return 1;
+  if (!reader.readBit()) return 2;
+  Uint32 value = reader.read(2);
+  if (value < 3) return 3 + value;
+  value = reader.read(5);
+  if (value < 31) return 6 + value;
+  return 37 + reader.read(7);
+}
+
+/// reads the SIZ marker segment
+OFCondition parseSIZ(Uint8 const *segment, size_t length,
+                     CodingLayout &layout) {
+  if (length < 36) return EC_HTJ2KInvalidCompressedData;
+  layout.width = readUint32(segment + 2);
+  layout.height = readUint32(segment + 6);
+  layout.x0 = readUint32(segment + 10);
+  layout.y0 = readUint32(segment + 14);
+  layout.tileWidth = readUint32(segment + 18);
+  layout.tileHeight = readUint32(segment + 22);
+  layout.tileX0 = readUint32(segment + 26);
+  layout.tileY0 = readUint32(segment + 30);
+  layout.components = readUint16(segment + 34);
+  size_t const components = layout.components;
+  if ((components == 0) || (length < 36 + 3 * components) ||
+      (layout.tileWidth == 0) || (layout.tileHeight == 0) ||
+      (layout.x0 >= layout.width) || (layout.y0 >= layout.height))
+    return EC_HTJ2KInvalidCompressedData;
+  // only components sharing the geometry of the image are supported
+  for (Uint16 c = 0; c < layout.components; c++) {
+    if ((segment[37 + 3 * c] != 1) || (segment[38 + 3 * c] != 1))
+      return EC_HTJ2KCodecUnsupportedValue;
+  }
+  layout.sizFound = OFTrue;
+  return EC_Normal;
+}
+
+/// reads the COD marker segment
+OFCondition parseCOD(Uint8 const *segment, size_t length,
+                     CodingLayout &layout) {
+  if (length < 10) return EC_HTJ2KInvalidCompressedData;
+  Uint8 const scod = segment[0];
+  layout.sop = (scod & 0x02) != 0;
+  layout.eph = (scod & 0x04) != 0;
+  layout.progressionOrder = segment[1];
+  Uint16 const layers = readUint16(segment + 2);
+  layout.decompositions = segment[5];
+  layout.xcb = OFstatic_cast(Uint16, segment[6] + 2);
+  layout.ycb = OFstatic_cast(Uint16, segment[7] + 2);
+  Uint8 const style = segment[8];
+  if ((layout.progressionOrder > 4) ||
+      (layout.decompositions > MAX_DECOMPOSITIONS))
+    return EC_HTJ2KInvalidCompressedData;
+  // a single quality layer of HT code-blocks is supported
+  if ((layers != 1) || ((style & 0x40) == 0))
+    return EC_HTJ2KCodecUnsupportedValue;
+  if (scod & 0x01) {
+    if (length < OFstatic_cast(size_t, 10 + layout.decompositions))
+      return EC_HTJ2KInvalidCompressedData;
+    for (Uint16 r = 0; r <= layout.decompositions; r++) {
+      layout.ppx[r] = segment[10 + r] & 0x0F;
+      layout.ppy[r] = segment[10 + r] >> 4;
+      if ((r > 0) && ((layout.ppx[r] == 0) || (layout.ppy[r] == 0)))
+        return EC_HTJ2KInvalidCompressedData;
+    }
+  }
+  layout.codFound = OFTrue;
+  return EC_Normal;
+}
+
+/// determines the packets of a tile in codestream order
+void enumeratePackets(CodingLayout const &layout, Uint16 tile,
+                      TileProgress &progress) {
+  Sint64 const tilesX =
+      ceilDiv(layout.width - layout.tileX0, layout.tileWidth);
+  Sint64 const p = tile % tilesX;
+  Sint64 const q = tile / tilesX;
+  progress.x0 = maximum(layout.tileX0 + p * layout.tileWidth, layout.x0);
+  progress.y0 = maximum(layout.tileY0 + q * layout.tileHeight, layout.y0);
+  progress.x1 =
+      minimum(layout.tileX0 + (p + 1) * layout.tileWidth, layout.width);
+  progress.y1 =
+      minimum(layout.tileY0 + (q + 1) * layout.tileHeight, layout.height);
+
+  Uint16 const levels = layout.decompositions;
+  progress.resolutions.resize(levels + 1);
+  Sint64 stepX = 0;
+  Sint64 stepY = 0;
+  for (Uint16 r = 0; r <= levels; r++) {
+    Resolution &res = progress.resolutions[r];
+    Sint64 const scale = OFstatic_cast(Sint64, 1) << (levels - r);
+    res.x0 = ceilDiv(progress.x0, scale);
+    res.y0 = ceilDiv(progress.y0, scale);
+    res.x1 = ceilDiv(progress.x1, scale);
+    res.y1 = ceilDiv(progress.y1, scale);
+    Sint64 const pw = OFstatic_cast(Sint64, 1) << layout.ppx[r];
+    Sint64 const ph = OFstatic_cast(Sint64, 1) << layout.ppy[r];
+    res.firstPrecinctX = floorDiv(res.x0, pw);
+    res.firstPrecinctY = floorDiv(res.y0, ph);
+    res.precinctsX =
+        (res.x1 > res.x0) ? ceilDiv(res.x1, pw) - res.firstPrecinctX : 0;
+    res.precinctsY =
+        (res.y1 > res.y0) ? ceilDiv(res.y1, ph) - res.firstPrecinctY : 0;
+    if ((r == 0) || (pw * scale < stepX)) stepX = pw * scale;
+    if ((r == 0) || (ph * scale < stepY)) stepY = ph * scale;
+  }
+
+  Packet packet;
+  Uint16 const components = layout.components;
+  switch (layout.progressionOrder) {
+    case 0:  // LRCP
+    case 1:  // RLCP, identical for a single layer
+      for (Uint16 r = 0; r <= levels; r++) {
+        Resolution const &res = progress.resolutions[r];
+        for (Uint16 c = 0; c < components; c++) {
+          for (Sint64 k = 0; k < res.precinctsX * res.precinctsY; k++) {
+            packet.resolution = r;
+            packet.component = c;
+            packet.precinct = k;
+            progress.packets.push_back(packet);
+          }
+        }
+      }
+      break;
+    default: {
+      // position driven progressions: every precinct is visited at the
+      // position of its upper left corner on the reference grid
+      Uint16 const outer = (layout.progressionOrder == 2) ? levels + 1 : 1;
+      Uint16 const first = (layout.progressionOrder == 4) ? components : 1;
+      for (Uint16 o = 0; o < outer; o++) {
+        for (Uint16 f = 0; f < first; f++) {
+          for (Sint64 y = progress.y0; y < progress.y1;
+               y += stepY - (y % stepY)) {
+            for (Sint64 x = progress.x0; x < progress.x1;
+                 x += stepX - (x % stepX)) {
+              for (Uint16 c = 0; c < components; c++) {
+                if ((first > 1) && (c != f)) continue;
+                for (Uint16 r = 0; r <= levels; r++) {
+                  if ((outer > 1) && (r != o)) continue;
+                  Resolution const &res = progress.resolutions[r];
+                  if ((res.precinctsX == 0) || (res.precinctsY == 0)) continue;
+                  Uint16 const d = OFstatic_cast(Uint16, levels - r);
+                  Sint64 const pw = OFstatic_cast(Sint64, 1)
+                                    << (layout.ppx[r] + d);
+                  Sint64 const ph = OFstatic_cast(Sint64, 1)
+                                    << (layout.ppy[r] + d);
+                  OFBool const matchY =
+                      (y % ph == 0) ||
+                      ((y == progress.y0) && (((res.y0 << d) % ph) != 0));
+                  OFBool const matchX =
+                      (x % pw == 0) ||
+                      ((x == progress.x0) && (((res.x0 << d) % pw) != 0));
+                  if (!matchX || !matchY) continue;
+                  Sint64 const scale = OFstatic_cast(Sint64, 1) << d;
+                  Sint64 const kx =
+                      floorDiv(ceilDiv(x, scale), pw >> d) - res.firstPrecinctX;
+                  Sint64 const ky =
+                      floorDiv(ceilDiv(y, scale), ph >> d) - res.firstPrecinctY;
+                  packet.resolution = r;
+                  packet.component = c;
+                  packet.precinct = kx + ky * res.precinctsX;
+                  progress.packets.push_back(packet);
+                }
+              }
+            }
+          }
+        }
+      }
+      break;
+    }
+  }
+  progress.initialized = OFTrue;
+}
+
+/** determines the length of a packet by parsing its header.
+ *  @param layout coding parameters of the codestream
+ *  @param progress tile the packet belongs to
+ *  @param packet packet to be parsed
+ *  @param data first byte of the packet
+ *  @param size number of bytes available for the packet
+ *  @param length length of the packet returned in this parameter
+ *  @return EC_Normal if successful, an error code otherwise
+ */
+OFCondition parsePacket(CodingLayout const &layout,
+                        TileProgress const &progress, Packet const &packet,
+                        Uint8 const *data, size_t size, size_t &length) {
+  size_t position = 0;
+  if (layout.sop && (size >= 6) && (readUint16(data) == MARKER_SOP))
+    position += 6;
+
+  PacketHeaderReader reader(data + position, size - position);
+  Uint64 bodyLength = 0;
+  if (reader.readBit()) {
+    Uint16 const r = packet.resolution;
+    Resolution const &res = progress.resolutions[r];
+    Sint64 const kx = res.firstPrecinctX + packet.precinct % res.precinctsX;
+    Sint64 const ky = res.firstPrecinctY + packet.precinct / res.precinctsX;
+    // the precinct partition of the subbands is half as large as the one of
+    // the resolution, except for the lowest resolution
+    Uint16 const ppx = (r > 0) ? layout.ppx[r] - 1 : layout.ppx[r];
+    Uint16 const ppy = (r > 0) ? layout.ppy[r] - 1 : layout.ppy[r];
+    Uint16 const xcb = (layout.xcb < ppx) ? layout.xcb : ppx;
+    Uint16 const ycb = (layout.ycb < ppy) ? layout.ycb : ppy;
+    Uint16 const nb =
+        OFstatic_cast(Uint16, (r > 0) ? layout.decompositions - r + 1
+                                      : layout.decompositions);
+    TagTree inclusion;
+    TagTree zeroBitPlanes;
+    // LL for the lowest resolution, HL, LH and HH for all others
+    for (Uint16 band = (r > 0) ? 1 : 0; band < ((r > 0) ? 4 : 1); band++) {
+      Sint64 const xob = band & 1;
+      Sint64 const yob = band >> 1;
+      Sint64 const bandScale = OFstatic_cast(Sint64, 1) << nb;
+      Sint64 const bandOffset = (nb > 0) ? bandScale >> 1 : 0;
+      Sint64 const bx0 = ceilDiv(progress.x0 - bandOffset * xob, bandScale);
+      Sint64 const by0 = ceilDiv(progress.y0 - bandOffset * yob, bandScale);
+      Sint64 const bx1 = ceilDiv(progress.x1 - bandOffset * xob, bandScale);
+      Sint64 const by1 = ceilDiv(progress.y1 - bandOffset * yob, bandScale);
+      Sint64 const px0 = maximum(kx << ppx, bx0);
+      Sint64 const py0 = maximum(ky << ppy, by0);
+      Sint64 const px1 = minimum((kx + 1) << ppx, bx1);
+      Sint64 const py1 = minimum((ky + 1) << ppy, by1);
+      if ((px0 >= px1) || (py0 >= py1)) continue;
+      Sint64 const cw = OFstatic_cast(Sint64, 1) << xcb;
+      Sint64 const ch = OFstatic_cast(Sint64, 1) << ycb;
+      Uint32 const blocksX =
+          OFstatic_cast(Uint32, ceilDiv(px1, cw) - floorDiv(px0, cw));
+      Uint32 const blocksY =
+          OFstatic_cast(Uint32, ceilDiv(py1, ch) - floorDiv(py0, ch));
+      inclusion.reset(blocksX, blocksY);
+      zeroBitPlanes.reset(blocksX, blocksY);
+      for (Uint32 y = 0; y < blocksY; y++) {
+        for (Uint32 x = 0; x < blocksX; x++) {
+          // every code-block contributes to the single layer or not at all
+          if (!inclusion.decode(reader, x, y, 1)) continue;
+          Sint32 threshold = 1;
+          while (!zeroBitPlanes.decode(reader, x, y, threshold)) {
+            if ((++threshold > 74) || reader.overrun())
+              return EC_HTJ2KInvalidCompressedData;
+          }
+          Uint32 const passes = readNumberOfPasses(reader);
+          // the cleanup pass, possibly followed by a SigProp and a MagRef
+          // pass in a second segment. Placeholder passes are not supported.
+          if (passes > 3) return EC_HTJ2KCodecUnsupportedValue;
+          Uint16 lblock = 3;
+          while (reader.readBit()) {
+            if ((++lblock > 31) || reader.overrun())
+              return EC_HTJ2KInvalidCompressedData;
+          }
+          bodyLength += reader.read(lblock);
+          if (passes > 1)
+            bodyLength += reader.read(
+                OFstatic_cast(Uint16, (passes > 2) ? lblock + 1 : lblock));
+        }
+      }
+    }
+  }
+  size_t const headerLength = reader.align();
+  if (reader.overrun()) return EC_HTJ2KInvalidCompressedData;
+  position += headerLength;
+  if (layout.eph) {
+    if ((position + 2 > size) || (readUint16(data + position) != MARKER_EPH))
+      return EC_HTJ2KInvalidCompressedData;
+    position += 2;
+  }
+  if (bodyLength > size - position) return EC_HTJ2KInvalidCompressedData;
+  length = position + OFstatic_cast(size_t, bodyLength);
+  return EC_Normal;
+}
+
+/** appends PLT marker segments listing the given packet lengths.
+ *  @return false if the lengths do not fit into 256 marker segments
+ */
+OFBool appendPacketLengths(OFVector<Uint32> const &lengths,
+                           OFVector<Uint8> &plt) {
+  size_t i = 0;
+  for (Uint16 index = 0; i < lengths.size(); index++) {
+    if (index > 255) return OFFalse;
+    size_t const start = plt.size();
+    plt.push_back(0xFF);
+    plt.push_back(0x58);
+    plt.push_back(0);  // Lplt, set below
+    plt.push_back(0);
+    plt.push_back(OFstatic_cast(Uint8, index));
+    for (; i < lengths.size(); i++) {
+      // lengths are coded in groups of 7 bits, most significant group first,
+      // all groups but the last with the high bit set
+      Uint8 code[5];
+      size_t count = 0;
+      Uint32 value = lengths[i];
+      do {
+        code[count++] = OFstatic_cast(Uint8, value & 0x7F);
+        value >>= 7;
+      } while (value > 0);
+      if (plt.size() - start - 2 + count > 0xFFFF) break;
+      while (count-- > 1) plt.push_back(code[count] | 0x80);
+      plt.push_back(code[0]);
+    }
+    size_t const segmentLength = plt.size() - start - 2;
+    plt[start + 2] = OFstatic_cast(Uint8, segmentLength >> 8);
+    plt[start + 3] = OFstatic_cast(Uint8, segmentLength & 0xFF);
+  }
+  return OFTrue;
+}
+
+/// writes bytes to the output file
+OFCondition writeBytes(ojph::outfile_base &outfile, Uint8 const *data,
+                       size_t count) {
+  if ((count > 0) && (outfile.write(data, count) != count))
+    return EC_MemoryExhausted;
+  return EC_Normal;
+}
+
+/// writes a big endian integer of the given size to the output file
+OFCondition writeInteger(ojph::outfile_base &outfile, Uint32 value,
+                         size_t size) {
+  Uint8 bytes[4];
+  for (size_t i = 0; i < size; i++)
+    bytes[i] = OFstatic_cast(Uint8, value >> (8 * (size - 1 - i)));
+  return writeBytes(outfile, bytes, size);
+}
+
+}  // namespace
+
+HtJ2kPacketLengthIndex::HtJ2kPacketLengthIndex()
+    : size_(0),
+      hasPacketLengths_(OFFalse),
+      tileParts_(),
+      tlmOffsets_(),
+      tlmSize_(0) {}
+
+OFCondition HtJ2kPacketLengthIndex::parse(Uint8 const *data, size_t size) {
+  size_ = 0;
+  hasPacketLengths_ = OFFalse;
+  tileParts_.clear();
+  tlmOffsets_.clear();
+  tlmSize_ = 0;
+
+  if ((data == NULL) || (size < 4) || (readUint16(data) != MARKER_SOC))
+    return EC_HTJ2KInvalidCompressedData;
+
+  // main header
+  CodingLayout layout;
+  size_t position = 2;
+  for (;;) {
+    if (position + 4 > size) return EC_HTJ2KInvalidCompressedData;
+    Uint16 const marker = readUint16(data + position);
+    if (marker == MARKER_SOT) break;
+    size_t const length = readUint16(data + position + 2);
+    if ((length < 2) || (position + 2 + length > size))
+      return EC_HTJ2KInvalidCompressedData;
+    Uint8 const *segment = data + position + 4;
+    OFCondition result = EC_Normal;
+    switch (marker) {
+      case MARKER_SIZ:
+        result = parseSIZ(segment, length - 2, layout);
+        break;
+      case MARKER_COD:
+        result = parseCOD(segment, length - 2, layout);
+        break;
+      case MARKER_TLM: {
+        if (length < 4) return EC_HTJ2KInvalidCompressedData;
+        Uint8 const stlm = segment[1];
+        size_t const st = (stlm >> 4) & 0x03;
+        size_t const sp = (stlm & 0x40) ? 4 : 2;
+        if ((st == 3) || ((tlmSize_ != 0) && (tlmSize_ != sp)))
+          return EC_HTJ2KInvalidCompressedData;
+        tlmSize_ = OFstatic_cast(Uint8, sp);
+        for (size_t entry = 2; entry + st + sp <= length - 2; entry += st + sp)
+          tlmOffsets_.push_back(position + 4 + entry + st);
+        break;
+      }
+      case MARKER_PLM:
+        hasPacketLengths_ = OFTrue;
+        break;
+      case MARKER_COC:
+      case MARKER_POC:
+      case MARKER_PPM:
+        result = EC_HTJ2KCodecUnsupportedValue;
+        break;
+      default:
+        break;
+    }
+    if (result.bad()) return result;
+    position += 2 + length;
+  }
+  if (!layout.sizFound || !layout.codFound)
+    return EC_HTJ2KInvalidCompressedData;
+
+  Sint64 const tiles =
+      ceilDiv(layout.width - layout.tileX0, layout.tileWidth) *
+      ceilDiv(layout.height - layout.tileY0, layout.tileHeight);
+  if ((tiles < 1) || (tiles > 65535)) return EC_HTJ2KInvalidCompressedData;
+  OFVector<TileProgress> progress(OFstatic_cast(size_t, tiles));
+
+  // tile-parts
+  while (!hasPacketLengths_ && (position + 2 <= size)) {
+    Uint16 const marker = readUint16(data + position);
+    if (marker == MARKER_EOC) break;
+    if ((marker != MARKER_SOT) || (position + 12 > size) ||
+        (readUint16(data + position + 2) != 10))
+      return EC_HTJ2KInvalidCompressedData;
+    Uint16 const tile = readUint16(data + position + 4);
+    TilePart tilePart;
+    tilePart.psotOffset = position + 6;
+    tilePart.psot = readUint32(data + position + 6);
+    size_t end = size;
+    if (tilePart.psot != 0) {
+      if ((tilePart.psot < 14) || (tilePart.psot > size - position))
+        return EC_HTJ2KInvalidCompressedData;
+      end = position + tilePart.psot;
+    } else if (readUint16(data + size - 2) == MARKER_EOC) {
+      end = size - 2;
+    }
+    if (tile >= progress.size()) return EC_HTJ2KInvalidCompressedData;
+
+    // tile-part header
+    size_t header = position + 12;
+    for (;;) {
+      if (header + 2 > end) return EC_HTJ2KInvalidCompressedData;
+      Uint16 const headerMarker = readUint16(data + header);
+      if (headerMarker == MARKER_SOD) break;
+      if (header + 4 > end) return EC_HTJ2KInvalidCompressedData;
+      size_t const length = readUint16(data + header + 2);
+      if ((length < 2) || (header + 2 + length > end))
+        return EC_HTJ2KInvalidCompressedData;
+      if (headerMarker == MARKER_PLT) hasPacketLengths_ = OFTrue;
+      if ((headerMarker == MARKER_COD) || (headerMarker == MARKER_COC) ||
+          (headerMarker == MARKER_POC) || (headerMarker == MARKER_PPT))
+        return EC_HTJ2KCodecUnsupportedValue;
+      header += 2 + length;
+    }
+    tilePart.sodOffset = header;
+
+    // tile-part body, continuing with the next packet of the tile
+    TileProgress &tileProgress = progress[tile];
+    if (!tileProgress.initialized)
+      enumeratePackets(layout, tile, tileProgress);
+    size_t packet = header + 2;
+    while (packet < end) {
+      if (tileProgress.next >= tileProgress.packets.size())
+        return EC_HTJ2KInvalidCompressedData;
+      size_t length = 0;
+      OFCondition result =
+          parsePacket(layout, tileProgress,
+                      tileProgress.packets[tileProgress.next++], data + packet,
+                      end - packet, length);
+      if (result.bad()) return result;
+      if (length > 0xFFFFFFFFUL) return EC_HTJ2KCodecUnsupportedValue;
+      tilePart.packetLengths.push_back(OFstatic_cast(Uint32, length));
+      packet += length;
+    }
+    tileParts_.push_back(tilePart);
+    position = end;
+  }
+
+  if (hasPacketLengths_) {
+    tileParts_.clear();
+    tlmOffsets_.clear();
+  } else {
+    // all packets of every tile must have been found
+    for (size_t t = 0; t < progress.size(); t++) {
+      if (progress[t].next != progress[t].packets.size())
+        return EC_HTJ2KInvalidCompressedData;
+    }
+    // the TLM marker must list every tile-part to be updated
+    if (!tlmOffsets_.empty() && (tlmOffsets_.size() != tileParts_.size()))
+      return EC_HTJ2KCodecUnsupportedValue;
+  }
+  size_ = size;
+  return EC_Normal;
+}
+
+OFCondition HtJ2kPacketLengthIndex::write(Uint8 const *data,
+                                          ojph::outfile_base &outfile) const {
+  // PLT marker segments of every tile-part and the updated lengths
+  OFVector<OFVector<Uint8> > markers(tileParts_.size());
+  OFVector<Uint32> psot(tileParts_.size());
+  OFVector<Uint32> ptlm(tlmOffsets_.size());
+  for (size_t i = 0; i < tileParts_.size(); i++) {
+    TilePart const &tilePart = tileParts_[i];
+    if (!appendPacketLengths(tilePart.packetLengths, markers[i]))
+      return EC_HTJ2KCodecUnsupportedValue;
+    Uint64 const added = markers[i].size();
+    psot[i] = tilePart.psot;
+    if (tilePart.psot != 0) {
+      if (tilePart.psot + added > 0xFFFFFFFFUL)
+        return EC_HTJ2KCodecUnsupportedValue;
+      psot[i] = OFstatic_cast(Uint32, tilePart.psot + added);
+    }
+    if (!tlmOffsets_.empty()) {
+      Uint8 const *field = data + tlmOffsets_[i];
+      Uint64 const length =
+          ((tlmSize_ == 4) ? readUint32(field) : readUint16(field)) + added;
+      if (length > ((tlmSize_ == 4) ? 0xFFFFFFFFUL : 0xFFFFUL))
+        return EC_HTJ2KCodecUnsupportedValue;
+      ptlm[i] = OFstatic_cast(Uint32, length);
+    }
+  }
+
+  OFCondition result = EC_Normal;
+  size_t position = 0;
+  for (size_t i = 0; result.good() && (i < tlmOffsets_.size()); i++) {
+    result = writeBytes(outfile, data + position, tlmOffsets_[i] - position);
+    if (result.good()) result = writeInteger(outfile, ptlm[i], tlmSize_);
+    position = tlmOffsets_[i] + tlmSize_;
+  }
+  for (size_t i = 0; result.good() && (i < tileParts_.size()); i++) {
+    TilePart const &tilePart = tileParts_[i];
+    result = writeBytes(outfile, data + position,
+                        tilePart.psotOffset - position);
+    if (result.good()) result = writeInteger(outfile, psot[i], 4);
+    position = tilePart.psotOffset + 4;
+    if (result.good())
+      result = writeBytes(outfile, data + position,
+                          tilePart.sodOffset - position);
+    if (result.good() && !markers[i].empty())
+      result = writeBytes(outfile, &markers[i][0], markers[i].size());
+    position = tilePart.sodOffset;
+  }
+  if (result.good())
+    result = writeBytes(outfile, data + position, size_ - position);
+  return result;
+}
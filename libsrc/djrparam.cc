@@ -4,15 +4,49 @@
 #include "dcmtk/ofstd/ofstd.h"
 
 HtJ2kRepresentationParameter::HtJ2kRepresentationParameter(
-    OFBool losslessProcess)
-    : DcmRepresentationParameter(), losslessProcess_(losslessProcess) {}
+    OFBool losslessProcess, double compressionRatio, Uint32 targetFrameSize,
+    double targetPSNR, Uint16 maximumError)
+    : DcmRepresentationParameter(),
+      losslessProcess_(losslessProcess),
+      compressionRatio_(compressionRatio),
+      targetFrameSize_(targetFrameSize),
+      targetPSNR_(targetPSNR),
+      maximumError_(maximumError),
+      encodingOptions_(OFFalse),
+      decompositions_(5),
+      cblkWidth_(64),
+      cblkHeight_(64),
+      progressionOrder_(EHTJ2KPO_default),
+      fragmentSize_(0) {}
 
 HtJ2kRepresentationParameter::HtJ2kRepresentationParameter(
     HtJ2kRepresentationParameter const &arg)
-    : DcmRepresentationParameter(arg), losslessProcess_(arg.losslessProcess_) {}
+    : DcmRepresentationParameter(arg),
+      losslessProcess_(arg.losslessProcess_),
+      compressionRatio_(arg.compressionRatio_),
+      targetFrameSize_(arg.targetFrameSize_),
+      targetPSNR_(arg.targetPSNR_),
+      maximumError_(arg.maximumError_),
+      encodingOptions_(arg.encodingOptions_),
+      decompositions_(arg.decompositions_),
+      cblkWidth_(arg.cblkWidth_),
+      cblkHeight_(arg.cblkHeight_),
+      progressionOrder_(arg.progressionOrder_),
+      fragmentSize_(arg.fragmentSize_) {}
 
 HtJ2kRepresentationParameter::~HtJ2kRepresentationParameter() {}
 
+void HtJ2kRepresentationParameter::setEncodingOptions(
+    Uint16 decompositions, Uint16 cblkWidth, Uint16 cblkHeight,
+    HTJ2K_ProgressionOrder progressionOrder, Uint32 fragmentSize) {
+  encodingOptions_ = OFTrue;
+  decompositions_ = decompositions;
+  cblkWidth_ = cblkWidth;
+  cblkHeight_ = cblkHeight;
+  progressionOrder_ = progressionOrder;
+  fragmentSize_ = fragmentSize;
+}
+
 DcmRepresentationParameter *HtJ2kRepresentationParameter::clone() const {
   return new HtJ2kRepresentationParameter(*this);
 }
@@ -29,11 +63,26 @@ OFBool HtJ2kRepresentationParameter::operator==(
     if (argstring == className()) {
       HtJ2kRepresentationParameter const &argll =
           OFreinterpret_cast(HtJ2kRepresentationParameter const &, arg);
+      // representations encoded with different options differ, whether
+      // lossless or lossy
+      if (encodingOptions_ != argll.encodingOptions_)
+        return OFFalse;
+      else if (encodingOptions_ &&
+               ((decompositions_ != argll.decompositions_) ||
+                (cblkWidth_ != argll.cblkWidth_) ||
+                (cblkHeight_ != argll.cblkHeight_) ||
+                (progressionOrder_ != argll.progressionOrder_) ||
+                (fragmentSize_ != argll.fragmentSize_)))
+        return OFFalse;
       if (losslessProcess_ && argll.losslessProcess_)
         return OFTrue;
       else if (losslessProcess_ != argll.losslessProcess_)
         return OFFalse;
-      return OFTrue;
+      // lossy representations differ by their rate control
+      return (compressionRatio_ == argll.compressionRatio_) &&
+             (targetFrameSize_ == argll.targetFrameSize_) &&
+             (targetPSNR_ == argll.targetPSNR_) &&
+             (maximumError_ == argll.maximumError_);
     }
   }
   return OFFalse;
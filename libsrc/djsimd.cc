@@ -0,0 +1,1117 @@
+#include "dcmtkhtj2k/djsimd.h"
+
+#include <cstring>
+
+#include "dcmtk/config/osconfig.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define DCMTKHTJ2K_SIMD_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h> /* for __cpuid, __cpuidex */
+#endif
+#endif
+
+// functions using instructions beyond the baseline of the compiler's target
+// must be marked as such for GCC and Clang. MSVC does not require this.
+#if defined(__GNUC__) || defined(__clang__)
+#define DCMTKHTJ2K_TARGET(isa) __attribute__((target(isa)))
+#else
+#define DCMTKHTJ2K_TARGET(isa)
+#endif
+
+namespace {
+
+// --------------------------------------------------------------------------
+// scalar kernels, also used for the tails of the vectorized kernels
+
+template <typename T, Sint32 Min, Sint32 Max>
+void narrowScalar(Sint32 const *source, T *target, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    Sint32 const v = source[i];
+    target[i] = OFstatic_cast(T, v < Min ? Min : (v > Max ? Max : v));
+  }
+}
+
+template <typename T>
+void interleaveScalar(T const *plane0, T const *plane1, T const *plane2,
+                      T *target, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    *target++ = plane0[i];
+    *target++ = plane1[i];
+    *target++ = plane2[i];
+  }
+}
+
+template <typename T>
+void widenScalar(T const *source, Uint16 component, Uint16 samplesPerPixel,
+                 Sint32 *target, size_t count) {
+  for (size_t i = 0; i < count; ++i)
+    target[i] = source[i * samplesPerPixel + component];
+}
+
+void narrowToUint8Scalar(Sint32 const *source, Uint8 *target, size_t count) {
+  narrowScalar<Uint8, 0, 255>(source, target, count);
+}
+
+void narrowToSint8Scalar(Sint32 const *source, Sint8 *target, size_t count) {
+  narrowScalar<Sint8, -128, 127>(source, target, count);
+}
+
+void narrowToUint16Scalar(Sint32 const *source, Uint16 *target,
+                          size_t count) {
+  narrowScalar<Uint16, 0, 65535>(source, target, count);
+}
+
+void narrowToSint16Scalar(Sint32 const *source, Sint16 *target,
+                          size_t count) {
+  narrowScalar<Sint16, -32768, 32767>(source, target, count);
+}
+
+void interleave8Scalar(Uint8 const *plane0, Uint8 const *plane1,
+                       Uint8 const *plane2, Uint8 *target, size_t count) {
+  interleaveScalar(plane0, plane1, plane2, target, count);
+}
+
+void interleave16Scalar(Uint16 const *plane0, Uint16 const *plane1,
+                        Uint16 const *plane2, Uint16 *target, size_t count) {
+  interleaveScalar(plane0, plane1, plane2, target, count);
+}
+
+void widenUint8Scalar(Uint8 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  widenScalar(source, component, samplesPerPixel, target, count);
+}
+
+void widenSint8Scalar(Sint8 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  widenScalar(source, component, samplesPerPixel, target, count);
+}
+
+void widenUint16Scalar(Uint16 const *source, Uint16 component,
+                       Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  widenScalar(source, component, samplesPerPixel, target, count);
+}
+
+void widenSint16Scalar(Sint16 const *source, Uint16 component,
+                       Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  widenScalar(source, component, samplesPerPixel, target, count);
+}
+
+void extractBitsScalar(Sint32 *line, size_t count, Uint16 lowBit,
+                       Uint16 bitsStored, OFBool isSigned) {
+  // the stored bits are moved to the top and back to the bottom, the second
+  // shift being arithmetic for signed samples
+  int const left = 32 - lowBit - bitsStored;
+  int const right = 32 - bitsStored;
+  if (isSigned) {
+    for (size_t i = 0; i < count; ++i)
+      line[i] = OFstatic_cast(Sint32, OFstatic_cast(Uint32, line[i]) << left) >>
+                right;
+  } else {
+    for (size_t i = 0; i < count; ++i)
+      line[i] = OFstatic_cast(
+          Sint32, (OFstatic_cast(Uint32, line[i]) << left) >> right);
+  }
+}
+
+void findRangeScalar(Sint32 const *line, size_t count, Sint32 &minimum,
+                     Sint32 &maximum) {
+  for (size_t i = 0; i < count; ++i) {
+    if (line[i] < minimum) minimum = line[i];
+    if (line[i] > maximum) maximum = line[i];
+  }
+}
+
+void shiftLeftScalar(Sint32 *line, size_t count, Uint16 shift) {
+  for (size_t i = 0; i < count; ++i)
+    line[i] = OFstatic_cast(Sint32, OFstatic_cast(Uint32, line[i]) << shift);
+}
+
+#ifdef DCMTKHTJ2K_SIMD_X86
+
+// --------------------------------------------------------------------------
+// CPU feature detection
+
+struct HtJ2kCpuFeatures {
+  HtJ2kCpuFeatures() : sse2(false), avx2(false), avx512(false) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int const maxLeaf = info[0];
+    __cpuid(info, 1);
+    sse2 = ((info[3] >> 26) & 1) != 0;
+    bool const osxsave = ((info[2] >> 27) & 1) != 0;
+    bool const avx = ((info[2] >> 28) & 1) != 0;
+    // the operating system must save the YMM (and ZMM) registers
+    unsigned __int64 const xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool const ymmState = (xcr0 & 0x06) == 0x06;
+    bool const zmmState = (xcr0 & 0xe6) == 0xe6;
+    int ebx7 = 0;
+    if (maxLeaf >= 7) {
+      __cpuidex(info, 7, 0);
+      ebx7 = info[1];
+    }
+    avx2 = avx && ymmState && ((ebx7 >> 5) & 1) != 0;
+    avx512 = avx2 && zmmState && ((ebx7 >> 16) & 1) != 0 &&
+             ((ebx7 >> 30) & 1) != 0;
+#else
+    // also checks whether the operating system saves the extended registers
+    __builtin_cpu_init();
+    sse2 = __builtin_cpu_supports("sse2") != 0;
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+    avx512 = avx2 && __builtin_cpu_supports("avx512f") != 0 &&
+             __builtin_cpu_supports("avx512bw") != 0;
+#endif
+  }
+
+  bool sse2;
+  bool avx2;
+  bool avx512;
+};
+
+HtJ2kCpuFeatures const &cpuFeatures() {
+  static HtJ2kCpuFeatures const features;
+  return features;
+}
+
+// --------------------------------------------------------------------------
+// shuffle control masks for interleaving three planes with PSHUFB.
+// Each 16-byte lane of an output vector takes its samples from a single
+// 16-byte block of each plane, which is broadcast to that lane first.
+
+struct HtJ2kInterleaveMasks {
+  /** computes the masks.
+   *  @param lanes number of 16-byte lanes per vector
+   */
+  explicit HtJ2kInterleaveMasks(int lanes) {
+    memset(mask, 0x80, sizeof(mask));
+    for (int size = 1; size <= 2; ++size) {
+      for (int out = 0; out < 3; ++out) {
+        for (int lane = 0; lane < lanes; ++lane) {
+          int const block = (out * lanes + lane) / 3;
+          for (int i = 0; i < 16; ++i) {
+            int const k = (out * lanes + lane) * 16 + i;  // output byte
+            int const sample = k / size;
+            int const pixel = sample / 3;
+            int const source = (pixel - block * (16 / size)) * size + k % size;
+            for (int plane = 0; plane < 3; ++plane) {
+              mask[size - 1][out][plane][lane * 16 + i] =
+                  (sample % 3 == plane) ? OFstatic_cast(Uint8, source) : 0x80;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  /// masks by sample size - 1, output vector, plane and byte
+  Uint8 mask[2][3][3][64];
+};
+
+HtJ2kInterleaveMasks const &interleaveMasksAvx2() {
+  static HtJ2kInterleaveMasks const masks(2);
+  return masks;
+}
+
+HtJ2kInterleaveMasks const &interleaveMasksAvx512() {
+  static HtJ2kInterleaveMasks const masks(4);
+  return masks;
+}
+
+// --------------------------------------------------------------------------
+// shuffle control masks for extracting one component of color-by-pixel data
+// with PSHUFB. 48 bytes of input, i.e. 16 pixels of 8-bit or 8 pixels of
+// 16-bit samples, are loaded into three vectors; the samples of the component
+// are collected from each of them into a single 16-byte vector.
+
+struct HtJ2kDeinterleaveMasks {
+  /// computes the masks
+  HtJ2kDeinterleaveMasks() {
+    for (int size = 1; size <= 2; ++size) {
+      for (int component = 0; component < 3; ++component) {
+        for (int i = 0; i < 16; ++i) {
+          int const source = ((i / size) * 3 + component) * size + i % size;
+          for (int block = 0; block < 3; ++block) {
+            mask[size - 1][component][block][i] =
+                (source / 16 == block) ? OFstatic_cast(Uint8, source % 16)
+                                       : 0x80;
+          }
+        }
+      }
+    }
+  }
+
+  /// masks by sample size - 1, component, input vector and byte
+  Uint8 mask[2][3][3][16];
+};
+
+HtJ2kDeinterleaveMasks const &deinterleaveMasks() {
+  static HtJ2kDeinterleaveMasks const masks;
+  return masks;
+}
+
+// --------------------------------------------------------------------------
+// SSE2 kernels
+
+DCMTKHTJ2K_TARGET("sse2")
+void narrowToUint8Sse2(Sint32 const *source, Uint8 *target, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i const *s = OFreinterpret_cast(__m128i const *, source + i);
+    __m128i const ab =
+        _mm_packs_epi32(_mm_loadu_si128(s), _mm_loadu_si128(s + 1));
+    __m128i const cd =
+        _mm_packs_epi32(_mm_loadu_si128(s + 2), _mm_loadu_si128(s + 3));
+    _mm_storeu_si128(OFreinterpret_cast(__m128i *, target + i),
+                     _mm_packus_epi16(ab, cd));
+  }
+  narrowToUint8Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void narrowToSint8Sse2(Sint32 const *source, Sint8 *target, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i const *s = OFreinterpret_cast(__m128i const *, source + i);
+    __m128i const ab =
+        _mm_packs_epi32(_mm_loadu_si128(s), _mm_loadu_si128(s + 1));
+    __m128i const cd =
+        _mm_packs_epi32(_mm_loadu_si128(s + 2), _mm_loadu_si128(s + 3));
+    _mm_storeu_si128(OFreinterpret_cast(__m128i *, target + i),
+                     _mm_packs_epi16(ab, cd));
+  }
+  narrowToSint8Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void narrowToUint16Sse2(Sint32 const *source, Uint16 *target, size_t count) {
+  // SSE2 lacks an unsigned 32-to-16 bit pack, so the samples are clamped to
+  // 0..65535, biased into the signed range, packed and unbiased again.
+  __m128i const zero = _mm_setzero_si128();
+  __m128i const max = _mm_set1_epi32(65535);
+  __m128i const bias32 = _mm_set1_epi32(32768);
+  __m128i const bias16 = _mm_set1_epi16(OFstatic_cast(short, 0x8000));
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i const *s = OFreinterpret_cast(__m128i const *, source + i);
+    __m128i v[2] = {_mm_loadu_si128(s), _mm_loadu_si128(s + 1)};
+    for (int j = 0; j < 2; ++j) {
+      v[j] = _mm_andnot_si128(_mm_cmplt_epi32(v[j], zero), v[j]);
+      __m128i const above = _mm_cmpgt_epi32(v[j], max);
+      v[j] = _mm_or_si128(_mm_and_si128(above, max),
+                          _mm_andnot_si128(above, v[j]));
+      v[j] = _mm_sub_epi32(v[j], bias32);
+    }
+    _mm_storeu_si128(OFreinterpret_cast(__m128i *, target + i),
+                     _mm_xor_si128(_mm_packs_epi32(v[0], v[1]), bias16));
+  }
+  narrowToUint16Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void narrowToSint16Sse2(Sint32 const *source, Sint16 *target, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i const *s = OFreinterpret_cast(__m128i const *, source + i);
+    _mm_storeu_si128(
+        OFreinterpret_cast(__m128i *, target + i),
+        _mm_packs_epi32(_mm_loadu_si128(s), _mm_loadu_si128(s + 1)));
+  }
+  narrowToSint16Scalar(source + i, target + i, count - i);
+}
+
+/// stores the low 12 bytes of a vector
+DCMTKHTJ2K_TARGET("sse2")
+inline void store12Sse2(Uint8 *target, __m128i v) {
+  _mm_storel_epi64(OFreinterpret_cast(__m128i *, target), v);
+  int const tail = _mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+  memcpy(target + 8, &tail, 4);
+}
+
+/// packs two pixels of four 16-bit samples each into 12 bytes
+DCMTKHTJ2K_TARGET("sse2")
+inline __m128i compact16Sse2(__m128i v) {
+  return _mm_or_si128(_mm_move_epi64(v),
+                      _mm_slli_si128(_mm_srli_si128(v, 8), 6));
+}
+
+/// packs four pixels of four 8-bit samples each into 12 bytes
+DCMTKHTJ2K_TARGET("sse2")
+inline __m128i compact8Sse2(__m128i v) {
+  __m128i const low = _mm_set_epi32(0, -1, 0, -1);
+  // two pixels of 3 bytes in the low 6 bytes of each 64-bit half
+  __m128i const pairs = _mm_or_si128(
+      _mm_and_si128(v, low), _mm_slli_epi64(_mm_srli_epi64(v, 32), 24));
+  return compact16Sse2(pairs);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void interleave8Sse2(Uint8 const *plane0, Uint8 const *plane1,
+                     Uint8 const *plane2, Uint8 *target, size_t count) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i const p0 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane0 + i));
+    __m128i const p1 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane1 + i));
+    __m128i const p2 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane2 + i));
+    __m128i const p01lo = _mm_unpacklo_epi8(p0, p1);
+    __m128i const p01hi = _mm_unpackhi_epi8(p0, p1);
+    __m128i const p2lo = _mm_unpacklo_epi8(p2, zero);
+    __m128i const p2hi = _mm_unpackhi_epi8(p2, zero);
+    Uint8 *t = target + 3 * i;
+    store12Sse2(t, compact8Sse2(_mm_unpacklo_epi16(p01lo, p2lo)));
+    store12Sse2(t + 12, compact8Sse2(_mm_unpackhi_epi16(p01lo, p2lo)));
+    store12Sse2(t + 24, compact8Sse2(_mm_unpacklo_epi16(p01hi, p2hi)));
+    store12Sse2(t + 36, compact8Sse2(_mm_unpackhi_epi16(p01hi, p2hi)));
+  }
+  interleave8Scalar(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                    count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void interleave16Sse2(Uint16 const *plane0, Uint16 const *plane1,
+                      Uint16 const *plane2, Uint16 *target, size_t count) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i const p0 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane0 + i));
+    __m128i const p1 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane1 + i));
+    __m128i const p2 =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, plane2 + i));
+    __m128i const p01lo = _mm_unpacklo_epi16(p0, p1);
+    __m128i const p01hi = _mm_unpackhi_epi16(p0, p1);
+    __m128i const p2lo = _mm_unpacklo_epi16(p2, zero);
+    __m128i const p2hi = _mm_unpackhi_epi16(p2, zero);
+    Uint8 *t = OFreinterpret_cast(Uint8 *, target + 3 * i);
+    store12Sse2(t, compact16Sse2(_mm_unpacklo_epi32(p01lo, p2lo)));
+    store12Sse2(t + 12, compact16Sse2(_mm_unpackhi_epi32(p01lo, p2lo)));
+    store12Sse2(t + 24, compact16Sse2(_mm_unpacklo_epi32(p01hi, p2hi)));
+    store12Sse2(t + 36, compact16Sse2(_mm_unpackhi_epi32(p01hi, p2hi)));
+  }
+  interleave16Scalar(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                     count - i);
+}
+
+// SSE2 lacks a byte shuffle, so color-by-pixel data is de-interleaved by
+// the scalar kernels
+
+DCMTKHTJ2K_TARGET("sse2")
+void widenUint8Sse2(Uint8 const *source, Uint16 component,
+                    Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m128i const lo = _mm_unpacklo_epi8(v, zero);
+      __m128i const hi = _mm_unpackhi_epi8(v, zero);
+      __m128i *t = OFreinterpret_cast(__m128i *, target + i);
+      _mm_storeu_si128(t, _mm_unpacklo_epi16(lo, zero));
+      _mm_storeu_si128(t + 1, _mm_unpackhi_epi16(lo, zero));
+      _mm_storeu_si128(t + 2, _mm_unpacklo_epi16(hi, zero));
+      _mm_storeu_si128(t + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+  }
+  widenUint8Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                   target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void widenSint8Sse2(Sint8 const *source, Uint16 component,
+                    Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      // every byte is replicated into the upper bytes and shifted back to
+      // the lowest byte, which extends the sign
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m128i const lo = _mm_unpacklo_epi8(v, v);
+      __m128i const hi = _mm_unpackhi_epi8(v, v);
+      __m128i *t = OFreinterpret_cast(__m128i *, target + i);
+      _mm_storeu_si128(t, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24));
+      _mm_storeu_si128(t + 1, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24));
+      _mm_storeu_si128(t + 2, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24));
+      _mm_storeu_si128(t + 3, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24));
+    }
+  }
+  widenSint8Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                   target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void widenUint16Sse2(Uint16 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  __m128i const zero = _mm_setzero_si128();
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m128i *t = OFreinterpret_cast(__m128i *, target + i);
+      _mm_storeu_si128(t, _mm_unpacklo_epi16(v, zero));
+      _mm_storeu_si128(t + 1, _mm_unpackhi_epi16(v, zero));
+    }
+  }
+  widenUint16Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                    target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void widenSint16Sse2(Sint16 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m128i *t = OFreinterpret_cast(__m128i *, target + i);
+      _mm_storeu_si128(t, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+      _mm_storeu_si128(t + 1, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    }
+  }
+  widenSint16Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                    target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void extractBitsSse2(Sint32 *line, size_t count, Uint16 lowBit,
+                     Uint16 bitsStored, OFBool isSigned) {
+  __m128i const left = _mm_cvtsi32_si128(32 - lowBit - bitsStored);
+  __m128i const right = _mm_cvtsi32_si128(32 - bitsStored);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i *s = OFreinterpret_cast(__m128i *, line + i);
+    __m128i const v = _mm_sll_epi32(_mm_loadu_si128(s), left);
+    _mm_storeu_si128(s, isSigned ? _mm_sra_epi32(v, right)
+                                 : _mm_srl_epi32(v, right));
+  }
+  extractBitsScalar(line + i, count - i, lowBit, bitsStored, isSigned);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void findRangeSse2(Sint32 const *line, size_t count, Sint32 &minimum,
+                   Sint32 &maximum) {
+  // SSE2 lacks 32-bit minimum and maximum, so they are selected by masks
+  size_t i = 0;
+  if (count >= 4) {
+    __m128i lo = _mm_set1_epi32(minimum);
+    __m128i hi = _mm_set1_epi32(maximum);
+    for (; i + 4 <= count; i += 4) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, line + i));
+      __m128i const below = _mm_cmplt_epi32(v, lo);
+      __m128i const above = _mm_cmpgt_epi32(v, hi);
+      lo = _mm_or_si128(_mm_and_si128(below, v), _mm_andnot_si128(below, lo));
+      hi = _mm_or_si128(_mm_and_si128(above, v), _mm_andnot_si128(above, hi));
+    }
+    Sint32 lanes[8];
+    _mm_storeu_si128(OFreinterpret_cast(__m128i *, lanes), lo);
+    _mm_storeu_si128(OFreinterpret_cast(__m128i *, lanes + 4), hi);
+    findRangeScalar(lanes, 4, minimum, maximum);
+    findRangeScalar(lanes + 4, 4, minimum, maximum);
+  }
+  findRangeScalar(line + i, count - i, minimum, maximum);
+}
+
+DCMTKHTJ2K_TARGET("sse2")
+void shiftLeftSse2(Sint32 *line, size_t count, Uint16 shift) {
+  __m128i const left = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i *s = OFreinterpret_cast(__m128i *, line + i);
+    _mm_storeu_si128(s, _mm_sll_epi32(_mm_loadu_si128(s), left));
+  }
+  shiftLeftScalar(line + i, count - i, shift);
+}
+
+// --------------------------------------------------------------------------
+// AVX2 kernels
+
+DCMTKHTJ2K_TARGET("avx2")
+void narrowToUint8Avx2(Sint32 const *source, Uint8 *target, size_t count) {
+  __m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i const *s = OFreinterpret_cast(__m256i const *, source + i);
+    __m256i const ab =
+        _mm256_packs_epi32(_mm256_loadu_si256(s), _mm256_loadu_si256(s + 1));
+    __m256i const cd = _mm256_packs_epi32(_mm256_loadu_si256(s + 2),
+                                          _mm256_loadu_si256(s + 3));
+    // the packs operate per 128-bit lane, restore the sample order
+    _mm256_storeu_si256(
+        OFreinterpret_cast(__m256i *, target + i),
+        _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), order));
+  }
+  narrowToUint8Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void narrowToSint8Avx2(Sint32 const *source, Sint8 *target, size_t count) {
+  __m256i const order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i const *s = OFreinterpret_cast(__m256i const *, source + i);
+    __m256i const ab =
+        _mm256_packs_epi32(_mm256_loadu_si256(s), _mm256_loadu_si256(s + 1));
+    __m256i const cd = _mm256_packs_epi32(_mm256_loadu_si256(s + 2),
+                                          _mm256_loadu_si256(s + 3));
+    // the packs operate per 128-bit lane, restore the sample order
+    _mm256_storeu_si256(
+        OFreinterpret_cast(__m256i *, target + i),
+        _mm256_permutevar8x32_epi32(_mm256_packs_epi16(ab, cd), order));
+  }
+  narrowToSint8Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void narrowToUint16Avx2(Sint32 const *source, Uint16 *target, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i const *s = OFreinterpret_cast(__m256i const *, source + i);
+    __m256i const ab = _mm256_packus_epi32(_mm256_loadu_si256(s),
+                                           _mm256_loadu_si256(s + 1));
+    // the pack operates per 128-bit lane, restore the sample order
+    _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                        _mm256_permute4x64_epi64(ab, 0xd8));
+  }
+  narrowToUint16Scalar(source + i, target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void narrowToSint16Avx2(Sint32 const *source, Sint16 *target, size_t count) {
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m256i const *s = OFreinterpret_cast(__m256i const *, source + i);
+    __m256i const ab =
+        _mm256_packs_epi32(_mm256_loadu_si256(s), _mm256_loadu_si256(s + 1));
+    // the pack operates per 128-bit lane, restore the sample order
+    _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                        _mm256_permute4x64_epi64(ab, 0xd8));
+  }
+  narrowToSint16Scalar(source + i, target + i, count - i);
+}
+
+/** interleaves 32 bytes of each plane into 96 bytes.
+ *  @param mask shuffle masks for the sample size
+ */
+DCMTKHTJ2K_TARGET("avx2")
+inline void interleaveBlockAvx2(Uint8 const *plane0, Uint8 const *plane1,
+                                Uint8 const *plane2, Uint8 *target,
+                                Uint8 const (*mask)[3][64]) {
+  __m256i const p[3] = {
+      _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, plane0)),
+      _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, plane1)),
+      _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, plane2))};
+  __m256i out[3] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                    _mm256_setzero_si256()};
+  for (int c = 0; c < 3; ++c) {
+    // blocks feeding the lanes of the output vectors: (0,0), (0,1), (1,1)
+    __m256i const src[3] = {_mm256_permute2x128_si256(p[c], p[c], 0x00), p[c],
+                            _mm256_permute2x128_si256(p[c], p[c], 0x11)};
+    for (int j = 0; j < 3; ++j) {
+      __m256i const m =
+          _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, mask[j][c]));
+      out[j] = _mm256_or_si256(out[j], _mm256_shuffle_epi8(src[j], m));
+    }
+  }
+  for (int j = 0; j < 3; ++j)
+    _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + 32 * j),
+                        out[j]);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void interleave8Avx2(Uint8 const *plane0, Uint8 const *plane1,
+                     Uint8 const *plane2, Uint8 *target, size_t count) {
+  Uint8 const(*mask)[3][64] = interleaveMasksAvx2().mask[0];
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    interleaveBlockAvx2(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                        mask);
+  }
+  interleave8Sse2(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                  count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void interleave16Avx2(Uint16 const *plane0, Uint16 const *plane1,
+                      Uint16 const *plane2, Uint16 *target, size_t count) {
+  Uint8 const(*mask)[3][64] = interleaveMasksAvx2().mask[1];
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    interleaveBlockAvx2(OFreinterpret_cast(Uint8 const *, plane0 + i),
+                        OFreinterpret_cast(Uint8 const *, plane1 + i),
+                        OFreinterpret_cast(Uint8 const *, plane2 + i),
+                        OFreinterpret_cast(Uint8 *, target + 3 * i), mask);
+  }
+  interleave16Sse2(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                   count - i);
+}
+
+/** collects one component of 48 bytes of color-by-pixel data into a vector.
+ *  @param mask shuffle masks for the sample size and component
+ */
+DCMTKHTJ2K_TARGET("avx2")
+inline __m128i deinterleaveBlockAvx2(void const *source,
+                                     Uint8 const (*mask)[16]) {
+  __m128i const *s = OFstatic_cast(__m128i const *, source);
+  __m128i v = _mm_setzero_si128();
+  for (int j = 0; j < 3; ++j) {
+    __m128i const m =
+        _mm_loadu_si128(OFreinterpret_cast(__m128i const *, mask[j]));
+    v = _mm_or_si128(v, _mm_shuffle_epi8(_mm_loadu_si128(s + j), m));
+  }
+  return v;
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void widenUint8Avx2(Uint8 const *source, Uint16 component,
+                    Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m256i *t = OFreinterpret_cast(__m256i *, target + i);
+      _mm256_storeu_si256(t, _mm256_cvtepu8_epi32(v));
+      _mm256_storeu_si256(t + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    }
+  } else if (samplesPerPixel == 3) {
+    Uint8 const(*mask)[16] = deinterleaveMasks().mask[0][component];
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v = deinterleaveBlockAvx2(source + 3 * i, mask);
+      __m256i *t = OFreinterpret_cast(__m256i *, target + i);
+      _mm256_storeu_si256(t, _mm256_cvtepu8_epi32(v));
+      _mm256_storeu_si256(t + 1, _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8)));
+    }
+  }
+  widenUint8Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                   target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void widenSint8Avx2(Sint8 const *source, Uint16 component,
+                    Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      __m256i *t = OFreinterpret_cast(__m256i *, target + i);
+      _mm256_storeu_si256(t, _mm256_cvtepi8_epi32(v));
+      _mm256_storeu_si256(t + 1, _mm256_cvtepi8_epi32(_mm_srli_si128(v, 8)));
+    }
+  } else if (samplesPerPixel == 3) {
+    Uint8 const(*mask)[16] = deinterleaveMasks().mask[0][component];
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v = deinterleaveBlockAvx2(source + 3 * i, mask);
+      __m256i *t = OFreinterpret_cast(__m256i *, target + i);
+      _mm256_storeu_si256(t, _mm256_cvtepi8_epi32(v));
+      _mm256_storeu_si256(t + 1, _mm256_cvtepi8_epi32(_mm_srli_si128(v, 8)));
+    }
+  }
+  widenSint8Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                   target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void widenUint16Avx2(Uint16 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                          _mm256_cvtepu16_epi32(v));
+    }
+  } else if (samplesPerPixel == 3) {
+    Uint8 const(*mask)[16] = deinterleaveMasks().mask[1][component];
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v = deinterleaveBlockAvx2(source + 3 * i, mask);
+      _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                          _mm256_cvtepu16_epi32(v));
+    }
+  }
+  widenUint16Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                    target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void widenSint16Avx2(Sint16 const *source, Uint16 component,
+                     Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                          _mm256_cvtepi16_epi32(v));
+    }
+  } else if (samplesPerPixel == 3) {
+    Uint8 const(*mask)[16] = deinterleaveMasks().mask[1][component];
+    for (; i + 8 <= count; i += 8) {
+      __m128i const v = deinterleaveBlockAvx2(source + 3 * i, mask);
+      _mm256_storeu_si256(OFreinterpret_cast(__m256i *, target + i),
+                          _mm256_cvtepi16_epi32(v));
+    }
+  }
+  widenSint16Scalar(source + i * samplesPerPixel, component, samplesPerPixel,
+                    target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void extractBitsAvx2(Sint32 *line, size_t count, Uint16 lowBit,
+                     Uint16 bitsStored, OFBool isSigned) {
+  __m128i const left = _mm_cvtsi32_si128(32 - lowBit - bitsStored);
+  __m128i const right = _mm_cvtsi32_si128(32 - bitsStored);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i *s = OFreinterpret_cast(__m256i *, line + i);
+    __m256i const v = _mm256_sll_epi32(_mm256_loadu_si256(s), left);
+    _mm256_storeu_si256(s, isSigned ? _mm256_sra_epi32(v, right)
+                                    : _mm256_srl_epi32(v, right));
+  }
+  extractBitsScalar(line + i, count - i, lowBit, bitsStored, isSigned);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void findRangeAvx2(Sint32 const *line, size_t count, Sint32 &minimum,
+                   Sint32 &maximum) {
+  size_t i = 0;
+  if (count >= 8) {
+    __m256i lo = _mm256_set1_epi32(minimum);
+    __m256i hi = _mm256_set1_epi32(maximum);
+    for (; i + 8 <= count; i += 8) {
+      __m256i const v =
+          _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, line + i));
+      lo = _mm256_min_epi32(lo, v);
+      hi = _mm256_max_epi32(hi, v);
+    }
+    Sint32 lanes[16];
+    _mm256_storeu_si256(OFreinterpret_cast(__m256i *, lanes), lo);
+    _mm256_storeu_si256(OFreinterpret_cast(__m256i *, lanes + 8), hi);
+    findRangeScalar(lanes, 8, minimum, maximum);
+    findRangeScalar(lanes + 8, 8, minimum, maximum);
+  }
+  findRangeScalar(line + i, count - i, minimum, maximum);
+}
+
+DCMTKHTJ2K_TARGET("avx2")
+void shiftLeftAvx2(Sint32 *line, size_t count, Uint16 shift) {
+  __m128i const left = _mm_cvtsi32_si128(shift);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i *s = OFreinterpret_cast(__m256i *, line + i);
+    _mm256_storeu_si256(s, _mm256_sll_epi32(_mm256_loadu_si256(s), left));
+  }
+  shiftLeftScalar(line + i, count - i, shift);
+}
+
+// --------------------------------------------------------------------------
+// AVX-512 kernels. The tails are processed with masked loads and stores.
+// Zero-masking variants are used throughout, including with a full mask:
+// the unmasked intrinsics of GCC pass an undefined source operand, which
+// triggers -Wuninitialized warnings.
+
+/// mask selecting all 32-bit lanes of a vector
+#define DCMTKHTJ2K_ALL_LANES OFstatic_cast(__mmask16, 0xFFFF)
+
+#define DCMTKHTJ2K_AVX512 "avx512f,avx512bw"
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void narrowToUint8Avx512(Sint32 const *source, Uint8 *target, size_t count) {
+  __m512i const zero = _mm512_setzero_si512();
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    __m512i const v = _mm512_maskz_max_epi32(
+        k, _mm512_maskz_loadu_epi32(k, source + i), zero);
+    _mm512_mask_cvtusepi32_storeu_epi8(target + i, k, v);
+  }
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void narrowToSint8Avx512(Sint32 const *source, Sint8 *target, size_t count) {
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    _mm512_mask_cvtsepi32_storeu_epi8(target + i, k,
+                                      _mm512_maskz_loadu_epi32(k, source + i));
+  }
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void narrowToUint16Avx512(Sint32 const *source, Uint16 *target,
+                          size_t count) {
+  __m512i const zero = _mm512_setzero_si512();
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    __m512i const v = _mm512_maskz_max_epi32(
+        k, _mm512_maskz_loadu_epi32(k, source + i), zero);
+    _mm512_mask_cvtusepi32_storeu_epi16(target + i, k, v);
+  }
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void narrowToSint16Avx512(Sint32 const *source, Sint16 *target,
+                          size_t count) {
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    _mm512_mask_cvtsepi32_storeu_epi16(target + i, k,
+                                       _mm512_maskz_loadu_epi32(k, source + i));
+  }
+}
+
+/** interleaves 64 bytes of each plane into 192 bytes.
+ *  @param mask shuffle masks for the sample size
+ */
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+inline void interleaveBlockAvx512(Uint8 const *plane0, Uint8 const *plane1,
+                                  Uint8 const *plane2, Uint8 *target,
+                                  Uint8 const (*mask)[3][64]) {
+  __m512i const p[3] = {_mm512_loadu_si512(plane0), _mm512_loadu_si512(plane1),
+                        _mm512_loadu_si512(plane2)};
+  // blocks feeding the lanes of the output vectors:
+  // (0,0,0,1), (1,1,2,2), (2,3,3,3)
+  __m512i const blocks[3] = {_mm512_setr_epi64(0, 1, 0, 1, 0, 1, 2, 3),
+                             _mm512_setr_epi64(2, 3, 2, 3, 4, 5, 4, 5),
+                             _mm512_setr_epi64(4, 5, 6, 7, 6, 7, 6, 7)};
+  __m512i out[3] = {_mm512_setzero_si512(), _mm512_setzero_si512(),
+                    _mm512_setzero_si512()};
+  for (int c = 0; c < 3; ++c) {
+    __m512i const src[3] = {
+        _mm512_maskz_permutexvar_epi64(0xFF, blocks[0], p[c]),
+        _mm512_maskz_permutexvar_epi64(0xFF, blocks[1], p[c]),
+        _mm512_maskz_permutexvar_epi64(0xFF, blocks[2], p[c])};
+    for (int j = 0; j < 3; ++j) {
+      __m512i const m = _mm512_loadu_si512(mask[j][c]);
+      out[j] = _mm512_or_si512(out[j], _mm512_shuffle_epi8(src[j], m));
+    }
+  }
+  for (int j = 0; j < 3; ++j) _mm512_storeu_si512(target + 64 * j, out[j]);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void interleave8Avx512(Uint8 const *plane0, Uint8 const *plane1,
+                       Uint8 const *plane2, Uint8 *target, size_t count) {
+  Uint8 const(*mask)[3][64] = interleaveMasksAvx512().mask[0];
+  size_t i = 0;
+  for (; i + 64 <= count; i += 64) {
+    interleaveBlockAvx512(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                          mask);
+  }
+  interleave8Avx2(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                  count - i);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void interleave16Avx512(Uint16 const *plane0, Uint16 const *plane1,
+                        Uint16 const *plane2, Uint16 *target, size_t count) {
+  Uint8 const(*mask)[3][64] = interleaveMasksAvx512().mask[1];
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    interleaveBlockAvx512(OFreinterpret_cast(Uint8 const *, plane0 + i),
+                          OFreinterpret_cast(Uint8 const *, plane1 + i),
+                          OFreinterpret_cast(Uint8 const *, plane2 + i),
+                          OFreinterpret_cast(Uint8 *, target + 3 * i), mask);
+  }
+  interleave16Avx2(plane0 + i, plane1 + i, plane2 + i, target + 3 * i,
+                   count - i);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void extractBitsAvx512(Sint32 *line, size_t count, Uint16 lowBit,
+                       Uint16 bitsStored, OFBool isSigned) {
+  __m128i const left = _mm_cvtsi32_si128(32 - lowBit - bitsStored);
+  __m128i const right = _mm_cvtsi32_si128(32 - bitsStored);
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    __m512i const v =
+        _mm512_maskz_sll_epi32(k, _mm512_maskz_loadu_epi32(k, line + i), left);
+    _mm512_mask_storeu_epi32(line + i, k,
+                             isSigned ? _mm512_maskz_sra_epi32(k, v, right)
+                                      : _mm512_maskz_srl_epi32(k, v, right));
+  }
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void findRangeAvx512(Sint32 const *line, size_t count, Sint32 &minimum,
+                     Sint32 &maximum) {
+  __m512i lo = _mm512_set1_epi32(minimum);
+  __m512i hi = _mm512_set1_epi32(maximum);
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    // lanes beyond the tail keep their value
+    __m512i const v = _mm512_maskz_loadu_epi32(k, line + i);
+    lo = _mm512_mask_min_epi32(lo, k, lo, v);
+    hi = _mm512_mask_max_epi32(hi, k, hi, v);
+  }
+  // lanes without data still hold the initial minimum and maximum, so the
+  // lanes of lo only contribute to the minimum and those of hi only to the
+  // maximum
+  Sint32 lanes[32];
+  _mm512_storeu_si512(lanes, lo);
+  _mm512_storeu_si512(lanes + 16, hi);
+  for (size_t i = 0; i < 16; ++i) {
+    if (lanes[i] < minimum) minimum = lanes[i];
+    if (lanes[16 + i] > maximum) maximum = lanes[16 + i];
+  }
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void shiftLeftAvx512(Sint32 *line, size_t count, Uint16 shift) {
+  __m128i const left = _mm_cvtsi32_si128(shift);
+  for (size_t i = 0; i < count; i += 16) {
+    size_t const n = count - i < 16 ? count - i : 16;
+    __mmask16 const k = OFstatic_cast(__mmask16, (1u << n) - 1);
+    _mm512_mask_storeu_epi32(
+        line + i, k,
+        _mm512_maskz_sll_epi32(k, _mm512_maskz_loadu_epi32(k, line + i), left));
+  }
+}
+
+// color-by-pixel data and the tails of the widening kernels are processed
+// by the AVX2 kernels
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void widenUint8Avx512(Uint8 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      _mm512_storeu_si512(
+          target + i, _mm512_maskz_cvtepu8_epi32(DCMTKHTJ2K_ALL_LANES, v));
+    }
+  }
+  widenUint8Avx2(source + i * samplesPerPixel, component, samplesPerPixel,
+                 target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void widenSint8Avx512(Sint8 const *source, Uint16 component,
+                      Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m128i const v =
+          _mm_loadu_si128(OFreinterpret_cast(__m128i const *, source + i));
+      _mm512_storeu_si512(
+          target + i, _mm512_maskz_cvtepi8_epi32(DCMTKHTJ2K_ALL_LANES, v));
+    }
+  }
+  widenSint8Avx2(source + i * samplesPerPixel, component, samplesPerPixel,
+                 target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void widenUint16Avx512(Uint16 const *source, Uint16 component,
+                       Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m256i const v =
+          _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, source + i));
+      _mm512_storeu_si512(
+          target + i, _mm512_maskz_cvtepu16_epi32(DCMTKHTJ2K_ALL_LANES, v));
+    }
+  }
+  widenUint16Avx2(source + i * samplesPerPixel, component, samplesPerPixel,
+                  target + i, count - i);
+}
+
+DCMTKHTJ2K_TARGET(DCMTKHTJ2K_AVX512)
+void widenSint16Avx512(Sint16 const *source, Uint16 component,
+                       Uint16 samplesPerPixel, Sint32 *target, size_t count) {
+  size_t i = 0;
+  if (samplesPerPixel == 1) {
+    for (; i + 16 <= count; i += 16) {
+      __m256i const v =
+          _mm256_loadu_si256(OFreinterpret_cast(__m256i const *, source + i));
+      _mm512_storeu_si512(
+          target + i, _mm512_maskz_cvtepi16_epi32(DCMTKHTJ2K_ALL_LANES, v));
+    }
+  }
+  widenSint16Avx2(source + i * samplesPerPixel, component, samplesPerPixel,
+                  target + i, count - i);
+}
+
+#endif  // DCMTKHTJ2K_SIMD_X86
+
+/// returns the kernels for the most capable supported instruction set
+HtJ2kSampleKernels const &selectBestKernels() {
+  HTJ2K_InstructionSet const candidates[] = {EHTJ2KIS_avx512, EHTJ2KIS_avx2,
+                                             EHTJ2KIS_sse2};
+  for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); ++i) {
+    HtJ2kSampleKernels const *kernels =
+        HtJ2kSampleKernels::forInstructionSet(candidates[i]);
+    if (kernels) return *kernels;
+  }
+  return *HtJ2kSampleKernels::forInstructionSet(EHTJ2KIS_scalar);
+}
+
+}  // namespace
+
+HtJ2kSampleKernels const &HtJ2kSampleKernels::best() {
+  static HtJ2kSampleKernels const &kernels = selectBestKernels();
+  return kernels;
+}
+
+HtJ2kSampleKernels const *HtJ2kSampleKernels::forInstructionSet(
+    HTJ2K_InstructionSet instructionSet) {
+  static HtJ2kSampleKernels const scalar = {
+      EHTJ2KIS_scalar,      narrowToUint8Scalar, narrowToSint8Scalar,
+      narrowToUint16Scalar, narrowToSint16Scalar, interleave8Scalar,
+      interleave16Scalar,   widenUint8Scalar,    widenSint8Scalar,
+      widenUint16Scalar,    widenSint16Scalar,   extractBitsScalar,
+      findRangeScalar,      shiftLeftScalar};
+#ifdef DCMTKHTJ2K_SIMD_X86
+  static HtJ2kSampleKernels const sse2 = {
+      EHTJ2KIS_sse2,      narrowToUint8Sse2, narrowToSint8Sse2,
+      narrowToUint16Sse2, narrowToSint16Sse2, interleave8Sse2,
+      interleave16Sse2,   widenUint8Sse2,    widenSint8Sse2,
+      widenUint16Sse2,    widenSint16Sse2,   extractBitsSse2,
+      findRangeSse2,      shiftLeftSse2};
+  static HtJ2kSampleKernels const avx2 = {
+      EHTJ2KIS_avx2,      narrowToUint8Avx2, narrowToSint8Avx2,
+      narrowToUint16Avx2, narrowToSint16Avx2, interleave8Avx2,
+      interleave16Avx2,   widenUint8Avx2,    widenSint8Avx2,
+      widenUint16Avx2,    widenSint16Avx2,   extractBitsAvx2,
+      findRangeAvx2,      shiftLeftAvx2};
+  static HtJ2kSampleKernels const avx512 = {
+      EHTJ2KIS_avx512,      narrowToUint8Avx512, narrowToSint8Avx512,
+      narrowToUint16Avx512, narrowToSint16Avx512, interleave8Avx512,
+      interleave16Avx512,   widenUint8Avx512,    widenSint8Avx512,
+      widenUint16Avx512,    widenSint16Avx512,   extractBitsAvx512,
+      findRangeAvx512,      shiftLeftAvx512};
+#endif
+
+  switch (instructionSet) {
+    case EHTJ2KIS_scalar:
+      return &scalar;
+#ifdef DCMTKHTJ2K_SIMD_X86
+    case EHTJ2KIS_sse2:
+      return cpuFeatures().sse2 ? &sse2 : NULL;
+    case EHTJ2KIS_avx2:
+      return cpuFeatures().avx2 ? &avx2 : NULL;
+    case EHTJ2KIS_avx512:
+      return cpuFeatures().avx512 ? &avx512 : NULL;
+#endif
+    default:
+      return NULL;
+  }
+}
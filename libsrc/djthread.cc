@@ -0,0 +1,378 @@
+#include "dcmtkhtj2k/djthread.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/ofstd/ofthread.h" /* for class OFThread, OFMutex */
+#include "dcmtkhtj2k/djutils.h"
+
+namespace {
+
+/** work queue shared between all threads that take part in a parallel loop.
+ */
+class HtJ2kWorkQueue {
+ public:
+  HtJ2kWorkQueue(HtJ2kParallelTask &task, size_t count,
+                 size_t const *schedule)
+      : task_(task),
+        count_(count),
+        schedule_(schedule),
+        next_(0),
+        failedIndex_(count),
+        result_(EC_Normal),
+        mutex_() {}
+
+  /// processes work items until the queue is exhausted or an item failed
+  void process() {
+    size_t position = 0;
+    while (fetch(position)) {
+      size_t const index = schedule_ ? schedule_[position] : position;
+      OFCondition cond = task_.execute(index);
+      if (cond.bad()) fail(index, cond);
+    }
+  }
+
+  /// returns the result of the loop
+  OFCondition result() const { return result_; }
+
+ private:
+  /// hands out the position of the next work item, if any
+  OFBool fetch(size_t &position) {
+    mutex_.lock();
+    OFBool const found = (next_ < count_) && (failedIndex_ == count_);
+    if (found) position = next_++;
+    mutex_.unlock();
+    return found;
+  }
+
+  /// records the failure of a work item
+  void fail(size_t index, OFCondition const &cond) {
+    mutex_.lock();
+    if (index < failedIndex_) {
+      failedIndex_ = index;
+      result_ = cond;
+    }
+    mutex_.unlock();
+  }
+
+  HtJ2kParallelTask &task_;
+  size_t const count_;
+  size_t const *schedule_;
+  size_t next_;
+  size_t failedIndex_;
+  OFCondition result_;
+  OFMutex mutex_;
+};
+
+/** worker thread processing items from a work queue.
+ */
+class HtJ2kWorkerThread : public OFThread {
+ public:
+  explicit HtJ2kWorkerThread(HtJ2kWorkQueue &queue)
+      : OFThread(), queue_(queue) {}
+
+ protected:
+  virtual void run() { queue_.process(); }
+
+ private:
+  HtJ2kWorkQueue &queue_;
+};
+
+/** waits until a counter advanced by another thread reaches a value. The
+ *  thread yields while waiting and, if the wait takes longer, sleeps.
+ *  @param counter counter to be watched
+ *  @param value value to be reached
+ *  @param cancelled flag set if the wait should be abandoned
+ *  @return true if the value was reached, false if the wait was abandoned
+ */
+OFBool waitFor(std::atomic<size_t> const &counter, size_t value,
+               std::atomic<bool> const &cancelled) {
+  for (unsigned int spins = 0;
+       counter.load(std::memory_order_acquire) < value; ++spins) {
+    if (cancelled.load(std::memory_order_relaxed)) return OFFalse;
+    if (spins < 64)
+      std::this_thread::yield();
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  return OFTrue;
+}
+
+/** lane of a frame pipeline: a ring of items processed by one thread. Every
+ *  counter is advanced by a single stage and read by the following one.
+ */
+struct HtJ2kPipelineLane {
+  HtJ2kPipelineLane() : items(), prepared(0), processed(0), finished(0) {}
+
+  ~HtJ2kPipelineLane() {
+    for (size_t i = 0; i < items.size(); ++i) delete items[i];
+  }
+
+  /// items of the lane, reused in turn
+  OFVector<HtJ2kPipelineItem *> items;
+
+  /// number of work items of the lane prepared so far
+  std::atomic<size_t> prepared;
+
+  /// number of work items of the lane processed so far
+  std::atomic<size_t> processed;
+
+  /// number of work items of the lane finished so far
+  std::atomic<size_t> finished;
+};
+
+/** state shared between all threads of a frame pipeline.
+ */
+class HtJ2kPipeline {
+ public:
+  HtJ2kPipeline(HtJ2kPipelineStages &stages, size_t count, size_t laneCount,
+                size_t itemsPerLane)
+      : stages_(stages),
+        count_(count),
+        laneCount_(laneCount),
+        itemsPerLane_(itemsPerLane),
+        lanes_(new HtJ2kPipelineLane[laneCount]),
+        started_(false),
+        cancelled_(false),
+        failedIndex_(count),
+        result_(EC_Normal),
+        mutex_() {
+    for (size_t l = 0; l < laneCount_; ++l) {
+      for (size_t i = 0; i < itemsPerLane_; ++i)
+        lanes_[l].items.push_back(stages_.createItem());
+    }
+  }
+
+  ~HtJ2kPipeline() { delete[] lanes_; }
+
+  /// returns the number of lanes
+  size_t laneCount() const { return laneCount_; }
+
+  /// lets the threads waiting in run() begin their stage
+  void start() { started_.store(true, std::memory_order_release); }
+
+  /// lets the threads waiting in run() return without doing anything
+  void cancel() { cancelled_.store(true, std::memory_order_release); }
+
+  /** executes a stage once the pipeline is started.
+   *  @param lane lane processed by the thread, laneCount() to prepare the
+   *    work items of all lanes
+   */
+  void run(size_t lane) {
+    while (!started_.load(std::memory_order_acquire)) {
+      if (cancelled_.load(std::memory_order_acquire)) return;
+      std::this_thread::yield();
+    }
+    if (lane < laneCount_)
+      process(lane);
+    else
+      prepare();
+  }
+
+  /// finishes the work items of all lanes in index order
+  void finish() {
+    for (size_t index = 0; index < count_; ++index) {
+      HtJ2kPipelineLane &lane = lanes_[index % laneCount_];
+      size_t const round = index / laneCount_;
+      if (!waitFor(lane.processed, round + 1, cancelled_)) return;
+      OFCondition cond =
+          stages_.finish(index, *lane.items[round % itemsPerLane_]);
+      if (cond.bad()) {
+        fail(index, cond);
+        return;
+      }
+      lane.finished.store(round + 1, std::memory_order_release);
+    }
+  }
+
+  /// returns the result of the pipeline
+  OFCondition result() const { return result_; }
+
+ private:
+  /// prepares the work items of all lanes in index order
+  void prepare() {
+    for (size_t index = 0; index < count_; ++index) {
+      HtJ2kPipelineLane &lane = lanes_[index % laneCount_];
+      size_t const round = index / laneCount_;
+      // the item is free once its previous work item has been finished
+      if ((round >= itemsPerLane_) &&
+          !waitFor(lane.finished, round - itemsPerLane_ + 1, cancelled_))
+        return;
+      OFCondition cond =
+          stages_.prepare(index, *lane.items[round % itemsPerLane_]);
+      if (cond.bad()) {
+        fail(index, cond);
+        return;
+      }
+      lane.prepared.store(round + 1, std::memory_order_release);
+    }
+  }
+
+  /// processes the work items of a lane
+  void process(size_t l) {
+    HtJ2kPipelineLane &lane = lanes_[l];
+    for (size_t round = 0, index = l; index < count_;
+         ++round, index += laneCount_) {
+      if (!waitFor(lane.prepared, round + 1, cancelled_)) return;
+      OFCondition cond =
+          stages_.process(index, *lane.items[round % itemsPerLane_]);
+      if (cond.bad()) {
+        fail(index, cond);
+        return;
+      }
+      lane.processed.store(round + 1, std::memory_order_release);
+    }
+  }
+
+  /// records the failure of a work item and stops all stages
+  void fail(size_t index, OFCondition const &cond) {
+    mutex_.lock();
+    if (index < failedIndex_) {
+      failedIndex_ = index;
+      result_ = cond;
+    }
+    mutex_.unlock();
+    cancel();
+  }
+
+  HtJ2kPipelineStages &stages_;
+  size_t const count_;
+  size_t const laneCount_;
+  size_t const itemsPerLane_;
+  HtJ2kPipelineLane *lanes_;
+  std::atomic<bool> started_;
+  std::atomic<bool> cancelled_;
+  size_t failedIndex_;
+  OFCondition result_;
+  OFMutex mutex_;
+};
+
+/** thread executing a stage of a frame pipeline.
+ */
+class HtJ2kPipelineThread : public OFThread {
+ public:
+  HtJ2kPipelineThread(HtJ2kPipeline &pipeline, size_t lane)
+      : OFThread(), pipeline_(pipeline), lane_(lane) {}
+
+ protected:
+  virtual void run() { pipeline_.run(lane_); }
+
+ private:
+  HtJ2kPipeline &pipeline_;
+  size_t lane_;
+};
+
+/** executes all stages of a frame pipeline serially with a single item.
+ *  @param stages stages to be executed
+ *  @param count number of work items
+ *  @return EC_Normal if all items were processed successfully, otherwise
+ *    the error code of the failed item
+ */
+OFCondition runSerially(HtJ2kPipelineStages &stages, size_t count) {
+  HtJ2kPipelineItem *item = stages.createItem();
+  OFCondition result = EC_Normal;
+  for (size_t index = 0; result.good() && (index < count); ++index) {
+    result = stages.prepare(index, *item);
+    if (result.good()) result = stages.process(index, *item);
+    if (result.good()) result = stages.finish(index, *item);
+  }
+  delete item;
+  return result;
+}
+
+}  // namespace
+
+OFCondition HtJ2kParallelLoop::run(HtJ2kParallelTask &task, size_t count,
+                                   Uint16 numberOfThreads,
+                                   size_t const *schedule) {
+  HtJ2kWorkQueue queue(task, count, schedule);
+
+  size_t threads = resolveThreadCount(numberOfThreads);
+  if (threads > count) threads = count;
+
+  // start the additional worker threads; the calling thread is one of them
+  HtJ2kWorkerThread **workers = NULL;
+  size_t startedWorkers = 0;
+  if (threads > 1) {
+    workers = new HtJ2kWorkerThread *[threads - 1];
+    for (size_t i = 0; i < threads - 1; ++i) {
+      HtJ2kWorkerThread *worker = new HtJ2kWorkerThread(queue);
+      if (worker->start() == 0)
+        workers[startedWorkers++] = worker;
+      else {
+        DCMTKHTJ2K_DEBUG("HT-J2K codec cannot start worker thread, continuing "
+                         "with "
+                         << (startedWorkers + 1) << " thread(s)");
+        delete worker;
+        break;
+      }
+    }
+  }
+
+  queue.process();
+
+  for (size_t i = 0; i < startedWorkers; ++i) {
+    workers[i]->join();
+    delete workers[i];
+  }
+  delete[] workers;
+
+  return queue.result();
+}
+
+Uint16 HtJ2kParallelLoop::resolveThreadCount(Uint16 numberOfThreads) {
+  if (numberOfThreads > 0) return numberOfThreads;
+  unsigned int const cores = std::thread::hardware_concurrency();
+  if (cores < 1) return 1;
+  if (cores > 0xFFFF) return 0xFFFF;
+  return OFstatic_cast(Uint16, cores);
+}
+
+OFCondition HtJ2kFramePipeline::run(HtJ2kPipelineStages &stages, size_t count,
+                                    Uint16 numberOfThreads,
+                                    size_t itemsPerLane) {
+  size_t const threads = HtJ2kParallelLoop::resolveThreadCount(numberOfThreads);
+  if ((threads < 2) || (count < 2)) return runSerially(stages, count);
+  if (itemsPerLane < 1) itemsPerLane = 1;
+
+  // one lane for every thread but the one preparing the items
+  size_t laneCount = threads - 1;
+  if (laneCount > count) laneCount = count;
+  HtJ2kPipeline pipeline(stages, count, laneCount, itemsPerLane);
+
+  // the threads wait until all of them have been started, the last one
+  // prepares the work items
+  size_t const threadCount = laneCount + 1;
+  HtJ2kPipelineThread **workers = new HtJ2kPipelineThread *[threadCount];
+  size_t startedWorkers = 0;
+  for (size_t i = 0; i < threadCount; ++i) {
+    HtJ2kPipelineThread *worker = new HtJ2kPipelineThread(pipeline, i);
+    if (worker->start() == 0)
+      workers[startedWorkers++] = worker;
+    else {
+      delete worker;
+      break;
+    }
+  }
+
+  OFBool const started = (startedWorkers == threadCount);
+  if (started) {
+    pipeline.start();
+    pipeline.finish();
+  } else {
+    DCMTKHTJ2K_DEBUG("HT-J2K codec cannot start pipeline thread, continuing "
+                     "with 1 thread");
+    pipeline.cancel();
+  }
+
+  for (size_t i = 0; i < startedWorkers; ++i) {
+    workers[i]->join();
+    delete workers[i];
+  }
+  delete[] workers;
+
+  if (!started) return runSerially(stages, count);
+  return pipeline.result();
+}
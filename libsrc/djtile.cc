@@ -0,0 +1,352 @@
+#include "dcmtkhtj2k/djtile.h"
+
+#include "dcmtk/config/osconfig.h"
+#include "dcmtk/dcmdata/dcerror.h" /* for EC_MemoryExhausted */
+#include "dcmtkhtj2k/djutils.h"
+
+// OpenJPH includes
+#include "openjph/ojph_file.h"
+
+namespace {
+
+/// markers of a JPEG 2000 codestream
+enum {
+  MARKER_SOC = 0xFF4F,
+  MARKER_SIZ = 0xFF51,
+  MARKER_TLM = 0xFF55,
+  MARKER_PLM = 0xFF57,
+  MARKER_PPM = 0xFF60,
+  MARKER_SOT = 0xFF90,
+  MARKER_EOC = 0xFFD9
+};
+
+/// position of the Xsiz field in the codestream, following SOC, SIZ and Lsiz
+const size_t SIZ_FIELDS = 8;
+
+/// length of the SIZ marker segment without the component parameters
+const size_t SIZ_LENGTH = 38;
+
+/// maximum number of tile-parts listed by a single TLM marker segment with
+/// 16-bit tile indices and 32-bit tile-part lengths
+const size_t TLM_ENTRIES = (0xFFFF - 4) / 6;
+
+Uint16 readUint16(Uint8 const *data) {
+  return OFstatic_cast(Uint16, (data[0] << 8) | data[1]);
+}
+
+Uint32 readUint32(Uint8 const *data) {
+  return (OFstatic_cast(Uint32, data[0]) << 24) |
+         (OFstatic_cast(Uint32, data[1]) << 16) |
+         (OFstatic_cast(Uint32, data[2]) << 8) | OFstatic_cast(Uint32, data[3]);
+}
+
+void storeUint16(Uint8 *data, Uint16 value) {
+  data[0] = OFstatic_cast(Uint8, value >> 8);
+  data[1] = OFstatic_cast(Uint8, value);
+}
+
+void storeUint32(Uint8 *data, Uint32 value) {
+  data[0] = OFstatic_cast(Uint8, value >> 24);
+  data[1] = OFstatic_cast(Uint8, value >> 16);
+  data[2] = OFstatic_cast(Uint8, value >> 8);
+  data[3] = OFstatic_cast(Uint8, value);
+}
+
+Uint32 ceilDiv(Uint64 a, Uint64 b) {
+  return OFstatic_cast(Uint32, (a + b - 1) / b);
+}
+
+Uint32 minimum(Uint64 a, Uint32 b) {
+  return (a < b) ? OFstatic_cast(Uint32, a) : b;
+}
+
+Uint32 maximum(Uint64 a, Uint32 b) {
+  return (a > b) ? OFstatic_cast(Uint32, a) : b;
+}
+
+/// sets the image area and the tile partition of a SIZ marker segment
+void storeSIZ(Uint8 *codestream, Uint32 x0, Uint32 y0, Uint32 x1, Uint32 y1,
+              Uint32 tileX0, Uint32 tileY0, Uint32 tileWidth,
+              Uint32 tileHeight) {
+  Uint8 *fields = codestream + SIZ_FIELDS;
+  storeUint32(fields, x1);
+  storeUint32(fields + 4, y1);
+  storeUint32(fields + 8, x0);
+  storeUint32(fields + 12, y0);
+  storeUint32(fields + 16, tileWidth);
+  storeUint32(fields + 20, tileHeight);
+  storeUint32(fields + 24, tileX0);
+  storeUint32(fields + 28, tileY0);
+}
+
+/// writes bytes to the output file
+OFCondition writeBytes(ojph::outfile_base &outfile, Uint8 const *data,
+                       size_t count) {
+  if ((count > 0) && (outfile.write(data, count) != count))
+    return EC_MemoryExhausted;
+  return EC_Normal;
+}
+
+/// writes a tile-part with the given tile index
+OFCondition writeTilePart(ojph::outfile_base &outfile, Uint8 const *tilePart,
+                          size_t length, Uint16 tile) {
+  // the length is updated as well, since a tile-part extending up to the
+  // EOC marker may be followed by others now
+  Uint8 sot[12];
+  memcpy(sot, tilePart, sizeof(sot));
+  storeUint16(sot + 4, tile);
+  storeUint32(sot + 6, OFstatic_cast(Uint32, length));
+  OFCondition result = writeBytes(outfile, sot, sizeof(sot));
+  if (result.good())
+    result =
+        writeBytes(outfile, tilePart + sizeof(sot), length - sizeof(sot));
+  return result;
+}
+
+}  // namespace
+
+HtJ2kTileIndex::HtJ2kTileIndex()
+    : mainHeader_(),
+      x0_(0),
+      y0_(0),
+      x1_(0),
+      y1_(0),
+      tileX0_(0),
+      tileY0_(0),
+      tileWidth_(0),
+      tileHeight_(0),
+      tiles_() {}
+
+OFCondition HtJ2kTileIndex::parseSIZ(Uint8 const *data, size_t size) {
+  // the SIZ marker segment immediately follows the SOC marker
+  if ((data == NULL) || (size < 4 + SIZ_LENGTH) ||
+      (readUint16(data) != MARKER_SOC) || (readUint16(data + 2) != MARKER_SIZ))
+    return EC_HTJ2KInvalidCompressedData;
+  size_t const sizLength = readUint16(data + 4);
+  Uint8 const *fields = data + SIZ_FIELDS;
+  x1_ = readUint32(fields);
+  y1_ = readUint32(fields + 4);
+  x0_ = readUint32(fields + 8);
+  y0_ = readUint32(fields + 12);
+  tileWidth_ = readUint32(fields + 16);
+  tileHeight_ = readUint32(fields + 20);
+  tileX0_ = readUint32(fields + 24);
+  tileY0_ = readUint32(fields + 28);
+  size_t const components = readUint16(fields + 32);
+  if ((sizLength < SIZ_LENGTH) || (4 + sizLength > size) ||
+      (sizLength != SIZ_LENGTH + 3 * components) || (x0_ >= x1_) ||
+      (y0_ >= y1_) || (tileWidth_ == 0) || (tileHeight_ == 0) ||
+      (tileX0_ > x0_) || (tileY0_ > y0_) ||
+      (x0_ - tileX0_ >= tileWidth_) || (y0_ - tileY0_ >= tileHeight_))
+    return EC_HTJ2KInvalidCompressedData;
+
+  // subsampled components are not supported by the decoder anyway
+  for (size_t c = 0; c < components; c++) {
+    Uint8 const *component = fields + 34 + 3 * c;
+    if ((component[1] != 1) || (component[2] != 1))
+      return EC_HTJ2KCodecUnsupportedValue;
+  }
+  return EC_Normal;
+}
+
+OFCondition HtJ2kTileIndex::parse(Uint8 const *data, size_t size) {
+  mainHeader_.clear();
+  tiles_.clear();
+
+  OFCondition result = parseSIZ(data, size);
+  if (result.bad()) return result;
+  Uint64 const tiles =
+      OFstatic_cast(Uint64, ceilDiv(x1_ - tileX0_, tileWidth_)) *
+      ceilDiv(y1_ - tileY0_, tileHeight_);
+  if (tiles > 65535) return EC_HTJ2KInvalidCompressedData;
+
+  // main header, the TLM and PLM marker segments describe the tile-parts of
+  // the complete codestream and are dropped from the codestream of a tile
+  size_t position = 2;
+  size_t rangeStart = 0;
+  for (;;) {
+    if (position + 4 > size) return EC_HTJ2KInvalidCompressedData;
+    Uint16 const marker = readUint16(data + position);
+    if (marker == MARKER_SOT) break;
+    size_t const length = readUint16(data + position + 2);
+    if ((length < 2) || (position + 2 + length > size))
+      return EC_HTJ2KInvalidCompressedData;
+    // packed packet headers of all tiles cannot be split
+    if (marker == MARKER_PPM) return EC_HTJ2KCodecUnsupportedValue;
+    if ((marker == MARKER_TLM) || (marker == MARKER_PLM)) {
+      Range range;
+      range.offset = rangeStart;
+      range.length = position - rangeStart;
+      if (range.length > 0) mainHeader_.push_back(range);
+      rangeStart = position + 2 + length;
+    }
+    position += 2 + length;
+  }
+  Range header;
+  header.offset = rangeStart;
+  header.length = position - rangeStart;
+  if (header.length > 0) mainHeader_.push_back(header);
+
+  // tile-parts
+  tiles_.resize(OFstatic_cast(size_t, tiles));
+  while (position + 2 <= size) {
+    Uint16 const marker = readUint16(data + position);
+    if (marker == MARKER_EOC) break;
+    if ((marker != MARKER_SOT) || (position + 12 > size) ||
+        (readUint16(data + position + 2) != 10))
+      return EC_HTJ2KInvalidCompressedData;
+    Uint16 const tile = readUint16(data + position + 4);
+    Uint32 const psot = readUint32(data + position + 6);
+    size_t end = size;
+    if (psot != 0) {
+      if ((psot < 14) || (psot > size - position))
+        return EC_HTJ2KInvalidCompressedData;
+      end = position + psot;
+    } else if (readUint16(data + size - 2) == MARKER_EOC) {
+      end = size - 2;
+    }
+    if ((tile >= tiles_.size()) || (end < position + 14))
+      return EC_HTJ2KInvalidCompressedData;
+    Range tilePart;
+    tilePart.offset = position;
+    tilePart.length = end - position;
+    tiles_[tile].push_back(tilePart);
+    position = end;
+  }
+  return EC_Normal;
+}
+
+size_t HtJ2kTileIndex::countTiles(Uint8 const *data, size_t size) {
+  HtJ2kTileIndex index;
+  if (index.parseSIZ(data, size).bad()) return 0;
+  return OFstatic_cast(size_t, ceilDiv(index.x1_ - index.tileX0_,
+                                       index.tileWidth_)) *
+         ceilDiv(index.y1_ - index.tileY0_, index.tileHeight_);
+}
+
+void HtJ2kTileIndex::getTileArea(size_t tile, Uint32 &tx0, Uint32 &ty0,
+                                 Uint32 &tx1, Uint32 &ty1) const {
+  Uint32 const tilesPerRow = ceilDiv(x1_ - tileX0_, tileWidth_);
+  Uint64 const p = tile % tilesPerRow;
+  Uint64 const q = tile / tilesPerRow;
+  tx0 = maximum(tileX0_ + p * tileWidth_, x0_);
+  ty0 = maximum(tileY0_ + q * tileHeight_, y0_);
+  tx1 = minimum(tileX0_ + (p + 1) * tileWidth_, x1_);
+  ty1 = minimum(tileY0_ + (q + 1) * tileHeight_, y1_);
+}
+
+void HtJ2kTileIndex::getTileRegion(size_t tile, Uint16 resolutionReduction,
+                                   Uint32 &left, Uint32 &top, Uint32 &columns,
+                                   Uint32 &rows) const {
+  Uint32 tx0, ty0, tx1, ty1;
+  getTileArea(tile, tx0, ty0, tx1, ty1);
+  Uint64 const scale = OFstatic_cast(Uint64, 1)
+                       << ((resolutionReduction < 32) ? resolutionReduction
+                                                      : 32);
+  left = ceilDiv(tx0, scale) - ceilDiv(x0_, scale);
+  top = ceilDiv(ty0, scale) - ceilDiv(y0_, scale);
+  columns = ceilDiv(tx1, scale) - ceilDiv(tx0, scale);
+  rows = ceilDiv(ty1, scale) - ceilDiv(ty0, scale);
+}
+
+OFCondition HtJ2kTileIndex::writeTile(Uint8 const *data, size_t tile,
+                                      ojph::outfile_base &outfile) const {
+  if (tile >= tiles_.size()) return EC_IllegalParameter;
+
+  // main header with the image restricted to the tile, which is the only
+  // tile of its partition
+  OFVector<Uint8> header;
+  for (size_t i = 0; i < mainHeader_.size(); i++) {
+    Uint8 const *first = data + mainHeader_[i].offset;
+    header.insert(header.end(), first, first + mainHeader_[i].length);
+  }
+  Uint32 tx0, ty0, tx1, ty1;
+  getTileArea(tile, tx0, ty0, tx1, ty1);
+  storeSIZ(&header[0], tx0, ty0, tx1, ty1, tx0, ty0, tileWidth_,
+           tileHeight_);
+  OFCondition result = writeBytes(outfile, &header[0], header.size());
+
+  OFVector<Range> const &tileParts = tiles_[tile];
+  for (size_t i = 0; result.good() && (i < tileParts.size()); i++)
+    result = writeTilePart(outfile, data + tileParts[i].offset,
+                           tileParts[i].length, 0);
+  if (result.good()) {
+    Uint8 eoc[2];
+    storeUint16(eoc, MARKER_EOC);
+    result = writeBytes(outfile, eoc, sizeof(eoc));
+  }
+  return result;
+}
+
+OFCondition HtJ2kTileIndex::assemble(OFVector<Uint8 const *> const &tiles,
+                                     OFVector<size_t> const &sizes,
+                                     Uint32 columns, Uint32 rows,
+                                     Uint32 tileSize,
+                                     ojph::outfile_base &outfile) {
+  if ((tileSize == 0) || (tiles.size() != sizes.size()) ||
+      (tiles.size() != OFstatic_cast(size_t, ceilDiv(columns, tileSize)) *
+                           ceilDiv(rows, tileSize)) ||
+      (tiles.size() > 65535))
+    return EC_IllegalParameter;
+
+  // locate the tile-parts of every tile
+  OFVector<HtJ2kTileIndex> indices(tiles.size());
+  size_t tilePartCount = 0;
+  for (size_t t = 0; t < tiles.size(); t++) {
+    OFCondition result = indices[t].parse(tiles[t], sizes[t]);
+    if (result.bad()) return result;
+    if (indices[t].numberOfTiles() != 1) return EC_HTJ2KInvalidCompressedData;
+    tilePartCount += indices[t].tiles_[0].size();
+  }
+  size_t const tlmCount = (tilePartCount + TLM_ENTRIES - 1) / TLM_ENTRIES;
+  if (tlmCount > 256) return EC_HTJ2KCodecUnsupportedValue;
+
+  // main header of the first tile, describing the complete image
+  HtJ2kTileIndex const &first = indices[0];
+  OFVector<Uint8> header;
+  for (size_t i = 0; i < first.mainHeader_.size(); i++) {
+    Uint8 const *data = tiles[0] + first.mainHeader_[i].offset;
+    header.insert(header.end(), data, data + first.mainHeader_[i].length);
+  }
+  storeSIZ(&header[0], 0, 0, columns, rows, 0, 0, tileSize, tileSize);
+
+  // TLM marker segments with 16-bit tile indices and 32-bit lengths
+  size_t entry = 0;
+  for (size_t t = 0; t < tiles.size(); t++) {
+    OFVector<Range> const &tileParts = indices[t].tiles_[0];
+    for (size_t i = 0; i < tileParts.size(); i++, entry++) {
+      if (tileParts[i].length > 0xFFFFFFFFUL)
+        return EC_HTJ2KCodecUnsupportedValue;
+      if (entry % TLM_ENTRIES == 0) {
+        size_t const entries = (tilePartCount - entry < TLM_ENTRIES)
+                                   ? tilePartCount - entry
+                                   : TLM_ENTRIES;
+        Uint8 tlm[6];
+        storeUint16(tlm, MARKER_TLM);
+        storeUint16(tlm + 2, OFstatic_cast(Uint16, 4 + 6 * entries));
+        tlm[4] = OFstatic_cast(Uint8, entry / TLM_ENTRIES);  // Ztlm
+        tlm[5] = 0x60;                                       // Stlm
+        header.insert(header.end(), tlm, tlm + sizeof(tlm));
+      }
+      Uint8 ptlm[6];
+      storeUint16(ptlm, OFstatic_cast(Uint16, t));
+      storeUint32(ptlm + 2, OFstatic_cast(Uint32, tileParts[i].length));
+      header.insert(header.end(), ptlm, ptlm + sizeof(ptlm));
+    }
+  }
+  OFCondition result = writeBytes(outfile, &header[0], header.size());
+
+  // tile-parts of all tiles, in raster order
+  for (size_t t = 0; result.good() && (t < tiles.size()); t++) {
+    OFVector<Range> const &tileParts = indices[t].tiles_[0];
+    for (size_t i = 0; result.good() && (i < tileParts.size()); i++)
+      result = writeTilePart(outfile, tiles[t] + tileParts[i].offset,
+                             tileParts[i].length, OFstatic_cast(Uint16, t));
+  }
+  if (result.good()) {
+    Uint8 eoc[2];
+    storeUint16(eoc, MARKER_EOC);
+    result = writeBytes(outfile, eoc, sizeof(eoc));
+  }
+  return result;
+}
@@ -45,3 +45,12 @@ MAKE_DCMTKHTJ2K_ERROR(14, HTJ2KUnsupportedImageType,
                       "Unsupported type of image for HT-J2K compression");
 MAKE_DCMTKHTJ2K_ERROR(15, HTJ2KTooMuchCompressedData,
                       "Too much compressed data, trailing data after image");
+MAKE_DCMTKHTJ2K_ERROR(16, HTJ2KResolutionReductionTooLarge,
+                      "Resolution reduction exceeds the number of "
+                      "decomposition levels of the HT-J2K codestream");
+MAKE_DCMTKHTJ2K_ERROR(17, HTJ2KUncompressedDataTooLarge,
+                      "Uncompressed pixel data exceeds the maximum length of "
+                      "a DICOM element");
+MAKE_DCMTKHTJ2K_ERROR(18, HTJ2KMaximumErrorExceeded,
+                      "Maximum error of near-lossless HT-J2K compression "
+                      "cannot be kept");
@@ -4,7 +4,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <iterator>
 #include <vector>
 
 #include "dcmtk/dcmdata/dcdeftag.h"
@@ -13,8 +16,12 @@
 #include "dcmtk/dcmimage/diregist.h"
 #include "dcmtk/oflog/oflog.h"
 #include "dcmtk/ofstd/oftempf.h"
+#include "dcmtkhtj2k/djcodecd.h"
+#include "dcmtkhtj2k/djcparam.h"
 #include "dcmtkhtj2k/djdecode.h"
 #include "dcmtkhtj2k/djencode.h"
+#include "dcmtkhtj2k/djrparam.h"
+#include "dcmtkhtj2k/djsimd.h"
 
 namespace {
 
@@ -431,4 +438,2007 @@ TEST(CodecTest, BasicColorCompressDecompressLossless) {
   HtJ2kDecoderRegistration::cleanup();
 }
 
+TEST(CodecTest, Color16BitCompressDecompressLossless) {
+  const Uint16 rows = 48;
+  const Uint16 cols = 80;
+  const Uint16 samplesPerPixel = 3;
+  const size_t sampleCount = static_cast<size_t>(rows) *
+                             static_cast<size_t>(cols) * samplesPerPixel;
+
+  std::vector<Uint16> original(sampleCount);
+  for (size_t i = 0; i < sampleCount; ++i) {
+    original[i] = static_cast<Uint16>((i * 2654435761u) >> 7);
+  }
+
+  // Color-by-pixel and color-by-plane input
+  for (Uint16 planarConfiguration = 0; planarConfiguration < 2;
+       ++planarConfiguration) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 3, "RGB", 0);
+    ASSERT_TRUE(dataset
+                    ->putAndInsertUint16(DCM_PlanarConfiguration,
+                                         planarConfiguration)
+                    .good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                      static_cast<unsigned long>(sampleCount))
+            .good());
+
+    HtJ2kEncoderRegistration::registerCodecs();
+    HtJ2kDecoderRegistration::registerCodecs();
+
+    const E_TransferSyntax htj2kLossless =
+        EXS_HighThroughputJPEG2000LosslessOnly;
+    ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+
+    // The planar configuration of the original image is restored
+    Uint16 const *decoded = nullptr;
+    unsigned long decodedCount = 0;
+    ASSERT_TRUE(
+        dataset->findAndGetUint16Array(DCM_PixelData, decoded, &decodedCount)
+            .good());
+    ASSERT_EQ(decodedCount, static_cast<unsigned long>(sampleCount));
+    for (size_t i = 0; i < sampleCount; ++i) {
+      EXPECT_EQ(decoded[i], original[i])
+          << "planar configuration " << planarConfiguration << ", sample "
+          << i;
+    }
+
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+  }
+}
+
+TEST(CodecTest, StoredBitsCompressedWithoutRendering) {
+  const Uint16 rows = 40;
+  const Uint16 cols = 72;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // Samples with arbitrary bits outside of the stored bits
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>((i * 2654435761u) >> 11);
+  }
+
+  // Unsigned 12 of 16 bits, and signed 8 of 16 bits above two unused bits
+  const Uint16 bitsStored[2] = {12, 8};
+  const Uint16 highBit[2] = {11, 9};
+  for (int pass = 0; pass < 2; ++pass) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", pass);
+    ASSERT_TRUE(
+        dataset->putAndInsertUint16(DCM_BitsStored, bitsStored[pass]).good());
+    ASSERT_TRUE(
+        dataset->putAndInsertUint16(DCM_HighBit, highBit[pass]).good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                      static_cast<unsigned long>(pixelCount))
+            .good());
+
+    HtJ2kEncoderRegistration::registerCodecs();
+    HtJ2kDecoderRegistration::registerCodecs();
+    ASSERT_TRUE(
+        dataset
+            ->chooseRepresentation(EXS_HighThroughputJPEG2000LosslessOnly,
+                                   nullptr)
+            .good());
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+
+    // Image Pixel Module adjusted like by the rendered encoder
+    Uint16 value = 0;
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_BitsAllocated, value).good());
+    EXPECT_EQ(value, pass == 0 ? 16 : 8);
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_HighBit, value).good());
+    EXPECT_EQ(value, bitsStored[pass] - 1);
+
+    if (pass == 0) {
+      Uint16 const *decoded = nullptr;
+      ASSERT_TRUE(
+          dataset->findAndGetUint16Array(DCM_PixelData, decoded).good());
+      for (size_t i = 0; i < pixelCount; ++i) {
+        EXPECT_EQ(decoded[i], original[i] & 0x0FFF) << "sample " << i;
+      }
+    } else {
+      Uint8 const *decoded = nullptr;
+      ASSERT_TRUE(dataset->findAndGetUint8Array(DCM_PixelData, decoded).good());
+      for (size_t i = 0; i < pixelCount; ++i) {
+        EXPECT_EQ(decoded[i], static_cast<Uint8>(original[i] >> 2))
+            << "sample " << i;
+      }
+    }
+  }
+}
+
+TEST(CodecTest, FittedPrecisionCompressDecompressLossless) {
+  const Uint16 rows = 48;
+  const Uint16 cols = 64;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // 16-bit samples using only a small part of their range
+  std::vector<Sint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Sint16>(((i * 2654435761u) >> 20) % 600) - 300;
+  }
+
+  // Unsigned samples fit into 10 bits, signed ones into 10 bits as well
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<Sint16> samples(original);
+    if (pass == 0) {
+      for (size_t i = 0; i < pixelCount; ++i) samples[i] += 300;
+    }
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", pass);
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(
+                DCM_PixelData, reinterpret_cast<Uint16 *>(samples.data()),
+                static_cast<unsigned long>(pixelCount))
+            .good());
+
+    const E_TransferSyntax htj2kLossless =
+        EXS_HighThroughputJPEG2000LosslessOnly;
+    HtJ2kCodecParameter parameters;
+    parameters.setPreferCookedEncoding(OFFalse);
+    parameters.setFitPrecision(OFTrue);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    HtJ2kDecoderRegistration::registerCodecs();
+    ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+
+    // The SIZ marker segment records the precision of the component
+    DcmElement *element = nullptr;
+    ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+    DcmPixelSequence *pixSeq = nullptr;
+    ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                    ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                    pixSeq)
+                    .good());
+    DcmPixelItem *fragment = nullptr;
+    ASSERT_TRUE(pixSeq->getItem(fragment, 1).good());
+    Uint8 *codestream = nullptr;
+    ASSERT_TRUE(fragment->getUint8Array(codestream).good());
+    const Uint8 ssiz = codestream[42];
+    EXPECT_EQ(ssiz & 0x7F, 10 - 1);
+    EXPECT_EQ((ssiz & 0x80) != 0, pass == 1);
+
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+
+    Uint16 const *decoded = nullptr;
+    ASSERT_TRUE(dataset->findAndGetUint16Array(DCM_PixelData, decoded).good());
+    for (size_t i = 0; i < pixelCount; ++i) {
+      EXPECT_EQ(decoded[i], static_cast<Uint16>(samples[i])) << "sample " << i;
+    }
+  }
+}
+
+TEST(CodecTest, RawPrecisionFromHighBit) {
+  const Uint16 rows = 32;
+  const Uint16 cols = 56;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // 12 of 16 bits, the second pass sets a bit above High Bit in one sample
+  for (int pass = 0; pass < 2; ++pass) {
+    std::vector<Uint16> original(pixelCount);
+    for (size_t i = 0; i < pixelCount; ++i) {
+      original[i] = static_cast<Uint16>(((i * 2654435761u) >> 13) & 0x0FFF);
+    }
+    if (pass == 1) original[pixelCount / 2] |= 0x4000;
+
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_BitsStored, 12).good());
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_HighBit, 11).good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                      static_cast<unsigned long>(pixelCount))
+            .good());
+
+    const E_TransferSyntax htj2kLossless =
+        EXS_HighThroughputJPEG2000LosslessOnly;
+    HtJ2kCodecParameter parameters;
+    parameters.setPreferCookedEncoding(OFFalse);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    HtJ2kDecoderRegistration::registerCodecs();
+    ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+
+    // The complete pixel cell is only coded if the bits above High Bit are
+    // used
+    DcmElement *element = nullptr;
+    ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+    DcmPixelSequence *pixSeq = nullptr;
+    ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                    ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                    pixSeq)
+                    .good());
+    DcmPixelItem *fragment = nullptr;
+    ASSERT_TRUE(pixSeq->getItem(fragment, 1).good());
+    Uint8 *codestream = nullptr;
+    ASSERT_TRUE(fragment->getUint8Array(codestream).good());
+    EXPECT_EQ(codestream[42], pass == 0 ? 12 - 1 : 16 - 1);
+
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+
+    Uint16 const *decoded = nullptr;
+    ASSERT_TRUE(dataset->findAndGetUint16Array(DCM_PixelData, decoded).good());
+    for (size_t i = 0; i < pixelCount; ++i) {
+      EXPECT_EQ(decoded[i], original[i]) << "sample " << i;
+    }
+  }
+}
+
+TEST(CodecTest, RPCLPrecinctsAndPacketLengths) {
+  const Uint16 rows = 150;
+  const Uint16 cols = 200;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols) * 3;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] =
+        static_cast<Uint8>((i / 3) % cols + ((i * 2654435761u) >> 29));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 3, "RGB", 0);
+  ASSERT_TRUE(dataset->putAndInsertUint16(DCM_PlanarConfiguration, 0).good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // 32x32 precincts at the lowest resolution, 64x64 at all others
+  OFVector<Uint16> precinctSizes;
+  precinctSizes.push_back(32);
+  precinctSizes.push_back(64);
+  const E_TransferSyntax htj2kRPCL =
+      EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly;
+  HtJ2kCodecParameter parameters;
+  parameters.setPrecinctSizes(precinctSizes);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+  HtJ2kDecoderRegistration::registerCodecs();
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kRPCL, nullptr).good());
+
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kRPCL, nullptr, pixSeq)
+                  .good());
+  DcmPixelItem *fragment = nullptr;
+  ASSERT_TRUE(pixSeq->getItem(fragment, 1).good());
+  Uint8 *codestream = nullptr;
+  ASSERT_TRUE(fragment->getUint8Array(codestream).good());
+  const size_t length = fragment->getLength();
+
+  // Every tile-part header lists the lengths of the packets of its body
+  size_t position = 2;
+  bool precinctsDefined = false;
+  while (position + 4 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) != 0xFF90) {
+    if (codestream[position + 1] == 0x52)
+      precinctsDefined = (codestream[position + 4] & 0x01) != 0;
+    position += 2 + (codestream[position + 2] << 8 | codestream[position + 3]);
+  }
+  EXPECT_TRUE(precinctsDefined);
+  int tileParts = 0;
+  while (position + 12 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) == 0xFF90) {
+    const size_t psot = static_cast<size_t>(codestream[position + 6]) << 24 |
+                        static_cast<size_t>(codestream[position + 7]) << 16 |
+                        static_cast<size_t>(codestream[position + 8]) << 8 |
+                        codestream[position + 9];
+    ASSERT_GT(psot, 0u);
+    size_t header = position + 12;
+    size_t packetLengths = 0;
+    bool plt = false;
+    while ((codestream[header] << 8 | codestream[header + 1]) != 0xFF93) {
+      const size_t segment =
+          codestream[header + 2] << 8 | codestream[header + 3];
+      if (codestream[header + 1] == 0x58) {
+        plt = true;
+        size_t value = 0;
+        for (size_t i = header + 5; i < header + 2 + segment; ++i) {
+          value = (value << 7) | (codestream[i] & 0x7F);
+          if ((codestream[i] & 0x80) == 0) {
+            packetLengths += value;
+            value = 0;
+          }
+        }
+      }
+      header += 2 + segment;
+    }
+    EXPECT_TRUE(plt) << "tile-part " << tileParts;
+    EXPECT_EQ(packetLengths, position + psot - header - 2)
+        << "tile-part " << tileParts;
+    position += psot;
+    ++tileParts;
+  }
+  EXPECT_GT(tileParts, 1);
+
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+  HtJ2kDecoderRegistration::cleanup();
+
+  Uint8 const *decoded = nullptr;
+  ASSERT_TRUE(dataset->findAndGetUint8Array(DCM_PixelData, decoded).good());
+  for (size_t i = 0; i < pixelCount; ++i) {
+    EXPECT_EQ(decoded[i], original[i]) << "sample " << i;
+  }
+}
+
+TEST(CodecTest, RPCLPacketLengthsOnPacketBoundaries) {
+  const Uint16 rows = 128;
+  const Uint16 cols = 128;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // Signed samples are not level shifted, so the wavelet coefficients are
+  // zero except near the block in the upper left corner
+  std::vector<Sint16> original(pixelCount, 0);
+  for (size_t row = 0; row < 16; ++row) {
+    for (size_t col = 0; col < 16; ++col) {
+      original[row * cols + col] =
+          static_cast<Sint16>((row * 37 + col * 11) % 200) - 100;
+    }
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 1);
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(
+              DCM_PixelData, reinterpret_cast<Uint16 *>(original.data()),
+              static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // 2 decompositions and 32x32 precincts: the resolutions of 32x32, 64x64
+  // and 128x128 samples have 1, 4 and 16 precincts, one tile-part each
+  OFVector<Uint16> precinctSizes;
+  precinctSizes.push_back(32);
+  const E_TransferSyntax htj2kRPCL =
+      EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly;
+  HtJ2kCodecParameter parameters(OFTrue, 2);
+  parameters.setPrecinctSizes(precinctSizes);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kRPCL, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kRPCL, nullptr, pixSeq)
+                  .good());
+  DcmPixelItem *fragment = nullptr;
+  ASSERT_TRUE(pixSeq->getItem(fragment, 1).good());
+  Uint8 *codestream = nullptr;
+  ASSERT_TRUE(fragment->getUint8Array(codestream).good());
+  const size_t length = fragment->getLength();
+
+  size_t position = 2;
+  while (position + 4 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) != 0xFF90) {
+    position += 2 + (codestream[position + 2] << 8 | codestream[position + 3]);
+  }
+
+  // Only the precinct in the upper left corner of every resolution, coded
+  // first in RPCL order, has a non-empty packet, whose header starts with a
+  // set bit. All other packets consist of the empty packet header 0x00.
+  const size_t expectedPackets[] = {1, 4, 16};
+  size_t tileParts = 0;
+  while (position + 12 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) == 0xFF90) {
+    const size_t psot = static_cast<size_t>(codestream[position + 6]) << 24 |
+                        static_cast<size_t>(codestream[position + 7]) << 16 |
+                        static_cast<size_t>(codestream[position + 8]) << 8 |
+                        codestream[position + 9];
+    ASSERT_LT(tileParts, 3u);
+    size_t header = position + 12;
+    std::vector<size_t> packetLengths;
+    while ((codestream[header] << 8 | codestream[header + 1]) != 0xFF93) {
+      const size_t segment =
+          codestream[header + 2] << 8 | codestream[header + 3];
+      if (codestream[header + 1] == 0x58) {
+        size_t value = 0;
+        for (size_t i = header + 5; i < header + 2 + segment; ++i) {
+          value = (value << 7) | (codestream[i] & 0x7F);
+          if ((codestream[i] & 0x80) == 0) {
+            packetLengths.push_back(value);
+            value = 0;
+          }
+        }
+      }
+      header += 2 + segment;
+    }
+    ASSERT_EQ(packetLengths.size(), expectedPackets[tileParts])
+        << "tile-part " << tileParts;
+
+    size_t packet = header + 2;
+    for (size_t i = 0; i < packetLengths.size(); ++i) {
+      ASSERT_LE(packet + packetLengths[i], position + psot)
+          << "tile-part " << tileParts << ", packet " << i;
+      if (i == 0) {
+        EXPECT_GT(packetLengths[i], 1u) << "tile-part " << tileParts;
+        EXPECT_NE(codestream[packet] & 0x80, 0) << "tile-part " << tileParts;
+      } else {
+        EXPECT_EQ(packetLengths[i], 1u)
+            << "tile-part " << tileParts << ", packet " << i;
+        EXPECT_EQ(codestream[packet], 0)
+            << "tile-part " << tileParts << ", packet " << i;
+      }
+      packet += packetLengths[i];
+    }
+    EXPECT_EQ(packet, position + psot) << "tile-part " << tileParts;
+    position += psot;
+    ++tileParts;
+  }
+  EXPECT_EQ(tileParts, 3u);
+}
+
+TEST(CodecTest, TiledCompressDecompressLossless) {
+  const Uint16 rows = 200;
+  const Uint16 cols = 300;
+  const Uint16 tileSize = 64;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>((i % cols) * 13 + (i / cols) * 7 +
+                                      ((i * 2654435761u) >> 22));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                    static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // the tiles are compressed and decompressed by several threads
+  const E_TransferSyntax htj2kLossless = EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kCodecParameter parameters;
+  parameters.setNumberOfThreads(4);
+  parameters.setTileSize(tileSize);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+  HtJ2kDecoderRegistration::registerCodecs(EHTJ2KUC_default, EHTJ2KPC_restore,
+                                           OFFalse, 4);
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  pixSeq)
+                  .good());
+  DcmPixelItem *fragment = nullptr;
+  ASSERT_TRUE(pixSeq->getItem(fragment, 1).good());
+  Uint8 *codestream = nullptr;
+  ASSERT_TRUE(fragment->getUint8Array(codestream).good());
+  const size_t length = fragment->getLength();
+
+  // The SIZ marker segment describes the tile size, followed by the
+  // tile-parts of all tiles in raster order
+  const size_t xtsiz = static_cast<size_t>(codestream[24]) << 24 |
+                       static_cast<size_t>(codestream[25]) << 16 |
+                       static_cast<size_t>(codestream[26]) << 8 |
+                       codestream[27];
+  EXPECT_EQ(xtsiz, tileSize);
+  size_t position = 2;
+  while (position + 4 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) != 0xFF90) {
+    position += 2 + (codestream[position + 2] << 8 | codestream[position + 3]);
+  }
+  const int tiles = ((cols + tileSize - 1) / tileSize) *
+                    ((rows + tileSize - 1) / tileSize);
+  std::vector<int> tilePartsOfTile(tiles, 0);
+  int previousTile = 0;
+  while (position + 12 <= length &&
+         (codestream[position] << 8 | codestream[position + 1]) == 0xFF90) {
+    const int tile = codestream[position + 4] << 8 | codestream[position + 5];
+    const size_t psot = static_cast<size_t>(codestream[position + 6]) << 24 |
+                        static_cast<size_t>(codestream[position + 7]) << 16 |
+                        static_cast<size_t>(codestream[position + 8]) << 8 |
+                        codestream[position + 9];
+    ASSERT_LT(tile, tiles);
+    ASSERT_GT(psot, 0u);
+    EXPECT_GE(tile, previousTile);
+    ++tilePartsOfTile[tile];
+    previousTile = tile;
+    position += psot;
+  }
+  for (int tile = 0; tile < tiles; ++tile) {
+    EXPECT_GT(tilePartsOfTile[tile], 0) << "tile " << tile;
+  }
+
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+  HtJ2kDecoderRegistration::cleanup();
+
+  Uint16 const *decoded = nullptr;
+  ASSERT_TRUE(dataset->findAndGetUint16Array(DCM_PixelData, decoded).good());
+  for (size_t i = 0; i < pixelCount; ++i) {
+    EXPECT_EQ(decoded[i], original[i]) << "sample " << i;
+  }
+}
+
+TEST(CodecTest, LossyCompressionBitDepth) {
+  const Uint16 rows = 48;
+  const Uint16 cols = 64;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // Smooth 12-bit gradient, reconstructed closely by lossy compression
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>((i % cols) * 40 + (i / cols) * 10);
+  }
+
+  // Limited to 8 bits first and forced to 14 bits second
+  const HTJ2K_CompressionBitDepth mode[2] = {EHTJ2KBD_limit, EHTJ2KBD_force};
+  const Uint16 bits[2] = {8, 14};
+  for (int pass = 0; pass < 2; ++pass) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_BitsStored, 12).good());
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_HighBit, 11).good());
+    ASSERT_TRUE(dataset->putAndInsertString(DCM_RescaleSlope, "1").good());
+    ASSERT_TRUE(dataset->putAndInsertString(DCM_RescaleIntercept, "0").good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                      static_cast<unsigned long>(pixelCount))
+            .good());
+
+    HtJ2kCodecParameter parameters;
+    parameters.setCompressionBitDepth(mode[pass]);
+    parameters.setCompressionBits(bits[pass]);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    HtJ2kDecoderRegistration::registerCodecs();
+    HtJ2kRepresentationParameter lossy(OFFalse);
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_HighThroughputJPEG2000, &lossy)
+            .good());
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+
+    // Image Pixel Module matches the scaled samples
+    Uint16 value = 0;
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_BitsAllocated, value).good());
+    EXPECT_EQ(value, pass == 0 ? 8 : 16);
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_BitsStored, value).good());
+    EXPECT_EQ(value, bits[pass]);
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_HighBit, value).good());
+    EXPECT_EQ(value, bits[pass] - 1);
+
+    // Rescaled values are preserved
+    Float64 slope = 0.0;
+    ASSERT_TRUE(dataset->findAndGetFloat64(DCM_RescaleSlope, slope).good());
+    EXPECT_DOUBLE_EQ(slope, pass == 0 ? 16.0 : 0.25);
+
+    Uint8 const *samples8 = nullptr;
+    Uint16 const *samples16 = nullptr;
+    if (pass == 0) {
+      ASSERT_TRUE(
+          dataset->findAndGetUint8Array(DCM_PixelData, samples8).good());
+    } else {
+      ASSERT_TRUE(
+          dataset->findAndGetUint16Array(DCM_PixelData, samples16).good());
+    }
+    for (size_t i = 0; i < pixelCount; ++i) {
+      const int decoded = (pass == 0) ? samples8[i] : samples16[i];
+      const int expected = (pass == 0) ? original[i] >> 4 : original[i] << 2;
+      EXPECT_LE(std::abs(decoded - expected), pass == 0 ? 2 : 32)
+          << "sample " << i;
+    }
+  }
+}
+
+TEST(CodecTest, LossyCompressionBitDepthLookupTables) {
+  const Uint16 rows = 48;
+  const Uint16 cols = 64;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>((i % cols) * 40 + (i / cols) * 10);
+  }
+  std::vector<Uint16> lutData(4096);
+  for (size_t i = 0; i < lutData.size(); ++i) {
+    lutData[i] = static_cast<Uint16>(i / 2);
+  }
+
+  // A Modality LUT first, a VOI LUT without rescaling second and a VOI LUT
+  // with rescaling third, each limited from 12 to 8 bits
+  for (int pass = 0; pass < 3; ++pass) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_BitsStored, 12).good());
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_HighBit, 11).good());
+    if (pass == 2) {
+      ASSERT_TRUE(dataset->putAndInsertString(DCM_RescaleSlope, "1").good());
+      ASSERT_TRUE(
+          dataset->putAndInsertString(DCM_RescaleIntercept, "0").good());
+    }
+    ASSERT_TRUE(
+        dataset->putAndInsertString(DCM_WindowCenter, "2048").good());
+    ASSERT_TRUE(dataset->putAndInsertString(DCM_WindowWidth, "4096").good());
+    DcmItem *lut = nullptr;
+    ASSERT_TRUE(dataset
+                    ->findOrCreateSequenceItem(pass == 0
+                                                   ? DCM_ModalityLUTSequence
+                                                   : DCM_VOILUTSequence,
+                                               lut, -2)
+                    .good());
+    ASSERT_TRUE(lut->putAndInsertUint16(DCM_LUTDescriptor, 4096, 0).good());
+    ASSERT_TRUE(lut->putAndInsertUint16(DCM_LUTDescriptor, 0, 1).good());
+    ASSERT_TRUE(lut->putAndInsertUint16(DCM_LUTDescriptor, 16, 2).good());
+    if (pass == 0) {
+      ASSERT_TRUE(lut->putAndInsertString(DCM_ModalityLUTType, "US").good());
+    }
+    ASSERT_TRUE(lut->putAndInsertUint16Array(
+                       DCM_LUTData, lutData.data(),
+                       static_cast<unsigned long>(lutData.size()))
+                    .good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                      static_cast<unsigned long>(pixelCount))
+            .good());
+
+    HtJ2kCodecParameter parameters;
+    parameters.setCompressionBitDepth(EHTJ2KBD_limit);
+    parameters.setCompressionBits(8);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    HtJ2kRepresentationParameter lossy(OFFalse);
+    const OFCondition result =
+        dataset->chooseRepresentation(EXS_HighThroughputJPEG2000, &lossy);
+    HtJ2kEncoderRegistration::cleanup();
+
+    Uint16 bitsStored = 0;
+    ASSERT_TRUE(dataset->findAndGetUint16(DCM_BitsStored, bitsStored).good());
+    Float64 windowCenter = 0.0;
+    ASSERT_TRUE(
+        dataset->findAndGetFloat64(DCM_WindowCenter, windowCenter).good());
+    if (pass == 0) {
+      // The Modality LUT maps the 12-bit samples, which are not scaled
+      EXPECT_TRUE(result.bad());
+      EXPECT_EQ(bitsStored, 12);
+      EXPECT_TRUE(dataset->tagExists(DCM_ModalityLUTSequence));
+    } else if (pass == 1) {
+      // The VOI LUT maps the samples and is removed, the window is scaled
+      ASSERT_TRUE(result.good());
+      EXPECT_EQ(bitsStored, 8);
+      EXPECT_FALSE(dataset->tagExists(DCM_VOILUTSequence));
+      EXPECT_DOUBLE_EQ(windowCenter, 128.0);
+    } else {
+      // The VOI LUT maps the rescaled values, which are preserved
+      ASSERT_TRUE(result.good());
+      EXPECT_EQ(bitsStored, 8);
+      EXPECT_TRUE(dataset->tagExists(DCM_VOILUTSequence));
+      EXPECT_DOUBLE_EQ(windowCenter, 2048.0);
+    }
+  }
+}
+
+TEST(CodecTest, LossyRateControl) {
+  const Uint16 rows = 96;
+  const Uint16 cols = 128;
+  const Uint16 frames = 2;
+  const size_t framePixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  const size_t pixelCount = framePixelCount * frames;
+
+  // Smooth pattern with some noise, different for every frame
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const size_t frame = i / framePixelCount;
+    const double x = static_cast<double>(i % cols);
+    const double y = static_cast<double>((i / cols) % rows);
+    original[i] = static_cast<Uint8>(
+        120 + 60 * sin(x / (7.0 + frame)) * cos(y / 5.0) +
+        ((i * 2654435761u) >> 28));
+  }
+
+  // Target ratio serially, target frame size with concurrent trials and
+  // target PSNR
+  const double targetRatio = 12.0;
+  const Uint32 targetFrameSize = 1500;
+  const double targetPSNR = 38.0;
+  for (int pass = 0; pass < 3; ++pass) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "2").good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                     static_cast<unsigned long>(pixelCount))
+            .good());
+
+    HtJ2kCodecParameter parameters;
+    parameters.setNumberOfThreads(pass == 1 ? 4 : 1);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    HtJ2kDecoderRegistration::registerCodecs();
+    HtJ2kRepresentationParameter lossy(OFFalse,
+                                       pass == 0 ? targetRatio : 0.0,
+                                       pass == 1 ? targetFrameSize : 0,
+                                       pass == 2 ? targetPSNR : 0.0);
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_HighThroughputJPEG2000, &lossy)
+            .good());
+
+    if (pass == 0) {
+      Float64 ratio = 0.0;
+      ASSERT_TRUE(
+          dataset->findAndGetFloat64(DCM_LossyImageCompressionRatio, ratio)
+              .good());
+      EXPECT_GE(ratio, targetRatio);
+      EXPECT_LT(ratio, targetRatio * 1.5);
+    } else if (pass == 1) {
+      DcmElement *element = nullptr;
+      ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+      DcmPixelSequence *pixSeq = nullptr;
+      ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                      ->getEncapsulatedRepresentation(
+                          EXS_HighThroughputJPEG2000, &lossy, pixSeq)
+                      .good());
+      for (unsigned long i = 1; i <= frames; ++i) {
+        DcmPixelItem *fragment = nullptr;
+        ASSERT_TRUE(pixSeq->getItem(fragment, i).good());
+        // items are padded to an even length
+        EXPECT_LE(fragment->getLength(), targetFrameSize + 1);
+        EXPECT_GT(fragment->getLength(), targetFrameSize / 2);
+      }
+    }
+
+    ASSERT_TRUE(
+        dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+            .good());
+    HtJ2kEncoderRegistration::cleanup();
+    HtJ2kDecoderRegistration::cleanup();
+
+    if (pass == 2) {
+      Uint8 const *decoded = nullptr;
+      ASSERT_TRUE(
+          dataset->findAndGetUint8Array(DCM_PixelData, decoded).good());
+      for (size_t frame = 0; frame < frames; ++frame) {
+        double squaredError = 0.0;
+        for (size_t i = 0; i < framePixelCount; ++i) {
+          const size_t index = frame * framePixelCount + i;
+          const double error = decoded[index] - original[index];
+          squaredError += error * error;
+        }
+        const double psnr =
+            10.0 * log10(255.0 * 255.0 * framePixelCount / squaredError);
+        EXPECT_GE(psnr, targetPSNR) << "frame " << frame;
+      }
+    }
+  }
+}
+
+TEST(CodecTest, NearLosslessMaximumError) {
+  const Uint16 rows = 96;
+  const Uint16 cols = 128;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // 12 bit smooth pattern with some noise
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const double x = static_cast<double>(i % cols);
+    const double y = static_cast<double>(i / cols);
+    original[i] = static_cast<Uint16>(2048 + 1500 * sin(x / 9.0) *
+                                                 cos(y / 6.0) +
+                                      ((i * 2654435761u) >> 26));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertUint16(DCM_BitsStored, 12).good());
+  ASSERT_TRUE(dataset->putAndInsertUint16(DCM_HighBit, 11).good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                    static_cast<unsigned long>(pixelCount))
+          .good());
+
+  const Uint16 maximumError = 2;
+  HtJ2kEncoderRegistration::registerCodecs();
+  HtJ2kDecoderRegistration::registerCodecs();
+  HtJ2kRepresentationParameter nearLossless(OFFalse, 0.0, 0, 0.0,
+                                            maximumError);
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(EXS_HighThroughputJPEG2000, &nearLossless)
+          .good());
+
+  Float64 ratio = 0.0;
+  ASSERT_TRUE(
+      dataset->findAndGetFloat64(DCM_LossyImageCompressionRatio, ratio)
+          .good());
+  EXPECT_GT(ratio, 1.0);
+
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+  HtJ2kDecoderRegistration::cleanup();
+
+  Uint16 const *decoded = nullptr;
+  ASSERT_TRUE(dataset->findAndGetUint16Array(DCM_PixelData, decoded).good());
+  int worstError = 0;
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const int error = std::abs(static_cast<int>(decoded[i]) -
+                               static_cast<int>(original[i]));
+    if (error > worstError) worstError = error;
+  }
+  EXPECT_LE(worstError, maximumError);
+}
+
+TEST(CodecTest, MultiFrameMonochrome8BitParallelDecompressLossless) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 96;
+  const Uint16 frames = 7;
+  const size_t framePixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  const size_t pixelCount = framePixelCount * frames;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    // Vary content per frame so frames compress to different sizes
+    const size_t frame = i / framePixelCount;
+    original[i] = static_cast<Uint8>((i * (frame + 1)) ^ (i >> 7));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+
+  // Populate dataset for an 8-bit monochrome multi-frame image
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "7").good());
+
+  // Pixel data
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // Register codecs, decoding with 4 threads
+  HtJ2kEncoderRegistration::registerCodecs();
+  HtJ2kDecoderRegistration::registerCodecs(EHTJ2KUC_default, EHTJ2KPC_restore,
+                                           OFFalse, 4);
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  ASSERT_TRUE(dataset->canWriteXfer(htj2kLossless));
+
+  // Save to temp file
+  OFTempFile tempFile;
+  ASSERT_TRUE(tempFile.getStatus().good());
+  ASSERT_TRUE(
+      fileformat.saveFile(tempFile.getFilename(), htj2kLossless).good());
+
+  // Read back
+  DcmFileFormat readFile;
+  ASSERT_TRUE(readFile.loadFile(tempFile.getFilename()).good());
+
+  DcmDataset *readDataset = readFile.getDataset();
+  ASSERT_TRUE(
+      readDataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+          .good());
+
+  Uint8 const *decoded = nullptr;
+  unsigned long decodedCount = 0;
+  ASSERT_TRUE(
+      readDataset->findAndGetUint8Array(DCM_PixelData, decoded, &decodedCount)
+          .good());
+  ASSERT_EQ(decodedCount, static_cast<unsigned long>(pixelCount));
+
+  for (size_t i = 0; i < pixelCount; ++i) {
+    EXPECT_EQ(decoded[i], original[i]);
+  }
+
+  // Cleanup codecs
+  HtJ2kEncoderRegistration::cleanup();
+  HtJ2kDecoderRegistration::cleanup();
+}
+
+TEST(CodecTest, MultiFrameParallelCompressMatchesSerialCompress) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 80;
+  const Uint16 frames = 9;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols) * frames;
+
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>((i * 37) ^ (i >> 5));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+
+  // Populate dataset for a 16-bit monochrome multi-frame image
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "9").good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                    static_cast<unsigned long>(pixelCount))
+          .good());
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  std::vector<char> compressed[3];
+  for (int pass = 0; pass < 3; ++pass) {
+    // Compress a copy of the dataset, serially first, with 4 threads second
+    // and with 4 threads rendering windows of 4 frames third
+    DcmFileFormat copy(fileformat);
+    HtJ2kCodecParameter parameters;
+    parameters.setNumberOfThreads(pass == 0 ? 1 : 4);
+    parameters.setFrameWindowSize(pass == 2 ? 4 : 0);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    ASSERT_TRUE(copy.getDataset()
+                    ->chooseRepresentation(htj2kLossless, nullptr)
+                    .good());
+    OFTempFile tempFile;
+    ASSERT_TRUE(tempFile.getStatus().good());
+    ASSERT_TRUE(copy.saveFile(tempFile.getFilename(), htj2kLossless).good());
+    HtJ2kEncoderRegistration::cleanup();
+
+    std::ifstream input(tempFile.getFilename(), std::ios::binary);
+    compressed[pass].assign(std::istreambuf_iterator<char>(input),
+                            std::istreambuf_iterator<char>());
+  }
+
+  ASSERT_FALSE(compressed[0].empty());
+  EXPECT_TRUE(compressed[0] == compressed[1]);
+  EXPECT_TRUE(compressed[0] == compressed[2]);
+}
+
+
+TEST(CodecTest, PipelinedColorCompressMatchesSerialCompress) {
+  const Uint16 rows = 48;
+  const Uint16 cols = 56;
+  const Uint16 frames = 7;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols) * 3 * frames;
+
+  // samples below 64, so that the fitted precision differs between frames
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const size_t frame = i / (pixelCount / frames);
+    original[i] = static_cast<Uint8>(((i * 2654435761u) >> 26) >> (frame % 3));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 3, "RGB", 0);
+  ASSERT_TRUE(dataset->putAndInsertUint16(DCM_PlanarConfiguration, 0).good());
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "7").good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  std::vector<char> compressed[3];
+  for (int pass = 0; pass < 3; ++pass) {
+    // Compress a copy of the dataset serially first, then with the frames
+    // converted by one thread while two and three other threads compress
+    // them, in fragments of 1 KB
+    DcmFileFormat copy(fileformat);
+    HtJ2kCodecParameter parameters;
+    parameters.setFragmentSize(1);
+    parameters.setNumberOfThreads(pass == 0 ? 1 : pass + 2);
+    parameters.setFitPrecision(OFTrue);
+    HtJ2kEncoderRegistration::registerCodecs(parameters);
+    ASSERT_TRUE(copy.getDataset()
+                    ->chooseRepresentation(htj2kLossless, nullptr)
+                    .good());
+    OFTempFile tempFile;
+    ASSERT_TRUE(tempFile.getStatus().good());
+    ASSERT_TRUE(copy.saveFile(tempFile.getFilename(), htj2kLossless).good());
+    HtJ2kEncoderRegistration::cleanup();
+
+    if (pass == 2) {
+      HtJ2kDecoderRegistration::registerCodecs();
+      ASSERT_TRUE(copy.getDataset()
+                      ->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+                      .good());
+      HtJ2kDecoderRegistration::cleanup();
+      Uint8 const *decoded = nullptr;
+      ASSERT_TRUE(copy.getDataset()
+                      ->findAndGetUint8Array(DCM_PixelData, decoded)
+                      .good());
+      for (size_t i = 0; i < pixelCount; ++i) {
+        ASSERT_EQ(decoded[i], original[i]) << "sample " << i;
+      }
+    }
+
+    std::ifstream input(tempFile.getFilename(), std::ios::binary);
+    compressed[pass].assign(std::istreambuf_iterator<char>(input),
+                            std::istreambuf_iterator<char>());
+  }
+
+  ASSERT_FALSE(compressed[0].empty());
+  EXPECT_TRUE(compressed[0] == compressed[1]);
+  EXPECT_TRUE(compressed[0] == compressed[2]);
+}
+
+TEST(CodecTest, ReusedCodestreamsMatchSingleFrameCompress) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 80;
+  const Uint16 frames = 5;
+  const size_t framePixels =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  std::vector<Uint16> original(framePixels * frames);
+  for (size_t i = 0; i < original.size(); ++i) {
+    original[i] = static_cast<Uint16>(((i * 2654435761u) >> 20) & 0x0FFF);
+  }
+
+  // tiles of 32x32 with packet lengths, compressed serially so that the
+  // codestreams and buffers of the first frame are reused for all others
+  const E_TransferSyntax htj2kRPCL =
+      EXS_HighThroughputJPEG2000withRPCLOptionsLosslessOnly;
+  HtJ2kCodecParameter parameters;
+  parameters.setPacketLengthMarkers(OFTrue);
+  parameters.setTileSize(32);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "5").good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                    static_cast<unsigned long>(
+                                        original.size()))
+          .good());
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kRPCL, nullptr).good());
+
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kRPCL, nullptr, pixSeq)
+                  .good());
+
+  for (Uint16 frame = 0; frame < frames; ++frame) {
+    // every frame compressed on its own yields the same codestream
+    DcmFileFormat single;
+    DcmDataset *singleDataset = single.getDataset();
+    PopulateDatasetWithRequiredAttributes(singleDataset, rows, cols, 16, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(singleDataset
+                    ->putAndInsertUint16Array(
+                        DCM_PixelData, original.data() + frame * framePixels,
+                        static_cast<unsigned long>(framePixels))
+                    .good());
+    ASSERT_TRUE(
+        singleDataset->chooseRepresentation(htj2kRPCL, nullptr).good());
+
+    DcmElement *singleElement = nullptr;
+    ASSERT_TRUE(
+        singleDataset->findAndGetElement(DCM_PixelData, singleElement).good());
+    DcmPixelSequence *singlePixSeq = nullptr;
+    ASSERT_TRUE(static_cast<DcmPixelData *>(singleElement)
+                    ->getEncapsulatedRepresentation(htj2kRPCL, nullptr,
+                                                    singlePixSeq)
+                    .good());
+
+    DcmPixelItem *fragment = nullptr;
+    DcmPixelItem *singleFragment = nullptr;
+    ASSERT_TRUE(pixSeq->getItem(fragment, frame + 1).good());
+    ASSERT_TRUE(singlePixSeq->getItem(singleFragment, 1).good());
+    Uint8 *data = nullptr;
+    Uint8 *singleData = nullptr;
+    ASSERT_TRUE(fragment->getUint8Array(data).good());
+    ASSERT_TRUE(singleFragment->getUint8Array(singleData).good());
+    ASSERT_EQ(fragment->getLength(), singleFragment->getLength())
+        << "frame " << frame;
+    EXPECT_EQ(memcmp(data, singleData, fragment->getLength()), 0)
+        << "frame " << frame;
+  }
+  HtJ2kEncoderRegistration::cleanup();
+}
+
+TEST(CodecTest, RepresentationEncodingOptions) {
+  HtJ2kRepresentationParameter archive;
+  HtJ2kRepresentationParameter preview;
+  preview.setEncodingOptions(2, 32, 32, EHTJ2KPO_RLCP, 1);
+  HtJ2kRepresentationParameter samePreview;
+  samePreview.setEncodingOptions(2, 32, 32, EHTJ2KPO_RLCP, 1);
+  HtJ2kRepresentationParameter otherPreview;
+  otherPreview.setEncodingOptions(2, 32, 32, EHTJ2KPO_RLCP, 0);
+  EXPECT_FALSE(archive == preview);
+  EXPECT_TRUE(preview == samePreview);
+  EXPECT_FALSE(preview == otherPreview);
+
+  const Uint16 rows = 80;
+  const Uint16 cols = 96;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  std::vector<Uint16> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint16>(((i * 40503u) >> 6) & 0x0FFF);
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 16, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint16Array(DCM_PixelData, original.data(),
+                                    static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // Both representations are created with the default codec parameters,
+  // the preview with the options of its representation parameter
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kEncoderRegistration::registerCodecs();
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(htj2kLossless, &archive).good());
+  ASSERT_TRUE(
+      dataset->chooseRepresentation(htj2kLossless, &preview).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelData *pixelData = static_cast<DcmPixelData *>(element);
+  DcmPixelSequence *archiveSeq = nullptr;
+  ASSERT_TRUE(pixelData
+                  ->getEncapsulatedRepresentation(htj2kLossless, &archive,
+                                                  archiveSeq)
+                  .good());
+  DcmPixelSequence *previewSeq = nullptr;
+  ASSERT_TRUE(pixelData
+                  ->getEncapsulatedRepresentation(htj2kLossless, &preview,
+                                                  previewSeq)
+                  .good());
+  ASSERT_TRUE(archiveSeq != previewSeq);
+
+  // The archive frame is stored in a single fragment, the preview frame is
+  // split into fragments of 1 KB
+  EXPECT_EQ(archiveSeq->card(), static_cast<unsigned long>(2));
+  ASSERT_GT(previewSeq->card(), static_cast<unsigned long>(2));
+  for (unsigned long i = 1; i < previewSeq->card(); ++i) {
+    DcmPixelItem *fragment = nullptr;
+    ASSERT_TRUE(previewSeq->getItem(fragment, i).good());
+    EXPECT_LE(fragment->getLength(), static_cast<Uint32>(1024));
+  }
+
+  // The COD marker segment of the preview has the progression order,
+  // decompositions and code-block size of the representation parameter
+  DcmPixelItem *fragment = nullptr;
+  ASSERT_TRUE(previewSeq->getItem(fragment, 1).good());
+  Uint8 *data = nullptr;
+  ASSERT_TRUE(fragment->getUint8Array(data).good());
+  size_t cod = 2;
+  while ((cod + 12 < fragment->getLength()) &&
+         !((data[cod] == 0xFF) && (data[cod + 1] == 0x52))) {
+    ++cod;
+  }
+  ASSERT_LT(cod + 12, static_cast<size_t>(fragment->getLength()));
+  EXPECT_EQ(data[cod + 5], 1);   // RLCP
+  EXPECT_EQ(data[cod + 9], 2);   // decomposition levels
+  EXPECT_EQ(data[cod + 10], 3);  // code-block width 2^(3+2)
+  EXPECT_EQ(data[cod + 11], 3);  // code-block height 2^(3+2)
+
+  // The preview is lossless as well
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  std::vector<Uint16> decoded(pixelCount);
+  Uint32 startFragment = 0;
+  OFString colorModel;
+  ASSERT_TRUE(decoder
+                  .decodeFrame(nullptr, previewSeq, &param, dataset, 0,
+                               startFragment, decoded.data(),
+                               static_cast<Uint32>(decoded.size() *
+                                                   sizeof(Uint16)),
+                               colorModel)
+                  .good());
+  EXPECT_TRUE(decoded == original);
+}
+
+TEST(KernelTest, VectorizedKernelsMatchScalar) {
+  const HtJ2kSampleKernels *scalar =
+      HtJ2kSampleKernels::forInstructionSet(EHTJ2KIS_scalar);
+  ASSERT_TRUE(scalar != nullptr);
+
+  // Samples covering the full range, including values that must saturate
+  const size_t maxCount = 300;
+  std::vector<Sint32> samples(maxCount);
+  Uint32 seed = 12345;
+  for (size_t i = 0; i < maxCount; ++i) {
+    seed = seed * 1103515245 + 12345;
+    samples[i] = static_cast<Sint32>(seed >> 8) - (1 << 23);
+    if (i % 4 == 0) samples[i] %= 300;
+  }
+
+  const HTJ2K_InstructionSet instructionSets[] = {
+      EHTJ2KIS_sse2, EHTJ2KIS_avx2, EHTJ2KIS_avx512};
+  for (HTJ2K_InstructionSet instructionSet : instructionSets) {
+    const HtJ2kSampleKernels *kernels =
+        HtJ2kSampleKernels::forInstructionSet(instructionSet);
+    // Skip instruction sets not supported by the CPU
+    if (kernels == nullptr) continue;
+    ASSERT_EQ(kernels->instructionSet, instructionSet);
+
+    // Every count up to maxCount exercises all partial vector tails
+    for (size_t count = 0; count <= maxCount; ++count) {
+      std::vector<Uint8> u8[2] = {std::vector<Uint8>(count + 1, 0xAA),
+                                  std::vector<Uint8>(count + 1, 0xAA)};
+      scalar->narrowToUint8(&samples[0], &u8[0][0], count);
+      kernels->narrowToUint8(&samples[0], &u8[1][0], count);
+      ASSERT_TRUE(u8[0] == u8[1]) << "narrowToUint8, count " << count;
+
+      std::vector<Sint8> s8[2] = {std::vector<Sint8>(count + 1, 0x55),
+                                  std::vector<Sint8>(count + 1, 0x55)};
+      scalar->narrowToSint8(&samples[0], &s8[0][0], count);
+      kernels->narrowToSint8(&samples[0], &s8[1][0], count);
+      ASSERT_TRUE(s8[0] == s8[1]) << "narrowToSint8, count " << count;
+
+      std::vector<Uint16> u16[2] = {std::vector<Uint16>(count + 1, 0xAAAA),
+                                    std::vector<Uint16>(count + 1, 0xAAAA)};
+      scalar->narrowToUint16(&samples[0], &u16[0][0], count);
+      kernels->narrowToUint16(&samples[0], &u16[1][0], count);
+      ASSERT_TRUE(u16[0] == u16[1]) << "narrowToUint16, count " << count;
+
+      std::vector<Sint16> s16[2] = {std::vector<Sint16>(count + 1, 0x5555),
+                                    std::vector<Sint16>(count + 1, 0x5555)};
+      scalar->narrowToSint16(&samples[0], &s16[0][0], count);
+      kernels->narrowToSint16(&samples[0], &s16[1][0], count);
+      ASSERT_TRUE(s16[0] == s16[1]) << "narrowToSint16, count " << count;
+
+      // start with an empty range, so that neither initial value may leak
+      // into the other result
+      Sint32 range[2][2] = {{0x7FFFFFFF, -0x7FFFFFFF - 1},
+                            {0x7FFFFFFF, -0x7FFFFFFF - 1}};
+      scalar->findRange(&samples[0], count, range[0][0], range[0][1]);
+      kernels->findRange(&samples[0], count, range[1][0], range[1][1]);
+      ASSERT_EQ(range[0][0], range[1][0]) << "findRange, count " << count;
+      ASSERT_EQ(range[0][1], range[1][1]) << "findRange, count " << count;
+
+      std::vector<Sint32> shifted[2] = {samples, samples};
+      scalar->shiftLeft(&shifted[0][0], count, 3);
+      kernels->shiftLeft(&shifted[1][0], count, 3);
+      ASSERT_TRUE(shifted[0] == shifted[1]) << "shiftLeft, count " << count;
+
+      std::vector<Uint8> planes8(3 * maxCount);
+      std::vector<Uint16> planes16(3 * maxCount);
+      for (size_t i = 0; i < planes8.size(); ++i) {
+        planes8[i] = static_cast<Uint8>(i * 7);
+        planes16[i] = static_cast<Uint16>(i * 0x0101 + 3);
+      }
+      std::vector<Uint8> i8[2] = {std::vector<Uint8>(3 * count + 1, 0xAA),
+                                  std::vector<Uint8>(3 * count + 1, 0xAA)};
+      scalar->interleave8(&planes8[0], &planes8[maxCount],
+                          &planes8[2 * maxCount], &i8[0][0], count);
+      kernels->interleave8(&planes8[0], &planes8[maxCount],
+                           &planes8[2 * maxCount], &i8[1][0], count);
+      ASSERT_TRUE(i8[0] == i8[1]) << "interleave8, count " << count;
+
+      std::vector<Uint16> i16[2] = {
+          std::vector<Uint16>(3 * count + 1, 0xAAAA),
+          std::vector<Uint16>(3 * count + 1, 0xAAAA)};
+      scalar->interleave16(&planes16[0], &planes16[maxCount],
+                           &planes16[2 * maxCount], &i16[0][0], count);
+      kernels->interleave16(&planes16[0], &planes16[maxCount],
+                            &planes16[2 * maxCount], &i16[1][0], count);
+      ASSERT_TRUE(i16[0] == i16[1]) << "interleave16, count " << count;
+
+      // Every component of monochrome and color-by-pixel samples
+      const Uint8 *raw = &planes8[0];
+      for (Uint16 spp = 1; spp <= 3; spp += 2) {
+        for (Uint16 component = 0; component < spp; ++component) {
+          std::vector<Sint32> w[2] = {std::vector<Sint32>(count + 1, 7),
+                                      std::vector<Sint32>(count + 1, 7)};
+          scalar->widenUint8(raw, component, spp, &w[0][0], count);
+          kernels->widenUint8(raw, component, spp, &w[1][0], count);
+          ASSERT_TRUE(w[0] == w[1]) << "widenUint8, count " << count;
+
+          const Sint8 *rawS8 = reinterpret_cast<const Sint8 *>(raw);
+          scalar->widenSint8(rawS8, component, spp, &w[0][0], count);
+          kernels->widenSint8(rawS8, component, spp, &w[1][0], count);
+          ASSERT_TRUE(w[0] == w[1]) << "widenSint8, count " << count;
+
+          scalar->widenUint16(&planes16[0], component, spp, &w[0][0], count);
+          kernels->widenUint16(&planes16[0], component, spp, &w[1][0], count);
+          ASSERT_TRUE(w[0] == w[1]) << "widenUint16, count " << count;
+
+          const Sint16 *rawS16 = reinterpret_cast<const Sint16 *>(&planes16[0]);
+          scalar->widenSint16(rawS16, component, spp, &w[0][0], count);
+          kernels->widenSint16(rawS16, component, spp, &w[1][0], count);
+          ASSERT_TRUE(w[0] == w[1]) << "widenSint16, count " << count;
+        }
+      }
+    }
+  }
+}
+
+
+TEST(CodecTest, ReducedResolutionDecompress) {
+  const Uint16 rows = 100;
+  const Uint16 cols = 90;
+  const Uint16 reduction = 2;
+  const Uint16 reducedRows = 25;  // 100 / 4
+  const Uint16 reducedCols = 23;  // 90 / 4, rounded up
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+
+  // A constant image is reconstructed exactly at every resolution level
+  std::vector<Uint8> original(pixelCount, 77);
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(
+      dataset->putAndInsertString(DCM_PixelSpacing, "0.5\\0.25").good());
+  ASSERT_TRUE(
+      dataset->putAndInsertString(DCM_ImageType, "ORIGINAL\\PRIMARY").good());
+  DcmTagKey const groupTags[] = {DCM_SharedFunctionalGroupsSequence,
+                                 DCM_PerFrameFunctionalGroupsSequence};
+  for (size_t i = 0; i < 2; ++i) {
+    DcmItem *group = nullptr;
+    ASSERT_TRUE(
+        dataset->findOrCreateSequenceItem(groupTags[i], group, -2).good());
+    DcmItem *measures = nullptr;
+    ASSERT_TRUE(group
+                    ->findOrCreateSequenceItem(DCM_PixelMeasuresSequence,
+                                               measures, -2)
+                    .good());
+    ASSERT_TRUE(
+        measures->putAndInsertString(DCM_PixelSpacing, "0.5\\0.25").good());
+  }
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+  OFString originalInstanceUID;
+  ASSERT_TRUE(
+      dataset->findAndGetOFString(DCM_SOPInstanceUID, originalInstanceUID)
+          .good());
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  // Compress with 3 decomposition levels
+  HtJ2kEncoderRegistration::registerCodecs(OFTrue, 3);
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  OFTempFile tempFile;
+  ASSERT_TRUE(tempFile.getStatus().good());
+  ASSERT_TRUE(
+      fileformat.saveFile(tempFile.getFilename(), htj2kLossless).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  // Decode a single frame through the frame-level API
+  DcmFileFormat frameFile;
+  ASSERT_TRUE(frameFile.loadFile(tempFile.getFilename()).good());
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(
+      frameFile.getDataset()->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  pixSeq)
+                  .good());
+  ASSERT_TRUE(pixSeq != nullptr);
+
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  std::vector<Uint8> frame(
+      static_cast<size_t>(reducedRows) * static_cast<size_t>(reducedCols));
+  Uint32 startFragment = 0;
+  Uint16 frameCols = 0;
+  Uint16 frameRows = 0;
+  OFString colorModel;
+  ASSERT_TRUE(decoder
+                  .decodeReducedFrame(pixSeq, &param, frameFile.getDataset(), 0,
+                                      startFragment, reduction, frame.data(),
+                                      static_cast<Uint32>(frame.size()),
+                                      frameCols, frameRows, colorModel)
+                  .good());
+  EXPECT_EQ(frameCols, reducedCols);
+  EXPECT_EQ(frameRows, reducedRows);
+  for (size_t i = 0; i < frame.size(); ++i) {
+    EXPECT_EQ(frame[i], 77);
+  }
+
+  // More resolution levels than decomposition levels cannot be skipped
+  startFragment = 0;
+  EXPECT_TRUE(decoder
+                  .decodeReducedFrame(pixSeq, &param, frameFile.getDataset(), 0,
+                                      startFragment, 4, frame.data(),
+                                      static_cast<Uint32>(frame.size()),
+                                      frameCols, frameRows, colorModel)
+                  .bad());
+
+  // Decode the whole dataset with the codec option
+  HtJ2kDecoderRegistration::registerCodecs(EHTJ2KUC_default, EHTJ2KPC_restore,
+                                           OFFalse, 1, reduction);
+  DcmFileFormat readFile;
+  ASSERT_TRUE(readFile.loadFile(tempFile.getFilename()).good());
+  DcmDataset *readDataset = readFile.getDataset();
+  ASSERT_TRUE(
+      readDataset->chooseRepresentation(EXS_LittleEndianExplicit, nullptr)
+          .good());
+  HtJ2kDecoderRegistration::cleanup();
+
+  Uint16 value = 0;
+  ASSERT_TRUE(readDataset->findAndGetUint16(DCM_Rows, value).good());
+  EXPECT_EQ(value, reducedRows);
+  ASSERT_TRUE(readDataset->findAndGetUint16(DCM_Columns, value).good());
+  EXPECT_EQ(value, reducedCols);
+
+  // Pixel spacing grows by the reduction factor of each direction
+  Float64 spacing = 0.0;
+  ASSERT_TRUE(
+      readDataset->findAndGetFloat64(DCM_PixelSpacing, spacing, 0).good());
+  EXPECT_LT(std::fabs(spacing - 2.0), 1e-6);
+  ASSERT_TRUE(
+      readDataset->findAndGetFloat64(DCM_PixelSpacing, spacing, 1).good());
+  EXPECT_LT(std::fabs(spacing - 0.25 * cols / reducedCols), 1e-6);
+
+  // So does the spacing of the Pixel Measures of the functional groups
+  for (size_t i = 0; i < 2; ++i) {
+    DcmItem *group = nullptr;
+    ASSERT_TRUE(
+        readDataset->findAndGetSequenceItem(groupTags[i], group, 0).good());
+    DcmItem *measures = nullptr;
+    ASSERT_TRUE(
+        group->findAndGetSequenceItem(DCM_PixelMeasuresSequence, measures, 0)
+            .good());
+    ASSERT_TRUE(
+        measures->findAndGetFloat64(DCM_PixelSpacing, spacing, 0).good());
+    EXPECT_LT(std::fabs(spacing - 2.0), 1e-6);
+    ASSERT_TRUE(
+        measures->findAndGetFloat64(DCM_PixelSpacing, spacing, 1).good());
+    EXPECT_LT(std::fabs(spacing - 0.25 * cols / reducedCols), 1e-6);
+  }
+
+  // The reduced image is a derived image with a SOP instance of its own,
+  // even though UIDs are only created by default for lossy compression
+  OFString instanceUID;
+  ASSERT_TRUE(
+      readDataset->findAndGetOFString(DCM_SOPInstanceUID, instanceUID).good());
+  EXPECT_NE(instanceUID, originalInstanceUID);
+  OFString imageType;
+  ASSERT_TRUE(
+      readDataset->findAndGetOFString(DCM_ImageType, imageType, 0).good());
+  EXPECT_EQ(imageType, "DERIVED");
+
+  Uint8 const *decoded = nullptr;
+  unsigned long decodedCount = 0;
+  ASSERT_TRUE(
+      readDataset->findAndGetUint8Array(DCM_PixelData, decoded, &decodedCount)
+          .good());
+  ASSERT_GE(decodedCount, static_cast<unsigned long>(frame.size()));
+  for (size_t i = 0; i < frame.size(); ++i) {
+    EXPECT_EQ(decoded[i], 77);
+  }
+}
+
+
+TEST(CodecTest, ColorWindowDecompress) {
+  const Uint16 rows = 80;
+  const Uint16 cols = 96;
+  const Uint16 samplesPerPixel = 3;
+  const size_t pixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols) * samplesPerPixel;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    original[i] = static_cast<Uint8>((i * 7) ^ (i >> 5));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 3, "RGB", 0);
+  ASSERT_TRUE(dataset->putAndInsertUint16(DCM_PlanarConfiguration, 0).good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kEncoderRegistration::registerCodecs();
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  OFTempFile tempFile;
+  ASSERT_TRUE(tempFile.getStatus().good());
+  ASSERT_TRUE(
+      fileformat.saveFile(tempFile.getFilename(), htj2kLossless).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmFileFormat readFile;
+  ASSERT_TRUE(readFile.loadFile(tempFile.getFilename()).good());
+  DcmDataset *readDataset = readFile.getDataset();
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(readDataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  pixSeq)
+                  .good());
+  ASSERT_TRUE(pixSeq != nullptr);
+
+  // Decode a window that touches none of the frame borders
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  const HtJ2kFrameWindow window(13, 7, 40, 21);
+  std::vector<Uint8> decoded(static_cast<size_t>(window.columns) *
+                             window.rows * samplesPerPixel);
+  Uint32 startFragment = 0;
+  OFString colorModel;
+  ASSERT_TRUE(decoder
+                  .decodeFrameWindow(pixSeq, &param, readDataset, 0,
+                                     startFragment, 0, window, decoded.data(),
+                                     static_cast<Uint32>(decoded.size()),
+                                     colorModel)
+                  .good());
+  EXPECT_EQ(colorModel, "RGB");
+
+  for (Uint16 r = 0; r < window.rows; ++r) {
+    for (size_t c = 0; c < window.columns * samplesPerPixel; ++c) {
+      const size_t source =
+          (static_cast<size_t>(window.top + r) * cols + window.left) *
+              samplesPerPixel +
+          c;
+      EXPECT_EQ(decoded[r * window.columns * samplesPerPixel + c],
+                original[source]);
+    }
+  }
+
+  // Windows extending beyond the frame are rejected
+  startFragment = 0;
+  EXPECT_TRUE(decoder
+                  .decodeFrameWindow(pixSeq, &param, readDataset, 0,
+                                     startFragment, 0,
+                                     HtJ2kFrameWindow(60, 0, 40, 21),
+                                     decoded.data(),
+                                     static_cast<Uint32>(decoded.size()),
+                                     colorModel)
+                  .bad());
+}
+
+TEST(CodecTest, MultiFragmentRandomFrameAccess) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 96;
+  const Uint16 frames = 5;
+  const size_t framePixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  const size_t pixelCount = framePixelCount * frames;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const size_t frame = i / framePixelCount;
+    original[i] = static_cast<Uint8>((i * (frame + 3)) ^ (i >> 4));
+  }
+
+  // With an offset table the fragments are located through the table,
+  // without one by searching for the start of each codestream
+  for (int createOffsetTable = 0; createOffsetTable < 2; ++createOffsetTable) {
+    DcmFileFormat fileformat;
+    DcmDataset *dataset = fileformat.getDataset();
+    PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                          "MONOCHROME2", 0);
+    ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "5").good());
+    ASSERT_TRUE(
+        dataset
+            ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                     static_cast<unsigned long>(pixelCount))
+            .good());
+
+    // Split every frame into fragments of 1 KB
+    const E_TransferSyntax htj2kLossless =
+        EXS_HighThroughputJPEG2000LosslessOnly;
+    HtJ2kEncoderRegistration::registerCodecs(
+        OFFalse, 5, 64, 64, EHTJ2KPO_default, OFTrue, 1,
+        createOffsetTable != 0);
+    ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+    HtJ2kEncoderRegistration::cleanup();
+
+    DcmElement *element = nullptr;
+    ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+    DcmPixelSequence *pixSeq = nullptr;
+    ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                    ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                    pixSeq)
+                    .good());
+    ASSERT_TRUE(pixSeq != nullptr);
+    ASSERT_GT(pixSeq->card(), static_cast<unsigned long>(frames + 1));
+    for (unsigned long i = 1; i < pixSeq->card(); ++i) {
+      DcmPixelItem *fragment = nullptr;
+      ASSERT_TRUE(pixSeq->getItem(fragment, i).good());
+      EXPECT_GT(fragment->getLength(), static_cast<Uint32>(0));
+      EXPECT_LE(fragment->getLength(), static_cast<Uint32>(1024));
+    }
+
+    // Decode the frames last to first without passing a start fragment
+    HtJ2kDecoder decoder;
+    HtJ2kCodecParameter param;
+    std::vector<Uint8> decoded(framePixelCount);
+    Uint32 endOfNextFrame = static_cast<Uint32>(pixSeq->card()) + 1;
+    for (Uint32 frame = frames; frame-- > 0;) {
+      Uint32 startFragment = 0;
+      OFString colorModel;
+      ASSERT_TRUE(decoder
+                      .decodeFrame(nullptr, pixSeq, &param, dataset, frame,
+                                   startFragment, decoded.data(),
+                                   static_cast<Uint32>(decoded.size()),
+                                   colorModel)
+                      .good())
+          << "frame " << frame;
+      for (size_t i = 0; i < framePixelCount; ++i) {
+        EXPECT_EQ(decoded[i], original[frame * framePixelCount + i]);
+      }
+
+      // The start fragment is advanced past the fragments of the frame
+      if (frame + 1 == frames) {
+        EXPECT_EQ(startFragment, static_cast<Uint32>(pixSeq->card()));
+      }
+      ASSERT_LT(startFragment, endOfNextFrame);
+      endOfNextFrame = startFragment;
+    }
+
+    // The image attributes are read again for every frame, so a frame no
+    // longer matching the modified attributes is rejected
+    ASSERT_TRUE(dataset->putAndInsertUint16(DCM_Columns, cols * 2).good());
+    Uint32 startFragment = 0;
+    OFString colorModel;
+    EXPECT_TRUE(decoder
+                    .decodeFrame(nullptr, pixSeq, &param, dataset, 0,
+                                 startFragment, decoded.data(),
+                                 static_cast<Uint32>(decoded.size()),
+                                 colorModel)
+                    .bad());
+  }
+}
+
+TEST(CodecTest, ThreadWorkspaceAcrossGeometries) {
+  const Uint16 monoRows = 48;
+  const Uint16 monoCols = 64;
+  const Uint16 colorRows = 72;
+  const Uint16 colorCols = 40;
+  const size_t monoPixels =
+      static_cast<size_t>(monoRows) * static_cast<size_t>(monoCols);
+  const size_t colorSamples =
+      3 * static_cast<size_t>(colorRows) * static_cast<size_t>(colorCols);
+
+  std::vector<Uint8> mono(monoPixels * 3);
+  for (size_t i = 0; i < mono.size(); ++i) {
+    mono[i] = static_cast<Uint8>((i * 7) ^ (i >> 5));
+  }
+  std::vector<Uint8> color(colorSamples * 2);
+  for (size_t i = 0; i < color.size(); ++i) {
+    color[i] = static_cast<Uint8>((i * 13) + (i >> 3));
+  }
+
+  DcmFileFormat monoFile;
+  DcmDataset *monoDataset = monoFile.getDataset();
+  PopulateDatasetWithRequiredAttributes(monoDataset, monoRows, monoCols, 8, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(
+      monoDataset->putAndInsertString(DCM_NumberOfFrames, "3").good());
+  ASSERT_TRUE(monoDataset
+                  ->putAndInsertUint8Array(
+                      DCM_PixelData, mono.data(),
+                      static_cast<unsigned long>(mono.size()))
+                  .good());
+
+  DcmFileFormat colorFile;
+  DcmDataset *colorDataset = colorFile.getDataset();
+  PopulateDatasetWithRequiredAttributes(colorDataset, colorRows, colorCols, 8,
+                                        3, "RGB", 0);
+  ASSERT_TRUE(
+      colorDataset->putAndInsertUint16(DCM_PlanarConfiguration, 0).good());
+  ASSERT_TRUE(
+      colorDataset->putAndInsertString(DCM_NumberOfFrames, "2").good());
+  ASSERT_TRUE(colorDataset
+                  ->putAndInsertUint8Array(
+                      DCM_PixelData, color.data(),
+                      static_cast<unsigned long>(color.size()))
+                  .good());
+
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kEncoderRegistration::registerCodecs();
+  ASSERT_TRUE(
+      monoDataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  ASSERT_TRUE(
+      colorDataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmElement *element = nullptr;
+  DcmPixelSequence *monoPixSeq = nullptr;
+  ASSERT_TRUE(monoDataset->findAndGetElement(DCM_PixelData, element).good());
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  monoPixSeq)
+                  .good());
+  DcmPixelSequence *colorPixSeq = nullptr;
+  ASSERT_TRUE(
+      colorDataset->findAndGetElement(DCM_PixelData, element).good());
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  colorPixSeq)
+                  .good());
+
+  // Frames of both images are decompressed alternately on this thread, so
+  // the workspace switches geometries, is reused for repeated frames of the
+  // same geometry and is released in between
+  const Uint32 monoFrames[] = {0, 1, 2, 2, 0};
+  const Uint32 colorFrames[] = {0, 1, 1, 0, 1};
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  std::vector<Uint8> monoDecoded(monoPixels);
+  std::vector<Uint8> colorDecoded(colorSamples);
+  for (size_t step = 0; step < 5; ++step) {
+    Uint32 startFragment = 0;
+    OFString colorModel;
+    ASSERT_TRUE(decoder
+                    .decodeFrame(nullptr, monoPixSeq, &param, monoDataset,
+                                 monoFrames[step], startFragment,
+                                 monoDecoded.data(),
+                                 static_cast<Uint32>(monoDecoded.size()),
+                                 colorModel)
+                    .good())
+        << "step " << step;
+    EXPECT_TRUE(std::equal(monoDecoded.begin(), monoDecoded.end(),
+                           mono.begin() + monoFrames[step] * monoPixels))
+        << "step " << step;
+
+    ASSERT_TRUE(decoder
+                    .decodeFrame(nullptr, colorPixSeq, &param, colorDataset,
+                                 colorFrames[step], startFragment,
+                                 colorDecoded.data(),
+                                 static_cast<Uint32>(colorDecoded.size()),
+                                 colorModel)
+                    .good())
+        << "step " << step;
+    EXPECT_TRUE(std::equal(colorDecoded.begin(), colorDecoded.end(),
+                           color.begin() + colorFrames[step] * colorSamples))
+        << "step " << step;
+
+    if (step == 2) HtJ2kDecoderBase::releaseThreadWorkspace();
+  }
+  HtJ2kDecoderBase::releaseThreadWorkspace();
+}
+
+TEST(CodecTest, ExtendedOffsetTableRoundTrip) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 96;
+  const Uint16 frames = 4;
+  const size_t framePixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  const size_t pixelCount = framePixelCount * frames;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const size_t frame = i / framePixelCount;
+    original[i] = static_cast<Uint8>((i * (frame + 5)) ^ (i >> 3));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "4").good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // Request an Extended Offset Table instead of the Basic Offset Table
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kCodecParameter parameters;
+  parameters.setCreateExtendedOffsetTable(OFTrue);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  OFTempFile tempFile;
+  ASSERT_TRUE(tempFile.getStatus().good());
+  ASSERT_TRUE(
+      fileformat.saveFile(tempFile.getFilename(), htj2kLossless).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmFileFormat readFile;
+  ASSERT_TRUE(readFile.loadFile(tempFile.getFilename()).good());
+  DcmDataset *readDataset = readFile.getDataset();
+
+  // One offset and one length per frame, the offsets strictly increasing
+  DcmElement *offsetElement = nullptr;
+  DcmElement *lengthElement = nullptr;
+  ASSERT_TRUE(
+      readDataset->findAndGetElement(DCM_ExtendedOffsetTable, offsetElement)
+          .good());
+  ASSERT_TRUE(readDataset
+                  ->findAndGetElement(DCM_ExtendedOffsetTableLengths,
+                                      lengthElement)
+                  .good());
+  ASSERT_EQ(offsetElement->getVM(), static_cast<unsigned long>(frames));
+  ASSERT_EQ(lengthElement->getVM(), static_cast<unsigned long>(frames));
+  Uint64 *offsets = nullptr;
+  Uint64 *lengths = nullptr;
+  ASSERT_TRUE(offsetElement->getUint64Array(offsets).good());
+  ASSERT_TRUE(lengthElement->getUint64Array(lengths).good());
+  EXPECT_EQ(offsets[0], static_cast<Uint64>(0));
+  for (Uint16 frame = 1; frame < frames; ++frame) {
+    EXPECT_GT(offsets[frame], offsets[frame - 1] + lengths[frame - 1]);
+  }
+
+  // The Basic Offset Table is left empty
+  DcmElement *element = nullptr;
+  ASSERT_TRUE(readDataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  pixSeq)
+                  .good());
+  ASSERT_TRUE(pixSeq != nullptr);
+  DcmPixelItem *offsetTable = nullptr;
+  ASSERT_TRUE(pixSeq->getItem(offsetTable, 0).good());
+  EXPECT_EQ(offsetTable->getLength(), static_cast<Uint32>(0));
+
+  // Every frame is a single fragment, as required for the Extended Offset
+  // Table
+  EXPECT_EQ(pixSeq->card(), static_cast<unsigned long>(frames + 1));
+
+  // Frames can be decompressed in any order
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  std::vector<Uint8> decoded(framePixelCount);
+  const Uint32 order[frames] = {2, 0, 3, 1};
+  for (Uint16 i = 0; i < frames; ++i) {
+    Uint32 startFragment = 0;
+    OFString colorModel;
+    ASSERT_TRUE(decoder
+                    .decodeFrame(nullptr, pixSeq, &param, readDataset,
+                                 order[i], startFragment, decoded.data(),
+                                 static_cast<Uint32>(decoded.size()),
+                                 colorModel)
+                    .good());
+    for (size_t p = 0; p < framePixelCount; ++p) {
+      EXPECT_EQ(decoded[p], original[order[i] * framePixelCount + p]);
+    }
+  }
+}
+
+TEST(CodecTest, ExtendedOffsetTableWithFragmentedFrames) {
+  const Uint16 rows = 64;
+  const Uint16 cols = 96;
+  const Uint16 frames = 4;
+  const size_t framePixelCount =
+      static_cast<size_t>(rows) * static_cast<size_t>(cols);
+  const size_t pixelCount = framePixelCount * frames;
+
+  std::vector<Uint8> original(pixelCount);
+  for (size_t i = 0; i < pixelCount; ++i) {
+    const size_t frame = i / framePixelCount;
+    original[i] = static_cast<Uint8>((i * (frame + 5)) ^ (i >> 3));
+  }
+
+  DcmFileFormat fileformat;
+  DcmDataset *dataset = fileformat.getDataset();
+  PopulateDatasetWithRequiredAttributes(dataset, rows, cols, 8, 1,
+                                        "MONOCHROME2", 0);
+  ASSERT_TRUE(dataset->putAndInsertString(DCM_NumberOfFrames, "4").good());
+  ASSERT_TRUE(
+      dataset
+          ->putAndInsertUint8Array(DCM_PixelData, original.data(),
+                                   static_cast<unsigned long>(pixelCount))
+          .good());
+
+  // Split every frame into fragments of 1 KB, which rules out the requested
+  // Extended Offset Table
+  const E_TransferSyntax htj2kLossless =
+      EXS_HighThroughputJPEG2000LosslessOnly;
+  HtJ2kCodecParameter parameters;
+  parameters.setFragmentSize(1);
+  parameters.setCreateExtendedOffsetTable(OFTrue);
+  HtJ2kEncoderRegistration::registerCodecs(parameters);
+  ASSERT_TRUE(dataset->chooseRepresentation(htj2kLossless, nullptr).good());
+  HtJ2kEncoderRegistration::cleanup();
+
+  DcmElement *element = nullptr;
+  EXPECT_TRUE(
+      dataset->findAndGetElement(DCM_ExtendedOffsetTable, element).bad());
+  EXPECT_TRUE(
+      dataset->findAndGetElement(DCM_ExtendedOffsetTableLengths, element)
+          .bad());
+
+  // A Basic Offset Table with one entry per frame is created instead
+  ASSERT_TRUE(dataset->findAndGetElement(DCM_PixelData, element).good());
+  DcmPixelSequence *pixSeq = nullptr;
+  ASSERT_TRUE(static_cast<DcmPixelData *>(element)
+                  ->getEncapsulatedRepresentation(htj2kLossless, nullptr,
+                                                  pixSeq)
+                  .good());
+  ASSERT_TRUE(pixSeq != nullptr);
+  ASSERT_GT(pixSeq->card(), static_cast<unsigned long>(frames + 1));
+  DcmPixelItem *offsetTable = nullptr;
+  ASSERT_TRUE(pixSeq->getItem(offsetTable, 0).good());
+  EXPECT_EQ(offsetTable->getLength(), static_cast<Uint32>(frames * 4));
+
+  HtJ2kDecoder decoder;
+  HtJ2kCodecParameter param;
+  std::vector<Uint8> decoded(framePixelCount);
+  const Uint32 order[frames] = {2, 0, 3, 1};
+  for (Uint16 i = 0; i < frames; ++i) {
+    Uint32 startFragment = 0;
+    OFString colorModel;
+    ASSERT_TRUE(decoder
+                    .decodeFrame(nullptr, pixSeq, &param, dataset, order[i],
+                                 startFragment, decoded.data(),
+                                 static_cast<Uint32>(decoded.size()),
+                                 colorModel)
+                    .good());
+    for (size_t p = 0; p < framePixelCount; ++p) {
+      EXPECT_EQ(decoded[p], original[order[i] * framePixelCount + p]);
+    }
+  }
+}
+
 }  // namespace